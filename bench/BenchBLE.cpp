@@ -0,0 +1,342 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BenchBLE
+// Advert decoder and BLE bus device manager benchmarks
+//
+// The advert captures are replayed in scan order. Decoder cases decode every advert (most scan traffic is
+// not BTHome) into a sink which only counts the records. Device manager cases hand the decoded records to
+// BLEBusDeviceManager (handlePollResult), process them (loop) and read them out as JSON or binary - either
+// as captured (so repeated packets are filtered as duplicates) or spread over a larger synthetic set of
+// devices with a new packet ID for each reading.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BenchCases.h"
+#include "RaftCore.h"
+#include "BLEAdvertDecoder.h"
+#include "BLEBusDeviceManager.h"
+
+namespace
+{
+    // Device manager config (the extended record type so all decoded sensors are used)
+    static const char* DEV_MAN_CONFIG = R"({"devType":"BLEBTHomeExt","maxDevices":50,"readingQueueLen":32,"historyLen":4})";
+    static const uint32_t READING_QUEUE_LEN = 32;
+    static const uint32_t NUM_SYNTHETIC_DEVICES = 40;
+    static const uint32_t READINGS_PER_DEVICE = 2;
+    static const uint32_t ADVERT_INTERVAL_US = 10000;
+
+    class AdvertCapture
+    {
+    public:
+        ble_addr_t addr = {};
+        std::vector<uint8_t> data;
+    };
+
+    class DecodedRecord
+    {
+    public:
+        BusElemAddrType address = 0;
+        std::vector<uint8_t> data;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Devices interface which counts (and optionally keeps) the records from the decoder
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class DecodedRecordSink : public RaftBusDevicesIF
+    {
+    public:
+        uint32_t recordCount = 0;
+        std::vector<DecodedRecord>* pRecords = nullptr;
+
+        virtual bool handlePollResult(uint64_t timeNowUs, BusElemAddrType address,
+                    const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo) override
+        {
+            recordCount++;
+            if (pRecords)
+                pRecords->push_back({ address, pollResultData });
+            return true;
+        }
+        virtual void getDeviceAddresses(std::vector<BusElemAddrType>& addresses, bool onlyAddressesWithIdentPollResponses) const override
+        {
+        }
+        virtual String getDevTypeInfoJsonByAddr(BusElemAddrType address, bool includePlugAndPlayInfo) const override
+        {
+            return "{}";
+        }
+        virtual String getDevTypeInfoJsonByTypeName(const String& deviceType, bool includePlugAndPlayInfo) const override
+        {
+            return "{}";
+        }
+        virtual String getDevTypeInfoJsonByTypeIdx(uint16_t deviceTypeIdx, bool includePlugAndPlayInfo) const override
+        {
+            return "{}";
+        }
+        virtual String getQueuedDeviceDataJson() const override
+        {
+            return "{}";
+        }
+        virtual std::vector<uint8_t> getQueuedDeviceDataBinary(uint32_t connMode) const override
+        {
+            return {};
+        }
+        virtual uint32_t getDecodedPollResponses(BusElemAddrType address, void* pStructOut, uint32_t structOutSize,
+                    uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const override
+        {
+            return 0;
+        }
+        virtual void registerForDeviceData(BusElemAddrType address, RaftDeviceDataChangeCB dataChangeCB,
+                    uint32_t minTimeBetweenReportsMs, const void* pCallbackInfo) override
+        {
+        }
+        virtual String getDebugJSON(bool includeBraces) const override
+        {
+            return "{}";
+        }
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Shared state (captures and the records decoded from them)
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class BLEBenchState
+    {
+    public:
+        std::vector<AdvertCapture> captures;
+        std::vector<ble_gap_event> events;
+        std::vector<std::pair<ble_addr_t, std::pair<const uint8_t*, uint32_t>>> btHomePayloads;
+        std::vector<DecodedRecord> capturedRecords;
+        std::vector<DecodedRecord> syntheticRecords;
+        ble_hs_adv_fields fields = {};
+        DecodedRecordSink sink;
+        BLEAdvertDecoder decoder;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Load captures - each line is an address (MSB first) and the advertising data in hex
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    bool loadCaptures(const std::string& path, std::vector<AdvertCapture>& captures)
+    {
+        FILE* pFile = fopen(path.c_str(), "r");
+        if (!pFile)
+            return false;
+        char line[300];
+        while (fgets(line, sizeof(line), pFile))
+        {
+            if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r'))
+                continue;
+            AdvertCapture capture;
+            unsigned addrBytes[6] = {};
+            char hexStr[200] = {};
+            if (sscanf(line, "%x:%x:%x:%x:%x:%x %199s", &addrBytes[0], &addrBytes[1], &addrBytes[2],
+                        &addrBytes[3], &addrBytes[4], &addrBytes[5], hexStr) != 7)
+                continue;
+            for (int i = 0; i < 6; i++)
+                capture.addr.val[5 - i] = addrBytes[i];
+            for (uint32_t i = 0; hexStr[i] && hexStr[i + 1]; i += 2)
+            {
+                unsigned byteVal = 0;
+                sscanf(hexStr + i, "%2x", &byteVal);
+                capture.data.push_back(byteVal);
+            }
+            captures.push_back(capture);
+        }
+        fclose(pFile);
+        return !captures.empty();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Device manager with readings fed through the reading queue
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class DevManBench
+    {
+    public:
+        DevManBench(const std::vector<DecodedRecord>& records) : _records(records), _devMan(_bus)
+        {
+            _devMan.setup(RaftJson(DEV_MAN_CONFIG));
+        }
+
+        // Queue the next readings (advancing the clock for each)
+        void queueReadings(uint32_t numReadings)
+        {
+            for (uint32_t i = 0; i < numReadings; i++)
+            {
+                const DecodedRecord& record = _records[_nextRecordIdx];
+                _nextRecordIdx = (_nextRecordIdx + 1) % _records.size();
+                BenchClock::advanceUs(ADVERT_INTERVAL_US);
+                _devMan.handlePollResult(micros(), record.address, record.data, nullptr);
+            }
+        }
+
+        // Queue and process readings (the queue is processed whenever it fills)
+        void feedReadings(uint32_t numReadings)
+        {
+            while (numReadings > 0)
+            {
+                uint32_t toQueue = numReadings < READING_QUEUE_LEN ? numReadings : READING_QUEUE_LEN;
+                queueReadings(toQueue);
+                _devMan.loop();
+                numReadings -= toQueue;
+            }
+        }
+
+        BLEBusDeviceManager& devMan()
+        {
+            return _devMan;
+        }
+        const DecodedRecord& nextRecord() const
+        {
+            return _records[_nextRecordIdx];
+        }
+        void skipRecord()
+        {
+            _nextRecordIdx = (_nextRecordIdx + 1) % _records.size();
+        }
+
+    private:
+        const std::vector<DecodedRecord>& _records;
+        uint32_t _nextRecordIdx = 0;
+        RaftBus _bus;
+        BLEBusDeviceManager _devMan;
+    };
+
+    // Keep results so the work isn't optimised away
+    volatile uint32_t benchResultSink = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add cases
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool addBLEBenchmarks(BenchRunner& runner, const BenchOptions& options)
+{
+    // Load captures
+    auto pState = std::make_shared<BLEBenchState>();
+    if (!loadCaptures(options.capturesPath, pState->captures))
+    {
+        fprintf(stderr, "Failed to load advert captures %s\n", options.capturesPath.c_str());
+        return false;
+    }
+
+    // Discovery events and BTHome service data
+    for (const AdvertCapture& capture : pState->captures)
+    {
+        ble_gap_event event = {};
+        event.type = BLE_GAP_EVENT_DISC;
+        event.disc.event_type = BLE_HCI_ADV_RPT_EVTYPE_ADV_IND;
+        event.disc.addr = capture.addr;
+        event.disc.data = capture.data.data();
+        event.disc.length_data = capture.data.size();
+        pState->events.push_back(event);
+        const uint8_t* pBtHomeData = nullptr;
+        uint32_t btHomeDataLen = 0;
+        if (BLEAdvertDecoder::findBTHomeServiceData(capture.data.data(), capture.data.size(), pBtHomeData, btHomeDataLen))
+            pState->btHomePayloads.push_back({ capture.addr, { pBtHomeData, btHomeDataLen } });
+    }
+
+    // Decoded records in capture order
+    pState->sink.pRecords = &pState->capturedRecords;
+    for (ble_gap_event& event : pState->events)
+        pState->decoder.decodeAdEvent(&event, pState->fields, &pState->sink);
+    pState->sink.pRecords = nullptr;
+    if (pState->capturedRecords.empty())
+    {
+        fprintf(stderr, "No BTHome records decoded from the advert captures\n");
+        return false;
+    }
+
+    // Synthetic devices - each reading is from the next device and has a new packet ID
+    for (uint32_t readingIdx = 0; readingIdx < NUM_SYNTHETIC_DEVICES * 8; readingIdx++)
+    {
+        DecodedRecord record = pState->capturedRecords[readingIdx % pState->capturedRecords.size()];
+        record.address = 0x10000000 + (readingIdx % NUM_SYNTHETIC_DEVICES) * 0x9e3779b1;
+        record.data[BLEAdvertDecoder::DUPLICATE_RECORD_DEVICE_ID_POS] = readingIdx / NUM_SYNTHETIC_DEVICES;
+        pState->syntheticRecords.push_back(record);
+    }
+    printf("Advert captures %d (BTHome %d decoded %d)\n", (int)pState->captures.size(),
+                (int)pState->btHomePayloads.size(), (int)pState->capturedRecords.size());
+
+    // Decoder
+    runner.add({ "advert/decodeAdEvent", nullptr, nullptr, [pState]() {
+        for (ble_gap_event& event : pState->events)
+            pState->decoder.decodeAdEvent(&event, pState->fields, &pState->sink);
+        return (uint32_t)pState->events.size();
+    }});
+    runner.add({ "advert/decodeAdEventBTHomeOnly", nullptr, nullptr, [pState]() {
+        for (ble_gap_event& event : pState->events)
+            pState->decoder.decodeAdEventBTHomeOnly(&event, &pState->sink);
+        return (uint32_t)pState->events.size();
+    }});
+    runner.add({ "advert/decodeBtHome", nullptr, nullptr, [pState]() {
+        for (const auto& payload : pState->btHomePayloads)
+            pState->decoder.decodeBtHome(payload.first, payload.second.first, payload.second.second, &pState->sink);
+        return (uint32_t)pState->btHomePayloads.size();
+    }});
+
+    // Device manager - hand over from the scan callback (the queue is emptied before each batch)
+    auto pHandoff = std::make_shared<std::unique_ptr<DevManBench>>();
+    runner.add({ "devman/handlePollResult",
+        [pState, pHandoff]() { *pHandoff = std::make_unique<DevManBench>(pState->capturedRecords); },
+        [pHandoff]() { (*pHandoff)->devMan().loop(); },
+        [pHandoff]() {
+            DevManBench& bench = **pHandoff;
+            for (uint32_t i = 0; i < READING_QUEUE_LEN; i++)
+            {
+                const DecodedRecord& record = bench.nextRecord();
+                bench.devMan().handlePollResult(micros(), record.address, record.data, nullptr);
+                bench.skipRecord();
+            }
+            return READING_QUEUE_LEN;
+        }});
+
+    // Device manager - processing queued readings
+    auto pLoopCaptured = std::make_shared<std::unique_ptr<DevManBench>>();
+    runner.add({ "devman/loop/captures",
+        [pState, pLoopCaptured]() { *pLoopCaptured = std::make_unique<DevManBench>(pState->capturedRecords); },
+        [pLoopCaptured]() { (*pLoopCaptured)->queueReadings(READING_QUEUE_LEN); },
+        [pLoopCaptured]() {
+            (*pLoopCaptured)->devMan().loop();
+            return READING_QUEUE_LEN;
+        }});
+    auto pLoopSynthetic = std::make_shared<std::unique_ptr<DevManBench>>();
+    runner.add({ "devman/loop/40dev",
+        [pState, pLoopSynthetic]() { *pLoopSynthetic = std::make_unique<DevManBench>(pState->syntheticRecords); },
+        [pLoopSynthetic]() { (*pLoopSynthetic)->queueReadings(READING_QUEUE_LEN); },
+        [pLoopSynthetic]() {
+            (*pLoopSynthetic)->devMan().loop();
+            return READING_QUEUE_LEN;
+        }});
+
+    // Device manager - reading out (each device has unread readings before each call)
+    auto pJson = std::make_shared<std::unique_ptr<DevManBench>>();
+    runner.add({ "devman/getQueuedDeviceDataJson/40dev",
+        [pState, pJson]() { *pJson = std::make_unique<DevManBench>(pState->syntheticRecords); },
+        [pJson]() { (*pJson)->feedReadings(NUM_SYNTHETIC_DEVICES * READINGS_PER_DEVICE); },
+        [pJson]() {
+            String jsonStr = (*pJson)->devMan().getQueuedDeviceDataJson();
+            benchResultSink = jsonStr.length();
+            return 1u;
+        }});
+    auto pBinary = std::make_shared<std::unique_ptr<DevManBench>>();
+    auto pBinaryBuf = std::make_shared<std::vector<uint8_t>>();
+    runner.add({ "devman/appendQueuedDeviceDataBinary/40dev",
+        [pState, pBinary]() { *pBinary = std::make_unique<DevManBench>(pState->syntheticRecords); },
+        [pBinary, pBinaryBuf]() {
+            (*pBinary)->feedReadings(NUM_SYNTHETIC_DEVICES * READINGS_PER_DEVICE);
+            pBinaryBuf->clear();
+        },
+        [pBinary, pBinaryBuf]() {
+            (*pBinary)->devMan().appendQueuedDeviceDataBinary(*pBinaryBuf, 0);
+            benchResultSink = pBinaryBuf->size();
+            return 1u;
+        }});
+    return true;
+}
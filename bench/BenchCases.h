@@ -0,0 +1,19 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BenchCases
+// Benchmark case sets
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "BenchHarness.h"
+
+/// @brief Add the advert decoder and BLE bus device manager cases (replaying the advert captures)
+/// @return false if the captures couldn't be loaded
+bool addBLEBenchmarks(BenchRunner& runner, const BenchOptions& options);
+
+/// @brief Add the state publisher cases (synthetic publication and subscription loads)
+void addStatePublisherBenchmarks(BenchRunner& runner, const BenchOptions& options);
@@ -0,0 +1,162 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BenchHarness
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include "BenchHarness.h"
+
+int BenchRunner::run()
+{
+    // List
+    if (_options.listOnly)
+    {
+        for (const BenchCase& benchCase : _cases)
+            printf("%s\n", benchCase.name.c_str());
+        return 0;
+    }
+
+    // Baseline
+    std::vector<BenchResult> baseline;
+    if (!_options.baselinePath.empty() && !readBaseline(baseline))
+    {
+        fprintf(stderr, "Failed to read baseline %s\n", _options.baselinePath.c_str());
+        return 2;
+    }
+
+    // Run
+    printf("%-48s %12s %10s %10s %12s%s\n", "benchmark", "ns/op", "allocs/op", "bytes/op", "ops",
+                baseline.empty() ? "" : "   vs baseline");
+    bool anyRegressed = false;
+    for (BenchCase& benchCase : _cases)
+    {
+        if (!_options.filter.empty() && (benchCase.name.find(_options.filter) == std::string::npos))
+            continue;
+        BenchResult result = runCase(benchCase);
+        _results.push_back(result);
+        printf("%-48s %12.1f %10.2f %10.1f %12llu", result.name.c_str(), result.nsPerOp, result.allocsPerOp,
+                    result.bytesPerOp, (unsigned long long)result.ops);
+
+        // Compare with baseline (allocation counts are deterministic so any increase is a regression)
+        auto baseIt = std::find_if(baseline.begin(), baseline.end(),
+                    [&result](const BenchResult& base) { return base.name == result.name; });
+        if (baseIt != baseline.end())
+        {
+            double nsChangePercent = baseIt->nsPerOp > 0 ? (result.nsPerOp / baseIt->nsPerOp - 1) * 100 : 0;
+            bool regressed = (nsChangePercent > _options.thresholdPercent) ||
+                        (result.allocsPerOp > baseIt->allocsPerOp + 0.005) ||
+                        (result.bytesPerOp > baseIt->bytesPerOp + 0.5);
+            printf("   %+6.1f%% allocs %+.2f bytes %+.1f%s", nsChangePercent, result.allocsPerOp - baseIt->allocsPerOp,
+                        result.bytesPerOp - baseIt->bytesPerOp, regressed ? "  REGRESSED" : "");
+            anyRegressed |= regressed;
+        }
+        else if (!baseline.empty())
+        {
+            printf("   (new)");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    // Save
+    if (!_options.outPath.empty() && !writeResults())
+    {
+        fprintf(stderr, "Failed to write results %s\n", _options.outPath.c_str());
+        return 2;
+    }
+    return anyRegressed ? 1 : 0;
+}
+
+BenchResult BenchRunner::runCase(BenchCase& benchCase)
+{
+    // Setup and a warm-up batch
+    if (benchCase.setupFn)
+        benchCase.setupFn();
+    if (benchCase.prepareFn)
+        benchCase.prepareFn();
+    benchCase.runFn();
+
+    // Rounds
+    uint32_t rounds = _options.rounds == 0 ? 1 : _options.rounds;
+    uint64_t roundNs = (uint64_t)_options.minTimeMs * 1000000 / rounds;
+    std::vector<double> roundNsPerOp;
+    uint64_t totalOps = 0;
+    uint64_t totalAllocs = 0;
+    uint64_t totalBytes = 0;
+    for (uint32_t roundIdx = 0; roundIdx < rounds; roundIdx++)
+    {
+        uint64_t elapsedNs = 0;
+        uint64_t ops = 0;
+        while ((elapsedNs < roundNs) || (ops == 0))
+        {
+            if (benchCase.prepareFn)
+                benchCase.prepareFn();
+            BenchAllocStats::count = 0;
+            BenchAllocStats::bytes = 0;
+            BenchAllocStats::enabled = true;
+            auto startTime = std::chrono::steady_clock::now();
+            uint32_t batchOps = benchCase.runFn();
+            auto endTime = std::chrono::steady_clock::now();
+            BenchAllocStats::enabled = false;
+            elapsedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+            ops += batchOps;
+            totalAllocs += BenchAllocStats::count;
+            totalBytes += BenchAllocStats::bytes;
+        }
+        roundNsPerOp.push_back((double)elapsedNs / ops);
+        totalOps += ops;
+    }
+
+    // Median round
+    std::sort(roundNsPerOp.begin(), roundNsPerOp.end());
+    BenchResult result;
+    result.name = benchCase.name;
+    result.nsPerOp = roundNsPerOp[roundNsPerOp.size() / 2];
+    result.allocsPerOp = (double)totalAllocs / totalOps;
+    result.bytesPerOp = (double)totalBytes / totalOps;
+    result.ops = totalOps;
+    return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Results files are tab separated: name, ns/op, allocs/op, bytes/op (lines starting with # are ignored)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BenchRunner::readBaseline(std::vector<BenchResult>& baseline) const
+{
+    FILE* pFile = fopen(_options.baselinePath.c_str(), "r");
+    if (!pFile)
+        return false;
+    char line[300];
+    while (fgets(line, sizeof(line), pFile))
+    {
+        if ((line[0] == '#') || (line[0] == '\n'))
+            continue;
+        char name[200];
+        BenchResult result;
+        if (sscanf(line, "%199s %lf %lf %lf", name, &result.nsPerOp, &result.allocsPerOp, &result.bytesPerOp) != 4)
+            continue;
+        result.name = name;
+        baseline.push_back(result);
+    }
+    fclose(pFile);
+    return true;
+}
+
+bool BenchRunner::writeResults() const
+{
+    FILE* pFile = fopen(_options.outPath.c_str(), "w");
+    if (!pFile)
+        return false;
+    fprintf(pFile, "# name\tns/op\tallocs/op\tbytes/op\n");
+    for (const BenchResult& result : _results)
+        fprintf(pFile, "%s\t%.1f\t%.3f\t%.1f\n", result.name.c_str(), result.nsPerOp, result.allocsPerOp, result.bytesPerOp);
+    fclose(pFile);
+    return true;
+}
@@ -0,0 +1,87 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BenchHarness
+// Runs benchmark cases and reports ns/op, heap allocations/op and bytes allocated/op
+//
+// Each case has an untimed setup, an optional untimed prepare step before each batch (e.g. to refill a
+// queue) and a timed batch which returns the number of operations it performed. Batches are repeated
+// for a number of rounds and the median round is reported (allocation counts are the mean over all
+// rounds). Results can be saved as a baseline and later runs compared against it.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Heap allocation counts (counted by the replacement operator new when enabled)
+struct BenchAllocStats
+{
+    static inline bool enabled = false;
+    static inline uint64_t count = 0;
+    static inline uint64_t bytes = 0;
+};
+
+class BenchCase
+{
+public:
+    std::string name;
+    std::function<void()> setupFn;
+    std::function<void()> prepareFn;
+    std::function<uint32_t()> runFn;
+};
+
+class BenchResult
+{
+public:
+    std::string name;
+    double nsPerOp = 0;
+    double allocsPerOp = 0;
+    double bytesPerOp = 0;
+    uint64_t ops = 0;
+};
+
+class BenchOptions
+{
+public:
+    std::string filter;
+    std::string capturesPath;
+    std::string outPath;
+    std::string baselinePath;
+    uint32_t minTimeMs = 500;
+    uint32_t rounds = 5;
+    double thresholdPercent = 10;
+    bool listOnly = false;
+};
+
+class BenchRunner
+{
+public:
+    BenchRunner(const BenchOptions& options) : _options(options)
+    {
+    }
+
+    /// @brief Add a case
+    void add(const BenchCase& benchCase)
+    {
+        _cases.push_back(benchCase);
+    }
+
+    /// @brief Run the cases matching the filter and report the results
+    /// @return process exit code (non-zero if a case regressed against the baseline)
+    int run();
+
+private:
+    const BenchOptions& _options;
+    std::vector<BenchCase> _cases;
+    std::vector<BenchResult> _results;
+
+    BenchResult runCase(BenchCase& benchCase);
+    bool readBaseline(std::vector<BenchResult>& baseline) const;
+    bool writeResults() const;
+};
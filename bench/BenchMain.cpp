@@ -0,0 +1,74 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BenchMain
+// Host benchmarks for the advert decoder, BLE bus device manager and state publisher
+//
+// Usage: raftsysmods_bench [--filter <substr>] [--min-time-ms <ms>] [--rounds <n>] [--captures <file>]
+//                          [--out <results.tsv>] [--baseline <results.tsv>] [--threshold <percent>] [--list]
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BenchCases.h"
+
+static void printUsage(const char* pProgName)
+{
+    printf("Usage: %s [options]\n"
+           "  --filter <substr>        only run benchmarks whose name contains substr\n"
+           "  --min-time-ms <ms>       timed duration of each benchmark (default 500)\n"
+           "  --rounds <n>             rounds per benchmark, the median is reported (default 5)\n"
+           "  --captures <file>        advert captures to replay (default %s)\n"
+           "  --out <file>             save results (e.g. as a baseline)\n"
+           "  --baseline <file>        compare with saved results (exit code 1 on regression)\n"
+           "  --threshold <percent>    ns/op increase treated as a regression (default 10)\n"
+           "  --list                   list benchmarks\n",
+           pProgName, BENCH_DATA_DIR "/adverts.txt");
+}
+
+int main(int argc, char** argv)
+{
+    // Options
+    BenchOptions options;
+    options.capturesPath = BENCH_DATA_DIR "/adverts.txt";
+    for (int argIdx = 1; argIdx < argc; argIdx++)
+    {
+        const char* pArg = argv[argIdx];
+        const char* pVal = argIdx + 1 < argc ? argv[argIdx + 1] : nullptr;
+        if (strcmp(pArg, "--list") == 0)
+        {
+            options.listOnly = true;
+            continue;
+        }
+        if ((strcmp(pArg, "--filter") == 0) && pVal)
+            options.filter = pVal;
+        else if ((strcmp(pArg, "--min-time-ms") == 0) && pVal)
+            options.minTimeMs = strtoul(pVal, nullptr, 10);
+        else if ((strcmp(pArg, "--rounds") == 0) && pVal)
+            options.rounds = strtoul(pVal, nullptr, 10);
+        else if ((strcmp(pArg, "--captures") == 0) && pVal)
+            options.capturesPath = pVal;
+        else if ((strcmp(pArg, "--out") == 0) && pVal)
+            options.outPath = pVal;
+        else if ((strcmp(pArg, "--baseline") == 0) && pVal)
+            options.baselinePath = pVal;
+        else if ((strcmp(pArg, "--threshold") == 0) && pVal)
+            options.thresholdPercent = strtod(pVal, nullptr);
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+        argIdx++;
+    }
+
+    // Cases
+    BenchRunner runner(options);
+    if (!addBLEBenchmarks(runner, options))
+        return 2;
+    addStatePublisherBenchmarks(runner, options);
+    return runner.run();
+}
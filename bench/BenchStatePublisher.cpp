@@ -0,0 +1,244 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BenchStatePublisher
+// State publisher loop and subscription API benchmarks
+//
+// Publications are synthetic: N topics each published on M interfaces at rates cycling through 1..50Hz
+// with state which changes at a different period for each topic. Each loop op advances the clock by 1ms
+// (so the scheduling sees the same time steps as on hardware) and calls loop() once. Cases cover polled
+// and deadline scheduling, delta/bundled subscriptions and a congested channel which refuses some
+// publishes.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include "BenchCases.h"
+#include "RaftCore.h"
+#include "RestAPIEndpointManager.h"
+#include "StatePublisher.h"
+
+namespace
+{
+    static const uint32_t LOOP_OPS_PER_BATCH = 100;
+    static const uint32_t API_OPS_PER_BATCH = 20;
+    static const uint32_t SUBSCRIBER_CHANNEL_ID_BASE = 10;
+    static const uint32_t NUM_SUBSCRIBER_CHANNELS = 4;
+    static const double PUB_RATES_HZ[] = { 1, 5, 10, 20, 50 };
+    static const char* PUB_INTERFACES[] = { "BLE", "WS", "Serial" };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Comms core which accepts (or for a congested channel sometimes refuses) and counts publishes
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class BenchCommsCore : public CommsCoreIF
+    {
+    public:
+        bool congested = false;
+        uint32_t msgCount = 0;
+        uint64_t msgBytes = 0;
+
+        virtual int32_t getChannelIDByName(const String& channelName, const String& protocolName) override
+        {
+            for (uint32_t i = 0; i < sizeof(PUB_INTERFACES) / sizeof(PUB_INTERFACES[0]); i++)
+                if (channelName.equals(PUB_INTERFACES[i]))
+                    return i + 1;
+            return -1;
+        }
+
+        // The BLE channel refuses 2 of every 5 publishes when congested
+        virtual bool outboundCanAccept(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn) override
+        {
+            noConn = false;
+            if (!congested || (channelID != 1))
+                return true;
+            return (_canAcceptCount++ % 5) >= 2;
+        }
+
+        virtual CommsCoreRetCode outboundHandleMsg(CommsChannelMsg& msg) override
+        {
+            msgCount++;
+            msgBytes += msg.getBufLen();
+            return COMMS_CORE_RET_OK;
+        }
+
+    private:
+        uint32_t _canAcceptCount = 0;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Publisher with synthetic publications
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class PubBench
+    {
+    public:
+        PubBench(uint32_t numTopics, uint32_t numInterfaces, bool deadlineSched, bool bundle, bool congested) :
+                    _config(genConfig(numTopics, numInterfaces, deadlineSched, bundle)),
+                    _publisher("Publish", _config),
+                    _numTopics(numTopics)
+        {
+            _commsCore.congested = congested;
+            RaftSysMod::setCommsCore(&_commsCore);
+            sysMod().addRestAPIEndpoints(_endpoints);
+            sysMod().setup();
+
+            // Data sources - the state of topic N changes every 50 * (N + 1) ms
+            for (uint32_t topicIdx = 0; topicIdx < numTopics; topicIdx++)
+            {
+                uint32_t changePeriodMs = 50 * (topicIdx + 1);
+                _publisher.registerDataSource(topicName(topicIdx).c_str(),
+                    [this, topicIdx, changePeriodMs](const char* messageName, CommsChannelMsg& msg) {
+                        char msgStr[200];
+                        int msgLen = snprintf(msgStr, sizeof(msgStr),
+                                    R"({"topic":%u,"seq":%u,"temp":%.1f,"mode":"auto","cfg":{"a":1,"b":%u}})",
+                                    topicIdx, _genCount++, 20.0 + (millis() / changePeriodMs) % 100 / 10.0,
+                                    (millis() / (changePeriodMs * 10)) % 4);
+                        msg.setFromBuffer((const uint8_t*)msgStr, msgLen);
+                        return true;
+                    },
+                    [changePeriodMs](const char* stateName, std::vector<uint8_t>& stateHash) {
+                        uint32_t stateIdx = millis() / changePeriodMs;
+                        stateHash.clear();
+                        stateHash.push_back(stateIdx & 0xff);
+                        stateHash.push_back((stateIdx >> 8) & 0xff);
+                    });
+            }
+        }
+
+        /// @brief Subscribe to every topic on each subscriber channel using the subscription API
+        void subscribeAll(bool delta, bool bundle)
+        {
+            for (uint32_t chanIdx = 0; chanIdx < NUM_SUBSCRIBER_CHANNELS; chanIdx++)
+                for (uint32_t topicIdx = 0; topicIdx < _numTopics; topicIdx++)
+                    subscribe(SUBSCRIBER_CHANNEL_ID_BASE + chanIdx, topicIdx,
+                                PUB_RATES_HZ[(topicIdx + chanIdx) % (sizeof(PUB_RATES_HZ) / sizeof(PUB_RATES_HZ[0]))],
+                                delta, bundle);
+        }
+
+        /// @brief Subscribe to a topic on a channel using the subscription API
+        void subscribe(uint32_t channelID, uint32_t topicIdx, double rateHz, bool delta, bool bundle)
+        {
+            apiRequest(subscribeReqStr(topicIdx, rateHz, delta, bundle), channelID);
+        }
+
+        /// @brief Handle an API request from a channel
+        void apiRequest(const String& reqStr, uint32_t channelID)
+        {
+            String respStr;
+            _endpoints.handleApiRequest(reqStr.c_str(), respStr, APISourceInfo(channelID));
+        }
+
+        static String subscribeReqStr(uint32_t topicIdx, double rateHz, bool delta, bool bundle)
+        {
+            return "subscription?action=update&topic=" + topicName(topicIdx) + "&rateHz=" + String(rateHz) +
+                        (delta ? "&delta=1" : "") + (bundle ? "&bundle=1" : "");
+        }
+
+        void loopBatch()
+        {
+            for (uint32_t i = 0; i < LOOP_OPS_PER_BATCH; i++)
+            {
+                BenchClock::advanceMs(1);
+                sysMod().loop();
+            }
+        }
+
+        static String topicName(uint32_t topicIdx)
+        {
+            return "topic" + String(topicIdx);
+        }
+
+    private:
+        BenchCommsCore _commsCore;
+        RaftJson _config;
+        StatePublisher _publisher;
+        RestAPIEndpointManager _endpoints;
+        uint32_t _numTopics = 0;
+        uint32_t _genCount = 0;
+
+        // The SysMod interface (setup and loop are protected in StatePublisher)
+        RaftSysMod& sysMod()
+        {
+            return _publisher;
+        }
+
+        static String genConfig(uint32_t numTopics, uint32_t numInterfaces, bool deadlineSched, bool bundle)
+        {
+            String pubList;
+            for (uint32_t topicIdx = 0; topicIdx < numTopics; topicIdx++)
+            {
+                String ifsStr;
+                for (uint32_t ifIdx = 0; ifIdx < numInterfaces; ifIdx++)
+                {
+                    double rateHz = PUB_RATES_HZ[(topicIdx + ifIdx) % (sizeof(PUB_RATES_HZ) / sizeof(PUB_RATES_HZ[0]))];
+                    ifsStr += String(ifIdx == 0 ? "" : ",") + R"({"if":")" +
+                                PUB_INTERFACES[ifIdx % (sizeof(PUB_INTERFACES) / sizeof(PUB_INTERFACES[0]))] +
+                                R"(","protocol":"RICSerial","rateHz":)" + String(rateHz) +
+                                (bundle ? R"(,"bundle":1})" : "}");
+                }
+                pubList += String(topicIdx == 0 ? "" : ",") + R"({"topic":")" + topicName(topicIdx) +
+                            R"(","trigger":"timeorchange","minStateChangeMs":100,"ifs":[)" + ifsStr + "]}";
+            }
+            return R"({"pubList":[)" + pubList + R"(],"deadlineSched":)" + String(deadlineSched ? 1 : 0) + "}";
+        }
+    };
+
+    // Add a loop case
+    void addLoopCase(BenchRunner& runner, const char* pName, uint32_t numTopics, uint32_t numInterfaces,
+                bool deadlineSched, bool deltaBundle, bool congested)
+    {
+        auto pBench = std::make_shared<std::unique_ptr<PubBench>>();
+        runner.add({ pName,
+            [=]() {
+                *pBench = std::make_unique<PubBench>(numTopics, numInterfaces, deadlineSched, deltaBundle, congested);
+                if (deltaBundle)
+                    (*pBench)->subscribeAll(true, true);
+            },
+            nullptr,
+            [pBench]() {
+                (*pBench)->loopBatch();
+                return LOOP_OPS_PER_BATCH;
+            }});
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add cases
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void addStatePublisherBenchmarks(BenchRunner& runner, const BenchOptions& options)
+{
+    // Loop
+    addLoopCase(runner, "statepub/loop/poll/20x2", 20, 2, false, false, false);
+    addLoopCase(runner, "statepub/loop/deadline/20x2", 20, 2, true, false, false);
+    addLoopCase(runner, "statepub/loop/poll/100x3", 100, 3, false, false, false);
+    addLoopCase(runner, "statepub/loop/deadline/100x3", 100, 3, true, false, false);
+    addLoopCase(runner, "statepub/loop/deadline/20x2+delta+bundle", 20, 2, true, true, false);
+    addLoopCase(runner, "statepub/loop/deadline/20x2+congested", 20, 2, true, false, true);
+
+    // Subscription API (updates of existing subscriptions once the first batch has created them)
+    auto pApiBench = std::make_shared<std::unique_ptr<PubBench>>();
+    auto pApiReqs = std::make_shared<std::vector<String>>();
+    auto pApiCount = std::make_shared<uint32_t>(0);
+    runner.add({ "statepub/apiSubscription",
+        [pApiBench, pApiReqs]() {
+            *pApiBench = std::make_unique<PubBench>(20, 2, true, false, false);
+            for (uint32_t reqIdx = 0; reqIdx < 20; reqIdx++)
+                pApiReqs->push_back(PubBench::subscribeReqStr(reqIdx,
+                            PUB_RATES_HZ[reqIdx % (sizeof(PUB_RATES_HZ) / sizeof(PUB_RATES_HZ[0]))], false, false));
+        },
+        nullptr,
+        [pApiBench, pApiReqs, pApiCount]() {
+            for (uint32_t i = 0; i < API_OPS_PER_BATCH; i++)
+            {
+                uint32_t reqIdx = (*pApiCount)++;
+                (*pApiBench)->apiRequest((*pApiReqs)[reqIdx % pApiReqs->size()],
+                            SUBSCRIBER_CHANNEL_ID_BASE + (reqIdx / pApiReqs->size()) % NUM_SUBSCRIBER_CHANNELS);
+            }
+            return API_OPS_PER_BATCH;
+        }});
+}
@@ -0,0 +1,108 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// TestCommandFile
+// Host tests of CommandFile api script execution (scheduling, reps and scripts which run other scripts)
+//
+// Each script line "log/<name>" is recorded by a log endpoint so the order in which the lines ran can be
+// checked against the expected sequence.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "RaftCore.h"
+#include "RestAPIEndpointManager.h"
+#include "FileSystem.h"
+#include "CommandFile.h"
+
+namespace
+{
+    static const uint32_t MAX_LOOP_MS = 1000;
+
+    class CommandFileTest
+    {
+    public:
+        CommandFileTest() : _config("{}"), _commandFile("CommandFile", _config)
+        {
+            _endpoints.addEndpoint("log", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
+                [this](const String& reqStr, String& respStr, const APISourceInfo& sourceInfo) {
+                    _log.push_back(RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1).c_str());
+                    return RAFT_OK;
+                }, "Log");
+            sysMod().addRestAPIEndpoints(_endpoints);
+            sysMod().setup();
+        }
+
+        /// @brief Run a file and loop until it is done (or MAX_LOOP_MS)
+        /// @return names logged in order (separated by spaces)
+        std::string run(const char* pFileName)
+        {
+            String respStr;
+            _endpoints.handleApiRequest((String("filerun/") + pFileName).c_str(), respStr,
+                        APISourceInfo(RestAPIEndpointManager::CHANNEL_ID_COMMAND_FILE));
+            for (uint32_t i = 0; i < MAX_LOOP_MS; i++)
+            {
+                BenchClock::advanceMs(1);
+                sysMod().loop();
+            }
+            std::string logStr;
+            for (const std::string& name : _log)
+                logStr += (logStr.empty() ? "" : " ") + name;
+            return logStr;
+        }
+
+    private:
+        RaftJson _config;
+        CommandFile _commandFile;
+        RestAPIEndpointManager _endpoints;
+        std::vector<std::string> _log;
+
+        // The SysMod interface (setup and loop are protected in CommandFile)
+        RaftSysMod& sysMod()
+        {
+            return _commandFile;
+        }
+    };
+
+    int _numFailed = 0;
+
+    void check(const char* pTestName, const char* pFileName, const char* pExpected)
+    {
+        CommandFileTest test;
+        std::string logStr = test.run(pFileName);
+        bool isOk = logStr == pExpected;
+        printf("%s %s\n", isOk ? "PASS" : "FAIL", pTestName);
+        if (!isOk)
+        {
+            printf("    expected \"%s\" got \"%s\"\n", pExpected, logStr.c_str());
+            _numFailed++;
+        }
+    }
+}
+
+int main()
+{
+    // Scripts
+    fileSystem.setFile("reps.api", "log/a 10 3\n\nlog/b 5\r\nlog/c\n");
+    fileSystem.setFile("chain.api", "log/a 10\nfilerun/next.api 10\nlog/never\n");
+    fileSystem.setFile("next.api", "log/n1 10\nlog/n2 10 2\nlog/n3\n");
+    fileSystem.setFile("chainone.api", "log/a\nfilerun/one.api\nlog/never\n");
+    fileSystem.setFile("one.api", "log/o1\n");
+
+    // Reps, delays and blank lines
+    check("reps", "reps.api", "a a a b c");
+
+    // A script line which runs another file replaces the running script (the new file starts at its first
+    // line and none of the rest of the first file is run)
+    check("chained", "chain.api", "a n1 n2 n2 n3");
+    check("chainedSingleLine", "chainone.api", "a o1");
+
+    // Missing file
+    check("missing", "none.api", "");
+
+    printf("%s (%d failed)\n", _numFailed == 0 ? "OK" : "FAILED", _numFailed);
+    return _numFailed == 0 ? 0 : 1;
+}
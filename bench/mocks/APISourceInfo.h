@@ -0,0 +1,20 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of APISourceInfo
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+class APISourceInfo
+{
+public:
+    APISourceInfo(uint32_t channelID) : channelID(channelID)
+    {
+    }
+    uint32_t channelID;
+};
@@ -0,0 +1,105 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of CommsChannelMsg
+// Message payload held in a vector (copies allocate as they do on the device)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+enum CommsMsgTypeCode
+{
+    MSG_TYPE_COMMAND,
+    MSG_TYPE_RESPONSE,
+    MSG_TYPE_PUBLISH,
+    MSG_TYPE_REPORT
+};
+
+enum CommsMsgProtocol
+{
+    MSG_PROTOCOL_ROSSERIAL,
+    MSG_PROTOCOL_RESERVED_1,
+    MSG_PROTOCOL_RAWCMDFRAME,
+    MSG_PROTOCOL_NONE = 0x3f
+};
+
+class CommsChannelMsg
+{
+public:
+    CommsChannelMsg()
+    {
+    }
+    CommsChannelMsg(uint32_t channelID, CommsMsgProtocol msgProtocol, uint32_t msgNumber, CommsMsgTypeCode msgTypeCode) :
+            _channelID(channelID), _msgProtocol(msgProtocol), _msgNumber(msgNumber), _msgTypeCode(msgTypeCode)
+    {
+    }
+    void setFromBuffer(const uint8_t* pBuf, uint32_t bufLen)
+    {
+        _cmdVector.assign(pBuf, pBuf + bufLen);
+    }
+    void setFromBuffer(uint32_t channelID, CommsMsgProtocol msgProtocol, uint32_t msgNumber, CommsMsgTypeCode msgTypeCode,
+                const uint8_t* pBuf, uint32_t bufLen)
+    {
+        _channelID = channelID;
+        _msgProtocol = msgProtocol;
+        _msgNumber = msgNumber;
+        _msgTypeCode = msgTypeCode;
+        setFromBuffer(pBuf, bufLen);
+    }
+    void setBufferSize(uint32_t bufSize)
+    {
+        _cmdVector.resize(bufSize);
+    }
+    uint32_t getChannelID() const
+    {
+        return _channelID;
+    }
+    void setChannelID(uint32_t channelID)
+    {
+        _channelID = channelID;
+    }
+    CommsMsgProtocol getProtocol() const
+    {
+        return _msgProtocol;
+    }
+    void setProtocol(CommsMsgProtocol msgProtocol)
+    {
+        _msgProtocol = msgProtocol;
+    }
+    uint32_t getMsgNumber() const
+    {
+        return _msgNumber;
+    }
+    CommsMsgTypeCode getMsgTypeCode() const
+    {
+        return _msgTypeCode;
+    }
+    const uint8_t* getBuf() const
+    {
+        return _cmdVector.data();
+    }
+    uint8_t* getBuf()
+    {
+        return _cmdVector.data();
+    }
+    uint32_t getBufLen() const
+    {
+        return _cmdVector.size();
+    }
+    std::vector<uint8_t>& getCmdVector()
+    {
+        return _cmdVector;
+    }
+
+private:
+    uint32_t _channelID = 0;
+    CommsMsgProtocol _msgProtocol = MSG_PROTOCOL_ROSSERIAL;
+    uint32_t _msgNumber = 0;
+    CommsMsgTypeCode _msgTypeCode = MSG_TYPE_PUBLISH;
+    std::vector<uint8_t> _cmdVector;
+};
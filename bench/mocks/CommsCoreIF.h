@@ -0,0 +1,36 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of CommsCoreIF
+// Only the members used by the publisher are provided (the benchmark implements a comms core which
+// accepts or refuses messages)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftArduino.h"
+#include "CommsChannelMsg.h"
+
+enum CommsCoreRetCode
+{
+    COMMS_CORE_RET_OK,
+    COMMS_CORE_RET_FAIL,
+    COMMS_CORE_RET_NO_CONN
+};
+
+class CommsCoreIF
+{
+public:
+    static const uint32_t CHANNEL_ID_UNDEFINED = 0xffff;
+    static const uint32_t CHANNEL_ID_REST_API = 0xfffe;
+
+    virtual ~CommsCoreIF()
+    {
+    }
+    virtual int32_t getChannelIDByName(const String& channelName, const String& protocolName) = 0;
+    virtual bool outboundCanAccept(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn) = 0;
+    virtual CommsCoreRetCode outboundHandleMsg(CommsChannelMsg& msg) = 0;
+};
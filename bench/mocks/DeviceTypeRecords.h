@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of DeviceTypeRecords
+// The BLE device types (BLEBTHome and BLEBTHomeExt) with poll response JSON formatted as RaftCore does (hex
+// encoded data)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftUtils.h"
+#include "RaftBusDevicesIF.h"
+
+class DeviceTypeRecord
+{
+public:
+    const char* deviceType = "";
+};
+
+class DeviceTypeRecords
+{
+public:
+    bool getDeviceInfo(const char* pDeviceType, DeviceTypeRecord& devTypeRec, uint32_t& deviceTypeIdx) const
+    {
+        for (uint32_t typeIdx = 0; typeIdx < NUM_TYPES; typeIdx++)
+        {
+            if (strcmp(pDeviceType, TYPE_NAMES[typeIdx]) == 0)
+            {
+                devTypeRec.deviceType = TYPE_NAMES[typeIdx];
+                deviceTypeIdx = typeIdx;
+                return true;
+            }
+        }
+        return false;
+    }
+    String getDevTypeInfoJsonByTypeIdx(uint16_t deviceTypeIdx, bool includePlugAndPlayInfo) const
+    {
+        return deviceTypeIdx < NUM_TYPES ? String(R"({"name":")") + TYPE_NAMES[deviceTypeIdx] + R"("})" : String("{}");
+    }
+    String getDevTypeInfoJsonByTypeName(const String& deviceType, bool includePlugAndPlayInfo) const
+    {
+        DeviceTypeRecord devTypeRec;
+        uint32_t deviceTypeIdx = UINT16_MAX;
+        getDeviceInfo(deviceType.c_str(), devTypeRec, deviceTypeIdx);
+        return getDevTypeInfoJsonByTypeIdx(deviceTypeIdx, includePlugAndPlayInfo);
+    }
+    String deviceStatusToJson(BusElemAddrType address, bool isOnline, const DeviceTypeRecord* pDevTypeRec,
+                const std::vector<uint8_t>& devicePollResponseData) const
+    {
+        String hexStr;
+        Raft::getHexStrFromBytes(devicePollResponseData.data(), devicePollResponseData.size(), hexStr);
+        return "\"" + String(address, 16) + R"(":{"x":")" + hexStr + R"(","_o":)" + String(isOnline ? 1 : 0) +
+                    R"(,"_t":")" + (pDevTypeRec ? pDevTypeRec->deviceType : "") + "\"}";
+    }
+    uint32_t decodeDeviceData(uint16_t deviceTypeIdx, const uint8_t* pPollBuf, uint32_t pollBufLen,
+                void* pStructOut, uint32_t structOutSize, uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const
+    {
+        if ((maxRecCount == 0) || (pollBufLen == 0))
+            return 0;
+        memcpy(pStructOut, pPollBuf, pollBufLen < structOutSize ? pollBufLen : structOutSize);
+        return 1;
+    }
+
+private:
+    static const uint32_t NUM_TYPES = 2;
+    static constexpr const char* TYPE_NAMES[NUM_TYPES] = { "BLEBTHome", "BLEBTHomeExt" };
+};
+
+inline DeviceTypeRecords deviceTypeRecords;
@@ -0,0 +1,45 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of FileSystem
+// Files are held in memory and set by the test
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <map>
+#include <string>
+#include "RaftArduino.h"
+
+class FileSystem
+{
+public:
+    void setFile(const char* pFileName, const char* pContents)
+    {
+        _files[pFileName] = pContents;
+    }
+
+    /// @brief Get file contents (allocated with malloc and null terminated, nullptr if not found or too long)
+    char* getFileContents(const char* fileSystemStr, const String& filename, int maxLen = 0)
+    {
+        auto it = _files.find(filename.c_str());
+        if ((it == _files.end()) || ((maxLen > 0) && (it->second.size() > (size_t)maxLen)))
+            return nullptr;
+        char* pContents = (char*)malloc(it->second.size() + 1);
+        memcpy(pContents, it->second.c_str(), it->second.size() + 1);
+        return pContents;
+    }
+
+    static String getFileExtension(const String& fileName)
+    {
+        int dotIdx = fileName.lastIndexOf('.');
+        return dotIdx < 0 ? String() : fileName.substring(dotIdx + 1);
+    }
+
+private:
+    std::map<std::string, std::string> _files;
+};
+
+inline FileSystem fileSystem;
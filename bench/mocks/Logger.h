@@ -0,0 +1,16 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of Logger
+// Logging is compiled out so that benchmarks measure the code rather than the console
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#define LOG_E(tag, ...) do {} while (0)
+#define LOG_W(tag, ...) do {} while (0)
+#define LOG_I(tag, ...) do {} while (0)
+#define LOG_D(tag, ...) do {} while (0)
+#define LOG_V(tag, ...) do {} while (0)
@@ -0,0 +1,142 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftArduino
+// String (backed by std::string so allocations behave like the heap-allocated Arduino String) and a simulated
+// clock for millis() and micros() which the benchmarks advance explicitly
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <string>
+
+class String
+{
+public:
+    String() {}
+    String(const char* pStr) : _str(pStr ? pStr : "") {}
+    String(const char* pStr, unsigned len) : _str(pStr, len) {}
+    String(const std::string& str) : _str(str) {}
+    explicit String(char c) : _str(1, c) {}
+    String(int val, unsigned char base = 10) { fromInt(val, base); }
+    String(unsigned int val, unsigned char base = 10) { fromUInt(val, base); }
+    String(long val, unsigned char base = 10) { fromInt(val, base); }
+    String(unsigned long val, unsigned char base = 10) { fromUInt(val, base); }
+    String(long long val, unsigned char base = 10) { fromInt(val, base); }
+    String(unsigned long long val, unsigned char base = 10) { fromUInt(val, base); }
+    String(float val, unsigned char decimalPlaces = 2) { fromDouble(val, decimalPlaces); }
+    String(double val, unsigned char decimalPlaces = 2) { fromDouble(val, decimalPlaces); }
+
+    const char* c_str() const { return _str.c_str(); }
+    unsigned length() const { return _str.length(); }
+    bool isEmpty() const { return _str.empty(); }
+    bool reserve(unsigned size) { _str.reserve(size); return true; }
+    void clear() { _str.clear(); }
+
+    bool equals(const String& other) const { return _str == other._str; }
+    bool equals(const char* pStr) const { return _str == (pStr ? pStr : ""); }
+    bool equalsIgnoreCase(const String& other) const { return strcasecmp(_str.c_str(), other.c_str()) == 0; }
+    bool startsWith(const String& prefix) const { return _str.compare(0, prefix._str.length(), prefix._str) == 0; }
+    bool endsWith(const String& suffix) const
+    {
+        return (_str.length() >= suffix._str.length()) &&
+                    (_str.compare(_str.length() - suffix._str.length(), suffix._str.length(), suffix._str) == 0);
+    }
+    int indexOf(char c, unsigned fromIdx = 0) const { return findResult(_str.find(c, fromIdx)); }
+    int indexOf(const String& str, unsigned fromIdx = 0) const { return findResult(_str.find(str._str, fromIdx)); }
+    int lastIndexOf(char c) const { return findResult(_str.rfind(c)); }
+    String substring(unsigned beginIdx) const { return beginIdx >= _str.length() ? String() : String(_str.substr(beginIdx)); }
+    String substring(unsigned beginIdx, unsigned endIdx) const
+    {
+        if ((beginIdx >= _str.length()) || (endIdx <= beginIdx))
+            return String();
+        return String(_str.substr(beginIdx, endIdx - beginIdx));
+    }
+    long toInt() const { return strtol(_str.c_str(), nullptr, 10); }
+    double toDouble() const { return strtod(_str.c_str(), nullptr); }
+    void toLowerCase() { for (char& c : _str) c = tolower(c); }
+    void toUpperCase() { for (char& c : _str) c = toupper(c); }
+    void replace(const String& find, const String& replaceWith)
+    {
+        if (find._str.empty())
+            return;
+        for (size_t pos = _str.find(find._str); pos != std::string::npos; pos = _str.find(find._str, pos + replaceWith._str.length()))
+            _str.replace(pos, find._str.length(), replaceWith._str);
+    }
+    void trim()
+    {
+        size_t startPos = _str.find_first_not_of(" \t\r\n");
+        size_t endPos = _str.find_last_not_of(" \t\r\n");
+        _str = startPos == std::string::npos ? std::string() : _str.substr(startPos, endPos - startPos + 1);
+    }
+
+    bool concat(const String& str) { _str += str._str; return true; }
+    bool concat(const char* pStr) { _str += pStr ? pStr : ""; return true; }
+    bool concat(const char* pStr, unsigned len) { _str.append(pStr, len); return true; }
+    bool concat(char c) { _str += c; return true; }
+    String& operator+=(const String& str) { _str += str._str; return *this; }
+    String& operator+=(const char* pStr) { _str += pStr ? pStr : ""; return *this; }
+    String& operator+=(char c) { _str += c; return *this; }
+
+    char charAt(unsigned idx) const { return idx < _str.length() ? _str[idx] : 0; }
+    char operator[](unsigned idx) const { return idx < _str.length() ? _str[idx] : 0; }
+    char& operator[](unsigned idx) { return _str[idx]; }
+    bool operator==(const String& other) const { return _str == other._str; }
+    bool operator!=(const String& other) const { return _str != other._str; }
+    bool operator<(const String& other) const { return _str < other._str; }
+
+    friend String operator+(const String& a, const String& b) { String r(a); r._str += b._str; return r; }
+    friend String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+    friend String operator+(const char* a, const String& b) { String r(a); r._str += b._str; return r; }
+    friend String operator+(const String& a, char b) { String r(a); r._str += b; return r; }
+
+private:
+    std::string _str;
+    static int findResult(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+    void fromInt(long long val, unsigned char base)
+    {
+        if ((base != 10) && (val >= 0))
+            return fromUInt(val, base);
+        _str = std::to_string(val);
+    }
+    void fromUInt(unsigned long long val, unsigned char base)
+    {
+        char buf[70];
+        if (base == 16)
+            snprintf(buf, sizeof(buf), "%llx", val);
+        else
+            snprintf(buf, sizeof(buf), "%llu", val);
+        _str = buf;
+    }
+    void fromDouble(double val, unsigned char decimalPlaces)
+    {
+        char buf[50];
+        snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, val);
+        _str = buf;
+    }
+};
+
+// Simulated clock - time only moves when the benchmark advances it so runs are repeatable
+class BenchClock
+{
+public:
+    static uint64_t nowUs() { return _nowUs; }
+    static void setUs(uint64_t timeUs) { _nowUs = timeUs; }
+    static void advanceUs(uint64_t us) { _nowUs += us; }
+    static void advanceMs(uint32_t ms) { _nowUs += (uint64_t)ms * 1000; }
+private:
+    static inline uint64_t _nowUs = 1000000;
+};
+
+inline uint32_t millis() { return BenchClock::nowUs() / 1000; }
+inline uint64_t micros() { return BenchClock::nowUs(); }
+inline void delay(uint32_t ms) { BenchClock::advanceMs(ms); }
+inline void delayMicroseconds(uint32_t us) { BenchClock::advanceUs(us); }
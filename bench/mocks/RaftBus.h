@@ -0,0 +1,26 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftBus
+// Element status changes are counted rather than passed on
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftBusDevicesIF.h"
+
+class RaftBus
+{
+public:
+    virtual ~RaftBus()
+    {
+    }
+    void callBusElemStatusCB(const std::vector<BusElemAddrAndStatus>& statusChanges)
+    {
+        statusChangeCount += statusChanges.size();
+    }
+    uint32_t statusChangeCount = 0;
+};
@@ -0,0 +1,64 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftBusDevicesIF
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include "RaftArduino.h"
+
+typedef uint32_t BusElemAddrType;
+
+class DevicePollingInfo;
+
+class RaftBusDeviceDecodeState
+{
+public:
+    uint64_t lastReportTimestampUs = 0;
+    uint64_t reportTimestampOffsetUs = 0;
+};
+
+typedef std::function<void(BusElemAddrType address, const std::vector<uint8_t>& data, const void* pCallbackInfo)> RaftDeviceDataChangeCB;
+
+class BusElemAddrAndStatus
+{
+public:
+    BusElemAddrAndStatus(BusElemAddrType address, bool isChangeToOnline, bool isChangeToOffline, bool isNewlyIdentified,
+                uint16_t deviceTypeIndex) :
+            address(address), isChangeToOnline(isChangeToOnline), isChangeToOffline(isChangeToOffline),
+            isNewlyIdentified(isNewlyIdentified), deviceTypeIndex(deviceTypeIndex)
+    {
+    }
+    BusElemAddrType address;
+    bool isChangeToOnline;
+    bool isChangeToOffline;
+    bool isNewlyIdentified;
+    uint16_t deviceTypeIndex;
+};
+
+class RaftBusDevicesIF
+{
+public:
+    virtual ~RaftBusDevicesIF()
+    {
+    }
+    virtual void getDeviceAddresses(std::vector<BusElemAddrType>& addresses, bool onlyAddressesWithIdentPollResponses) const = 0;
+    virtual String getDevTypeInfoJsonByAddr(BusElemAddrType address, bool includePlugAndPlayInfo) const = 0;
+    virtual String getDevTypeInfoJsonByTypeName(const String& deviceType, bool includePlugAndPlayInfo) const = 0;
+    virtual String getDevTypeInfoJsonByTypeIdx(uint16_t deviceTypeIdx, bool includePlugAndPlayInfo) const = 0;
+    virtual String getQueuedDeviceDataJson() const = 0;
+    virtual std::vector<uint8_t> getQueuedDeviceDataBinary(uint32_t connMode) const = 0;
+    virtual uint32_t getDecodedPollResponses(BusElemAddrType address, void* pStructOut, uint32_t structOutSize,
+                uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const = 0;
+    virtual void registerForDeviceData(BusElemAddrType address, RaftDeviceDataChangeCB dataChangeCB,
+                uint32_t minTimeBetweenReportsMs, const void* pCallbackInfo) = 0;
+    virtual bool handlePollResult(uint64_t timeNowUs, BusElemAddrType address,
+                const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo) = 0;
+    virtual String getDebugJSON(bool includeBraces) const = 0;
+};
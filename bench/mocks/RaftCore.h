@@ -0,0 +1,23 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftCore (includes the mocked RaftCore headers)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "sdkconfig.h"
+#include "RaftArduino.h"
+#include "RaftThreading.h"
+#include "RaftUtils.h"
+#include "Logger.h"
+#include "RaftJson.h"
+#include "RaftBusDevicesIF.h"
+#include "RaftBus.h"
+#include "RaftDevice.h"
+#include "DeviceTypeRecords.h"
+#include "CommsChannelMsg.h"
+#include "CommsCoreIF.h"
+#include "RaftSysMod.h"
@@ -0,0 +1,33 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftDevice
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftBusDevicesIF.h"
+
+class RaftDevice
+{
+public:
+    /// @brief Append a binary device data message
+    /// Format: length (2 bytes MSB first, excluding the length), connMode with online flag in bit 7,
+    /// address (4 bytes MSB first), device type index (2 bytes MSB first), data
+    static void genBinaryDataMsg(std::vector<uint8_t>& binaryMsg, uint32_t connMode, BusElemAddrType address,
+                uint16_t deviceTypeIndex, bool isOnline, const std::vector<uint8_t>& deviceMsgData)
+    {
+        uint32_t msgLen = 7 + deviceMsgData.size();
+        binaryMsg.push_back((msgLen >> 8) & 0xff);
+        binaryMsg.push_back(msgLen & 0xff);
+        binaryMsg.push_back((connMode & 0x7f) | (isOnline ? 0x80 : 0));
+        for (int i = 3; i >= 0; i--)
+            binaryMsg.push_back((address >> (i * 8)) & 0xff);
+        binaryMsg.push_back((deviceTypeIndex >> 8) & 0xff);
+        binaryMsg.push_back(deviceTypeIndex & 0xff);
+        binaryMsg.insert(binaryMsg.end(), deviceMsgData.begin(), deviceMsgData.end());
+    }
+};
@@ -0,0 +1,268 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftJson
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RaftJson.h"
+
+namespace
+{
+    const char* skipWhitespace(const char* p)
+    {
+        while (*p && ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')))
+            p++;
+        return p;
+    }
+
+    // Skip a value returning a pointer to the character after it (nullptr if invalid)
+    const char* skipValue(const char* p)
+    {
+        p = skipWhitespace(p);
+        if (*p == '"')
+        {
+            for (p++; *p && (*p != '"'); p++)
+            {
+                if ((*p == '\\') && p[1])
+                    p++;
+            }
+            return *p ? p + 1 : nullptr;
+        }
+        if ((*p == '{') || (*p == '['))
+        {
+            uint32_t depth = 0;
+            for (; *p; p++)
+            {
+                if (*p == '"')
+                {
+                    p = skipValue(p);
+                    if (!p)
+                        return nullptr;
+                    p--;
+                }
+                else if ((*p == '{') || (*p == '['))
+                {
+                    depth++;
+                }
+                else if (((*p == '}') || (*p == ']')) && (--depth == 0))
+                {
+                    return p + 1;
+                }
+            }
+            return nullptr;
+        }
+        const char* pStart = p;
+        while (*p && (*p != ',') && (*p != '}') && (*p != ']') && (*p != ' ') && (*p != '\t') && (*p != '\r') && (*p != '\n'))
+            p++;
+        return p == pStart ? nullptr : p;
+    }
+
+    // Find a member of an object (p at the opening brace)
+    const char* findMember(const char* p, const char* pName, uint32_t nameLen)
+    {
+        p = skipWhitespace(p + 1);
+        while (*p == '"')
+        {
+            const char* pKey = p + 1;
+            const char* pKeyEnd = skipValue(p);
+            if (!pKeyEnd)
+                return nullptr;
+            p = skipWhitespace(pKeyEnd);
+            if (*p != ':')
+                return nullptr;
+            p = skipWhitespace(p + 1);
+            if ((uint32_t)(pKeyEnd - 1 - pKey) == nameLen && (strncmp(pKey, pName, nameLen) == 0))
+                return p;
+            p = skipValue(p);
+            if (!p)
+                return nullptr;
+            p = skipWhitespace(p);
+            if (*p != ',')
+                return nullptr;
+            p = skipWhitespace(p + 1);
+        }
+        return nullptr;
+    }
+
+    // Find an element of an array (p at the opening bracket)
+    const char* findElem(const char* p, uint32_t elemIdx)
+    {
+        p = skipWhitespace(p + 1);
+        if (*p == ']')
+            return nullptr;
+        for (uint32_t i = 0; i < elemIdx; i++)
+        {
+            p = skipValue(p);
+            if (!p)
+                return nullptr;
+            p = skipWhitespace(p);
+            if (*p != ',')
+                return nullptr;
+            p = skipWhitespace(p + 1);
+        }
+        return p;
+    }
+
+    // Value as a string (string values are unescaped, others are the JSON text)
+    String valueToString(const char* pStart, const char* pEnd)
+    {
+        if (*pStart != '"')
+            return String(pStart, pEnd - pStart);
+        std::string outStr;
+        outStr.reserve(pEnd - pStart);
+        for (const char* p = pStart + 1; p < pEnd - 1; p++)
+        {
+            if ((*p == '\\') && (p + 1 < pEnd - 1))
+            {
+                p++;
+                switch (*p)
+                {
+                    case 'n': outStr += '\n'; break;
+                    case 't': outStr += '\t'; break;
+                    case 'r': outStr += '\r'; break;
+                    default: outStr += *p; break;
+                }
+                continue;
+            }
+            outStr += *p;
+        }
+        return String(outStr);
+    }
+}
+
+bool RaftJson::locate(const char* pDataPath, const char*& pStart, const char*& pEnd) const
+{
+    const char* p = skipWhitespace(_jsonStr.c_str());
+    const char* pPath = pDataPath ? pDataPath : "";
+    while (*pPath)
+    {
+        // Member name
+        const char* pName = pPath;
+        while (*pPath && (*pPath != '/') && (*pPath != '['))
+            pPath++;
+        if (pPath != pName)
+        {
+            if (*p != '{')
+                return false;
+            p = findMember(p, pName, pPath - pName);
+            if (!p)
+                return false;
+        }
+
+        // Array indices
+        while (*pPath == '[')
+        {
+            uint32_t elemIdx = strtoul(pPath + 1, nullptr, 10);
+            while (*pPath && (*pPath != ']'))
+                pPath++;
+            if (*pPath)
+                pPath++;
+            if (*p != '[')
+                return false;
+            p = findElem(p, elemIdx);
+            if (!p)
+                return false;
+        }
+        if (*pPath == '/')
+            pPath++;
+    }
+    pStart = p;
+    pEnd = skipValue(p);
+    return pEnd != nullptr;
+}
+
+String RaftJson::getString(const char* pDataPath, const char* defaultValue) const
+{
+    const char* pStart = nullptr;
+    const char* pEnd = nullptr;
+    if (!locate(pDataPath, pStart, pEnd))
+        return defaultValue;
+    return valueToString(pStart, pEnd);
+}
+
+double RaftJson::getDouble(const char* pDataPath, double defaultValue) const
+{
+    const char* pStart = nullptr;
+    const char* pEnd = nullptr;
+    if (!locate(pDataPath, pStart, pEnd))
+        return defaultValue;
+    if (*pStart == '"')
+        pStart++;
+    if (strncmp(pStart, "true", 4) == 0)
+        return 1;
+    if (strncmp(pStart, "false", 5) == 0)
+        return 0;
+    char* pNumEnd = nullptr;
+    double val = strtod(pStart, &pNumEnd);
+    return pNumEnd == pStart ? defaultValue : val;
+}
+
+bool RaftJson::getBool(const char* pDataPath, bool defaultValue) const
+{
+    return getDouble(pDataPath, defaultValue ? 1 : 0) != 0;
+}
+
+bool RaftJson::getArrayElems(const char* pDataPath, std::vector<String>& strList) const
+{
+    strList.clear();
+    const char* pStart = nullptr;
+    const char* pEnd = nullptr;
+    if (!locate(pDataPath, pStart, pEnd) || (*pStart != '['))
+        return false;
+    const char* p = skipWhitespace(pStart + 1);
+    while (*p && (*p != ']'))
+    {
+        const char* pElemEnd = skipValue(p);
+        if (!pElemEnd)
+            return false;
+        strList.push_back(valueToString(p, pElemEnd));
+        p = skipWhitespace(pElemEnd);
+        if (*p == ',')
+            p = skipWhitespace(p + 1);
+    }
+    return true;
+}
+
+RaftJson::RaftJsonType RaftJson::getType(const char* pDataPath, int& arrayLen) const
+{
+    arrayLen = 0;
+    const char* pStart = nullptr;
+    const char* pEnd = nullptr;
+    if (!locate(pDataPath, pStart, pEnd))
+        return RAFT_JSON_UNDEFINED;
+    switch (*pStart)
+    {
+        case '{': return RAFT_JSON_OBJECT;
+        case '"': return RAFT_JSON_STRING;
+        case 't': case 'f': return RAFT_JSON_BOOLEAN;
+        case 'n': return RAFT_JSON_NULL;
+        case '[': break;
+        default: return RAFT_JSON_NUMBER;
+    }
+    const char* p = skipWhitespace(pStart + 1);
+    while (*p && (*p != ']'))
+    {
+        p = skipValue(p);
+        if (!p)
+            break;
+        arrayLen++;
+        p = skipWhitespace(p);
+        if (*p == ',')
+            p = skipWhitespace(p + 1);
+    }
+    return RAFT_JSON_ARRAY;
+}
+
+String RaftJson::getJSONFromNVPairs(const std::vector<NameValuePair>& nameValuePairs, bool includeOuterBraces)
+{
+    String jsonStr;
+    for (const NameValuePair& nvPair : nameValuePairs)
+    {
+        if (jsonStr.length() > 0)
+            jsonStr += ",";
+        jsonStr += "\"" + nvPair.name + "\":\"" + nvPair.value + "\"";
+    }
+    return includeOuterBraces ? "{" + jsonStr + "}" : jsonStr;
+}
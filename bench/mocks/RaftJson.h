@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftJson
+// Values are located by scanning the document text on each access (as RaftJson does) using the same path
+// syntax - members separated by / with array elements as [N] e.g. "pubList[2]/ifs[0]/rateHz"
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftJsonIF.h"
+
+class RaftJson : public RaftJsonIF
+{
+public:
+    enum RaftJsonType
+    {
+        RAFT_JSON_UNDEFINED,
+        RAFT_JSON_OBJECT,
+        RAFT_JSON_ARRAY,
+        RAFT_JSON_STRING,
+        RAFT_JSON_BOOLEAN,
+        RAFT_JSON_NUMBER,
+        RAFT_JSON_NULL
+    };
+
+    class NameValuePair
+    {
+    public:
+        NameValuePair()
+        {
+        }
+        NameValuePair(const String& name, const String& value) : name(name), value(value)
+        {
+        }
+        String name;
+        String value;
+    };
+
+    RaftJson()
+    {
+    }
+    RaftJson(const char* pJsonStr, bool makeCopy = true) : _jsonStr(pJsonStr)
+    {
+    }
+    RaftJson(const String& jsonStr) : _jsonStr(jsonStr)
+    {
+    }
+
+    virtual String getString(const char* pDataPath, const char* defaultValue) const override;
+    virtual double getDouble(const char* pDataPath, double defaultValue) const override;
+    virtual int getInt(const char* pDataPath, int defaultValue) const override
+    {
+        return getLong(pDataPath, defaultValue);
+    }
+    virtual long getLong(const char* pDataPath, long defaultValue) const override
+    {
+        return (long)getDouble(pDataPath, defaultValue);
+    }
+    virtual bool getBool(const char* pDataPath, bool defaultValue) const override;
+    virtual bool getArrayElems(const char* pDataPath, std::vector<String>& strList) const override;
+    virtual bool contains(const char* pDataPath) const override
+    {
+        const char* pStart = nullptr;
+        const char* pEnd = nullptr;
+        return locate(pDataPath, pStart, pEnd);
+    }
+    virtual const char* getJsonDoc() const override
+    {
+        return _jsonStr.c_str();
+    }
+    const char* c_str() const
+    {
+        return _jsonStr.c_str();
+    }
+
+    /// @brief Get the type of a value
+    /// @param pDataPath path
+    /// @param arrayLen (out) number of elements if the value is an array
+    RaftJsonType getType(const char* pDataPath, int& arrayLen) const;
+
+    /// @brief Get JSON object from name-value pairs (values are held as strings)
+    static String getJSONFromNVPairs(const std::vector<NameValuePair>& nameValuePairs, bool includeOuterBraces);
+
+private:
+    String _jsonStr;
+
+    // Find the value at a path (pEnd is one past the end of the value)
+    bool locate(const char* pDataPath, const char*& pStart, const char*& pEnd) const;
+};
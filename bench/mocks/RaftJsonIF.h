@@ -0,0 +1,28 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftJsonIF
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftArduino.h"
+
+class RaftJsonIF
+{
+public:
+    virtual ~RaftJsonIF()
+    {
+    }
+    virtual String getString(const char* pDataPath, const char* defaultValue) const = 0;
+    virtual double getDouble(const char* pDataPath, double defaultValue) const = 0;
+    virtual int getInt(const char* pDataPath, int defaultValue) const = 0;
+    virtual long getLong(const char* pDataPath, long defaultValue) const = 0;
+    virtual bool getBool(const char* pDataPath, bool defaultValue) const = 0;
+    virtual bool getArrayElems(const char* pDataPath, std::vector<String>& strList) const = 0;
+    virtual bool contains(const char* pDataPath) const = 0;
+    virtual const char* getJsonDoc() const = 0;
+};
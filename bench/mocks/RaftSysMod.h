@@ -0,0 +1,118 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftSysMod
+// Config is read directly from the JSON passed to the constructor (rather than from the section of the
+// system config named for the module) and the comms core is set by the benchmark
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftJsonIF.h"
+#include "RaftUtils.h"
+#include "CommsCoreIF.h"
+#include "CommsChannelMsg.h"
+
+class RestAPIEndpointManager;
+
+typedef std::function<bool(const char* messageName, CommsChannelMsg& msg)> SysMod_publishMsgGenFn;
+typedef std::function<void(const char* stateName, std::vector<uint8_t>& stateHash)> SysMod_stateDetectCB;
+
+class RaftSysMod
+{
+public:
+    RaftSysMod(const char* pModuleName, RaftJsonIF& sysConfig) : _moduleName(pModuleName), _config(sysConfig)
+    {
+    }
+    virtual ~RaftSysMod()
+    {
+    }
+
+    // Called by the system manager (public here so the benchmark can call them)
+    virtual void setup()
+    {
+    }
+    virtual void loop()
+    {
+    }
+    virtual void addRestAPIEndpoints(RestAPIEndpointManager& endpointManager)
+    {
+    }
+    virtual void addCommsChannels(CommsCoreIF& commsCore)
+    {
+    }
+
+    virtual String getDebugJSON() const
+    {
+        return "{}";
+    }
+    virtual RaftRetCode receiveCmdJSON(const char* cmdJSON)
+    {
+        return RAFT_INVALID_OPERATION;
+    }
+    virtual bool registerDataSource(const char* pubTopic, SysMod_publishMsgGenFn msgGenCB, SysMod_stateDetectCB stateDetectCB)
+    {
+        return false;
+    }
+
+    const char* modName() const
+    {
+        return _moduleName.c_str();
+    }
+    CommsCoreIF* getCommsCore() const
+    {
+        return _pCommsCore;
+    }
+    static void setCommsCore(CommsCoreIF* pCommsCore)
+    {
+        _pCommsCore = pCommsCore;
+    }
+
+    // System state
+    bool isSystemMainFWUpdate() const
+    {
+        return false;
+    }
+    bool isSystemFileTransferring() const
+    {
+        return false;
+    }
+
+    // Commands to other SysMods are ignored
+    RaftRetCode sysModSendCmdJSON(const char* sysModName, const char* jsonCmd)
+    {
+        return RAFT_OK;
+    }
+
+protected:
+    String configGetString(const char* pDataPath, const char* defaultValue) const
+    {
+        return _config.getString(pDataPath, defaultValue);
+    }
+    long configGetLong(const char* pDataPath, long defaultValue) const
+    {
+        return _config.getLong(pDataPath, defaultValue);
+    }
+    double configGetDouble(const char* pDataPath, double defaultValue) const
+    {
+        return _config.getDouble(pDataPath, defaultValue);
+    }
+    bool configGetBool(const char* pDataPath, bool defaultValue) const
+    {
+        return _config.getBool(pDataPath, defaultValue);
+    }
+    bool configGetArrayElems(const char* pDataPath, std::vector<String>& strList) const
+    {
+        return _config.getArrayElems(pDataPath, strList);
+    }
+
+private:
+    String _moduleName;
+    RaftJsonIF& _config;
+    static inline CommsCoreIF* _pCommsCore = nullptr;
+};
@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RaftUtils
+// Return codes and the subset of the Raft namespace helpers used by the benchmarked code
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "RaftArduino.h"
+
+enum RaftRetCode
+{
+    RAFT_OK,
+    RAFT_BUSY,
+    RAFT_POS_MISMATCH,
+    RAFT_NOT_XFERING,
+    RAFT_NOT_STREAMING,
+    RAFT_SESSION_NOT_FOUND,
+    RAFT_CANNOT_START,
+    RAFT_INVALID_DATA,
+    RAFT_INVALID_OBJECT,
+    RAFT_INVALID_OPERATION,
+    RAFT_INSUFFICIENT_RESOURCE,
+    RAFT_OTHER_FAILURE,
+    RAFT_NOT_IMPLEMENTED
+};
+
+namespace Raft
+{
+    // Check for timeout (allowing for the time wrapping)
+    inline bool isTimeout(uint64_t curTime, uint64_t lastTime, uint64_t maxDuration)
+    {
+        if (curTime >= lastTime)
+            return curTime > lastTime + maxDuration;
+        return UINT64_MAX - (lastTime - curTime) > maxDuration;
+    }
+
+    inline uint64_t timeElapsed(uint64_t curTime, uint64_t lastTime)
+    {
+        return curTime >= lastTime ? curTime - lastTime : UINT64_MAX - (lastTime - curTime);
+    }
+
+    template <typename T>
+    T clamp(T val, T lo, T hi)
+    {
+        return val < lo ? lo : (val > hi ? hi : val);
+    }
+
+    inline void getHexStrFromBytes(const uint8_t* pBuf, uint32_t bufLen, String& outStr)
+    {
+        static const char HEX_CHARS[] = "0123456789abcdef";
+        outStr.clear();
+        outStr.reserve(bufLen * 2);
+        for (uint32_t i = 0; i < bufLen; i++)
+        {
+            outStr += HEX_CHARS[pBuf[i] >> 4];
+            outStr += HEX_CHARS[pBuf[i] & 0x0f];
+        }
+    }
+
+    inline String getHexStr(const uint8_t* pBuf, uint32_t bufLen)
+    {
+        String outStr;
+        getHexStrFromBytes(pBuf, bufLen, outStr);
+        return outStr;
+    }
+
+    inline RaftRetCode setJsonResult(const char* pReqStr, String& respStr, bool rslt,
+                const char* pErrorMsg = nullptr, const char* pOtherJson = nullptr)
+    {
+        String otherJson = (pOtherJson && pOtherJson[0]) ? String(",") + pOtherJson : String();
+        String errorJson = (!rslt && pErrorMsg) ? String(R"(,"error":")") + pErrorMsg + "\"" : String();
+        respStr = String(R"({"req":")") + (pReqStr ? pReqStr : "") + R"(","rslt":")" + (rslt ? "ok" : "fail") + "\"" +
+                    errorJson + otherJson + "}";
+        return rslt ? RAFT_OK : RAFT_OTHER_FAILURE;
+    }
+
+    inline RaftRetCode setJsonBoolResult(const char* pReqStr, String& respStr, bool rslt, const char* pOtherJson = nullptr)
+    {
+        return setJsonResult(pReqStr, respStr, rslt, nullptr, pOtherJson);
+    }
+
+    inline RaftRetCode setJsonErrorResult(const char* pReqStr, String& respStr, const char* pErrorMsg,
+                const char* pOtherJson = nullptr, RaftRetCode retCode = RAFT_OTHER_FAILURE)
+    {
+        setJsonResult(pReqStr, respStr, false, pErrorMsg, pOtherJson);
+        return retCode;
+    }
+}
@@ -0,0 +1,123 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of RestAPIEndpointManager
+// Endpoints are held by name so the benchmark can call them with a request string
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftUtils.h"
+#include "RaftJson.h"
+#include "APISourceInfo.h"
+
+typedef std::function<RaftRetCode(const String& reqStr, String& respStr, const APISourceInfo& sourceInfo)> RestAPIFunction;
+
+class RestAPIEndpoint
+{
+public:
+    enum EndpointType
+    {
+        ENDPOINT_NONE,
+        ENDPOINT_CALLBACK
+    };
+    enum EndpointMethod
+    {
+        ENDPOINT_GET,
+        ENDPOINT_POST,
+        ENDPOINT_PUT,
+        ENDPOINT_DELETE,
+        ENDPOINT_OPTIONS
+    };
+};
+
+class RestAPIEndpointManager
+{
+public:
+    // Channel IDs for requests which don't come from a comms channel
+    static const uint32_t CHANNEL_ID_COMMAND_FILE = 10003;
+
+    void addEndpoint(const char* pEndpointStr, RestAPIEndpoint::EndpointType endpointType,
+                RestAPIEndpoint::EndpointMethod endpointMethod, RestAPIFunction callbackMain,
+                const char* pDescription)
+    {
+        _endpoints.push_back({ pEndpointStr, callbackMain });
+    }
+
+    /// @brief Handle a request (the endpoint is the first element of the path)
+    RaftRetCode handleApiRequest(const char* pReqStr, String& respStr, const APISourceInfo& sourceInfo)
+    {
+        String endpointName = getNthArgStr(pReqStr, 0);
+        for (const Endpoint& endpoint : _endpoints)
+        {
+            if (endpoint.name.equals(endpointName))
+                return endpoint.callback(pReqStr, respStr, sourceInfo);
+        }
+        return RAFT_INVALID_OPERATION;
+    }
+
+    /// @brief Get an element of the request path (elements are separated by / and the path ends at ?)
+    static String getNthArgStr(const char* pReqStr, int argIdx)
+    {
+        const char* p = pReqStr;
+        for (int i = 0; (i < argIdx) && *p; p++)
+        {
+            if (*p == '?')
+                return String();
+            if (*p == '/')
+                i++;
+        }
+        const char* pEnd = p;
+        while (*pEnd && (*pEnd != '/') && (*pEnd != '?'))
+            pEnd++;
+        return String(p, pEnd - p);
+    }
+
+    /// @brief Get path elements and query name-value pairs from a request
+    static bool getParamsAndNameValues(const char* pReqStr, std::vector<String>& params,
+                std::vector<RaftJson::NameValuePair>& nameValuePairs)
+    {
+        params.clear();
+        nameValuePairs.clear();
+        const char* p = pReqStr;
+        while (true)
+        {
+            const char* pEnd = p;
+            while (*pEnd && (*pEnd != '/') && (*pEnd != '?'))
+                pEnd++;
+            params.push_back(String(p, pEnd - p));
+            p = pEnd;
+            if (*p != '/')
+                break;
+            p++;
+        }
+        if (*p != '?')
+            return true;
+        for (p++; *p; )
+        {
+            const char* pEq = p;
+            while (*pEq && (*pEq != '=') && (*pEq != '&'))
+                pEq++;
+            const char* pEnd = pEq;
+            while (*pEnd && (*pEnd != '&'))
+                pEnd++;
+            nameValuePairs.push_back(RaftJson::NameValuePair(String(p, pEq - p),
+                        *pEq == '=' ? String(pEq + 1, pEnd - pEq - 1) : String()));
+            p = *pEnd ? pEnd + 1 : pEnd;
+        }
+        return true;
+    }
+
+private:
+    struct Endpoint
+    {
+        String name;
+        RestAPIFunction callback;
+    };
+    std::vector<Endpoint> _endpoints;
+};
@@ -0,0 +1,59 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host mock of the NimBLE GAP types used by the advert decoder
+// Only the discovery event members are provided (same names and types as NimBLE)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+#define BLE_GAP_EVENT_DISC 7
+#define BLE_HCI_ADV_RPT_EVTYPE_ADV_IND 0
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t val[6];
+} ble_addr_t;
+
+struct ble_gap_disc_desc
+{
+    uint8_t event_type;
+    uint8_t length_data;
+    ble_addr_t addr;
+    int8_t rssi;
+    const uint8_t* data;
+    ble_addr_t direct_addr;
+};
+
+struct ble_gap_event
+{
+    uint8_t type;
+    union
+    {
+        struct ble_gap_disc_desc disc;
+    };
+};
+
+struct ble_hs_adv_fields
+{
+    uint8_t flags;
+    uint8_t num_uuids16;
+    uint8_t num_uuids32;
+    uint8_t num_uuids128;
+    const uint8_t* name;
+    uint8_t name_len;
+    int8_t tx_pwr_lvl;
+    uint16_t adv_itvl;
+    uint8_t le_role;
+    const uint8_t* svc_data_uuid16;
+    uint8_t svc_data_uuid16_len;
+    const uint8_t* mfg_data;
+    uint8_t mfg_data_len;
+};
@@ -11,6 +11,13 @@
 #include "BTHomeConsts.h"
 #include "RaftBusDevicesIF.h"
 
+static_assert(BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_PACKET_ID].pos == BLEAdvertDecoder::DUPLICATE_RECORD_DEVICE_ID_POS,
+            "BTHome packet ID slot must be at the duplicate record device ID position");
+static_assert(BTHOME_LEGACY_RECORD_LEN == BLEAdvertDecoder::BTHOME_LEGACY_RECORD_LEN,
+            "BTHome legacy record length mismatch");
+static_assert(BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_ILLUMINANCE].pos + BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_ILLUMINANCE].size == BTHOME_LEGACY_RECORD_LEN,
+            "BTHome legacy record must end with illuminance");
+
 #ifdef CONFIG_BT_ENABLED
 
 #define WARN_ON_TOO_MANY_BLE_CLIENTS
@@ -100,6 +107,7 @@ bool BLEAdvertDecoder::decodeAdEvent(struct ble_gap_event *pEvent, struct ble_hs
             case 0x01:
             {
                 // Flags
+#ifdef DEBUG_BLE_ADVERT_DECODER
                 if (len >= 2)
                 {
                     uint8_t flags = pData[2];
@@ -116,6 +124,7 @@ bool BLEAdvertDecoder::decodeAdEvent(struct ble_gap_event *pEvent, struct ble_hs
                         flagString += "SIMUL_LE_BREDR_HOST ";
                     DEBUG_APPEND_LOG("decodeAdEvent Flags " + String(flags, 16) + " " + flagString + ", ");
                 }
+#endif
                 break;
             }
             case 0x02: 
@@ -226,6 +235,58 @@ bool BLEAdvertDecoder::decodeAdEvent(struct ble_gap_event *pEvent, struct ble_hs
     return false;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Decode BTHome data in an ad packet (single allocation-free pass which skips all other AD structures)
+/// @param pEvent BLE discovery event
+/// @param pBusDevicesIF pointer to bus devices interface
+/// @return true if the packet contained BTHome data which was successfully decoded
+bool BLEAdvertDecoder::decodeAdEventBTHomeOnly(struct ble_gap_event *pEvent, RaftBusDevicesIF* pBusDevicesIF)
+{
+    // Check there is an interface to send data to
+    if (!pEvent || !pBusDevicesIF)
+        return false;
+
+    // Find BTHome service data
+    const uint8_t* pBtHomeData = nullptr;
+    uint32_t btHomeDataLen = 0;
+    if (!findBTHomeServiceData(pEvent->disc.data, pEvent->disc.length_data, pBtHomeData, btHomeDataLen))
+        return false;
+    return decodeBtHome(pEvent->disc.addr, pBtHomeData, btHomeDataLen, pBusDevicesIF);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Find BTHome service data in advertisement data
+/// @param pAdData advertisement data
+/// @param adDataLen advertisement data length
+/// @param pBtHomeData (out) start of BTHome data (after the UUID)
+/// @param btHomeDataLen (out) BTHome data length
+/// @return true if found
+bool BLEAdvertDecoder::findBTHomeServiceData(const uint8_t* pAdData, uint32_t adDataLen, const uint8_t*& pBtHomeData, uint32_t& btHomeDataLen)
+{
+    if (!pAdData)
+        return false;
+
+    // Each AD structure is a length byte (covering the type and data) followed by the AD type and data
+    uint32_t pos = 0;
+    while (pos + 1 < adDataLen)
+    {
+        uint32_t len = pAdData[pos];
+        if ((len == 0) || (pos + 1 + len > adDataLen))
+            break;
+
+        // 16-bit Service Data UUID with BTHome UUID (little-endian) and at least one data byte
+        if ((pAdData[pos + 1] == 0x16) && (len > 3) &&
+                    ((pAdData[pos + 2] | (pAdData[pos + 3] << 8)) == BTHOME_SERVICE_DATA_UUID))
+        {
+            pBtHomeData = pAdData + pos + 4;
+            btHomeDataLen = len - 3;
+            return true;
+        }
+        pos += len + 1;
+    }
+    return false;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Decode BTHome 
 /// @param bleAddr BLE address
@@ -255,94 +316,98 @@ bool BLEAdvertDecoder::decodeBtHome(ble_addr_t bleAddr, const uint8_t* pBtHomeDa
     logStr += " DevInfo " + String(isEncrypted ? "ENC " : "NOENC ") + String(isTriggerBased ? "TRIG " : "NO_TRIG ") + "Ver " + String(btHomeVersion);
 #endif
 
-    // Start of variable data
+    // Encrypted data can't be decoded
+    if (pBtHomeData[0] & 0x01)
+    {
+#ifdef DEBUG_BT_HOME_DECODE
+        LOG_I(MODULE_PREFIX, "decodeBtHome %s ENCRYPTED", logStr.c_str());
+#endif
+        return false;
+    }
+
+    // Record with all slots initially not present
+    uint8_t record[BTHOME_RECORD_LEN];
+    for (uint32_t slotIdx = BTHOME_SLOT_NONE + 1; slotIdx < BTHOME_NUM_SLOTS; slotIdx++)
+    {
+        const BTHomeSlotLayout& layout = BTHOME_SLOT_LAYOUTS[slotIdx];
+        for (uint32_t i = 0; i < layout.size * layout.maxCount; i++)
+            record[layout.pos + i] = ((i % layout.size) == 0) && layout.isSigned ? 0x7f : 0xff;
+    }
+    setRecordSlot(record, BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_BINARY_VALUES], 0, 0);
+    setRecordSlot(record, BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_BINARY_PRESENT], 0, 0);
+    // Absent motion is 0 as in the original record
+    setRecordSlot(record, BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_MOTION], 0, 0);
+    uint8_t slotCounts[BTHOME_NUM_SLOTS] = {};
+    uint32_t binaryValues = 0;
+    uint32_t binaryPresent = 0;
+
+    // Decode the objects
     const uint8_t* pVarData = pBtHomeData + 1;
     int varDataLen = btHomeDataLen - 1;
-
-    // Fields of interest
-    uint8_t packetID = 0;
-    bool motion = false;
     bool dataOfInterest = false;
-    int16_t temperatureX100 = INT16_MAX;
-    uint8_t batteryPC = UINT8_MAX;
-    uint32_t illumuninanceX100 = UINT32_MAX;
-
-    // Decode the fields
     static const uint32_t MAX_BTHOME_FIELDS = 20;
     uint32_t loopCnt = 0;
     while (varDataLen >= 2 && loopCnt++ < MAX_BTHOME_FIELDS) 
     {
-        // Sensor type
-        uint8_t sensorType = pVarData[0];
-
-        // Get length from table
-        int8_t fieldLen = -1;
-        if (sensorType == 0x53) // Text
-            fieldLen = pVarData[1];
-        else if (sensorType == 0x54) // Binary
-            fieldLen = pVarData[1];
-        else if (sensorType < BTHOME_SENSOR_TYPE_COUNT) // Use LUT
-            fieldLen = BTHOME_SENSOR_TYPES[sensorType].len;
-        else if (sensorType == 0xf0) // device type ID
+        // Object ID and length
+        uint8_t objectID = pVarData[0];
+        int fieldLen = -1;
+        const BTHomeObjectDesc* pDesc = nullptr;
+        if (objectID < BTHOME_OBJECT_COUNT)
+        {
+            pDesc = &BTHOME_OBJECTS[objectID];
+            fieldLen = pDesc->len == 0 ? pVarData[1] + 1 : pDesc->len;
+        }
+        else if (objectID == BTHOME_OBJ_DEVICE_TYPE_ID)
             fieldLen = 2;
-        else if (sensorType == 0xf1) // firmware version
+        else if (objectID == BTHOME_OBJ_FIRMWARE_VERSION_4)
             fieldLen = 4;
-        else if (sensorType == 0xf2) // firmware version
+        else if (objectID == BTHOME_OBJ_FIRMWARE_VERSION_3)
             fieldLen = 3;
 
         // Check for valid length
         if (fieldLen < 0 || varDataLen < fieldLen + 1)
         {
 #ifdef DEBUG_BT_HOME_DECODE
-            logStr += " INVALID FIELD " + String(sensorType, 16) + " " + String(fieldLen) + " varDataLen " + String(varDataLen);
+            logStr += " INVALID FIELD " + String(objectID, 16) + " " + String(fieldLen) + " varDataLen " + String(varDataLen);
 #endif
             break;
         }
 
-        // Decode the field
-        switch(sensorType)
+        // Binary sensors
+        if ((objectID >= BTHOME_BINARY_FIRST_ID) && (objectID <= BTHOME_BINARY_LAST_ID))
         {
-            case 0x00: // Packet ID
-            {
-                packetID = pVarData[1];
-#ifdef DEBUG_BT_HOME_DECODE
-                logStr += " PacketID " + String(packetID);
-#endif
-                break;
-            }
-            case 0x01: // Battery
-            {
-                batteryPC = pVarData[1];
-#ifdef DEBUG_BT_HOME_DECODE
-                logStr += " Battery " + String(batteryPC);
-#endif
-                break;
-            }
-            case 0x02: // Temperature
-            {
-                temperatureX100 = (pVarData[2] << 8) | pVarData[1];
-#ifdef DEBUG_BT_HOME_DECODE
-                logStr += " Temp " + String(temperatureX100/100.0, 2);
-#endif
-                break;
-            }
-            case 0x05: // Illuminance
-            {
-                illumuninanceX100 = (pVarData[2] << 16) | (pVarData[1] << 8) | pVarData[0];
-#ifdef DEBUG_BT_HOME_DECODE
-                logStr += " Illum " + String(illumuninanceX100/100.0, 2);
-#endif
-                break;
-            }
-            case 0x21: // Motion
-            {
-                motion = pVarData[1];
+            uint32_t bitMask = 1 << (objectID - BTHOME_BINARY_FIRST_ID);
+            binaryPresent |= bitMask;
+            if (pVarData[1])
+                binaryValues |= bitMask;
+            dataOfInterest = true;
+        }
+
+        // Objects with a slot in the record
+        if (pDesc && (pDesc->slot != BTHOME_SLOT_NONE) && (slotCounts[pDesc->slot] < BTHOME_SLOT_LAYOUTS[pDesc->slot].maxCount))
+        {
+            // Little-endian value (sign extended)
+            int64_t val = 0;
+            for (int i = fieldLen - 1; i >= 0; i--)
+                val = (val << 8) | pVarData[1 + i];
+            if (pDesc->isSigned && (pVarData[fieldLen] & 0x80))
+                val -= (int64_t)1 << (fieldLen * 8);
+
+            // Scale to the slot units
+            for (int8_t i = 0; i < pDesc->scalePow10; i++)
+                val *= 10;
+            for (int8_t i = 0; i > pDesc->scalePow10; i--)
+                val /= 10;
+
+            // Write to the record
+            setRecordSlot(record, BTHOME_SLOT_LAYOUTS[pDesc->slot], slotCounts[pDesc->slot], val);
+            slotCounts[pDesc->slot]++;
+            if (pDesc->slot != BTHOME_SLOT_PACKET_ID)
                 dataOfInterest = true;
 #ifdef DEBUG_BT_HOME_DECODE
-                logStr += " Motion " + String(motion == 0 ? "NO" : "YES");
+            logStr += " Obj " + String(objectID, 16) + " slot " + String(pDesc->slot) + " val " + String((int32_t)val);
 #endif
-                break;
-            }
         }
 
         // Move to next field
@@ -360,31 +425,20 @@ bool BLEAdvertDecoder::decodeBtHome(ble_addr_t bleAddr, const uint8_t* pBtHomeDa
         return false;
     }
 
-    // Fill in the decoded data
-    std::vector<uint8_t> decodedData;
+    // Record header - the packet ID MUST be at the position indicated by DUPLICATE_RECORD_DEVICE_ID_POS
     uint16_t timeVal = (uint16_t)(millis() & 0xFFFF);
-    decodedData.push_back((timeVal >> 8) & 0xFF);
-    decodedData.push_back(timeVal & 0xFF);    
-    // Add the packet ID
-    // Note that this MUST be at the position indicated by DUPLICATE_RECORD_DEVICE_ID_POS
-    decodedData.push_back(packetID);
-    // Add the BLE address (padded to 8 bytes)
-    decodedData.push_back(0);
-    decodedData.push_back(0);
+    record[BTHOME_RECORD_TIME_POS] = (timeVal >> 8) & 0xFF;
+    record[BTHOME_RECORD_TIME_POS + 1] = timeVal & 0xFF;
+    if (slotCounts[BTHOME_SLOT_PACKET_ID] == 0)
+        record[DUPLICATE_RECORD_DEVICE_ID_POS] = 0;
+    // BLE address (padded to 8 bytes)
+    record[BTHOME_RECORD_ADDR_POS] = 0;
+    record[BTHOME_RECORD_ADDR_POS + 1] = 0;
     for (int i = 0; i < 6; i++)
-        decodedData.push_back(bleAddr.val[5-i]);
-    // Add the motion
-    decodedData.push_back(motion);
-    // Add the battery
-    decodedData.push_back(batteryPC);
-    // Add the temperature
-    decodedData.push_back((temperatureX100 >> 8) & 0xff);
-    decodedData.push_back(temperatureX100 & 0xff);
-    // Add the illuminance
-    decodedData.push_back((illumuninanceX100 >> 24) & 0xff);
-    decodedData.push_back((illumuninanceX100 >> 16) & 0xff);
-    decodedData.push_back((illumuninanceX100 >> 8) & 0xff);
-    decodedData.push_back(illumuninanceX100 & 0xff);
+        record[BTHOME_RECORD_ADDR_POS + 2 + i] = bleAddr.val[5-i];
+    setRecordSlot(record, BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_BINARY_VALUES], 0, binaryValues);
+    setRecordSlot(record, BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_BINARY_PRESENT], 0, binaryPresent);
+    std::vector<uint8_t> decodedData(record, record + BTHOME_RECORD_LEN);
 
     // We need a 32 bit version of the address - so XOR the 3 manufacturer bytes together in the top byte
     uint32_t bleAddr32 = (bleAddr.val[5] ^ bleAddr.val[4] ^ bleAddr.val[3]) << 24;
@@ -402,4 +456,36 @@ bool BLEAdvertDecoder::decodeBtHome(ble_addr_t bleAddr, const uint8_t* pBtHomeDa
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if a decoded record is of interest for the original BLEBTHome device type (motion present)
+/// @param pRecord decoded record
+/// @param recordLen record length
+/// @return true if the advert included motion
+bool BLEAdvertDecoder::isLegacyRecordOfInterest(const uint8_t* pRecord, uint32_t recordLen)
+{
+    const BTHomeSlotLayout& layout = BTHOME_SLOT_LAYOUTS[BTHOME_SLOT_BINARY_PRESENT];
+    if (!pRecord || (recordLen < layout.pos + layout.size))
+        return false;
+    uint32_t binaryPresent = 0;
+    for (uint32_t i = 0; i < layout.size; i++)
+        binaryPresent = (binaryPresent << 8) | pRecord[layout.pos + i];
+    return binaryPresent & (1 << (BTHOME_OBJ_MOTION - BTHOME_BINARY_FIRST_ID));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write a value to a slot in a decoded BTHome record (big-endian)
+/// @param pRecord record
+/// @param layout slot layout
+/// @param elemIdx index of repeated element in the slot
+/// @param val value (truncated to the slot size)
+void BLEAdvertDecoder::setRecordSlot(uint8_t* pRecord, const BTHomeSlotLayout& layout, uint32_t elemIdx, int64_t val)
+{
+    uint8_t* pSlot = pRecord + layout.pos + elemIdx * layout.size;
+    for (int i = layout.size - 1; i >= 0; i--)
+    {
+        pSlot[i] = val & 0xff;
+        val >>= 8;
+    }
+}
+
 #endif
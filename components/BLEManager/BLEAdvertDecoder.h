@@ -22,6 +22,7 @@
 #undef max
 
 class RaftBusDevicesIF;
+struct BTHomeSlotLayout;
 
 class BLEAdvertDecoder
 {
@@ -29,6 +30,28 @@ public:
 
     // Position in message buffer of BTHome Device ID field
     static const uint32_t DUPLICATE_RECORD_DEVICE_ID_POS = 2;
+
+    // Length of the original BLEBTHome record (the BLEBTHomeExt record is BLEBusReading::MAX_DATA_LEN)
+    static const uint32_t BTHOME_LEGACY_RECORD_LEN = 19;
+
+    // BTHome service data UUID
+    static const uint16_t BTHOME_SERVICE_DATA_UUID = 0xFCD2;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Decode BTHome data in an ad packet (single allocation-free pass which skips all other AD structures)
+    /// @param event BLE discovery event
+    /// @param pBusDevicesIF pointer to bus devices interface
+    /// @return true if the packet contained BTHome data which was successfully decoded
+    bool decodeAdEventBTHomeOnly(struct ble_gap_event *event, RaftBusDevicesIF* pBusDevicesIF);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Find BTHome service data in advertisement data
+    /// @param pAdData advertisement data
+    /// @param adDataLen advertisement data length
+    /// @param pBtHomeData (out) start of BTHome data (after the UUID)
+    /// @param btHomeDataLen (out) BTHome data length
+    /// @return true if found
+    static bool findBTHomeServiceData(const uint8_t* pAdData, uint32_t adDataLen, const uint8_t*& pBtHomeData, uint32_t& btHomeDataLen);
     
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Decode ad packet
@@ -47,9 +70,22 @@ public:
     /// @return true if the packet was successfully decoded
     bool decodeBtHome(ble_addr_t bleAddr, const uint8_t* pBtHomeData, int btHomeDataLen, RaftBusDevicesIF* pBusDevicesIF);
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if a decoded record is of interest for the original BLEBTHome device type (motion present)
+    /// @param pRecord decoded record
+    /// @param recordLen record length
+    /// @return true if the advert included motion (the first BTHOME_LEGACY_RECORD_LEN bytes are the record)
+    static bool isLegacyRecordOfInterest(const uint8_t* pRecord, uint32_t recordLen);
+
 private:
     static constexpr const char* MODULE_PREFIX = "BLEAdvertDecoder";
 
+    /// @brief Write a value to a slot in a decoded BTHome record (big-endian)
+    /// @param pRecord record
+    /// @param layout slot layout
+    /// @param elemIdx index of repeated element in the slot
+    /// @param val value (truncated to the slot size)
+    static void setRecordSlot(uint8_t* pRecord, const BTHomeSlotLayout& layout, uint32_t elemIdx, int64_t val);
 };
 
 #endif
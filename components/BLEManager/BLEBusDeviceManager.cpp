@@ -10,6 +10,7 @@
 #include "RaftCore.h"
 #include "DeviceTypeRecords.h"
 #include "BLEAdvertDecoder.h"
+#include "BLEJSONWriter.h"
 
 // #define DEBUG_GET_DEVICE_ADDRESSES
 // #define DEBUG_GET_DEVICE_DATA_JSON
@@ -28,8 +29,11 @@ BLEBusDeviceManager::BLEBusDeviceManager(RaftBus& raftBus) :
     // Access semaphore
     _accessMutex = xSemaphoreCreateMutex();
 
+    // Device table
+    _bleBusDeviceStates.setup(DEFAULT_MAX_BLE_BUS_DEVICES);
+
     // Get device type info
-    deviceTypeRecords.getDeviceInfo("BLEBTHome", _devTypeRec, _deviceTypeIndex);
+    deviceTypeRecords.getDeviceInfo(DEVICE_TYPE_BTHOME, _devTypeRec, _deviceTypeIndex);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,8 +41,105 @@ BLEBusDeviceManager::BLEBusDeviceManager(RaftBus& raftBus) :
 /// @param config configuration
 void BLEBusDeviceManager::setup(const RaftJsonIF& config)
 {
+    // Device type - the full decoded BTHome record is only passed on for the BLEBTHomeExt device type
+    String devTypeName = config.getString("devType", DEVICE_TYPE_BTHOME);
+    _isExtRecord = devTypeName.equals(DEVICE_TYPE_BTHOME_EXT) &&
+                deviceTypeRecords.getDeviceInfo(DEVICE_TYPE_BTHOME_EXT, _devTypeRec, _deviceTypeIndex);
+    if (!_isExtRecord)
+    {
+        if (!devTypeName.equals(DEVICE_TYPE_BTHOME))
+            LOG_W(MODULE_PREFIX, "setup devType %s not available - using %s", devTypeName.c_str(), DEVICE_TYPE_BTHOME);
+        deviceTypeRecords.getDeviceInfo(DEVICE_TYPE_BTHOME, _devTypeRec, _deviceTypeIndex);
+    }
+
+    // Device table capacity (the least recently seen device is replaced when full)
+    uint32_t maxDevices = config.getLong("maxDevices", DEFAULT_MAX_BLE_BUS_DEVICES);
+    _readingRing.setup(config.getLong("readingQueueLen", DEFAULT_READING_QUEUE_LEN));
+    _historyLen = Raft::clamp((uint32_t)config.getLong("historyLen", DEFAULT_HISTORY_LEN), (uint32_t)1, MAX_HISTORY_LEN);
+
+    // Offline timeouts - default and per device type e.g. "offlineTimeouts":[{"type":"BLEBTHome","ms":120000}]
+    _offlineTimeoutDefaultMs = config.getLong("offlineTimeoutMs", DEFAULT_OFFLINE_TIMEOUT_MS);
+    _offlineTimeoutsByType.clear();
+    std::vector<String> typeTimeoutConfigs;
+    config.getArrayElems("offlineTimeouts", typeTimeoutConfigs);
+    for (const String& typeTimeoutConfig : typeTimeoutConfigs)
+    {
+        RaftJson typeTimeoutJson(typeTimeoutConfig);
+        String typeName = typeTimeoutJson.getString("type", "");
+        DeviceTypeRecord devTypeRec;
+        uint32_t devTypeIdx = 0;
+        if (deviceTypeRecords.getDeviceInfo(typeName.c_str(), devTypeRec, devTypeIdx))
+            _offlineTimeoutsByType.push_back({(uint16_t)devTypeIdx, (uint32_t)typeTimeoutJson.getLong("ms", _offlineTimeoutDefaultMs)});
+        else
+            LOG_W(MODULE_PREFIX, "setup offlineTimeouts unknown device type %s", typeName.c_str());
+    }
+
+    if (xSemaphoreTake(_accessMutex, portMAX_DELAY) == pdTRUE)
+    {
+        _bleBusDeviceStates.setup(maxDevices);
+        _offlineWheel.setup(_bleBusDeviceStates.capacity(), OFFLINE_WHEEL_SLOTS, OFFLINE_WHEEL_TICK_MS, millis());
+        xSemaphoreGive(_accessMutex);
+    }
+    _offlineAddrs.reserve(_bleBusDeviceStates.capacity());
+
     // Debug
-    LOG_I(MODULE_PREFIX, "BLEBusDeviceManager setup");
+    LOG_I(MODULE_PREFIX, "BLEBusDeviceManager setup maxDevices %d readingQueueLen %d historyLen %d offlineTimeoutMs %d (%d types)", 
+                (int)_bleBusDeviceStates.capacity(), (int)_readingRing.capacity(), (int)_historyLen,
+                (int)_offlineTimeoutDefaultMs, (int)_offlineTimeoutsByType.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Loop - processes readings handed over by handlePollResult() and reports devices gone offline
+void BLEBusDeviceManager::loop()
+{
+    // Process at most one queue's worth so a continuous stream of readings can't hold up the loop
+    for (uint32_t i = 0; i < _readingRing.capacity(); i++)
+    {
+        const BLEBusReading* pReading = _readingRing.peek();
+        if (!pReading || !processReading(*pReading))
+            break;
+        _readingRing.pop();
+    }
+
+    // Offline detection
+    serviceOfflineTimers();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Report devices which have gone offline
+/// Only the wheel slots which have come due are visited so the cost doesn't depend on the number of devices
+void BLEBusDeviceManager::serviceOfflineTimers()
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(5)) != pdTRUE)
+        return;
+
+    // Collect devices whose timers have expired
+    _offlineAddrs.clear();
+    uint32_t timeNowMs = millis();
+    _offlineWheel.advance(timeNowMs, [this](uint32_t entryPos) {
+        if (entryPos >= _bleBusDeviceStates.size())
+            return;
+        BLEBusDeviceState& devState = _bleBusDeviceStates.elemAt(entryPos);
+        if (!devState.isOnline)
+            return;
+        devState.isOnline = false;
+        _offlineAddrs.push_back(devState.busElemAddr);
+    });
+    if (_offlineAddrs.size() > 0)
+        _elemStatusLastChangeMs = timeNowMs;
+
+    // Return semaphore
+    xSemaphoreGive(_accessMutex);
+
+    // Callback
+    if (_offlineAddrs.size() == 0)
+        return;
+    std::vector<BusElemAddrAndStatus> statusChanges;
+    statusChanges.reserve(_offlineAddrs.size());
+    for (BusElemAddrType addr : _offlineAddrs)
+        statusChanges.push_back(BusElemAddrAndStatus(addr, false, true, false, _deviceTypeIndex));
+    _raftBus.callBusElemStatusCB(statusChanges);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -52,10 +153,12 @@ void BLEBusDeviceManager::getDeviceAddresses(std::vector<BusElemAddrType>& addre
         return;
 
     // Iterate device states
-    for (const BLEBusDeviceState& devState : _bleBusDeviceStates)
+    for (uint32_t i = 0; i < _bleBusDeviceStates.size(); i++)
     {
+        const BLEBusDeviceState& devState = _bleBusDeviceStates.elemAt(i);
+
         // Check if only addresses with poll responses
-        if (onlyAddressesWithPollResponses && devState.lastDataReceived.size() == 0)
+        if (onlyAddressesWithPollResponses && devState.history.numUnread() == 0)
             continue;
 
         // Add address to list
@@ -87,21 +190,35 @@ String BLEBusDeviceManager::getQueuedDeviceDataJson() const
     if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(5)) != pdTRUE)
         return "{}";
 
+    // Size pre-pass so the result is allocated once (readings are hex encoded in the JSON)
+    uint32_t maxDevDataLen = 0;
+    uint32_t jsonLen = 2;
+    for (uint32_t i = 0; i < _bleBusDeviceStates.size(); i++)
+    {
+        uint32_t devDataLen = _bleBusDeviceStates.elemAt(i).history.numUnreadBytes();
+        if (devDataLen > 0)
+            jsonLen += devDataLen * 2 + JSON_PER_DEVICE_OVERHEAD_BYTES;
+        maxDevDataLen = devDataLen > maxDevDataLen ? devDataLen : maxDevDataLen;
+    }
+    jsonStr.reserve(jsonLen);
+    std::vector<uint8_t> pollResponses;
+    pollResponses.reserve(maxDevDataLen);
+
     // Iterate list of devices
-    for (const BLEBusDeviceState& devState : _bleBusDeviceStates)
+    for (uint32_t i = 0; i < _bleBusDeviceStates.size(); i++)
     {
-        // Get poll response JSON
-        if (devState.lastDataReceived.size() > 0)
+        const BLEBusDeviceState& devState = _bleBusDeviceStates.elemAt(i);
+
+        // Get poll response JSON (all readings since the last call)
+        if (devState.history.numUnread() > 0)
         {
-            String pollResponseJson = deviceStatusToJson(devState.busElemAddr, true, _deviceTypeIndex, 
-                            devState.lastDataReceived, devState.lastDataReceived.size());
-            if (pollResponseJson.length() > 0)
-            {
-                jsonStr += (jsonStr.length() == 0 ? "{" : ",") + pollResponseJson;
-            }
+            pollResponses.clear();
+            uint32_t numReadings = devState.history.getUnread(pollResponses);
+            jsonStr += jsonStr.length() == 0 ? "{" : ",";
+            appendDeviceStatusJson(jsonStr, devState.busElemAddr, true, pollResponses);
 
-            // Clear data - const cast
-            const_cast<BLEBusDeviceState&>(devState).lastDataReceived.clear();
+            // Mark consumed - const cast
+            const_cast<BLEBusDeviceState&>(devState).history.consume(numReadings);
         }
     }
 
@@ -122,24 +239,50 @@ String BLEBusDeviceManager::getQueuedDeviceDataJson() const
 /// @return Binary data vector
 std::vector<uint8_t> BLEBusDeviceManager::getQueuedDeviceDataBinary(uint32_t connMode) const
 {
-    // Binary data
     std::vector<uint8_t> binaryData;
+    appendQueuedDeviceDataBinary(binaryData, connMode);
+    return binaryData;
+}
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Append queued device data in binary format to a buffer (e.g. an outbound message buffer)
+/// @param binaryData buffer to append to
+/// @param connMode connection mode (inc bus number)
+void BLEBusDeviceManager::appendQueuedDeviceDataBinary(std::vector<uint8_t>& binaryData, uint32_t connMode) const
+{
     // Get semaphore
     if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(5)) != pdTRUE)
-        return binaryData;
+        return;
+
+    // Size pre-pass so the buffer is grown once
+    uint32_t maxDevDataLen = 0;
+    uint32_t binaryLen = binaryData.size();
+    for (uint32_t i = 0; i < _bleBusDeviceStates.size(); i++)
+    {
+        uint32_t devDataLen = _bleBusDeviceStates.elemAt(i).history.numUnreadBytes();
+        if (devDataLen > 0)
+            binaryLen += devDataLen + BINARY_PER_DEVICE_OVERHEAD_BYTES;
+        maxDevDataLen = devDataLen > maxDevDataLen ? devDataLen : maxDevDataLen;
+    }
+    binaryData.reserve(binaryLen);
+    std::vector<uint8_t> pollResponses;
+    pollResponses.reserve(maxDevDataLen);
 
     // Iterate list of devices
-    for (const BLEBusDeviceState& devState : _bleBusDeviceStates)
+    for (uint32_t i = 0; i < _bleBusDeviceStates.size(); i++)
     {
-        // Get poll response JSON
-        if (devState.lastDataReceived.size() > 0)
+        const BLEBusDeviceState& devState = _bleBusDeviceStates.elemAt(i);
+
+        // Get poll responses (all readings since the last call)
+        if (devState.history.numUnread() > 0)
         {
             // Generate binary device message
-            RaftDevice::genBinaryDataMsg(binaryData, connMode, devState.busElemAddr, _deviceTypeIndex, true, devState.lastDataReceived);
+            pollResponses.clear();
+            uint32_t numReadings = devState.history.getUnread(pollResponses);
+            RaftDevice::genBinaryDataMsg(binaryData, connMode, devState.busElemAddr, _deviceTypeIndex, true, pollResponses);
 
-            // Clear data - const cast
-            const_cast<BLEBusDeviceState&>(devState).lastDataReceived.clear();
+            // Mark consumed - const cast
+            const_cast<BLEBusDeviceState&>(devState).history.consume(numReadings);
         }
     }
 
@@ -148,11 +291,8 @@ std::vector<uint8_t> BLEBusDeviceManager::getQueuedDeviceDataBinary(uint32_t con
 
     // Debug
 #ifdef DEBUG_GET_DEVICE_DATA_BINARY
-    LOG_I(MODULE_PREFIX, "getQueuedDeviceDataBinary len %d", binaryData.size());
+    LOG_I(MODULE_PREFIX, "appendQueuedDeviceDataBinary len %d", binaryData.size());
 #endif
-
-    // Return binary data
-    return binaryData;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -162,30 +302,69 @@ std::vector<uint8_t> BLEBusDeviceManager::getQueuedDeviceDataBinary(uint32_t con
 /// @return timestamp of most recent device info in ms
 uint32_t BLEBusDeviceManager::getDeviceInfoTimestampMs(bool includeElemOnlineStatusChanges, bool includeDeviceDataUpdates) const
 {
-    // Check if any updates required
-    if (!includeDeviceDataUpdates)
-        return 0;
+    // Most recent of the requested changes
+    uint32_t timestampMs = 0;
+    if (includeElemOnlineStatusChanges)
+        timestampMs = _elemStatusLastChangeMs;
+    if (includeDeviceDataUpdates && ((int32_t)(_deviceDataLastSetMs - timestampMs) > 0))
+        timestampMs = _deviceDataLastSetMs;
 
 #ifdef DEBUG_GET_DEVICE_DATA_TIMESTAMP
-    LOG_I(MODULE_PREFIX, "getDeviceInfoTimestampMs %d", _deviceDataLastSetMs);
+    LOG_I(MODULE_PREFIX, "getDeviceInfoTimestampMs status %d data %d", _elemStatusLastChangeMs, _deviceDataLastSetMs);
 #endif
-
-    // Return time of last set
-    return _deviceDataLastSetMs;
+    return timestampMs;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Handle poll results
+/// @brief Handle poll results (called from the scan callback - the result is queued without blocking and
+///        processed in loop())
 /// @param timeNowUs time in us (passed in to aid testing)
 /// @param address address
 /// @param pollResultData poll result data
 /// @param pPollInfo pointer to device polling info (maybe nullptr) 
-/// @return true if result stored
+/// @return true if result queued (false if it was dropped because the queue is full)
 bool BLEBusDeviceManager::handlePollResult(uint64_t timeNowUs, BusElemAddrType address, 
                         const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo)
 {
+    // The original BLEBTHome record is the start of the decoded record and only adverts with motion are used
+    uint32_t dataLen = pollResultData.size();
+#ifdef CONFIG_BT_ENABLED
+    if (!_isExtRecord)
+    {
+        if (!BLEAdvertDecoder::isLegacyRecordOfInterest(pollResultData.data(), dataLen))
+            return false;
+        dataLen = BLEAdvertDecoder::BTHOME_LEGACY_RECORD_LEN;
+    }
+#endif
+
+    // Get a slot in the queue
+    BLEBusReading* pReading = _readingRing.getSlotForWrite();
+    if (!pReading || (dataLen > BLEBusReading::MAX_DATA_LEN))
+    {
+        _readingsDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Fill and commit
+    pReading->timeNowUs = timeNowUs;
+    pReading->address = address;
+    pReading->dataLen = dataLen;
+    memcpy(pReading->data, pollResultData.data(), dataLen);
+    _readingRing.commitWrite();
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Process a reading
+/// @param reading reading
+/// @return false if the reading couldn't be processed yet (and should be retried)
+bool BLEBusDeviceManager::processReading(const BLEBusReading& reading)
+{
+    BusElemAddrType address = reading.address;
+    std::vector<uint8_t> pollResultData(reading.data, reading.data + reading.dataLen);
+
     // Ms time
-    uint32_t timeNowMs = timeNowUs / 1000;
+    uint32_t timeNowMs = reading.timeNowUs / 1000;
 
     // Get the deviceID
     uint8_t deviceID = 0;
@@ -203,24 +382,37 @@ bool BLEBusDeviceManager::handlePollResult(uint64_t timeNowUs, BusElemAddrType a
 
     // Check if device already seen
     BLEBusDeviceState* pDevState = getBLEBusDeviceState(address);
-    if ((pDevState == nullptr) && (_bleBusDeviceStates.size() < MAX_BLE_BUS_DEVICES))
+    if (pDevState == nullptr)
     {
-        // Create new device state
-        BLEBusDeviceState devState;
-        devState.busElemAddr = address;
-        devState.lastBTHomePacketID = deviceID;
-        _bleBusDeviceStates.push_back(devState);
+        // Create new device state (replacing the least recently seen device if the table is full)
+        bool evicted = false;
+        BusElemAddrType evictedAddr = 0;
+        pDevState = _bleBusDeviceStates.add(address, evicted, evictedAddr);
+        if (pDevState)
+        {
+            pDevState->busElemAddr = address;
+            pDevState->lastBTHomePacketID = deviceID;
+            pDevState->history.setup(_historyLen, BLEBusReading::MAX_DATA_LEN);
+        }
         isFirst = true;
+        _elemStatusLastChangeMs = timeNowMs;
 
         // Return semaphore
         xSemaphoreGive(_accessMutex);
 
         // Callback
-        _raftBus.callBusElemStatusCB({BusElemAddrAndStatus(address, true, false, true, _deviceTypeIndex)});
+        std::vector<BusElemAddrAndStatus> statusChanges;
+        if (evicted)
+            statusChanges.push_back(BusElemAddrAndStatus(evictedAddr, false, true, false, _deviceTypeIndex));
+        statusChanges.push_back(BusElemAddrAndStatus(address, true, false, true, _deviceTypeIndex));
+        _raftBus.callBusElemStatusCB(statusChanges);
 
-        // Obtain semaphore again
+        // Obtain semaphore again (the device now exists so a retry would be treated as a repeat - count as dropped)
         if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(5)) != pdTRUE)
-            return false;
+        {
+            _readingsDropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
 
         // Get the device state
         pDevState = getBLEBusDeviceState(address);
@@ -229,7 +421,24 @@ bool BLEBusDeviceManager::handlePollResult(uint64_t timeNowUs, BusElemAddrType a
         if (pDevState == nullptr)
         {
             xSemaphoreGive(_accessMutex);
-            return false;
+            return true;
+        }
+    }
+
+    // Restart the offline timer (repeated packets still show the device is present) and check if the
+    // device is coming back online
+    bool isBackOnline = false;
+    if (pDevState)
+    {
+        uint32_t offlineTimeoutMs = getOfflineTimeoutMs(_deviceTypeIndex);
+        int32_t entryPos = _bleBusDeviceStates.findPos(address);
+        if ((offlineTimeoutMs != 0) && (entryPos >= 0))
+            _offlineWheel.schedule(entryPos, timeNowMs, offlineTimeoutMs);
+        if (!pDevState->isOnline)
+        {
+            pDevState->isOnline = true;
+            isBackOnline = true;
+            _elemStatusLastChangeMs = timeNowMs;
         }
     }
 
@@ -252,17 +461,26 @@ bool BLEBusDeviceManager::handlePollResult(uint64_t timeNowUs, BusElemAddrType a
         }
 
         // Store poll results
-        pDevState->lastDataReceived = pollResultData;
+        pDevState->history.add(reading.data, reading.dataLen);
         _deviceDataLastSetMs = timeNowMs;
 
         // Update last seen time and packet ID
         pDevState->lastSeenTimeMs = timeNowMs;
         pDevState->lastBTHomePacketID = deviceID;
+        _bleBusDeviceStates.touch(address);
     }
 
     // Return semaphore
     xSemaphoreGive(_accessMutex);
 
+    // Report device back online
+    if (isBackOnline)
+    {
+        std::vector<BusElemAddrAndStatus> statusChanges;
+        statusChanges.push_back(BusElemAddrAndStatus(address, true, false, false, _deviceTypeIndex));
+        _raftBus.callBusElemStatusCB(statusChanges);
+    }
+
     // Call data change callback if required
     if (dataChangeCB)
     {
@@ -277,7 +495,7 @@ bool BLEBusDeviceManager::handlePollResult(uint64_t timeNowUs, BusElemAddrType a
     LOG_I(MODULE_PREFIX, "handlePollResult %04x %s %s", 
                 address, 
                 pollResultStr.c_str(), 
-                storeReqd ? "STORED" : "NOT_STORED");
+                isNotARepeat ? "STORED" : "NOT_STORED");
 #endif
 
     return true;
@@ -290,43 +508,122 @@ bool BLEBusDeviceManager::handlePollResult(uint64_t timeNowUs, BusElemAddrType a
 BLEBusDeviceManager::BLEBusDeviceState* BLEBusDeviceManager::getBLEBusDeviceState(BusElemAddrType busElemAddr)
 {
     // Find the device state
-    for (auto& devState : _bleBusDeviceStates)
-    {
-        if (devState.busElemAddr == busElemAddr)
-        {
-#ifdef DEBUG_GET_DEVICE_STATE_BY_ADDR
-            LOG_I(MODULE_PREFIX, "getBLEBusDeviceState found %04x lastSeenTimeMs %dms ago lastDataLen %d", 
-                    busElemAddr, 
-                    Raft::timeElapsed(millis(), devState.lastSeenTimeMs),
-                    devState.lastDataReceived.size());
-#endif
-            return &devState;
-        }
-    }
+    BLEBusDeviceState* pDevState = _bleBusDeviceStates.find(busElemAddr);
 #ifdef DEBUG_GET_DEVICE_STATE_BY_ADDR
-    LOG_I(MODULE_PREFIX, "getBLEBusDeviceState not found %04x", busElemAddr);
+    if (pDevState)
+        LOG_I(MODULE_PREFIX, "getBLEBusDeviceState found %04x lastSeenTimeMs %dms ago lastDataLen %d", 
+                busElemAddr, 
+                Raft::timeElapsed(millis(), pDevState->lastSeenTimeMs),
+                pDevState->history.numUnread());
+    else
+        LOG_I(MODULE_PREFIX, "getBLEBusDeviceState not found %04x", busElemAddr);
 #endif
-    return nullptr;
+    return pDevState;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Get device status JSON
+/// @brief Append device status JSON (in the DeviceTypeRecords format with hex encoded data) to a string
+/// @param jsonStr string to append to (reserved by the caller so nothing is allocated per device)
 /// @param address address
 /// @param isOnline true if device is online
-/// @param deviceTypeIndex index of device type
 /// @param devicePollResponseData poll response data
-/// @param responseSize size of poll response data
-/// @return JSON string
-String BLEBusDeviceManager::deviceStatusToJson(BusElemAddrType address, bool isOnline, uint16_t deviceTypeIndex, 
-                const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize) const
+void BLEBusDeviceManager::appendDeviceStatusJson(String& jsonStr, BusElemAddrType address, bool isOnline,
+                const std::vector<uint8_t>& devicePollResponseData) const
 {
-    // Get the poll response JSON
-    String devJson = deviceTypeRecords.deviceStatusToJson(address, isOnline, &_devTypeRec, devicePollResponseData);
+    static const char HEX_CHARS[] = "0123456789abcdef";
+    static const uint32_t HEX_CHUNK_BYTES = 32;
+    char buf[HEX_CHUNK_BYTES * 2 + 1];
+
+    // Address and start of data
+    BLEJSONWriter headWriter(buf, sizeof(buf));
+    headWriter.appendf(R"("%x":{"x":")", (unsigned)address);
+    jsonStr += buf;
+
+    // Hex encoded data (in chunks through the stack buffer)
+    for (uint32_t pos = 0; pos < devicePollResponseData.size(); pos += HEX_CHUNK_BYTES)
+    {
+        uint32_t chunkLen = devicePollResponseData.size() - pos;
+        chunkLen = chunkLen < HEX_CHUNK_BYTES ? chunkLen : HEX_CHUNK_BYTES;
+        for (uint32_t i = 0; i < chunkLen; i++)
+        {
+            uint8_t val = devicePollResponseData[pos + i];
+            buf[i * 2] = HEX_CHARS[val >> 4];
+            buf[i * 2 + 1] = HEX_CHARS[val & 0x0f];
+        }
+        buf[chunkLen * 2] = 0;
+        jsonStr += buf;
+    }
+
+    // Online status and device type
+    jsonStr += isOnline ? R"(","_o":1,"_t":")" : R"(","_o":0,"_t":")";
+    jsonStr += _devTypeRec.deviceType;
+    jsonStr += "\"}";
 
     // Debug
 #ifdef DEBUG_GET_DEVICE_JSON_BY_ADDR
-    LOG_I(MODULE_PREFIX, "deviceStatusToJson %04x %s %s", address, isOnline ? "ONLINE" : "OFFLINE", devJson.c_str());
+    LOG_I(MODULE_PREFIX, "appendDeviceStatusJson %04x %s len %d", address, isOnline ? "ONLINE" : "OFFLINE",
+                jsonStr.length());
 #endif
-    return devJson;
 }
 
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get decoded poll responses (readings are consumed)
+/// @param address address of device to get data from
+/// @param pStructOut pointer to structure (or array of structures) to receive decoded data
+/// @param structOutSize size of structure (in bytes) to receive decoded data
+/// @param maxRecCount maximum number of records to decode
+/// @param decodeState decode state for this device
+/// @return number of records decoded
+uint32_t BLEBusDeviceManager::getDecodedPollResponses(BusElemAddrType address, 
+                void* pStructOut, uint32_t structOutSize, 
+                uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const
+{
+    // Check parameters
+    if (!pStructOut || (structOutSize == 0) || (maxRecCount == 0))
+        return 0;
+
+    // Obtain semaphore
+    if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(5)) != pdTRUE)
+        return 0;
+
+    // Find the device
+    const BLEBusDeviceState* pDevState = const_cast<BLEBusDeviceManager*>(this)->getBLEBusDeviceState(address);
+    uint32_t numDecoded = 0;
+    if (pDevState)
+    {
+        // Decode readings oldest first - each reading is a single record
+        uint8_t* pOut = static_cast<uint8_t*>(pStructOut);
+        uint32_t numReadings = pDevState->history.forEachUnread(maxRecCount, 
+                [&](const uint8_t* pData, uint32_t dataLen) {
+                    numDecoded += decodePollResponses(_deviceTypeIndex, pData, dataLen, 
+                                pOut + numDecoded * structOutSize, structOutSize, 1, decodeState);
+                    return true;
+                });
+
+        // Mark consumed - const cast
+        const_cast<BLEBusDeviceState*>(pDevState)->history.consume(numReadings);
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_accessMutex);
+    return numDecoded;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Decode one or more poll responses for a device
+/// @param deviceTypeIndex index of device type
+/// @param pPollBuf buffer containing poll responses
+/// @param pollBufLen length of poll response buffer
+/// @param pStructOut pointer to structure (or array of structures) to receive decoded data
+/// @param structOutSize size of structure (in bytes) to receive decoded data
+/// @param maxRecCount maximum number of records to decode
+/// @return number of records decoded
+uint32_t BLEBusDeviceManager::decodePollResponses(uint16_t deviceTypeIndex, 
+                const uint8_t* pPollBuf, uint32_t pollBufLen, 
+                void* pStructOut, uint32_t structOutSize, 
+                uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const
+{
+    return deviceTypeRecords.decodeDeviceData(deviceTypeIndex, pPollBuf, pollBufLen, 
+                pStructOut, structOutSize, maxRecCount, decodeState);
+}
@@ -11,6 +11,10 @@
 #include "RaftBusDevicesIF.h"
 #include "DeviceTypeRecords.h"
 #include "RaftThreading.h"
+#include "BLEDeviceTable.h"
+#include "BLESPSCRing.h"
+#include "BLEReadingHistory.h"
+#include "BLETimerWheel.h"
 
 class DeviceStatus;
 class RaftJsonIF;
@@ -28,6 +32,10 @@ public:
     /// @param config configuration
     void setup(const RaftJsonIF& config);
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Loop - processes readings handed over by handlePollResult() and reports devices gone offline
+    void loop();
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Get list of device addresses attached to the bus
     /// @param pAddrList pointer to array to receive addresses
@@ -78,6 +86,12 @@ public:
     /// @return Binary data vector
     virtual std::vector<uint8_t> getQueuedDeviceDataBinary(uint32_t connMode) const override final;
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Append queued device data in binary format to a buffer (e.g. an outbound message buffer)
+    /// @param binaryData buffer to append to
+    /// @param connMode connection mode (inc bus number)
+    void appendQueuedDeviceDataBinary(std::vector<uint8_t>& binaryData, uint32_t connMode) const;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Get decoded poll responses
     /// @param address address of device to get data from
@@ -90,10 +104,7 @@ public:
     ///       decodeState should be maintained between calls for the same device
     virtual uint32_t getDecodedPollResponses(BusElemAddrType address, 
                     void* pStructOut, uint32_t structOutSize, 
-                    uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const override final
-    {
-        return 0;
-    }
+                    uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const override final;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Register for device data notifications
@@ -115,12 +126,13 @@ public:
     }
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief Handle poll results
+    /// @brief Handle poll results (called from the scan callback - the result is queued without blocking and
+    ///        processed in loop())
     /// @param timeNowUs time in us (passed in to aid testing)
     /// @param address address
     /// @param pollResultData poll result data
     /// @param pPollInfo pointer to device polling info (maybe nullptr) 
-    /// @return true if result stored
+    /// @return true if result queued (false if it was dropped because the queue is full)
     virtual bool handlePollResult(uint64_t timeNowUs, BusElemAddrType address, 
                             const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo) override final;
 
@@ -129,7 +141,9 @@ public:
     /// @return JSON string
     virtual String getDebugJSON(bool includeBraces) const override final
     {
-        return "{}";
+        String jsonStr = R"("rdgQ":)" + String(_readingRing.count()) + R"(,"rdgDrop":)" + String(_readingsDropped.load()) +
+                    R"(,"offTmrs":)" + String(_offlineWheel.numActive());
+        return includeBraces ? "{" + jsonStr + "}" : jsonStr;
     }
 
     // /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -180,32 +194,68 @@ private:
     public:
         BusElemAddrType busElemAddr = 0;
         uint32_t lastSeenTimeMs = 0;
+        bool isOnline = true;
         uint16_t lastBTHomePacketID = UINT16_MAX;
-        std::vector<uint8_t> lastDataReceived;
+        BLEReadingHistory history;
         RaftDeviceDataChangeCB dataChangeCB = nullptr;
         uint32_t minTimeBetweenReportsMs = 1000;
         const void* pCallbackInfo = nullptr;
     };
-    static const uint32_t MAX_BLE_BUS_DEVICES = 20;
-    std::list<BLEBusDeviceState> _bleBusDeviceStates;
+    static const uint32_t DEFAULT_MAX_BLE_BUS_DEVICES = 50;
+    BLEDeviceTable<BLEBusDeviceState> _bleBusDeviceStates;
 
-    // Time of last device data change
-    uint32_t _deviceDataLastSetMs = 0;
+    // Readings handed over from the scan callback (records are the decoded BTHome record - up to 64 bytes)
+    struct BLEBusReading
+    {
+        static const uint32_t MAX_DATA_LEN = 64;
+        uint64_t timeNowUs = 0;
+        BusElemAddrType address = 0;
+        uint32_t dataLen = 0;
+        uint8_t data[MAX_DATA_LEN];
+    };
+    static const uint32_t DEFAULT_READING_QUEUE_LEN = 32;
+
+    // Number of readings held for each device (readings not consumed before being overwritten are lost)
+    static const uint32_t DEFAULT_HISTORY_LEN = 4;
+    static const uint32_t MAX_HISTORY_LEN = 32;
+    uint32_t _historyLen = DEFAULT_HISTORY_LEN;
+    BLESPSCRing<BLEBusReading> _readingRing;
+    std::atomic<uint32_t> _readingsDropped = 0;
+
+    // Estimated output size per device in addition to the reading data (for sizing output buffers)
+    static const uint32_t JSON_PER_DEVICE_OVERHEAD_BYTES = 64;
+    static const uint32_t BINARY_PER_DEVICE_OVERHEAD_BYTES = 16;
 
-    // Device type info - common to all BLE devices
+    // Time of last device data change and online status change
+    uint32_t _deviceDataLastSetMs = 0;
+    uint32_t _elemStatusLastChangeMs = 0;
+
+    // Offline detection - a timer for each device table entry is restarted whenever the device is seen
+    // (timeouts are per device type with a default for types not listed, 0 disables)
+    static const uint32_t DEFAULT_OFFLINE_TIMEOUT_MS = 300000;
+    static const uint32_t OFFLINE_WHEEL_SLOTS = 64;
+    static const uint32_t OFFLINE_WHEEL_TICK_MS = 1000;
+    BLETimerWheel _offlineWheel;
+    uint32_t _offlineTimeoutDefaultMs = DEFAULT_OFFLINE_TIMEOUT_MS;
+    std::vector<std::pair<uint16_t, uint32_t>> _offlineTimeoutsByType;
+    std::vector<BusElemAddrType> _offlineAddrs;
+
+    // Device type info - common to all BLE devices (BLEBTHome devices use the original 19 byte record and
+    // BLEBTHomeExt devices the full decoded record)
+    static constexpr const char* DEVICE_TYPE_BTHOME = "BLEBTHome";
+    static constexpr const char* DEVICE_TYPE_BTHOME_EXT = "BLEBTHomeExt";
     DeviceTypeRecord _devTypeRec;
     uint32_t _deviceTypeIndex = 0;
+    bool _isExtRecord = false;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief Format device status to JSON
+    /// @brief Append device status JSON (in the DeviceTypeRecords format with hex encoded data) to a string
+    /// @param jsonStr string to append to (reserved by the caller so nothing is allocated per device)
     /// @param address address
     /// @param isOnline true if device is online
-    /// @param deviceTypeIndex index of device type
     /// @param devicePollResponseData poll response data
-    /// @param responseSize size of poll response data
-    /// @return JSON string
-    String deviceStatusToJson(BusElemAddrType address, bool isOnline, uint16_t deviceTypeIndex, 
-                    const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize) const;
+    void appendDeviceStatusJson(String& jsonStr, BusElemAddrType address, bool isOnline,
+                    const std::vector<uint8_t>& devicePollResponseData) const;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Decode one or more poll responses for a device
@@ -224,6 +274,28 @@ private:
 
     BLEBusDeviceState* getBLEBusDeviceState(BusElemAddrType busElemAddr);
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get offline timeout for a device type
+    /// @param deviceTypeIndex index of device type
+    /// @return timeout in ms (0 if offline detection is disabled)
+    uint32_t getOfflineTimeoutMs(uint16_t deviceTypeIndex) const
+    {
+        for (const auto& typeTimeout : _offlineTimeoutsByType)
+            if (typeTimeout.first == deviceTypeIndex)
+                return typeTimeout.second;
+        return _offlineTimeoutDefaultMs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Report devices which have gone offline
+    void serviceOfflineTimers();
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Process a reading
+    /// @param reading reading
+    /// @return false if the reading couldn't be processed yet (and should be retried)
+    bool processReading(const BLEBusReading& reading);
+
     // Debug
     static constexpr const char* MODULE_PREFIX = "BLEBusDevMan";
 
@@ -54,18 +54,36 @@ public:
     static const int DEFAULT_TASK_PRIORITY = 1;
     static const int DEFAULT_TASK_SIZE_BYTES = 4000;
     static const int DEFAULT_OUTBOUND_MSG_QUEUE_SIZE = 30;
+    static const int DEFAULT_INBOUND_POOL_SIZE = 8;
     static const uint32_t BLE_MIN_TIME_BETWEEN_OUTBOUND_MSGS_MS = 50;
     static const uint32_t MAX_BLE_PACKET_LEN_DEFAULT = 500;
     static const uint32_t PREFERRED_MTU_SIZE = 512;
     static const uint32_t DEFAULT_NUM_OUTBOUND_MSGS_IN_FLIGHT_MAX = 10;
     static const uint32_t BLE_OUTBOUND_MSGS_IN_FLIGHT_TIMEOUT_MS = 500;
+    static const bool DEFAULT_SEND_WINDOWED = false;
+    static const bool DEFAULT_SEND_PACKED = false;
     static const uint32_t DEFAULT_CONN_INTERVAL_BLE_UNITS = 12; // 15ms
     static const uint32_t DEFAULT_CONN_LATENCY = 0;
     static const uint32_t PREF_SUPERVISORY_TIMEOUT_MS = 10000;
     static const uint32_t DEFAULT_LL_PACKET_TIME = 2500;
     static const uint32_t DEFAULT_LL_PACKET_LENGTH = 251;
+    static const bool DEFAULT_LINK_ADAPTIVE = false;
+    static const uint32_t DEFAULT_CONN_INTERVAL_IDLE_BLE_UNITS = 80; // 100ms
+    static const uint32_t DEFAULT_CONN_LATENCY_IDLE = 4;
+    static const uint32_t DEFAULT_LINK_IDLE_AFTER_MS = 2000;
     static const uint32_t DEFAULT_SCAN_INTERVAL_MS = 200;
     static const uint32_t DEFAULT_SCAN_WINDOW_MS = 150;
+    static const bool DEFAULT_SCAN_ADAPTIVE = false;
+    static const uint32_t DEFAULT_SCAN_WINDOW_BUSY_MS = 20;
+    static const uint32_t DEFAULT_SCAN_IDLE_AFTER_MS = 1000;
+    static const uint32_t DEFAULT_SCAN_SWEEP_EVERY_MS = 10000;
+    static const uint32_t DEFAULT_SCAN_SWEEP_FOR_MS = 1500;
+    static const uint32_t DEFAULT_MAX_CONNECTIONS = 1;
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+    static const uint32_t MAX_CONNECTIONS = CONFIG_BT_NIMBLE_MAX_CONNECTIONS;
+#else
+    static const uint32_t MAX_CONNECTIONS = 1;
+#endif
 
     bool setup(const RaftJsonIF& config)
     {
@@ -73,6 +91,9 @@ public:
         enPeripheral = config.getBool("peripheral", true);
         enCentral = config.getBool("central", false);
 
+        // Max simultaneous connections from centrals (limited by the NimBLE config)
+        maxConns = Raft::clamp((uint32_t)config.getLong("maxConns", DEFAULT_MAX_CONNECTIONS), (uint32_t)1, MAX_CONNECTIONS);
+
         // Scanning
         scanPassive = config.getBool("scanPassive", false);
         scanNoDuplicates = config.getBool("scanNoDup", false);
@@ -90,6 +111,15 @@ public:
         connIntervalPreferredBLEUnits = std::round(connIntvPrefMs / 1.25);
         connLatencyPref = config.getLong("connLatencyPref", DEFAULT_CONN_LATENCY);
 
+        // Adaptive link - the conn interval and latency above are used while there is an outbound backlog
+        // and the idle values when the link has been idle for linkIdleAfterMs
+        linkAdaptive = config.getBool("linkAdaptive", DEFAULT_LINK_ADAPTIVE);
+        double connIntvIdleMs = config.getDouble("connIntvIdleMs", DEFAULT_CONN_INTERVAL_IDLE_BLE_UNITS * 1.25);
+        connIntvIdleMs = Raft::clamp(connIntvIdleMs, 7.5, 4000.0);
+        connIntervalIdleBLEUnits = std::round(connIntvIdleMs / 1.25);
+        connLatencyIdle = config.getLong("connLatencyIdle", DEFAULT_CONN_LATENCY_IDLE);
+        linkIdleAfterMs = config.getLong("linkIdleAfterMs", DEFAULT_LINK_IDLE_AFTER_MS);
+
         // Advertising
         advertisingIntervalMs = config.getLong("advIntervalMs", 0);
 
@@ -99,6 +129,25 @@ public:
         scanForSecs = config.getLong("scanForSecs", 0);
         scanBTHome = config.getBool("scanBTHome", false);
 
+        // Adaptive scanning - the scan window is reduced to scanWinBusyMs while connections are busy with a
+        // sweep using the full window for scanSweepForMs every scanSweepEveryMs (0 to disable sweeps)
+        scanAdaptive = config.getBool("scanAdaptive", DEFAULT_SCAN_ADAPTIVE);
+        scanWindowBusyMs = config.getLong("scanWinBusyMs", DEFAULT_SCAN_WINDOW_BUSY_MS);
+        scanIdleAfterMs = config.getLong("scanIdleAfterMs", DEFAULT_SCAN_IDLE_AFTER_MS);
+        scanSweepEveryMs = config.getLong("scanSweepEveryMs", DEFAULT_SCAN_SWEEP_EVERY_MS);
+        scanSweepForMs = config.getLong("scanSweepForMs", DEFAULT_SCAN_SWEEP_FOR_MS);
+
+        // Scan filtering - MAC addresses or prefixes ("aa:bb:cc:dd:ee:ff" or "aa:bb:cc"), 16-bit service UUIDs (hex)
+        // and manufacturer IDs (decimal or 0x prefixed hex) - full MAC addresses are loaded into the controller's
+        // filter accept list when scanFiltCtrl is set
+        scanFilterMACs.clear();
+        config.getArrayElems("scanMACs", scanFilterMACs);
+        scanFilterUUIDs.clear();
+        config.getArrayElems("scanUUIDs", scanFilterUUIDs);
+        scanFilterMfrIDs.clear();
+        config.getArrayElems("scanMfrIDs", scanFilterMfrIDs);
+        scanFilterUseController = config.getBool("scanFiltCtrl", true);
+
         // Pairing parameters
         // This corresponds to the BLE_SM_IO_CAP_XXX values
         // See host/ble_sm.h
@@ -118,6 +167,11 @@ public:
         outboundQueueSize = config.getLong("outQSize", DEFAULT_OUTBOUND_MSG_QUEUE_SIZE);
         outMsgsInFlightMax = config.getLong("outMsgsInFlightMax", DEFAULT_NUM_OUTBOUND_MSGS_IN_FLIGHT_MAX);
         outMsgsInFlightTimeoutMs = config.getLong("outMsgsInFlightMs", BLE_OUTBOUND_MSGS_IN_FLIGHT_TIMEOUT_MS);
+        sendWindowed = config.getBool("outWindowed", DEFAULT_SEND_WINDOWED);
+        sendPacked = config.getBool("outPacked", DEFAULT_SEND_PACKED);
+
+        // Inbound message settings
+        inboundPoolSize = config.getLong("inPoolSize", DEFAULT_INBOUND_POOL_SIZE);
 
         // Task settings
         taskCore = config.getLong("taskCore", DEFAULT_TASK_CORE);
@@ -150,6 +204,15 @@ public:
                     " scanNoDup:" + String(scanNoDuplicates) +
                     " scanPass:" + String(scanPassive) +
                     " scanBTHome:" + String(scanBTHome) +
+                    " scanAdapt:" + String(scanAdaptive) +
+                    " scanWinBusyMs:" + String(scanWindowBusyMs) +
+                    " scanIdleMs:" + String(scanIdleAfterMs) +
+                    " scanSweepEvMs:" + String(scanSweepEveryMs) +
+                    " scanSweepForMs:" + String(scanSweepForMs) +
+                    " scanMACs:" + String((int)scanFilterMACs.size()) +
+                    " scanUUIDs:" + String((int)scanFilterUUIDs.size()) +
+                    " scanMfrIDs:" + String((int)scanFilterMfrIDs.size()) +
+                    " scanFiltCtrl:" + String(scanFilterUseController) +
                     " pairIO:" + String(pairingSMIOCap) +
                     " pairSecConn:" + String(pairingSecureConn) +
                     " useInd:" + String(sendUsingIndication) + 
@@ -160,14 +223,22 @@ public:
                     " llPktTPref:" + String(llPacketTimePref) + 
                     " llPktLPref:" + String(llPacketLengthPref) + 
                     " supvTOMs:" + String(supvTimeoutPrefMs) +
+                    " linkAdapt:" + String(linkAdaptive) +
+                    " conItvIdleMs:" + String(connIntervalIdleBLEUnits*1.25) +
+                    " conLatIdle:" + String(connLatencyIdle) +
+                    " linkIdleMs:" + String(linkIdleAfterMs) +
                     " busConnName:\"" + busConnName + String("\"") +
                     " uuidCmdRspSvc:" + uuidCmdRespService +
                     " uuidCmdRspCmd:" + uuidCmdRespCommand +
                     " uuidCmdRspResp:" + uuidCmdRespResponse +
+                    " maxConns:" + String(maxConns) +
                     " outQSz:" + String(outboundQueueSize) +
+                    " inPoolSz:" + String(inboundPoolSize) +
                     " minSndMs:" + String(minMsBetweenSends) + 
                     " inFlghtMax:" + String(outMsgsInFlightMax) +
                     " inFlghtMs:" + String(outMsgsInFlightTimeoutMs) +
+                    " windowed:" + String(sendWindowed) +
+                    " packed:" + String(sendPacked) +
                     " tskEn:" + String(useTaskForSending) + 
                     " tskCore:" + String(taskCore) + 
                     " tskPrty:" + String(taskPriority) + 
@@ -195,11 +266,28 @@ public:
     // Note: indication requires an ACK from the central device
     bool sendUsingIndication:1 = true;
 
+    // Send windowed - when using indication allow up to outMsgsInFlightMax chunks
+    // to be awaiting confirmation (otherwise stop-and-wait with one chunk in flight)
+    bool sendWindowed:1 = DEFAULT_SEND_WINDOWED;
+
+    // Send packed - consecutive outbound messages are packed into full-MTU packets as segments each with a
+    // 2-byte big-endian header (bit 15 lane, bit 14 more segments follow, bits 13..0 length) - the central
+    // must reassemble the messages of each lane
+    bool sendPacked:1 = DEFAULT_SEND_PACKED;
+
+    // Adaptive link (conn interval/latency follow the outbound backlog, 2M PHY and DLE per connection)
+    bool linkAdaptive:1 = DEFAULT_LINK_ADAPTIVE;
+
     // Scanning
     bool scanPassive:1 = false;
     bool scanNoDuplicates:1 = false;
     bool scanLimited:1 = false;    
     bool scanBTHome:1 = false;
+    bool scanAdaptive:1 = DEFAULT_SCAN_ADAPTIVE;
+    bool scanFilterUseController:1 = true;
+    std::vector<String> scanFilterMACs;
+    std::vector<String> scanFilterUUIDs;
+    std::vector<String> scanFilterMfrIDs;
 
     // Standard services
     std::vector<BLEStandardServiceConfig> stdServices;
@@ -216,6 +304,9 @@ public:
     uint16_t supvTimeoutPrefMs = PREF_SUPERVISORY_TIMEOUT_MS;
     uint16_t llPacketTimePref = DEFAULT_LL_PACKET_TIME;
     uint16_t llPacketLengthPref = DEFAULT_LL_PACKET_LENGTH;
+    uint16_t connIntervalIdleBLEUnits = DEFAULT_CONN_INTERVAL_IDLE_BLE_UNITS;
+    uint16_t connLatencyIdle = DEFAULT_CONN_LATENCY_IDLE;
+    uint32_t linkIdleAfterMs = DEFAULT_LINK_IDLE_AFTER_MS;
 
     // Advertising
     uint16_t advertisingIntervalMs = 0;
@@ -224,6 +315,10 @@ public:
     uint16_t scanningIntervalMs = DEFAULT_SCAN_INTERVAL_MS;
     uint16_t scanningWindowMs = DEFAULT_SCAN_WINDOW_MS;
     int32_t scanForSecs = 0;
+    uint16_t scanWindowBusyMs = DEFAULT_SCAN_WINDOW_BUSY_MS;
+    uint32_t scanIdleAfterMs = DEFAULT_SCAN_IDLE_AFTER_MS;
+    uint32_t scanSweepEveryMs = DEFAULT_SCAN_SWEEP_EVERY_MS;
+    uint32_t scanSweepForMs = DEFAULT_SCAN_SWEEP_FOR_MS;
 
     // Bus connection name
     String busConnName;
@@ -239,6 +334,12 @@ public:
     uint16_t outMsgsInFlightMax = DEFAULT_NUM_OUTBOUND_MSGS_IN_FLIGHT_MAX;
     uint32_t outMsgsInFlightTimeoutMs = BLE_OUTBOUND_MSGS_IN_FLIGHT_TIMEOUT_MS;
 
+    // Inbound message settings (writes are held in the pool until handled in loop())
+    uint16_t inboundPoolSize = DEFAULT_INBOUND_POOL_SIZE;
+
+    // Max connections (each connection has its own outbound queue, flow control and comms channel)
+    uint16_t maxConns = DEFAULT_MAX_CONNECTIONS;
+
     // Task settings
     uint8_t taskCore = DEFAULT_TASK_CORE;
     int8_t taskPriority = DEFAULT_TASK_PRIORITY;
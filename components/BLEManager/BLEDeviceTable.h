@@ -0,0 +1,249 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEDeviceTable
+// Fixed capacity table of devices keyed by bus address with O(1) lookup and least-recently-seen eviction
+//
+// Entries are held in a flat array and located using an open-addressing (linear probing) index of entry
+// numbers. A doubly-linked list of entry numbers is maintained in order of use so that when the table is
+// full the stalest entry can be replaced without searching.
+//
+// Not thread safe - the owner must provide locking.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftBusDevicesIF.h"
+
+template <typename ElemType>
+class BLEDeviceTable
+{
+public:
+    // Max capacity (entry numbers are 16 bit)
+    static constexpr uint32_t MAX_CAPACITY = 4096;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup the table (clears the table)
+    /// @param capacity max number of entries
+    void setup(uint32_t capacity)
+    {
+        capacity = capacity == 0 ? 1 : (capacity > MAX_CAPACITY ? MAX_CAPACITY : capacity);
+        _entries.clear();
+        _entries.reserve(capacity);
+        _capacity = capacity;
+
+        // Index is at least twice the capacity (and a power of 2) to keep probe sequences short
+        _indexBits = 1;
+        while ((1u << _indexBits) < capacity * 2)
+            _indexBits++;
+        _index.assign(1u << _indexBits, INDEX_EMPTY);
+        _mruIdx = NO_ENTRY;
+        _lruIdx = NO_ENTRY;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Find an entry
+    /// @param addr address
+    /// @return pointer to element or nullptr if not found
+    ElemType* find(BusElemAddrType addr)
+    {
+        uint32_t slot = 0;
+        uint16_t entryIdx = findEntryIdx(addr, slot);
+        return entryIdx == NO_ENTRY ? nullptr : &_entries[entryIdx].elem;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Find the position of an entry (positions are stable until the entry is replaced)
+    /// @param addr address
+    /// @return position (0..capacity()-1) or -1 if not found
+    int32_t findPos(BusElemAddrType addr) const
+    {
+        uint32_t slot = 0;
+        uint16_t entryIdx = findEntryIdx(addr, slot);
+        return entryIdx == NO_ENTRY ? -1 : entryIdx;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Mark an entry as the most recently used
+    /// @param addr address
+    void touch(BusElemAddrType addr)
+    {
+        uint32_t slot = 0;
+        uint16_t entryIdx = findEntryIdx(addr, slot);
+        if (entryIdx != NO_ENTRY)
+            moveToFront(entryIdx);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add an entry (the least recently used entry is replaced if the table is full)
+    /// @param addr address (must not already be in the table)
+    /// @param evicted (out) true if an entry was replaced
+    /// @param evictedAddr (out) address of the replaced entry
+    /// @return pointer to the new element (default constructed)
+    ElemType* add(BusElemAddrType addr, bool& evicted, BusElemAddrType& evictedAddr)
+    {
+        evicted = false;
+        if (_index.empty())
+            return nullptr;
+
+        // Use a new entry or replace the least recently used
+        uint16_t entryIdx = NO_ENTRY;
+        if (_entries.size() < _capacity)
+        {
+            entryIdx = _entries.size();
+            _entries.emplace_back();
+        }
+        else
+        {
+            entryIdx = _lruIdx;
+            evicted = true;
+            evictedAddr = _entries[entryIdx].addr;
+            unlink(entryIdx);
+            removeFromIndex(evictedAddr);
+            _entries[entryIdx].elem = ElemType();
+        }
+
+        // Add to index and MRU list
+        Entry& entry = _entries[entryIdx];
+        entry.addr = addr;
+        uint32_t slot = hashSlot(addr);
+        while (_index[slot] != INDEX_EMPTY)
+            slot = (slot + 1) & (_index.size() - 1);
+        _index[slot] = entryIdx;
+        linkAtFront(entryIdx);
+        return &entry.elem;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of entries
+    uint32_t size() const
+    {
+        return _entries.size();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get capacity
+    uint32_t capacity() const
+    {
+        return _capacity;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Access entries by position (unordered - for iteration)
+    /// @param pos position (0..size()-1)
+    ElemType& elemAt(uint32_t pos)
+    {
+        return _entries[pos].elem;
+    }
+    const ElemType& elemAt(uint32_t pos) const
+    {
+        return _entries[pos].elem;
+    }
+    BusElemAddrType addrAt(uint32_t pos) const
+    {
+        return _entries[pos].addr;
+    }
+
+private:
+    // Entry
+    struct Entry
+    {
+        BusElemAddrType addr = 0;
+        uint16_t prevIdx = NO_ENTRY;
+        uint16_t nextIdx = NO_ENTRY;
+        ElemType elem;
+    };
+
+    // Entries and index
+    static constexpr uint16_t NO_ENTRY = UINT16_MAX;
+    static constexpr uint16_t INDEX_EMPTY = UINT16_MAX;
+    std::vector<Entry> _entries;
+    std::vector<uint16_t> _index;
+    uint32_t _capacity = 0;
+    uint32_t _indexBits = 1;
+
+    // Most and least recently used entries
+    uint16_t _mruIdx = NO_ENTRY;
+    uint16_t _lruIdx = NO_ENTRY;
+
+    // Hash (Fibonacci hashing - the top bits of the product are used)
+    uint32_t hashSlot(BusElemAddrType addr) const
+    {
+        return ((uint32_t)addr * 2654435769u) >> (32 - _indexBits);
+    }
+
+    // Find entry index and index slot
+    uint16_t findEntryIdx(BusElemAddrType addr, uint32_t& slot) const
+    {
+        if (_index.empty())
+            return NO_ENTRY;
+        slot = hashSlot(addr);
+        while (_index[slot] != INDEX_EMPTY)
+        {
+            if (_entries[_index[slot]].addr == addr)
+                return _index[slot];
+            slot = (slot + 1) & (_index.size() - 1);
+        }
+        return NO_ENTRY;
+    }
+
+    // Remove from index (backward shift deletion keeps probe sequences intact without tombstones)
+    void removeFromIndex(BusElemAddrType addr)
+    {
+        uint32_t slot = 0;
+        if (findEntryIdx(addr, slot) == NO_ENTRY)
+            return;
+        uint32_t mask = _index.size() - 1;
+        uint32_t nextSlot = (slot + 1) & mask;
+        while (_index[nextSlot] != INDEX_EMPTY)
+        {
+            // Move the entry back if its home slot isn't in the (cyclic) range slot+1..nextSlot
+            uint32_t homeSlot = hashSlot(_entries[_index[nextSlot]].addr);
+            if (((nextSlot - homeSlot) & mask) >= ((nextSlot - slot) & mask))
+            {
+                _index[slot] = _index[nextSlot];
+                slot = nextSlot;
+            }
+            nextSlot = (nextSlot + 1) & mask;
+        }
+        _index[slot] = INDEX_EMPTY;
+    }
+
+    // MRU list
+    void linkAtFront(uint16_t entryIdx)
+    {
+        Entry& entry = _entries[entryIdx];
+        entry.prevIdx = NO_ENTRY;
+        entry.nextIdx = _mruIdx;
+        if (_mruIdx != NO_ENTRY)
+            _entries[_mruIdx].prevIdx = entryIdx;
+        _mruIdx = entryIdx;
+        if (_lruIdx == NO_ENTRY)
+            _lruIdx = entryIdx;
+    }
+    void unlink(uint16_t entryIdx)
+    {
+        Entry& entry = _entries[entryIdx];
+        if (entry.prevIdx != NO_ENTRY)
+            _entries[entry.prevIdx].nextIdx = entry.nextIdx;
+        else
+            _mruIdx = entry.nextIdx;
+        if (entry.nextIdx != NO_ENTRY)
+            _entries[entry.nextIdx].prevIdx = entry.prevIdx;
+        else
+            _lruIdx = entry.prevIdx;
+        entry.prevIdx = NO_ENTRY;
+        entry.nextIdx = NO_ENTRY;
+    }
+    void moveToFront(uint16_t entryIdx)
+    {
+        if (entryIdx == _mruIdx)
+            return;
+        unlink(entryIdx);
+        linkAtFront(entryIdx);
+    }
+};
@@ -28,6 +28,7 @@
 #if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
 #include "esp_nimble_hci.h"
 #endif
+#include "soc/soc_caps.h"
 #undef min
 #undef max
 
@@ -59,6 +60,7 @@
 // #define DEBUG_BLE_ON_SYNC
 // #define DEBUG_BLE_SCAN_START_STOP
 // #define DEBUG_BLE_SCAN_EVENT
+// #define DEBUG_BLE_SCAN_FULL_ADV_PARSE
 
 // Singleton instance
 BLEGapServer* BLEGapServer::_pThis = nullptr;
@@ -69,9 +71,9 @@ BLEGapServer* BLEGapServer::_pThis = nullptr;
 /// @param statusChangeFn function pointer to handle status changes
 BLEGapServer::BLEGapServer(GetAdvertisingNameFnType getAdvertisingNameFn, 
                 StatusChangeFnType statusChangeFn) :
-        _gattServer([this](const char* characteristicName, bool readOp, std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> rxMsg)
+        _gattServer([this](uint16_t connHandle, const char* characteristicName, bool readOp, const uint8_t* pData, uint32_t dataLen)
                     {
-                        return gattAccessCallback(characteristicName, readOp, rxMsg.data(), rxMsg.size());
+                        return gattAccessCallback(connHandle, characteristicName, readOp, pData, dataLen);
                     },
                     _bleStats),
         _bleAdvertDecoder()
@@ -98,6 +100,13 @@ bool BLEGapServer::setup(CommsCoreIF* pCommsCoreIF, const BLEConfig& bleConfig)
     _bleConfig = bleConfig;
     _pCommsCoreIF = pCommsCoreIF;
 
+    // Connection state for each connection slot
+    _connStates.resize(_bleConfig.maxConns);
+    for (ConnState& connState : _connStates)
+        connState.linkManager.setup(_bleConfig);
+    _scanScheduler.setup(_bleConfig, millis());
+    _scanFilter.setup(_bleConfig);
+
     // Check if peripheral role enabled
     if (_bleConfig.enPeripheral)
     {
@@ -121,7 +130,8 @@ bool BLEGapServer::setup(CommsCoreIF* pCommsCoreIF, const BLEConfig& bleConfig)
     }
 
     // Currently disconnected
-    setConnState(false);
+    _numConnections = 0;
+    onConnCountChange();
 
 #ifdef DEBUG_BLE_SETUP
         LOG_I(MODULE_PREFIX, "setup OK %s", bleConfig.debugStr().c_str());
@@ -185,13 +195,40 @@ void BLEGapServer::loop(NamedValueProvider* pNamedValueProvider)
     // Update cached RSSI value
     updateRSSICachedValue();
 
-    // Check connection interval some time after connection
-    if (_connIntervalCheckPending && 
-            Raft::isTimeout(millis(), _connIntervalCheckPendingStartMs, CONN_INTERVAL_CHECK_MS))
+    // Service each connection
+    bool isAnyLinkBusy = false;
+    for (uint32_t slotIdx = 0; slotIdx < _connStates.size(); slotIdx++)
     {
-        // Request conn interval we want
-        requestConnInterval();
-        _connIntervalCheckPending = false;
+        if (!_gattServer.isSlotConnected(slotIdx))
+            continue;
+        ConnState& connState = _connStates[slotIdx];
+
+        // Check connection interval some time after connection
+        if (connState.connIntervalCheckPending && 
+                Raft::isTimeout(millis(), connState.connIntervalCheckPendingStartMs, CONN_INTERVAL_CHECK_MS))
+        {
+            // Request conn interval we want
+            requestConnInterval(slotIdx);
+            connState.connIntervalCheckPending = false;
+        }
+
+        // Adapt connection params to the outbound backlog
+        BLEGattOutbound* pOutbound = _gattServer.getOutbound(slotIdx);
+        if (connState.linkManager.loop(millis(), pOutbound && (pOutbound->getQueuedCount() > 0)))
+            requestConnInterval(slotIdx);
+        if (pOutbound && ((pOutbound->getQueuedCount() > 0) || (pOutbound->getInFlightCount() > 0)))
+            isAnyLinkBusy = true;
+    }
+
+    // Adapt the scan window to the connection traffic (restarting the scan if it is in progress)
+    bool isScanning = _bleConfig.enCentral && ble_gap_disc_active();
+    if (_scanScheduler.loop(millis(), isAnyLinkBusy, isScanning, _numConnections > 0) && isScanning)
+    {
+#ifdef DEBUG_BLE_SCAN_START_STOP
+        LOG_I(MODULE_PREFIX, "loop scan window now %dms", (int)_scanScheduler.getScanWindowMs());
+#endif
+        ble_gap_disc_cancel();
+        startScanning(true);
     }
 }
 
@@ -207,6 +244,30 @@ void BLEGapServer::restart()
     _bleRestartLastMs = millis();
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start an outbound throughput test (PRBS test frames sent through the outbound path)
+/// @param frameLen length of each test frame
+/// @param numFrames number of frames to send (0 for no limit)
+/// @param maxDurationMs max duration of the test (0 for no limit)
+/// @return true if the test was started (a connection is required)
+bool BLEGapServer::startOutboundTest(uint32_t frameLen, uint32_t numFrames, uint32_t maxDurationMs)
+{
+    if (!_isInit || !isConnected())
+        return false;
+
+    // Run the test on the first connection
+    for (uint32_t slotIdx = 0; slotIdx < _gattServer.getNumConnSlots(); slotIdx++)
+    {
+        if (!_gattServer.isSlotConnected(slotIdx))
+            continue;
+        stopOutboundTest();
+        _outboundTestSlotIdx = slotIdx;
+        _gattServer.getOutbound(slotIdx)->startOutboundTest(frameLen, numFrames, maxDurationMs);
+        return true;
+    }
+    return false;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Register BLEGapServer as a communication channel with the Raft CommsCore interface
 /// @param commsCoreIF reference to the CommsCore interface
@@ -216,13 +277,32 @@ void BLEGapServer::registerChannel(CommsCoreIF& commsCoreIF)
     uint32_t maxPktLen = _gattServer.getMaxPacketLen();
     const CommsChannelSettings commsChannelSettings(maxPktLen, maxPktLen, 0, 0, maxPktLen, 0);
 
-    // Register as a message channel
-    _commsChannelID = commsCoreIF.registerChannel("RICSerial", 
-            "BLE",
-            "BLE",
-            std::bind(&BLEGapServer::sendBLEMsg, this, std::placeholders::_1),
-            std::bind(&BLEGapServer::isReadyToSend, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
-            &commsChannelSettings);
+    // Register a message channel for each connection slot (the first is named BLE and others BLE2, BLE3, etc)
+    _commsChannelIDs.resize(_bleConfig.maxConns);
+    for (uint32_t slotIdx = 0; slotIdx < _commsChannelIDs.size(); slotIdx++)
+    {
+        String channelName = slotIdx == 0 ? String("BLE") : "BLE" + String(slotIdx + 1);
+        _commsChannelIDs[slotIdx] = commsCoreIF.registerChannel("RICSerial", 
+                "BLE",
+                channelName.c_str(),
+                std::bind(&BLEGapServer::sendBLEMsg, this, std::placeholders::_1),
+                std::bind(&BLEGapServer::isReadyToSend, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                &commsChannelSettings);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the connection slot index for a comms channel
+/// @param channelID comms channel ID
+/// @return slot index or -1 if not found
+int BLEGapServer::getSlotIdxForChannel(uint32_t channelID) const
+{
+    for (uint32_t slotIdx = 0; slotIdx < _commsChannelIDs.size(); slotIdx++)
+    {
+        if (_commsChannelIDs[slotIdx] == channelID)
+            return slotIdx;
+    }
+    return -1;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -231,7 +311,7 @@ void BLEGapServer::registerChannel(CommsCoreIF& commsCoreIF)
 /// @return The RSSI value in dBm.
 double BLEGapServer::getRSSI(bool& isValid)
 {
-    isValid = _isConnected && (_rssi != 0);
+    isValid = isConnected() && (_rssi != 0);
     return _rssi;
 }
 
@@ -242,11 +322,27 @@ double BLEGapServer::getRSSI(bool& isValid)
 /// @return The status of the BLEGapServer as a JSON string
 String BLEGapServer::getStatusJSON(bool includeBraces, bool shortForm) const
 {
-    // Status result
-    String statusStr;
+    // Write into a stack buffer - if that is too small the size is known so write again into a buffer of that size
+    char buf[STATUS_JSON_STACK_BUF_LEN];
+    BLEJSONWriter writer(buf, sizeof(buf));
+    writeStatusJSON(writer, includeBraces, shortForm);
+    if (!writer.isTruncated())
+        return buf;
+    std::vector<char> largeBuf(writer.requiredLen() + 1);
+    BLEJSONWriter largeWriter(largeBuf.data(), largeBuf.size());
+    writeStatusJSON(largeWriter, includeBraces, shortForm);
+    return largeBuf.data();
+}
 
-    // RSSI
-    String rssiStr = _isConnected ? R"("rssi":)" + String(_rssi) : "";
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write the status of the BLEGapServer as JSON
+/// @param writer writer
+/// @param includeBraces if true, the JSON will be enclosed in braces
+/// @param shortForm if true, the JSON will be in a short form
+void BLEGapServer::writeStatusJSON(BLEJSONWriter& writer, bool includeBraces, bool shortForm) const
+{
+    if (includeBraces)
+        writer.append("{", 1);
 
     // Check format
     if (shortForm)
@@ -255,52 +351,58 @@ String BLEGapServer::getStatusJSON(bool includeBraces, bool shortForm) const
         bool gapConn = ble_gap_conn_active();
         bool isAdv = ble_gap_adv_active();
         bool isDisco = ble_gap_disc_active();
-        String connStr = String(R"("s":")") + 
-                (_isConnected ? (gapConn ? "actv" : "conn") : (isAdv ? "adv" : (isDisco ? "disco" : "none"))) + 
-                R"(")";
+        writer.appendf(R"("s":"%s")", 
+                isConnected() ? (gapConn ? "actv" : "conn") : (isAdv ? "adv" : (isDisco ? "disco" : "none")));
 
         // Advertising name
-        String advNameStr = isAdv ? R"("adv":")" + String(ble_svc_gap_device_name()) + R"(")" : "";
-
-        // Status str
-        statusStr = connStr;
-        if (!advNameStr.isEmpty())
-            statusStr += "," + advNameStr;
-        if (!rssiStr.isEmpty())
-            statusStr += "," + rssiStr;
+        if (isAdv)
+            writer.appendf(R"(,"adv":"%s")", ble_svc_gap_device_name());
     }
     else
     {
-        // Advertising
+        // Connection, advertising and discovery active
         bool advertisingActive = ble_gap_adv_active();
-        String isAdvStr = R"("isAdv":)" + String(advertisingActive ? 1 : 0);
-        String advNameStr = advertisingActive ? R"("advName":")" + String(ble_svc_gap_device_name()) : "";
-
-        // Discovery active
-        String isDiscoveryStr = R"("isDisc":)" + String(ble_gap_disc_active() ? 1 : 0);
+        writer.appendf(R"("isConn":%d,"isAdv":%d)", ble_gap_conn_active() ? 1 : 0, advertisingActive ? 1 : 0);
+        if (advertisingActive)
+            writer.appendf(R"(,"advName":"%s")", ble_svc_gap_device_name());
+    }
 
-        // Connection active
-        String connStr = R"("isConn":)" + String(ble_gap_conn_active() ? 1 : 0);
+    // RSSI
+    if (isConnected())
+        writer.appendf(R"(,"rssi":%d)", (int)_rssi);
 
+    if (!shortForm)
+    {
         // BLE MAC address
-        String bleMACStr = R"("BLEMAC":")" + getSystemMACAddressStr(ESP_MAC_BT, ":") + R"(")";
-
-        // Status
-        statusStr = connStr + "," + isAdvStr;
-        if (!advNameStr.isEmpty())
-            statusStr += "," + advNameStr;
-        if (!rssiStr.isEmpty())
-            statusStr += "," + rssiStr;
-        statusStr += "," + bleMACStr;
+        writer.appendf(R"(,"BLEMAC":"%s")", getSystemMACAddressStr(ESP_MAC_BT, ":").c_str());
+
+        // Scan scheduler
+        writer.append(",", 1);
+        _scanScheduler.writeJSON(writer);
+        writer.append(",", 1);
+        _scanFilter.writeJSON(writer);
+
+        // Connections and their negotiated link params
+        writer.appendf(R"(,"nConn":%d,"conns":[)", (int)_numConnections);
+        bool isFirst = true;
+        for (uint32_t slotIdx = 0; slotIdx < _connStates.size(); slotIdx++)
+        {
+            if (!_gattServer.isSlotConnected(slotIdx))
+                continue;
+            writer.appendSep(isFirst);
+            writer.appendf(R"({"hdl":%d,)", (int)_gattServer.getSlotConnHandle(slotIdx));
+            _connStates[slotIdx].linkManager.writeJSON(writer);
+            writer.append("}", 1);
+        }
+        writer.append("]", 1);
     }
 
     // Add stats
-    statusStr += "," + _bleStats.getJSON(false, shortForm);
+    writer.append(",", 1);
+    _bleStats.writeJSON(writer, shortForm);
 
-    // Return
     if (includeBraces)
-        return "{" + statusStr + "}";
-    return statusStr;
+        writer.append("}", 1);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -501,17 +603,41 @@ int BLEGapServer::nimbleGapEvent(struct ble_gap_event *event)
             connHandle = event->enc_change.conn_handle; 
             break;
         case BLE_GAP_EVENT_NOTIFY_TX:
+        {
             statusStr = BLEGattServer::getHSErrorMsg(event->notify_tx.status);
-            _gattServer.getOutbound().notifyTxComplete(event->notify_tx.status);
+            connHandle = event->notify_tx.conn_handle;
+            BLEGattOutbound* pOutbound = _gattServer.getOutbound(_gattServer.getConnSlotIdx(connHandle));
+            if (pOutbound)
+                pOutbound->notifyTxComplete(event->notify_tx.status);
             break;
+        }
         case BLE_GAP_EVENT_SUBSCRIBE:
             // Handle subscription to GATT attr
             _gattServer.handleSubscription(event, statusStr);
             break;
         case BLE_GAP_EVENT_MTU:
+        {
             statusStr = "mtu:" + String(event->mtu.value) + ",chanID:" + String(event->mtu.channel_id);
-            _gattServer.getOutbound().onMTUSizeInfo(event->mtu.value);
+            connHandle = event->mtu.conn_handle;
+            BLEGattOutbound* pOutbound = _gattServer.getOutbound(_gattServer.getConnSlotIdx(connHandle));
+            if (pOutbound)
+                pOutbound->onMTUSizeInfo(event->mtu.value);
+            break;
+        }
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            errorCode = gapEventPhyUpdate(event, statusStr, connHandle);
+            break;
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+        case BLE_GAP_EVENT_DATA_LEN_CHG:
+        {
+            statusStr = "txOct:" + String(event->data_len_chg.max_tx_octets) + ",rxOct:" + String(event->data_len_chg.max_rx_octets);
+            connHandle = event->data_len_chg.conn_handle;
+            ConnState* pConnState = getConnState(connHandle);
+            if (pConnState)
+                pConnState->linkManager.onDataLen(event->data_len_chg.max_tx_octets, event->data_len_chg.max_rx_octets);
             break;
+        }
+#endif
         case BLE_GAP_EVENT_REPEAT_PAIRING:
             errorCode = gapEventRepeatPairing(event);
             break;
@@ -571,38 +697,51 @@ void BLEGapServer::bleHostTask(void *param)
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Callback function for GATT characteristic access
-/// This function is called when a GATT read or write operation is performed on a characteristic.
+/// This function is called (from loop() rather than the host task) for GATT read or write operations on a characteristic.
 /// It handles test frames used to determine link performance, and for write operations, it sends
 /// the received message to the communication core interface
+/// @param connHandle connection handle of the central accessing the characteristic
 /// @param characteristicName name of the GATT characteristic being accessed
 /// @param readOp true if the operation is a read; false if it is a write
 /// @param payloadbuffer pointer to the buffer containing the data being read or written
 /// @param payloadlength length of the data in the payload buffer
-void BLEGapServer::gattAccessCallback(const char* characteristicName, bool readOp, const uint8_t *payloadbuffer, int payloadlength)
+/// @return false if the comms channel can't accept the message yet (it will be offered again)
+bool BLEGapServer::gattAccessCallback(uint16_t connHandle, const char* characteristicName, bool readOp, const uint8_t *payloadbuffer, int payloadlength)
 {
+    // Connection slot and comms channel
+    int slotIdx = _gattServer.getConnSlotIdx(connHandle);
+    ConnState* pConnState = getConnState(connHandle);
+    uint32_t channelID = (slotIdx >= 0) && (slotIdx < (int)_commsChannelIDs.size()) ? 
+                _commsChannelIDs[slotIdx] : CommsCoreIF::CHANNEL_ID_UNDEFINED;
+
+    // Check the comms channel can accept the message
+    if (!readOp && _pCommsCoreIF && (channelID != CommsCoreIF::CHANNEL_ID_UNDEFINED) && 
+                !_pCommsCoreIF->inboundCanAccept(channelID))
+        return false;
+
     // Check for test frames (used to determine performance of the link)
-    if ((payloadlength > 10) && (payloadbuffer[5] == 0x1f) && (payloadbuffer[6] == 0x9d) && (payloadbuffer[7] == 0xf4) && (payloadbuffer[8] == 0x7a) && (payloadbuffer[9] == 0xb5))
+    if (pConnState && (payloadlength > 10) && (payloadbuffer[5] == 0x1f) && (payloadbuffer[6] == 0x9d) && (payloadbuffer[7] == 0xf4) && (payloadbuffer[8] == 0x7a) && (payloadbuffer[9] == 0xb5))
     {
         // Get msg count
         uint32_t inMsgCount = (payloadbuffer[1] << 24)
                     | (payloadbuffer[2] << 16)
                     | (payloadbuffer[3] << 8)
                     | payloadbuffer[4];
-        bool isSeqOk = inMsgCount == _lastTestMsgCount+1;
+        bool isSeqOk = inMsgCount == pConnState->lastTestMsgCount+1;
         bool isFirst = inMsgCount == 0;
         if (isFirst)
         {
-            _testPerfPrbsState = 1;
+            pConnState->testPerfPrbsState = 1;
             _bleStats.clearTestPerfStats();
             isSeqOk = true;
         }
-        _lastTestMsgCount = inMsgCount;
+        pConnState->lastTestMsgCount = inMsgCount;
         
         // Check test message valid
         bool isDataOk = true;
         for (uint32_t i = 10; i < payloadlength; i++) {
-            _testPerfPrbsState = Raft::parkMillerNext(_testPerfPrbsState);
-            if (payloadbuffer[i] != (_testPerfPrbsState & 0xff)) {
+            pConnState->testPerfPrbsState = Raft::parkMillerNext(pConnState->testPerfPrbsState);
+            if (payloadbuffer[i] != (pConnState->testPerfPrbsState & 0xff)) {
                 isDataOk = false;
             }
         }
@@ -631,9 +770,9 @@ void BLEGapServer::gattAccessCallback(const char* characteristicName, bool readO
     }
     if (!readOp)
     {
-        // Send the message to the comms channel if this is a write to the characteristic
-        if (_pCommsCoreIF)
-            _pCommsCoreIF->inboundHandleMsg(_commsChannelID, payloadbuffer, payloadlength);
+        // Send the message to the comms channel for the connection if this is a write to the characteristic
+        if (_pCommsCoreIF && (channelID != CommsCoreIF::CHANNEL_ID_UNDEFINED))
+            _pCommsCoreIF->inboundHandleMsg(channelID, payloadbuffer, payloadlength);
 
 #ifdef DEBUG_BLE_RX_PAYLOAD
         // Debug
@@ -644,6 +783,7 @@ void BLEGapServer::gattAccessCallback(const char* characteristicName, bool readO
         LOG_I(MODULE_PREFIX, "gatt rx payloadLen %d payload %s", sz, outStr.c_str());
 #endif
     }
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -655,12 +795,13 @@ void BLEGapServer::gattAccessCallback(const char* characteristicName, bool readO
 bool BLEGapServer::isReadyToSend(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn)
 {
     noConn = false;
-    if (!_isInit || !_isConnected)
+    int slotIdx = getSlotIdxForChannel(channelID);
+    if (!_isInit || (slotIdx < 0) || !_gattServer.isSlotConnected(slotIdx))
     {
         noConn = true;
         return false;
     }
-    return _gattServer.isReadyToSend(channelID, msgType, noConn);
+    return _gattServer.isReadyToSend(slotIdx, msgType, noConn);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -669,35 +810,27 @@ bool BLEGapServer::isReadyToSend(uint32_t channelID, CommsMsgTypeCode msgType, b
 /// @return true if the message was successfully sent
 bool BLEGapServer::sendBLEMsg(CommsChannelMsg& msg)
 {
-    if (!_isInit)
+    int slotIdx = getSlotIdxForChannel(msg.getChannelID());
+    if (!_isInit || (slotIdx < 0))
         return false;
-    return _gattServer.sendMsg(msg);
+    return _gattServer.sendMsg(slotIdx, msg);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Set the connection state of the BLE server
-/// This function updates the internal state to reflect whether a BLE connection is active and sets the connection handle.
-/// It also updates the GATT server's connection state and notifies any registered status change handlers.
-/// @param isConnected True if the BLE connection is established, false otherwise.
-/// @param connHandle The connection handle associated with the current BLE connection.
-void BLEGapServer::setConnState(bool isConnected, uint16_t connHandle)
+/// @brief Update state after the number of connections has changed
+/// Advertising continues (checked in loop) while there are free connection slots and any registered status
+/// change handlers are informed of the connected state (connected to at least one central)
+void BLEGapServer::onConnCountChange()
 {
 #ifdef USE_TIMED_ADVERTISING_CHECK
     // Reset timer for advertising check
-    _advertisingCheckRequired = !isConnected;
+    _advertisingCheckRequired = _numConnections < _bleConfig.maxConns;
     _advertisingCheckMs = millis();
 #endif
 
-    // Connected state change
-    _isConnected = isConnected;
-    _bleGapConnHandle = connHandle;
-
-    // Set into GATT
-    _gattServer.setConnState(isConnected, connHandle);
-    
     // Inform hooks of status change
     if (_statusChangeFn)
-        _statusChangeFn(isConnected);
+        _statusChangeFn(isConnected());
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -875,8 +1008,9 @@ String BLEGapServer::getGapEventName(int eventType)
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Handle a GAP connection event when a new BLE connection is established or a connection attempt fails
 /// This function processes the connection event, updates the connection handle, and sets the connection state.
-/// If the connection is successful, it sets the preferred MTU size and connection parameters. If the connection fails,
-/// it attempts to resume advertising.
+/// If the connection is successful, it allocates a connection slot (the connection is terminated if all slots are in use)
+/// and sets the preferred MTU size and connection parameters. Advertising continues while there are free slots.
+/// If the connection fails, it attempts to resume advertising.
 /// @param event GAP event structure containing details about the connection event
 /// @param statusStr string reference that will be updated with the connection status (e.g., "conn-ok" or "conn-fail")
 /// @param connHandle reference to the connection handle that will be updated if the connection is established
@@ -890,7 +1024,18 @@ int BLEGapServer::gapEventConnect(struct ble_gap_event *event, String& statusStr
         // Return values
         statusStr = "conn-ok";
         connHandle = event->connect.conn_handle;
-        
+
+        // Allocate a connection slot
+        _gattServer.connSlotOpen(event->connect.conn_handle);
+        ConnState* pConnState = getConnState(event->connect.conn_handle);
+        if (!pConnState)
+        {
+            statusStr = "conn-limit";
+            _gattServer.connSlotClose(event->connect.conn_handle);
+            ble_gap_terminate(event->connect.conn_handle, BLE_ERR_CONN_LIMIT);
+            return NIMBLE_RETC_OK;
+        }
+
         // Request preferred MTU
         rc = ble_att_set_preferred_mtu(_gattServer.getPreferredMTUSize());
         if (rc != NIMBLE_RETC_OK) 
@@ -924,20 +1069,54 @@ int BLEGapServer::gapEventConnect(struct ble_gap_event *event, String& statusStr
                             _bleConfig.llPacketLengthPref,
                             _bleConfig.llPacketTimePref);
 #endif
+        // Adaptive link - request 2M PHY and DLE for this connection (the peer may decline)
+        pConnState->linkManager.onConnect(millis());
+        if (pConnState->linkManager.isAdaptive())
+        {
+#if SOC_BLE_50_SUPPORTED
+            rc = ble_gap_set_prefered_le_phy(event->connect.conn_handle, 
+                            BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+            if (rc != NIMBLE_RETC_OK)
+            {
+                LOG_W(MODULE_PREFIX, "nimbleGAPEvent conn failed to request 2M PHY; rc = %d", rc);
+            }
+#endif
+            rc = ble_hs_hci_util_set_data_len(event->connect.conn_handle,
+                            _bleConfig.llPacketLengthPref,
+                            _bleConfig.llPacketTimePref);
+            if (rc != NIMBLE_RETC_OK)
+            {
+                LOG_W(MODULE_PREFIX, "nimbleGAPEvent conn failed to set data len; rc = %d", rc);
+            }
+            rc = NIMBLE_RETC_OK;
+        }
+        struct ble_gap_conn_desc desc;
+        if (ble_gap_conn_find(event->connect.conn_handle, &desc) == NIMBLE_RETC_OK)
+            pConnState->linkManager.onConnParams(desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+
         // Conn interval check pending
-        _connIntervalCheckPending = true;
-        _connIntervalCheckPendingStartMs = millis();
+        pConnState->connIntervalCheckPending = true;
+        pConnState->connIntervalCheckPendingStartMs = millis();
         
         // Now connected
-        setConnState(true, event->connect.conn_handle);
+        _numConnections++;
+        onConnCountChange();
+
+        // Continue advertising if more connections are allowed
+        if (_bleConfig.enPeripheral && (_numConnections < _bleConfig.maxConns) && !startAdvertising())
+        {
+#ifdef WARN_ON_BLE_ADVERTISING_START_FAILURE
+            LOG_W(MODULE_PREFIX, "nimbleGAPEvent conn start advertising for more connections FAILED");
+#endif
+        }
     }
     else
     {
         // Return values
         statusStr = "conn-fail";
 
-        // Not connected
-        setConnState(false);
+        // Connection count unchanged
+        onConnCountChange();
 
         // Check if peripheral mode is enabled
         if (_bleConfig.enPeripheral)
@@ -972,8 +1151,16 @@ int BLEGapServer::gapEventDisconnect(struct ble_gap_event *event, String& status
     statusStr = "disconn reason " + BLEGattServer::getHSErrorMsg(event->disconnect.reason);
     connHandle = event->disconnect.conn.conn_handle;
 
-    // Connection terminated
-    setConnState(false);
+    // Connection terminated - free the connection slot (connections rejected due to the limit have no slot)
+    ConnState* pConnState = getConnState(event->disconnect.conn.conn_handle);
+    if (pConnState)
+    {
+        pConnState->linkManager.onDisconnect();
+        pConnState->connIntervalCheckPending = false;
+    }
+    if ((_gattServer.connSlotClose(event->disconnect.conn.conn_handle) >= 0) && (_numConnections > 0))
+        _numConnections--;
+    onConnCountChange();
 
     // Check if we should restart - peripheral mode
     if (_bleConfig.enPeripheral)
@@ -1002,14 +1189,41 @@ int BLEGapServer::gapEventConnUpdate(struct ble_gap_event *event, String& status
     statusStr = BLEGattServer::getHSErrorMsg(event->conn_update.status);
     // Check if conn interval is greater than the one we want
     connHandle = event->conn_update.conn_handle;
+    int slotIdx = _gattServer.getConnSlotIdx(event->conn_update.conn_handle);
+    ConnState* pConnState = getConnState(event->conn_update.conn_handle);
+    if (!pConnState)
+        return NIMBLE_RETC_OK;
     struct ble_gap_conn_desc desc;
     int rc = ble_gap_conn_find(event->conn_update.conn_handle, &desc);
-    if ((rc == NIMBLE_RETC_OK) && _connIntervalCheckPending && (desc.conn_itvl != _bleConfig.getConnIntervalPrefBLEUnits()))
+    if (rc == NIMBLE_RETC_OK)
+        pConnState->linkManager.onConnParams(desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+    uint16_t connIntervalBLEUnits = _bleConfig.getConnIntervalPrefBLEUnits();
+    uint16_t connLatency = _bleConfig.connLatencyPref;
+    pConnState->linkManager.getTargetConnParams(connIntervalBLEUnits, connLatency);
+    if ((rc == NIMBLE_RETC_OK) && pConnState->connIntervalCheckPending && (desc.conn_itvl != connIntervalBLEUnits))
     {
         // Request conn interval we want
-        requestConnInterval();
+        requestConnInterval(slotIdx);
     }
-    _connIntervalCheckPending = false;
+    pConnState->connIntervalCheckPending = false;
+    return NIMBLE_RETC_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle a GAP PHY update complete event
+/// The negotiated PHY is recorded for status reporting
+/// @param event GAP event structure containing details about the PHY update
+/// @param statusStr string reference that will be updated with the status of the PHY update
+/// @param connHandle reference to the connection handle that will be updated with the handle of the connection
+/// @return NIMBLE_RETC_OK if the event was handled successfully
+int BLEGapServer::gapEventPhyUpdate(struct ble_gap_event *event, String& statusStr, int& connHandle)
+{
+    statusStr = BLEGattServer::getHSErrorMsg(event->phy_updated.status) + 
+                ",txPhy:" + String(event->phy_updated.tx_phy) + ",rxPhy:" + String(event->phy_updated.rx_phy);
+    connHandle = event->phy_updated.conn_handle;
+    ConnState* pConnState = getConnState(event->phy_updated.conn_handle);
+    if (pConnState && (event->phy_updated.status == 0))
+        pConnState->linkManager.onPhy(event->phy_updated.tx_phy, event->phy_updated.rx_phy);
     return NIMBLE_RETC_OK;
 }
 
@@ -1040,7 +1254,14 @@ int BLEGapServer::gapEventRepeatPairing(struct ble_gap_event *event)
 /// @return NIMBLE_RETC_OK if the event was handled successfully.
 int BLEGapServer::gapEventDiscovery(struct ble_gap_event *event, String& statusStr)
 {
-    // Parse the advertisement data
+    // Discard advertisements which don't pass the scan filter before doing anything else
+    if (_scanFilter.isActive() && 
+                !_scanFilter.isAccepted(event->disc.addr.val, event->disc.data, event->disc.length_data))
+        return NIMBLE_RETC_OK;
+
+    // Full parsing of the advertisement data is only done when debugging as BTHome decoding only needs
+    // the service data which is found in a single pass (there can be hundreds of adverts per second)
+#ifdef DEBUG_BLE_SCAN_FULL_ADV_PARSE
     struct ble_hs_adv_fields fields;
     int rc = ble_hs_adv_parse_fields(&fields, event->disc.data,
                                     event->disc.length_data);
@@ -1050,6 +1271,7 @@ int BLEGapServer::gapEventDiscovery(struct ble_gap_event *event, String& statusS
 #endif
         return rc;
     }
+#endif
 
     // Check if BTHome is enabled - in which case decode the packet
     if (_bleConfig.scanBTHome)
@@ -1067,7 +1289,11 @@ int BLEGapServer::gapEventDiscovery(struct ble_gap_event *event, String& statusS
         }
 
         // Decode the packet
+#ifdef DEBUG_BLE_SCAN_FULL_ADV_PARSE
         _bleAdvertDecoder.decodeAdEvent(event, fields, _pBusDevicesIF);
+#else
+        _bleAdvertDecoder.decodeAdEventBTHomeOnly(event, _pBusDevicesIF);
+#endif
     }
 
     // Debug
@@ -1131,14 +1357,14 @@ bool BLEGapServer::loopRestartHandler()
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Periodically check if BLE advertising needs to be restarted if the device is not connected.
-/// This function handles the timed advertising check and ensures that advertising is restarted if it's not already active and the device is not connected.
+/// @brief Periodically check if BLE advertising needs to be restarted if the device can accept more connections.
+/// This function handles the timed advertising check and ensures that advertising is restarted if it's not already active and there are free connection slots.
 /// It is expected to be called on the main task loop and uses a timeout mechanism to periodically perform the check and restart advertising if necessary.
 void BLEGapServer::serviceTimedAdvertisingCheck()
 {
 #ifdef USE_TIMED_ADVERTISING_CHECK
     // Handle advertising check
-    if (_bleConfig.enPeripheral && (!_isConnected) && (_advertisingCheckRequired))
+    if (_bleConfig.enPeripheral && (_numConnections < _bleConfig.maxConns) && (_advertisingCheckRequired))
     {
         if (Raft::isTimeout(millis(), _advertisingCheckMs, ADVERTISING_CHECK_MS))
         {
@@ -1148,7 +1374,7 @@ void BLEGapServer::serviceTimedAdvertisingCheck()
             {
                 // Debug
 #ifdef WARN_ON_BLE_ADVERTISING
-                LOG_W(MODULE_PREFIX, "loop not conn or adv so start advertising");
+                LOG_W(MODULE_PREFIX, "loop conn slot free and not adv so start advertising");
 #endif
 
                 // Start advertising
@@ -1186,17 +1412,20 @@ void BLEGapServer::serviceTimedAdvertisingCheck()
 /// If the RSSI retrieval fails, the RSSI value is set to 0.
 void BLEGapServer::updateRSSICachedValue()
 {
-    // Get RSSI value if connected - not too often as getting RSSI info can take ~2ms
+    // Get RSSI value (of the first connection) if connected - not too often as getting RSSI info can take ~2ms
     if (Raft::isTimeout(millis(), _rssiLastMs, RSSI_CHECK_MS))
     {
         _rssiLastMs = millis();
         _rssi = 0;
-        if (_isConnected)
+        uint32_t slotIdx = 0;
+        while ((slotIdx < _gattServer.getNumConnSlots()) && !_gattServer.isSlotConnected(slotIdx))
+            slotIdx++;
+        if (slotIdx < _gattServer.getNumConnSlots())
         {
 #ifdef DEBUG_RSSI_GET_TIME
             uint64_t startUs = micros();
 #endif
-            int rslt = ble_gap_conn_rssi(_bleGapConnHandle, &_rssi);
+            int rslt = ble_gap_conn_rssi(_gattServer.getSlotConnHandle(slotIdx), &_rssi);
 #ifdef DEBUG_RSSI_GET_TIME
             uint64_t endUs = micros();
             LOG_I(MODULE_PREFIX, "loop get RSSI %d us", (int)(endUs - startUs));
@@ -1213,18 +1442,27 @@ void BLEGapServer::updateRSSICachedValue()
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Request update to the BLE connection interval params based on the preferred connection parameters
-/// This function sends a request to update the connection interval, latency, and supervision timeout to the preferred values.
-void BLEGapServer::requestConnInterval()
+/// This function sends a request to update the connection interval, latency, and supervision timeout to the preferred values
+/// (or the idle values if the link manager has relaxed the link).
+/// @param slotIdx connection slot
+void BLEGapServer::requestConnInterval(uint32_t slotIdx)
 {
+    if ((slotIdx >= _connStates.size()) || !_gattServer.isSlotConnected(slotIdx))
+        return;
+    uint16_t connIntervalBLEUnits = _bleConfig.getConnIntervalPrefBLEUnits();
+    uint16_t connLatency = _bleConfig.connLatencyPref;
+    _connStates[slotIdx].linkManager.getTargetConnParams(connIntervalBLEUnits, connLatency);
+    uint32_t supvTimeoutMs = std::max((uint32_t)_bleConfig.supvTimeoutPrefMs, 
+                BLELinkManager::getMinSupvTimeoutMs(connIntervalBLEUnits, connLatency));
     struct ble_gap_upd_params params;
     memset(&params, 0, sizeof(params));
-    params.itvl_min = _bleConfig.getConnIntervalPrefBLEUnits();
-    params.itvl_max = _bleConfig.getConnIntervalPrefBLEUnits();
-    params.latency = _bleConfig.connLatencyPref;
-    params.supervision_timeout = _bleConfig.supvTimeoutPrefMs / 10;
+    params.itvl_min = connIntervalBLEUnits;
+    params.itvl_max = connIntervalBLEUnits;
+    params.latency = connLatency;
+    params.supervision_timeout = std::min(supvTimeoutMs / 10, (uint32_t)BLE_SUPV_TIMEOUT_MAX_10MS);
     params.min_ce_len = 0x0001;
     params.max_ce_len = 0x0001;
-    int rc = ble_gap_update_params(_bleGapConnHandle, &params);
+    int rc = ble_gap_update_params(_gattServer.getSlotConnHandle(slotIdx), &params);
     if (rc != NIMBLE_RETC_OK)
     {
         LOG_W(MODULE_PREFIX, "requestConnInterval FAILED rc = %d", rc);
@@ -1234,9 +1472,10 @@ void BLEGapServer::requestConnInterval()
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Start BLE scanning
 /// This function starts BLE scanning in the central role to discover nearby BLE devices.
-/// It uses the general discovery mode and sets the scanning interval and window to the specified values.
+/// It uses the general discovery mode and sets the scanning interval and window from the scan scheduler.
+/// @param isRestart true if restarting (with new parameters) a scan which is already in progress
 /// @return true if scanning was started successfully
-bool BLEGapServer::startScanning()
+bool BLEGapServer::startScanning(bool isRestart)
 {
     if (!_isInit)
         return false;
@@ -1250,13 +1489,18 @@ bool BLEGapServer::startScanning()
         return true;
     }
 
+    // Load the controller filter accept list (this can't be changed while scanning so a restart keeps it)
+    if (!isRestart)
+        setScanFilterAcceptList();
+
     // Set scanning parameters
     struct ble_gap_disc_params disc_params;
     memset(&disc_params, 0, sizeof disc_params);
     disc_params.passive = _bleConfig.scanPassive;
-    disc_params.itvl = _bleConfig.scanningIntervalMs / 0.625;
-    disc_params.window = _bleConfig.scanningWindowMs / 0.625;
+    disc_params.itvl = _scanScheduler.getScanIntervalMs() / 0.625;
+    disc_params.window = _scanScheduler.getScanWindowMs() / 0.625;
     disc_params.filter_duplicates = _bleConfig.scanNoDuplicates;
+    disc_params.filter_policy = _scanFilter.isControllerListActive() ? BLE_HCI_SCAN_FILT_USE_WL : BLE_HCI_SCAN_FILT_NO_WL;
 
     // Check how long to scan for
     uint32_t scanForMs = ((uint32_t)_bleConfig.scanForSecs) * 1000;
@@ -1265,6 +1509,16 @@ bool BLEGapServer::startScanning()
         // Scan indefinitely
         scanForMs = INT32_MAX;
     }
+    else if (isRestart)
+    {
+        // Continue for the remainder of the original scan duration
+        uint32_t elapsedMs = millis() - _scanStartedMs;
+        if (elapsedMs >= scanForMs)
+            return false;
+        scanForMs -= elapsedMs;
+    }
+    if (!isRestart)
+        _scanStartedMs = millis();
 
     // Start scanning
     int rc = ble_gap_disc(_ownAddrType, scanForMs, &disc_params,
@@ -1284,4 +1538,38 @@ bool BLEGapServer::startScanning()
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Load the scan filter MAC addresses into the controller filter accept list
+/// Each address is added as both public and random as the address type isn't configured. If the addresses
+/// can't all be loaded the controller list isn't used and filtering is done in the host only.
+void BLEGapServer::setScanFilterAcceptList()
+{
+    std::vector<uint8_t> listAddrs;
+    bool isListActive = false;
+    if (_scanFilter.getControllerListAddrs(listAddrs))
+    {
+        ble_addr_t addrs[BLEScanFilter::MAX_CONTROLLER_LIST_LEN];
+        uint32_t numAddrs = 0;
+        for (uint32_t pos = 0; (pos + sizeof(addrs[0].val) <= listAddrs.size()) && (numAddrs + 2 <= BLEScanFilter::MAX_CONTROLLER_LIST_LEN); 
+                        pos += sizeof(addrs[0].val))
+        {
+            for (uint8_t addrType : { BLE_ADDR_PUBLIC, BLE_ADDR_RANDOM })
+            {
+                addrs[numAddrs].type = addrType;
+                memcpy(addrs[numAddrs].val, listAddrs.data() + pos, sizeof(addrs[0].val));
+                numAddrs++;
+            }
+        }
+        int rc = ble_gap_wl_set(addrs, numAddrs);
+        if (rc == NIMBLE_RETC_OK)
+            isListActive = true;
+        else
+            LOG_W(MODULE_PREFIX, "setScanFilterAcceptList FAILED rc=%d (filtering in host only)", rc);
+    }
+    _scanFilter.setControllerListActive(isListActive);
+#ifdef DEBUG_BLE_SCAN_START_STOP
+    LOG_I(MODULE_PREFIX, "setScanFilterAcceptList %s", isListActive ? "controller list active" : "controller list not used");
+#endif
+}
+
 #endif // CONFIG_BT_ENABLED
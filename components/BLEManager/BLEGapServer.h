@@ -23,6 +23,10 @@
 #include "CommsCoreIF.h"
 #include "BLEConfig.h"
 #include "BLEAdvertDecoder.h"
+#include "BLELinkManager.h"
+#include "BLEScanScheduler.h"
+#include "BLEScanFilter.h"
+#include "BLEJSONWriter.h"
 
 #define USE_TIMED_ADVERTISING_CHECK 1
 
@@ -70,10 +74,65 @@ public:
     /// @return The status of the BLEGapServer as a JSON string
     String getStatusJSON(bool includeBraces, bool shortForm) const;
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write the status of the BLEGapServer as JSON
+    /// @param writer writer
+    /// @param includeBraces if true, the JSON will be enclosed in braces
+    /// @param shortForm if true, the JSON will be in a short form
+    void writeStatusJSON(BLEJSONWriter& writer, bool includeBraces, bool shortForm) const;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Restart the BLEGapServer (by stopping and restarting the BLE stack)
     void restart();
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Start an outbound throughput test (PRBS test frames sent through the outbound path)
+    /// @param frameLen length of each test frame
+    /// @param numFrames number of frames to send (0 for no limit)
+    /// @param maxDurationMs max duration of the test (0 for no limit)
+    /// @return true if the test was started (a connection is required - the test runs on the first connection)
+    bool startOutboundTest(uint32_t frameLen, uint32_t numFrames, uint32_t maxDurationMs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Stop the outbound throughput test
+    void stopOutboundTest()
+    {
+        BLEGattOutbound* pOutbound = _gattServer.getOutbound(_outboundTestSlotIdx);
+        if (pOutbound)
+            pOutbound->stopOutboundTest();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get outbound throughput test results as JSON
+    /// @return JSON string (without braces)
+    String getOutboundTestJSON()
+    {
+        BLEGattOutbound* pOutbound = _gattServer.getOutbound(_outboundTestSlotIdx);
+        return pOutbound ? pOutbound->getOutboundTestJSON() : R"("active":0)";
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get BLE stats including outbound histograms as JSON
+    /// @return JSON string (without braces)
+    String getStatsJSON() const
+    {
+        char scanBuf[200];
+        BLEJSONWriter scanWriter(scanBuf, sizeof(scanBuf));
+        _scanScheduler.writeJSON(scanWriter);
+        scanWriter.append(",", 1);
+        _scanFilter.writeJSON(scanWriter);
+        return _bleStats.getJSON(false, false) + "," + _bleStats.getHistogramsJSON(false) + "," + scanBuf;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear BLE stats and histograms
+    void clearStats()
+    {
+        _bleStats.clear();
+        _scanScheduler.clearStats();
+        _scanFilter.clearStats();
+    }
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Register BLEGapServer as a communication channel with the Raft CommsCore interface
     /// @param commsCoreIF reference to the CommsCore interface
@@ -87,10 +146,10 @@ public:
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Check if the BLE server is connected
-    /// @return true if the BLE server is connected
+    /// @return true if the BLE server is connected (to at least one central)
     bool isConnected() const
     {
-        return _isConnected;
+        return _numConnections > 0;
     }
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -105,7 +164,8 @@ public:
         if (reqConnIntervalBLEUnits != _bleConfig.connIntervalPreferredBLEUnits)
         {
             _bleConfig.connIntervalPreferredBLEUnits = reqConnIntervalBLEUnits;
-            _connIntervalCheckPending = true;
+            for (ConnState& connState : _connStates)
+                connState.connIntervalCheckPending = true;
         }
     }
 
@@ -122,6 +182,9 @@ private:
     // BLE device initialised
     bool _isInit = false;
 
+    // Status JSON is written into a stack buffer of this size when it fits
+    static const uint32_t STATUS_JSON_STACK_BUF_LEN = 512;
+
     // Get advertising name function
     GetAdvertisingNameFnType _getAdvertisingNameFn = nullptr;
     static const uint32_t BLE_GAP_MAX_ADV_NAME_LEN = 31;
@@ -146,12 +209,11 @@ private:
     // BLE Bus device manager
     RaftBusDevicesIF* _pBusDevicesIF = nullptr;
 
-    // ChannelID used to identify this message channel to the CommsCoreIF
-    uint32_t _commsChannelID = CommsCoreIF::CHANNEL_ID_UNDEFINED;
+    // ChannelIDs used to identify the message channel for each connection slot to the CommsCoreIF
+    std::vector<uint32_t> _commsChannelIDs;
 
-    // Status
-    bool _isConnected = false;
-    uint16_t _bleGapConnHandle = 0;
+    // Number of connections
+    uint32_t _numConnections = 0;
 
     // Cached RSSI value - updated regularly in loop()
     int8_t _rssi = 0;
@@ -163,8 +225,7 @@ private:
 
     // BLE performance testing
     static const uint32_t TEST_THROUGHPUT_MAX_PAYLOAD = 500;
-    uint32_t _testPerfPrbsState = 1;
-    uint32_t _lastTestMsgCount = 0;
+    uint32_t _outboundTestSlotIdx = 0;
 
     // BLE restart state
     enum BLERestartState
@@ -185,11 +246,36 @@ private:
     static const uint32_t ADVERTISING_CHECK_MS = 3000;
 #endif
 
-    // Check connection interval some time after connection
-    bool _connIntervalCheckPending = false;
-    uint32_t _connIntervalCheckPendingStartMs = 0;
+    // State for each connection slot (slots are allocated by the GATT server)
+    struct ConnState
+    {
+        // Check connection interval some time after connection
+        bool connIntervalCheckPending = false;
+        uint32_t connIntervalCheckPendingStartMs = 0;
+
+        // Link manager (adapts conn params to traffic and records negotiated params)
+        BLELinkManager linkManager;
+
+        // Inbound test frame state
+        uint32_t testPerfPrbsState = 1;
+        uint32_t lastTestMsgCount = 0;
+    };
+    std::vector<ConnState> _connStates;
+    ConnState* getConnState(uint16_t connHandle)
+    {
+        int slotIdx = _gattServer.getConnSlotIdx(connHandle);
+        return (slotIdx >= 0) && (slotIdx < (int)_connStates.size()) ? &_connStates[slotIdx] : nullptr;
+    }
     static const uint32_t CONN_INTERVAL_CHECK_MS = 200;
 
+    // Scan scheduler (adapts the scan window to connection traffic) and time the current scan was started
+    BLEScanScheduler _scanScheduler;
+    uint32_t _scanStartedMs = 0;
+
+    // Scan filter (applied to advertisements before decoding)
+    BLEScanFilter _scanFilter;
+    static const uint32_t BLE_SUPV_TIMEOUT_MAX_10MS = 3200;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Start BLE advertising
     /// @return true if advertising started successfully
@@ -205,8 +291,13 @@ private:
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Start BLE scanning
+    /// @param isRestart true if restarting (with new parameters) a scan which is already in progress
     /// @return true if scanning was started successfully
-    bool startScanning();
+    bool startScanning(bool isRestart = false);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Load the scan filter MAC addresses into the controller filter accept list
+    void setScanFilterAcceptList();
     
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Callback function triggered when the BLE stack synchronization occurs
@@ -227,18 +318,24 @@ private:
     int nimbleGapEvent(struct ble_gap_event *event);
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief Set the connection state of the BLE server
-    /// @param isConnected True if the BLE connection is established, false otherwise.
-    /// @param connHandle The connection handle associated with the current BLE connection.
-    void setConnState(bool isConnected, uint16_t connHandle = 0);
+    /// @brief Update state after the number of connections has changed
+    void onConnCountChange();
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the connection slot index for a comms channel
+    /// @param channelID comms channel ID
+    /// @return slot index or -1 if not found
+    int getSlotIdxForChannel(uint32_t channelID) const;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Callback function for GATT characteristic access
+    /// @param connHandle connection handle of the central accessing the characteristic
     /// @param characteristicName name of the GATT characteristic being accessed
     /// @param readOp true if the operation is a read; false if it is a write
     /// @param payloadbuffer pointer to the buffer containing the data being read or written
     /// @param payloadlength length of the data in the payload buffer
-    void gattAccessCallback(const char* characteristicName, bool readOp, const uint8_t *payloadbuffer, int payloadlength);
+    /// @return false if the comms channel can't accept the message yet (it will be offered again)
+    bool gattAccessCallback(uint16_t connHandle, const char* characteristicName, bool readOp, const uint8_t *payloadbuffer, int payloadlength);
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Check if a restart of the BLE service is required and handles the restart process.
@@ -267,6 +364,10 @@ private:
     /// @brief Handle a GAP connection update event
     int gapEventConnUpdate(struct ble_gap_event *event, String& statusStr, int& connHandle);
     
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Handle a GAP PHY update complete event
+    int gapEventPhyUpdate(struct ble_gap_event *event, String& statusStr, int& connHandle);
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Handle a GAP repeat pairing event
     int gapEventRepeatPairing(struct ble_gap_event *event);
@@ -307,7 +408,7 @@ private:
     static void print_addr(const uint8_t *addr);
     bool nimbleStart();
     bool nimbleStop();
-    void requestConnInterval();
+    void requestConnInterval(uint32_t slotIdx);
 
 #else // CONFIG_BT_ENABLED
 
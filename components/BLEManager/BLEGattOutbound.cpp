@@ -24,7 +24,7 @@
 BLEGattOutbound::BLEGattOutbound(BLEGattServer& gattServer, BLEManStats& bleStats) :
         _gattServer(gattServer),
         _bleStats(bleStats),
-        _outboundQueue(BLEConfig::DEFAULT_OUTBOUND_MSG_QUEUE_SIZE)
+        _outboundQueues{BLEConfig::DEFAULT_OUTBOUND_MSG_QUEUE_SIZE, BLEConfig::DEFAULT_OUTBOUND_MSG_QUEUE_SIZE}
 {
     _inFlightMutex = xSemaphoreCreateMutex();
 }
@@ -48,9 +48,14 @@ bool BLEGattOutbound::setup(const BLEConfig& bleConfig)
     _outMsgsInFlightMax = bleConfig.outMsgsInFlightMax;
     _outMsgsInFlightTimeoutMs = bleConfig.outMsgsInFlightTimeoutMs;
     _minMsBetweenSends = bleConfig.minMsBetweenSends;
+    _sendWindowed = bleConfig.sendWindowed;
+    _inFlightWindow.setup(_sendWindowed ? _outMsgsInFlightMax : 1, _outMsgsInFlightTimeoutMs);
+    _notifyTxWindow.setup(BLEOutboundWindow::MAX_WINDOW_SIZE, NOTIFY_TX_TIMEOUT_MS);
+    _sendPacked = bleConfig.sendPacked;
 
-    // Setup queue
-    _outboundQueue.setMaxLen(bleConfig.outboundQueueSize);
+    // Setup queues
+    for (OutboundMsgQueue& queue : _outboundQueues)
+        queue.setMaxLen(bleConfig.outboundQueueSize);
 
     // Check if a thread should be started for sending
     if (bleConfig.useTaskForSending)
@@ -81,6 +86,9 @@ bool BLEGattOutbound::setup(const BLEConfig& bleConfig)
 
 void BLEGattOutbound::loop()
 {
+    // Generate outbound test frames if a test is running
+    serviceOutboundTest();
+
     // Service the outbound queue
     serviceOutboundQueue();
 }
@@ -95,6 +103,20 @@ void BLEGattOutbound::stop()
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set connection handle
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattOutbound::setConnHandle(uint16_t connHandle)
+{
+    _connHandle = connHandle;
+    _actualMtuSize = _preferredMtuSize;
+
+    // The slot may have been used by a previous connection so request the sender resets the queues
+    _connResetReq = true;
+    wakeOutboundTask();
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Service outbound queue
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -112,12 +134,14 @@ void BLEGattOutbound::serviceOutboundQueue()
 
 bool BLEGattOutbound::isReadyToSend(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn)
 {
-    // Only send PUBLISH messages if nothing else pending
+    // Only send PUBLISH messages if no other publish is pending (responses etc have their own lane and
+    // take priority over publish messages when sending)
     if (msgType == MSG_TYPE_PUBLISH)
-        return (!_sendUsingIndication || (_outboundMsgsInFlight == 0)) && (_outboundQueue.count() == 0);
+        return (!_sendUsingIndication || (getNumMsgsInFlight() == 0)) && (_outboundQueues[OUTBOUND_LANE_PUBLISH].count() == 0);
 
-    // Check the queue is empty
-    return _outboundQueue.count() < _outboundQueue.maxLen();
+    // Check the queue has space
+    const OutboundMsgQueue& queue = _outboundQueues[OUTBOUND_LANE_RESPONSE];
+    return queue.count() < queue.maxLen();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -138,13 +162,17 @@ bool BLEGattOutbound::sendMsg(CommsChannelMsg& msg)
 #endif
 #endif
 
-    // Add to the queue
-    ProtocolRawMsg bleOutMsg(msg.getBuf(), msg.getBufLen());
-    bool putOk = _outboundQueue.put(bleOutMsg);
+    // Add to the queue for the lane
+    OutboundLane lane = msg.getMsgTypeCode() == MSG_TYPE_PUBLISH ? OUTBOUND_LANE_PUBLISH : OUTBOUND_LANE_RESPONSE;
+    bool putOk = _outboundQueues[lane].put(msg.getBuf(), msg.getBufLen());
     if (!putOk)
     {
         LOG_W(MODULE_PREFIX, "sendBLEMsg FAILEDTOSEND totalLen %d", msg.getBufLen());
     }
+
+    // Wake the outbound task
+    if (putOk)
+        wakeOutboundTask();
     return putOk;
 }
 
@@ -154,24 +182,33 @@ bool BLEGattOutbound::sendMsg(CommsChannelMsg& msg)
 
 bool BLEGattOutbound::handleSendFromOutboundQueue()
 {
+    // Discard messages (and any partly sent message) left from a previous connection in this slot
+    if (_connResetReq.exchange(false))
+        resetOutboundQueues();
+
     // When using send with indication we get a confirmation of each packet being sent and this is used to
-    // control the rate of sending. When not using indication we send using timed intervals.
+    // control the rate of sending - up to the window size of chunks may be awaiting confirmation. When not
+    // using indication we send using timed intervals.
     if (_sendUsingIndication)
     {
-        // Check if less than the max number of messages in flight
-        if (_outboundMsgsInFlight > 0)
-        {
-            // Check for timeout on in flight messages
-            if (Raft::isTimeout(millis(), _outbountMsgInFlightLastMs, _outMsgsInFlightTimeoutMs))
-            {
-                // Debug
-                LOG_W(MODULE_PREFIX, "loop outbound msg timeout");
-
-                // Timeout so clear the in flight count
-                _outboundMsgsInFlight = 0;
-            }
+        // Reclaim credits for chunks which have not been confirmed in time and check if a credit is available
+        if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) != pdTRUE)
             return false;
+        uint32_t numTimedOut = _inFlightWindow.reclaimTimedOut(millis());
+        bool creditAvailable = _inFlightWindow.canSend();
+        xSemaphoreGive(_inFlightMutex);
+
+        // Handle timeouts
+        if (numTimedOut > 0)
+        {
+            // Debug
+            LOG_W(MODULE_PREFIX, "loop outbound msg timeout numChunks %d", numTimedOut);
+            _bleStats.txTimeout(numTimedOut);
+            if (_outboundTest.isActive())
+                _outboundTest.onTimeout(numTimedOut);
         }
+        if (!creditAvailable)
+            return false;
     }
 
     // Check time since last send
@@ -181,118 +218,406 @@ bool BLEGattOutbound::handleSendFromOutboundQueue()
             return false;
     }
 
-    // Peek next message in queue
-    ProtocolRawMsg bleOutMsg;
-    if (!_outboundQueue.peek(bleOutMsg))
+    // Get the next chunk to send - either the next section of the message at the front of the queue (sent
+    // in place from the queue slot) or, in packed mode, as many framed messages as fit in the packet
+    uint32_t maxLen = ((_actualMtuSize != 0) && (_actualMtuSize > MTU_SIZE_REDUCTION+1)) ? _actualMtuSize - MTU_SIZE_REDUCTION : _maxPacketLen;
+    const uint8_t* pChunk = nullptr;
+    uint32_t toSendLen = 0;
+    ChunkProgress progress;
+    bool chunkOk = _sendPacked ? 
+                getNextPackedChunk(maxLen, pChunk, toSendLen, progress) :
+                getNextChunk(maxLen, pChunk, toSendLen, progress);
+    if (!chunkOk)
         return false;
 
-    // Extract next section of message to send
-    uint32_t toSendLen = 0;
-    bool removeFromQueue = true;
-    if (bleOutMsg.getBufLen() > _outboundMsgPos)
-        toSendLen = bleOutMsg.getBufLen() - _outboundMsgPos;
-    uint32_t maxLen = ((_actualMtuSize != 0) && (_actualMtuSize > MTU_SIZE_REDUCTION+1)) ? _actualMtuSize - MTU_SIZE_REDUCTION : _maxPacketLen;
-    if (toSendLen > maxLen)
-        toSendLen = maxLen;
-    if (bleOutMsg.getBufLen() > _outboundMsgPos + toSendLen)
-        removeFromQueue = false;
+    // Check if the chunk completes a message (for latency stats)
+    uint32_t msgQueuedMs = 0;
+    bool isMsgEnd = getChunkMsgEnd(progress, msgQueuedMs);
+
+    // Send
+    bool removeFromQueue = toSendLen == 0;
     BLEGattServerSendResult rslt = BLEGATT_SERVER_SEND_RESULT_TRY_AGAIN;
     if (toSendLen != 0)
     {
-        // Handle messages in flight calculation when using indication
+        // Take a credit from the in flight window when using indication (this must be done before
+        // sending as the confirmation may arrive before sendToCentral returns)
         if (_sendUsingIndication)
         {
-            _outbountMsgInFlightLastMs = millis();
-            if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) == pdTRUE)
-            {
-                _outboundMsgsInFlight = _outboundMsgsInFlight + 1;
-                xSemaphoreGive(_inFlightMutex);
-            }
+            if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) != pdTRUE)
+                return false;
+            bool creditTaken = _inFlightWindow.takeCredit(millis(), isMsgEnd, msgQueuedMs);
+            xSemaphoreGive(_inFlightMutex);
+            if (!creditTaken)
+                return false;
         }
 
-        // Send to central
+        // Send to central (for notifications the send time is recorded before sending as tx complete
+        // may arrive before sendToCentral returns)
         _lastOutboundMsgMs = millis();
-        rslt = _gattServer.sendToCentral(bleOutMsg.getBuf() + _outboundMsgPos, toSendLen);
+        bool isTestActive = _outboundTest.isActive();
+        bool notifyTestRecorded = false;
+        if (!_sendUsingIndication && (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) == pdTRUE))
+        {
+            _notifyTxWindow.reclaimTimedOut(_lastOutboundMsgMs);
+            _notifyTxWindow.takeCredit(_lastOutboundMsgMs, isMsgEnd, msgQueuedMs);
+            if (isTestActive)
+            {
+                _outboundTest.onChunkSent(toSendLen, _lastOutboundMsgMs);
+                notifyTestRecorded = true;
+            }
+            xSemaphoreGive(_inFlightMutex);
+        }
+        rslt = _gattServer.sendToCentral(_connHandle, pChunk, toSendLen);
+        if (isTestActive && _sendUsingIndication && (rslt == BLEGATT_SERVER_SEND_RESULT_OK))
+            _outboundTest.onChunkSent(toSendLen, _lastOutboundMsgMs);
         if (rslt == BLEGATT_SERVER_SEND_RESULT_OK)
         {
-            _bleStats.txMsg(bleOutMsg.getBufLen(), rslt);
-            _outboundMsgPos += toSendLen;
+            _bleStats.txMsg(toSendLen, true);
+
+            // Remove completed messages and move on
+            recordChunkSent(progress, _lastOutboundMsgMs);
+            applyChunkProgress(progress, false);
         }
 
-        // Handle try-again failures
+        // Try-again failures are retried later
         else if (rslt == BLEGATT_SERVER_SEND_RESULT_TRY_AGAIN)
         {
-            // Try again later
-            removeFromQueue = false;
+            recordChunkRetry(progress);
+            if (isTestActive)
+                _outboundTest.onRetry();
         }
 
         // Check if failed
         else
         {
+            _bleStats.txMsg(0, false);
             removeFromQueue = true;
         }
 
-        // Handle messages in flight calculation when using indication
-        if ((rslt != BLEGATT_SERVER_SEND_RESULT_OK) && _sendUsingIndication)
+        // Return the credit (and for notifications undo the test's record of the chunk) if the chunk wasn't sent
+        if (rslt != BLEGATT_SERVER_SEND_RESULT_OK)
         {
             if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) == pdTRUE)
             {
-                _outboundMsgsInFlight = _outboundMsgsInFlight - 1;
+                if (_sendUsingIndication)
+                {
+                    _inFlightWindow.cancelCredit();
+                }
+                else
+                {
+                    _notifyTxWindow.cancelCredit();
+                    if (notifyTestRecorded)
+                        _outboundTest.onChunkUnsent(toSendLen);
+                }
                 xSemaphoreGive(_inFlightMutex);
             }
         }
     }
 
-    // Remove from queue if required
+    // Remove the message(s) in the chunk if it can't be sent
     if (removeFromQueue)
-    {
-        _outboundQueue.get(bleOutMsg);
-        _outboundMsgPos = 0;
-    }
+        applyChunkProgress(progress, true);
 
 #ifdef DEBUG_SEND_FROM_OUTBOUND_QUEUE
     if (_sendUsingIndication)
     {
-        uint32_t msgsInFlight = 0;
-        if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) == pdTRUE)
-        {
-            msgsInFlight = _outboundMsgsInFlight;
-            xSemaphoreGive(_inFlightMutex);
-        }
-        LOG_I(MODULE_PREFIX, "handleSendFromOutboundQueue sendLen %d totalLen %d msgPos %d sendOk %d inFlight %d leftInQueue %d removeFromQ %d", 
-                toSendLen, bleOutMsg.getBufLen(), _outboundMsgPos, rslt, msgsInFlight, _outboundQueue.count(), removeFromQueue);
+        uint32_t msgsInFlight = getNumMsgsInFlight();
+        LOG_I(MODULE_PREFIX, "handleSendFromOutboundQueue sendLen %d rspDone %d pubDone %d sendOk %d inFlight %d leftInQueue %d removeFromQ %d", 
+                toSendLen, progress.numMsgsCompleted[OUTBOUND_LANE_RESPONSE], progress.numMsgsCompleted[OUTBOUND_LANE_PUBLISH], 
+                rslt, msgsInFlight, getQueuedCount(), removeFromQueue);
     }
     else
     {
-        LOG_I(MODULE_PREFIX, "handleSendFromOutboundQueue sendLen %d totalLen %d msgPos %d sendOk %s leftInQueue %d removeFromQ %d", 
-            toSendLen, bleOutMsg.getBufLen(), _outboundMsgPos, 
+        LOG_I(MODULE_PREFIX, "handleSendFromOutboundQueue sendLen %d rspDone %d pubDone %d sendOk %s leftInQueue %d removeFromQ %d", 
+            toSendLen, progress.numMsgsCompleted[OUTBOUND_LANE_RESPONSE], progress.numMsgsCompleted[OUTBOUND_LANE_PUBLISH], 
             rslt == BLEGATT_SERVER_SEND_RESULT_OK ? "OK" : rslt == BLEGATT_SERVER_SEND_RESULT_FAIL ? "FAIL" : "TRYAGAIN", 
-            _outboundQueue.count(), removeFromQueue);
+            getQueuedCount(), removeFromQueue);
     }
 #endif
 
     return rslt == BLEGATT_SERVER_SEND_RESULT_OK;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get next chunk of a message
+// Chunks have no framing so a message which has been partly sent must be completed before another
+// message (from either lane) is started - otherwise the highest priority lane with a message is used
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BLEGattOutbound::getNextChunk(uint32_t maxLen, const uint8_t*& pChunk, uint32_t& chunkLen, ChunkProgress& progress)
+{
+    // Select lane
+    uint32_t lane = 0;
+    for (lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+    {
+        if (_outboundMsgPos[lane] != 0)
+            break;
+    }
+    if (lane == OUTBOUND_LANE_COUNT)
+    {
+        for (lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+        {
+            if (_outboundQueues[lane].count() != 0)
+                break;
+        }
+    }
+    if (lane == OUTBOUND_LANE_COUNT)
+        return false;
+
+    // Peek next message in the lane (the message remains in the queue slot until removed so the chunk
+    // is sent from it in place)
+    const uint8_t* pMsgBuf = nullptr;
+    uint32_t msgLen = 0;
+    if (!_outboundQueues[lane].peekFront(pMsgBuf, msgLen))
+        return false;
+
+    // Extract next section of message to send
+    uint32_t msgPos = _outboundMsgPos[lane];
+    chunkLen = 0;
+    if (msgLen > msgPos)
+        chunkLen = msgLen - msgPos;
+    if (chunkLen > maxLen)
+        chunkLen = maxLen;
+    pChunk = pMsgBuf + msgPos;
+
+    // Progress
+    for (uint32_t i = 0; i < OUTBOUND_LANE_COUNT; i++)
+    {
+        progress.numMsgsCompleted[i] = 0;
+        progress.nextMsgPos[i] = _outboundMsgPos[i];
+    }
+    progress.nextMsgPos[lane] = msgPos + chunkLen;
+    if (progress.nextMsgPos[lane] >= msgLen)
+    {
+        progress.numMsgsCompleted[lane] = 1;
+        progress.nextMsgPos[lane] = 0;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get next packed chunk
+// The packet is filled with segments taken from the lanes in priority order - many small messages share a
+// packet and a long message continues over as many packets as required. Each segment has a header so the
+// central can reassemble the messages of each lane even when a response pre-empts a partly sent publish.
+// Messages are only removed from the queues once the packet has been sent.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BLEGattOutbound::getNextPackedChunk(uint32_t maxLen, const uint8_t*& pChunk, uint32_t& chunkLen, ChunkProgress& progress)
+{
+    // Packet buffer (capacity retained between packets)
+    _packedBuf.resize(maxLen);
+    chunkLen = 0;
+
+    // Add segments from each lane in turn until the packet is full
+    for (uint32_t lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+    {
+        uint32_t msgIdx = 0;
+        uint32_t msgPos = _outboundMsgPos[lane];
+        const uint8_t* pMsgBuf = nullptr;
+        uint32_t msgLen = 0;
+        while ((chunkLen + PACKED_SEG_HEADER_LEN < maxLen) && _outboundQueues[lane].peekAt(msgIdx, pMsgBuf, msgLen))
+        {
+            // Segment
+            uint32_t remainingLen = msgLen > msgPos ? msgLen - msgPos : 0;
+            uint32_t segLen = std::min(remainingLen, std::min(maxLen - chunkLen - PACKED_SEG_HEADER_LEN, PACKED_SEG_LEN_MAX));
+            bool moreSegs = segLen < remainingLen;
+            uint32_t segHeader = (lane == OUTBOUND_LANE_PUBLISH ? PACKED_SEG_LANE_BIT : 0) | 
+                        (moreSegs ? PACKED_SEG_MORE_BIT : 0) | segLen;
+            _packedBuf[chunkLen++] = (segHeader >> 8) & 0xff;
+            _packedBuf[chunkLen++] = segHeader & 0xff;
+            memcpy(_packedBuf.data() + chunkLen, pMsgBuf + msgPos, segLen);
+            chunkLen += segLen;
+
+            // Check if the message is complete
+            if (moreSegs)
+            {
+                msgPos += segLen;
+                break;
+            }
+            msgIdx++;
+            msgPos = 0;
+        }
+        progress.numMsgsCompleted[lane] = msgIdx;
+        progress.nextMsgPos[lane] = msgPos;
+    }
+    pChunk = _packedBuf.data();
+    return chunkLen > 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Apply chunk progress
+// Removes completed messages from the lanes and updates the position in partly sent messages - if dropPartial
+// is set (the chunk could not be sent) the partly sent messages are also removed
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattOutbound::applyChunkProgress(const ChunkProgress& progress, bool dropPartial)
+{
+    for (uint32_t lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+    {
+        // Lanes which had nothing in the chunk are unchanged
+        uint32_t numToRemove = progress.numMsgsCompleted[lane];
+        if ((numToRemove == 0) && (progress.nextMsgPos[lane] == _outboundMsgPos[lane]))
+            continue;
+        _outboundMsgPos[lane] = progress.nextMsgPos[lane];
+        if (dropPartial && (_outboundMsgPos[lane] != 0))
+        {
+            numToRemove++;
+            _outboundMsgPos[lane] = 0;
+        }
+        for (uint32_t i = 0; i < numToRemove; i++)
+            _outboundQueues[lane].popFront();
+
+        // Stats for the new front message (which may have been started by this chunk)
+        if (numToRemove > 0)
+        {
+            _frontMsgChunks[lane] = _outboundMsgPos[lane] != 0 ? 1 : 0;
+            _frontMsgRetries[lane] = 0;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if a chunk completes a message
+// If the chunk completes more than one message (packed mode) the oldest message is used
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BLEGattOutbound::getChunkMsgEnd(const ChunkProgress& progress, uint32_t& msgQueuedMs)
+{
+    for (uint32_t lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+    {
+        if ((progress.numMsgsCompleted[lane] > 0) && _outboundQueues[lane].getPutMs(0, msgQueuedMs))
+            return true;
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Record stats for a chunk which has been sent (called before the chunk progress is applied)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattOutbound::recordChunkSent(const ChunkProgress& progress, uint32_t nowMs)
+{
+    for (uint32_t lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+    {
+        // Lanes which had nothing in the chunk
+        uint32_t numCompleted = progress.numMsgsCompleted[lane];
+        if ((numCompleted == 0) && (progress.nextMsgPos[lane] == _outboundMsgPos[lane]))
+            continue;
+
+        // Front message - queue wait is recorded when the first chunk is sent
+        uint32_t putMs = 0;
+        if ((_frontMsgChunks[lane] == 0) && _outboundQueues[lane].getPutMs(0, putMs))
+            _bleStats.txQueueWait(Raft::timeElapsed(nowMs, putMs));
+        _frontMsgChunks[lane]++;
+        if (numCompleted > 0)
+            _bleStats.txMsgDone(_frontMsgChunks[lane], _frontMsgRetries[lane]);
+
+        // Other messages completed in this chunk (packed mode)
+        for (uint32_t msgIdx = 1; msgIdx < numCompleted; msgIdx++)
+        {
+            if (_outboundQueues[lane].getPutMs(msgIdx, putMs))
+                _bleStats.txQueueWait(Raft::timeElapsed(nowMs, putMs));
+            _bleStats.txMsgDone(1, 0);
+        }
+
+        // Message started at the end of this chunk (packed mode)
+        if ((numCompleted > 0) && (progress.nextMsgPos[lane] != 0) && _outboundQueues[lane].getPutMs(numCompleted, putMs))
+            _bleStats.txQueueWait(Raft::timeElapsed(nowMs, putMs));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Record a send retry (stack busy) for the messages in a chunk
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattOutbound::recordChunkRetry(const ChunkProgress& progress)
+{
+    for (uint32_t lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+    {
+        if ((progress.numMsgsCompleted[lane] != 0) || (progress.nextMsgPos[lane] != _outboundMsgPos[lane]))
+            _frontMsgRetries[lane]++;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reset the outbound queues, positions and chunks in flight (sender only)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattOutbound::resetOutboundQueues()
+{
+    for (uint32_t lane = 0; lane < OUTBOUND_LANE_COUNT; lane++)
+    {
+        _outboundQueues[lane].clear();
+        _outboundMsgPos[lane] = 0;
+        _frontMsgChunks[lane] = 0;
+        _frontMsgRetries[lane] = 0;
+    }
+    if (xSemaphoreTake(_inFlightMutex, portMAX_DELAY) == pdTRUE)
+    {
+        _inFlightWindow.clear();
+        _notifyTxWindow.clear();
+        xSemaphoreGive(_inFlightMutex);
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Task worker for outbound messages
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void BLEGattOutbound::outboundMsgTask()
 {
-    // Run the task until asked to stop
-    while (ulTaskNotifyTake(pdTRUE, 0) == 0)
-    {        
-        // Handle queue
-        handleSendFromOutboundQueue();
+    // Run the task until deleted by stop()
+    while (true)
+    {
+        // Send as many chunks as possible
+        while (handleSendFromOutboundQueue())
+        {
+        }
 
-        // Yield
-        vTaskDelay(1);
+        // Block until woken by sendMsg() or a tx complete (credit returned) or until the wait time
+        // has elapsed (which handles pacing between sends, retries and in-flight timeouts)
+        uint32_t waitMs = getTaskWaitMs();
+        ulTaskNotifyTake(pdTRUE, waitMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(waitMs));
     }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get time the outbound task should wait before trying to send again
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // Task has exited
-    _outboundMsgTaskHandle = nullptr;
-    vTaskDelete(NULL);
+uint32_t BLEGattOutbound::getTaskWaitMs()
+{
+    // Nothing to send so wait until woken by sendMsg()
+    if (getQueuedCount() == 0)
+        return UINT32_MAX;
+
+    // When using indication wait for a credit to be returned (notifyTxComplete will wake the task)
+    // but wake at the chunk timeout anyway so that unconfirmed chunks are reclaimed
+    if (_sendUsingIndication)
+    {
+        uint32_t msgsInFlight = getNumMsgsInFlight();
+        if (msgsInFlight >= _inFlightWindow.windowSize())
+            return _outMsgsInFlightTimeoutMs;
+        return OUTBOUND_TASK_RETRY_MS;
+    }
+
+    // Pacing between sends when using notification
+    uint32_t elapsedMs = Raft::timeElapsed(millis(), _lastOutboundMsgMs);
+    if (elapsedMs < _minMsBetweenSends)
+        return _minMsBetweenSends - elapsedMs;
+    return OUTBOUND_TASK_RETRY_MS;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Wake the outbound task (if running)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattOutbound::wakeOutboundTask()
+{
+    TaskHandle_t taskHandle = _outboundMsgTaskHandle;
+    if (taskHandle)
+        xTaskNotifyGive(taskHandle);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -310,24 +635,115 @@ void BLEGattOutbound::notifyTxComplete(int statusBLEHSCode)
             uint32_t msgsInFlight = 0;
             if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) == pdTRUE)
             {
-                // Decrement messages in flight
-                if (_outboundMsgsInFlight != 0)
+                // Return the credit for the oldest chunk in flight
+                uint32_t nowMs = millis();
+                uint32_t chunkInFlightMs = 0;
+                bool isMsgEnd = false;
+                uint32_t msgQueuedMs = 0;
+                if (_inFlightWindow.returnCredit(nowMs, chunkInFlightMs, isMsgEnd, msgQueuedMs))
                 {
-                    // Decrement the in flight count
-                    _outboundMsgsInFlight = _outboundMsgsInFlight - 1;
+                    if (isMsgEnd)
+                        _bleStats.txComplete(Raft::timeElapsed(nowMs, msgQueuedMs));
+                    if (_outboundTest.isActive())
+                        _outboundTest.onIndicationComplete(chunkInFlightMs);
                 }
-                msgsInFlight = _outboundMsgsInFlight;
+                msgsInFlight = _inFlightWindow.inFlight();
                 xSemaphoreGive(_inFlightMutex);
             }
-            _outbountMsgInFlightLastMs = millis();
             (msgsInFlight = msgsInFlight); // avoid warning when not debugging
 
+            // Credit returned so wake the outbound task
+            wakeOutboundTask();
+
 #ifdef DEBUG_SEND_FROM_OUTBOUND_QUEUE
             LOG_I(MODULE_PREFIX, "notifyTxComplete status %s msgsInFlight %d", 
                     BLEGattServer::getHSErrorMsg(statusBLEHSCode), msgsInFlight);
 #endif
         }
     }
+
+    // Notifications complete when sent (used for latency stats)
+    else if (statusBLEHSCode == 0)
+    {
+        if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) == pdTRUE)
+        {
+            uint32_t nowMs = millis();
+            uint32_t chunkInFlightMs = 0;
+            bool isMsgEnd = false;
+            uint32_t msgQueuedMs = 0;
+            if (_notifyTxWindow.returnCredit(nowMs, chunkInFlightMs, isMsgEnd, msgQueuedMs) && isMsgEnd)
+                _bleStats.txComplete(Raft::timeElapsed(nowMs, msgQueuedMs));
+            if (_outboundTest.isActive())
+                _outboundTest.onNotificationComplete(nowMs);
+            xSemaphoreGive(_inFlightMutex);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get number of messages (chunks) in flight
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t BLEGattOutbound::getNumMsgsInFlight()
+{
+    // Assume the window is full if the mutex can't be obtained
+    uint32_t msgsInFlight = _inFlightWindow.windowSize();
+    if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) == pdTRUE)
+    {
+        msgsInFlight = _inFlightWindow.inFlight();
+        xSemaphoreGive(_inFlightMutex);
+    }
+    return msgsInFlight;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Outbound throughput test
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattOutbound::startOutboundTest(uint32_t frameLen, uint32_t numFrames, uint32_t maxDurationMs)
+{
+    if (xSemaphoreTake(_inFlightMutex, pdMS_TO_TICKS(WAIT_FOR_INFLIGHT_MUTEX_MAX_MS)) != pdTRUE)
+        return;
+    _outboundTest.start(frameLen, numFrames, maxDurationMs, _sendUsingIndication, millis());
+    _outboundTestFrame.clear();
+    xSemaphoreGive(_inFlightMutex);
+    LOG_I(MODULE_PREFIX, "startOutboundTest frameLen %d numFrames %d maxDurationMs %d", frameLen, numFrames, maxDurationMs);
+}
+
+void BLEGattOutbound::stopOutboundTest()
+{
+    _outboundTest.stop();
+}
+
+void BLEGattOutbound::serviceOutboundTest()
+{
+    // Check test active
+    if (!_outboundTest.isActive())
+        return;
+
+    // Test frames are queued in the publish lane so responses still take priority (and publishing pauses
+    // while the test is running)
+    OutboundMsgQueue& queue = _outboundQueues[OUTBOUND_LANE_PUBLISH];
+    bool framesAdded = false;
+    while (queue.count() < queue.maxLen())
+    {
+        // A frame which couldn't be queued is retained and retried so the sequence isn't broken
+        if (_outboundTestFrame.empty())
+        {
+            if (!_outboundTest.isFrameRequired(millis()))
+                break;
+            _outboundTest.genFrame(_outboundTestFrame);
+        }
+        if (!queue.put(_outboundTestFrame.data(), _outboundTestFrame.size()))
+            break;
+        _outboundTestFrame.clear();
+        framesAdded = true;
+    }
+    if (framesAdded)
+        wakeOutboundTask();
+
+    // Check for end of test
+    _outboundTest.checkFinished(queue.count() == 0);
 }
 
 #endif // CONFIG_BT_ENABLED
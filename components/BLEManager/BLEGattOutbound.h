@@ -9,10 +9,12 @@
 
 #pragma once
 
-#include "ThreadSafeQueue.h"
-#include "ProtocolRawMsg.h"
+#include <atomic>
+#include "OutboundMsgQueue.h"
 #include "CommsChannelMsg.h"
 #include "BLEConfig.h"
+#include "BLEOutboundWindow.h"
+#include "BLEOutboundTest.h"
 
 class CommsChannelMsg;
 class BLEGattServer;
@@ -44,6 +46,10 @@ public:
     bool isReadyToSend(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn);
     bool sendMsg(CommsChannelMsg& msg);
 
+    // Set connection handle (each connection has its own outbound handler and the MTU is negotiated
+    // separately for each connection) - anything left queued for a previous connection is discarded
+    void setConnHandle(uint16_t connHandle);
+
     // Inform of MTU size
     void onMTUSizeInfo(uint32_t mtuSize)
     {
@@ -56,6 +62,29 @@ public:
         return _preferredMtuSize;
     }
 
+    // Get number of messages waiting to be sent
+    uint32_t getQueuedCount() const
+    {
+        uint32_t count = 0;
+        for (const OutboundMsgQueue& queue : _outboundQueues)
+            count += queue.count();
+        return count;
+    }
+
+    // Get number of chunks sent but not yet acknowledged (read without locking so only indicative)
+    uint32_t getInFlightCount() const
+    {
+        return _inFlightWindow.inFlight();
+    }
+
+    // Outbound throughput test
+    void startOutboundTest(uint32_t frameLen, uint32_t numFrames, uint32_t maxDurationMs);
+    void stopOutboundTest();
+    String getOutboundTestJSON() const
+    {
+        return _outboundTest.getJSON();
+    }
+
 private:
     // GATT server
     BLEGattServer& _gattServer;
@@ -63,29 +92,77 @@ private:
     // Stats
     BLEManStats& _bleStats;
 
+    // Connection handle
+    uint16_t _connHandle = 0;
+
+    // Set when the slot is opened for a new connection - the queues and send state are then reset by the
+    // sender (as the queues must only have one consumer)
+    std::atomic<bool> _connResetReq = false;
+
     // Send using indication
     bool _sendUsingIndication = false;
 
-    // Outbound queue of messages
-    ThreadSafeQueue<ProtocolRawMsg> _outboundQueue;
+    // Outbound lanes in priority order - publish messages are sent only when no responses etc are waiting
+    enum OutboundLane
+    {
+        OUTBOUND_LANE_RESPONSE,
+        OUTBOUND_LANE_PUBLISH,
+        OUTBOUND_LANE_COUNT
+    };
+
+    // Outbound queue of messages for each lane (chunks are sent directly from the queue slot)
+    OutboundMsgQueue _outboundQueues[OUTBOUND_LANE_COUNT];
+
+    // Position in the message at the front of each lane
+    uint32_t _outboundMsgPos[OUTBOUND_LANE_COUNT] = {};
 
-    // Position in current message being sent
-    uint16_t _outboundMsgPos = 0;
+    // Chunks sent and send retries for the message at the front of each lane (for stats)
+    uint32_t _frontMsgChunks[OUTBOUND_LANE_COUNT] = {};
+    uint32_t _frontMsgRetries[OUTBOUND_LANE_COUNT] = {};
+
+    // Progress made by the chunk being sent (applied when the send succeeds)
+    struct ChunkProgress
+    {
+        uint32_t numMsgsCompleted[OUTBOUND_LANE_COUNT];
+        uint32_t nextMsgPos[OUTBOUND_LANE_COUNT];
+    };
+
+    // Packed mode - each packet is filled with segments of messages, each segment is a 2-byte big-endian header
+    // (bit 15 lane, bit 14 more segments follow, bits 13..0 segment length) followed by the segment data. This
+    // allows a response to pre-empt a partially sent publish at any packet boundary. Without packed mode
+    // chunks carry no framing so messages are only re-ordered at message boundaries.
+    bool _sendPacked = BLEConfig::DEFAULT_SEND_PACKED;
+    std::vector<uint8_t> _packedBuf;
+    static const uint32_t PACKED_SEG_HEADER_LEN = 2;
+    static const uint32_t PACKED_SEG_LANE_BIT = 0x8000;
+    static const uint32_t PACKED_SEG_MORE_BIT = 0x4000;
+    static const uint32_t PACKED_SEG_LEN_MAX = 0x3fff;
 
     // Min time between adjacent outbound messages
     uint32_t _lastOutboundMsgMs = 0;
     uint32_t _minMsBetweenSends = BLEConfig::BLE_MIN_TIME_BETWEEN_OUTBOUND_MSGS_MS;
 
     // Task that runs the outbound queue (if enabled)
+    // The task blocks until woken by sendMsg(), notifyTxComplete() or a timeout for pacing/retries
     volatile TaskHandle_t _outboundMsgTaskHandle = nullptr;
+    static const uint32_t OUTBOUND_TASK_RETRY_MS = 2;
 
-    // Outbound messages in flight
-    volatile uint32_t _outboundMsgsInFlight = 0;
+    // Outbound chunks in flight (awaiting indication confirmation)
+    // The window size is outMsgsInFlightMax when windowed sending is enabled or 1 (stop-and-wait) otherwise
+    BLEOutboundWindow _inFlightWindow;
+    bool _sendWindowed = BLEConfig::DEFAULT_SEND_WINDOWED;
     uint16_t _outMsgsInFlightMax = BLEConfig::DEFAULT_NUM_OUTBOUND_MSGS_IN_FLIGHT_MAX;
-    uint32_t _outbountMsgInFlightLastMs = 0;
     uint32_t _outMsgsInFlightTimeoutMs = BLEConfig::BLE_OUTBOUND_MSGS_IN_FLIGHT_TIMEOUT_MS;
 
-    // Mutex for in flight variable
+    // Notifications awaiting tx complete (used for message latency stats - notifications aren't flow controlled)
+    BLEOutboundWindow _notifyTxWindow;
+    static const uint32_t NOTIFY_TX_TIMEOUT_MS = 1000;
+
+    // Outbound throughput test (results are protected by the in flight mutex)
+    BLEOutboundTest _outboundTest;
+    std::vector<uint8_t> _outboundTestFrame;
+
+    // Mutex for in flight window
     SemaphoreHandle_t _inFlightMutex = nullptr;
     static const uint32_t WAIT_FOR_INFLIGHT_MUTEX_MAX_MS = 2;
 
@@ -101,8 +178,19 @@ private:
 
     // Outbound queue
     void serviceOutboundQueue();
+    void resetOutboundQueues();
     bool handleSendFromOutboundQueue();
+    bool getNextChunk(uint32_t maxLen, const uint8_t*& pChunk, uint32_t& chunkLen, ChunkProgress& progress);
+    bool getNextPackedChunk(uint32_t maxLen, const uint8_t*& pChunk, uint32_t& chunkLen, ChunkProgress& progress);
+    void applyChunkProgress(const ChunkProgress& progress, bool dropPartial);
+    bool getChunkMsgEnd(const ChunkProgress& progress, uint32_t& msgQueuedMs);
+    void recordChunkSent(const ChunkProgress& progress, uint32_t nowMs);
+    void recordChunkRetry(const ChunkProgress& progress);
     void outboundMsgTask();
+    uint32_t getTaskWaitMs();
+    void wakeOutboundTask();
+    uint32_t getNumMsgsInFlight();
+    void serviceOutboundTest();
     
 #endif // CONFIG_BT_ENABLED
 
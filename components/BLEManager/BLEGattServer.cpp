@@ -16,6 +16,7 @@
 #include "RaftArduino.h"
 #include "NamedValueProvider.h"
 #include "BLEGattServer.h"
+#include "BLEManStats.h"
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 
@@ -71,7 +72,7 @@ ble_uuid128_t BLEGattServer::DEFAULT_MESSAGE_RESPONSE_UUID =
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 BLEGattServer::BLEGattServer(BLEGattServerAccessCBType callback, BLEManStats& bleStats) :
-    _bleOutbound(*this, bleStats)
+    _bleStats(bleStats)
 {
     _accessCallback = callback;
     _mainServiceUUID128 = DEFAULT_MAIN_SERVICE_UUID;
@@ -82,6 +83,8 @@ BLEGattServer::BLEGattServer(BLEGattServerAccessCBType callback, BLEManStats& bl
 BLEGattServer::~BLEGattServer()
 {
     stop();
+    for (ConnSlot& slot : _connSlots)
+        delete slot.pOutbound;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -123,8 +126,24 @@ bool BLEGattServer::setup(const BLEConfig& bleConfig)
     // Save standard services config
     _stdServicesConfig = bleConfig.stdServices;
 
-    // Setup outbound handler
-    _isEnabled = _bleOutbound.setup(bleConfig);
+    // Preferred MTU
+    _preferredMTUSize = bleConfig.preferredMTUSize;
+
+    // Inbound pool
+    _inboundPool.setup(bleConfig.inboundPoolSize);
+
+    // Connection slots (these are created once as the outbound handlers may run tasks)
+    if (_connSlots.empty())
+    {
+        _connSlots.resize(bleConfig.maxConns);
+        for (ConnSlot& slot : _connSlots)
+            slot.pOutbound = new BLEGattOutbound(*this, _bleStats);
+    }
+
+    // Setup outbound handlers
+    _isEnabled = true;
+    for (ConnSlot& slot : _connSlots)
+        _isEnabled = slot.pOutbound->setup(bleConfig) && _isEnabled;
     return _isEnabled;
 }
 
@@ -137,52 +156,150 @@ void BLEGattServer::loop(NamedValueProvider* pNamedValueProvider)
     // Check enabled
     if (!_isEnabled)
         return;
-    // Service outbound queue
-    _bleOutbound.loop();
 
-    // Update standard services
-    if (_bleIsConnected)
-        _stdServices.updateStdServices(_bleGapConnHandle, pNamedValueProvider);
+    // Handle inbound messages
+    serviceInboundPool();
+
+    // Service outbound queues - the slot which goes first is rotated so that one connection doesn't
+    // always get first use of the stack's buffers
+    uint32_t numSlots = _connSlots.size();
+    for (uint32_t i = 0; i < numSlots; i++)
+        _connSlots[(_firstSlotToService + i) % numSlots].pOutbound->loop();
+    if (numSlots > 0)
+        _firstSlotToService = (_firstSlotToService + 1) % numSlots;
+
+    // Sample outbound queue depths
+    if (Raft::isTimeout(millis(), _lastQueueDepthSampleMs, QUEUE_DEPTH_SAMPLE_MS))
+    {
+        _lastQueueDepthSampleMs = millis();
+        for (const ConnSlot& slot : _connSlots)
+        {
+            if (slot.isConnected)
+                _bleStats.txQueueDepth(slot.pOutbound->getQueuedCount());
+        }
+    }
+
+    // Update standard services (changes are notified to each subscribed connection)
+    for (const ConnSlot& slot : _connSlots)
+    {
+        if (slot.isConnected)
+        {
+            _stdServices.updateStdServices(pNamedValueProvider);
+            break;
+        }
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Check ready to send
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool BLEGattServer::isReadyToSend(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn)
+bool BLEGattServer::isReadyToSend(uint32_t slotIdx, CommsMsgTypeCode msgType, bool& noConn)
 {
     // Check state of gatt server
-    noConn = !_isEnabled || !isNotificationEnabled();
+    noConn = !_isEnabled || !isNotificationEnabled(slotIdx);
     if (noConn)
         return false;
-    return _bleOutbound.isReadyToSend(channelID, msgType, noConn);
+    return _connSlots[slotIdx].pOutbound->isReadyToSend(slotIdx, msgType, noConn);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Send message over BLE
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool BLEGattServer::sendMsg(CommsChannelMsg& msg)
+bool BLEGattServer::sendMsg(uint32_t slotIdx, CommsChannelMsg& msg)
 {
     // Check if enabled
-    if (!_isEnabled)
+    if (!_isEnabled || (slotIdx >= _connSlots.size()))
         return false;
-    return _bleOutbound.sendMsg(msg);
+    return _connSlots[slotIdx].pOutbound->sendMsg(msg);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Get data written (to characteristic) by central
+// Connection slots
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-int BLEGattServer::getDataWrittenToCharacteristic(struct os_mbuf *om, std::vector<uint8_t, SpiramAwareAllocator<uint8_t>>& rxMsg)
+int BLEGattServer::connSlotOpen(uint16_t connHandle)
+{
+    // Find a free slot
+    for (uint32_t slotIdx = 0; slotIdx < _connSlots.size(); slotIdx++)
+    {
+        ConnSlot& slot = _connSlots[slotIdx];
+        if (slot.isConnected)
+            continue;
+        slot.connHandle = connHandle;
+        slot.notifyState = false;
+        slot.pOutbound->setConnHandle(connHandle);
+        slot.isConnected = true;
+        return slotIdx;
+    }
+    return -1;
+}
+
+int BLEGattServer::connSlotClose(uint16_t connHandle)
+{
+    int slotIdx = getConnSlotIdx(connHandle);
+    if (slotIdx < 0)
+        return -1;
+    _connSlots[slotIdx].isConnected = false;
+    _connSlots[slotIdx].notifyState = false;
+    return slotIdx;
+}
+
+int BLEGattServer::getConnSlotIdx(uint16_t connHandle) const
+{
+    for (uint32_t slotIdx = 0; slotIdx < _connSlots.size(); slotIdx++)
+    {
+        if (_connSlots[slotIdx].isConnected && (_connSlots[slotIdx].connHandle == connHandle))
+            return slotIdx;
+    }
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add data written (to characteristic) by central to the inbound pool
+// This is called on the host task so the data is only flattened into a pool slot here - if the pool is full
+// the write is rejected (the central sees an ATT error for writes with response)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int BLEGattServer::poolDataWrittenToCharacteristic(uint16_t connHandle, struct os_mbuf *om)
 {
     uint16_t om_len = OS_MBUF_PKTLEN(om);
     if (om_len == 0)
         return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
-    rxMsg.resize(om_len);
+    uint8_t* pSlotBuf = _inboundPool.reserve(om_len);
+    if (!pSlotBuf)
+    {
+        _bleStats.rxDropped();
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
     uint16_t len = 0;
-    int rc = ble_hs_mbuf_to_flat(om, rxMsg.data(), rxMsg.size(), &len);
-    return (rc == 0) ? 0 : BLE_ATT_ERR_UNLIKELY;
+    int rc = ble_hs_mbuf_to_flat(om, pSlotBuf, om_len, &len);
+    if (rc != 0)
+        return BLE_ATT_ERR_UNLIKELY;
+    _inboundPool.commit(connHandle);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle messages waiting in the inbound pool
+// Messages are handled in place from the pool slot - a message which can't be accepted yet stays at the
+// front of the pool (so order is maintained) and the pool filling up applies backpressure to the central
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BLEGattServer::serviceInboundPool()
+{
+    uint16_t connHandle = 0;
+    const uint8_t* pMsg = nullptr;
+    uint32_t msgLen = 0;
+    for (uint32_t i = 0; i < _inboundPool.numSlots(); i++)
+    {
+        if (!_inboundPool.peekFront(connHandle, pMsg, msgLen))
+            break;
+        if (_accessCallback && !_accessCallback(connHandle, "cmdmsg", false, pMsg, msgLen))
+            break;
+        _inboundPool.popFront();
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -201,15 +318,24 @@ int BLEGattServer::commandCharAccess(uint16_t conn_handle, uint16_t attr_handle,
     {
         case BLE_GATT_ACCESS_OP_WRITE_CHR:
         {
-            // Get the written data
-            std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> rxMsg;
-            int nimbleRetCode = getDataWrittenToCharacteristic(ctxt->om, rxMsg);
+            // Add the written data to the inbound pool (handled in loop)
+            int nimbleRetCode = poolDataWrittenToCharacteristic(conn_handle, ctxt->om);
 
             // Debug
             if (nimbleRetCode == 0)
             {
 #ifdef DEBUG_CMD_CHARACTERISTIC
-                LOG_W(MODULE_PREFIX, "cmdCharCB opWrite rxFromCentral nimbleRetCode %d len %d", nimbleRetCode, rxMsg.size());
+                LOG_W(MODULE_PREFIX, "cmdCharCB opWrite rxFromCentral nimbleRetCode %d len %d", nimbleRetCode, OS_MBUF_PKTLEN(ctxt->om));
+#endif
+            }
+            else if (nimbleRetCode == BLE_ATT_ERR_INSUFFICIENT_RES)
+            {
+#ifdef WARN_ON_BLE_CHAR_WRITE_FAIL
+                if (Raft::isTimeout(millis(), _lastPoolFullMsgMs, MIN_TIME_BETWEEN_POOL_FULL_MSGS_MS))
+                {
+                    LOG_W(MODULE_PREFIX, "cmdCharCB opWrite rxFromCentral inbound pool full (%d msgs)", _inboundPool.count());
+                    _lastPoolFullMsgMs = millis();
+                }
 #endif
             }
             else
@@ -218,11 +344,6 @@ int BLEGattServer::commandCharAccess(uint16_t conn_handle, uint16_t attr_handle,
                 LOG_W(MODULE_PREFIX, "cmdCharCB opWrite rxFromCentral failed to get mbuf nimbleRetCode=%d", nimbleRetCode);
 #endif
             }
-
-            // Callback with data
-            if (_accessCallback && (nimbleRetCode==0) && (rxMsg.size() > 0))
-                _accessCallback("cmdmsg", false, rxMsg);
-
             return nimbleRetCode;
         }
         case BLE_GATT_ACCESS_OP_READ_CHR:
@@ -341,17 +462,18 @@ void BLEGattServer::registrationCallbackStatic(struct ble_gatt_register_ctxt *ct
 #define ble_gatts_notify_custom ble_gattc_notify_custom
 #endif
 
-BLEGattServerSendResult BLEGattServer::sendToCentral(const uint8_t* pBuf, uint32_t bufLen)
+BLEGattServerSendResult BLEGattServer::sendToCentral(uint16_t connHandle, const uint8_t* pBuf, uint32_t bufLen)
 {
     // Check connected
-    if (!BLEGattServer::_bleIsConnected)
+    int slotIdx = getConnSlotIdx(connHandle);
+    if (slotIdx < 0)
     {
         LOG_W(MODULE_PREFIX, "sendToCentral failed as not connected");
         return BLEGATT_SERVER_SEND_RESULT_FAIL;
     }
 
     // Check if we are in notify state
-    if (!BLEGattServer::_responseNotifyState) 
+    if (!_connSlots[slotIdx].notifyState) 
     {
         LOG_W(MODULE_PREFIX, "sendToCentral failed as client has not subscribed");
         return BLEGATT_SERVER_SEND_RESULT_FAIL;
@@ -370,11 +492,11 @@ BLEGattServerSendResult BLEGattServer::sendToCentral(const uint8_t* pBuf, uint32
     int rc = 0;
     if (_sendUsingIndication)
     {
-        rc = ble_gatts_indicate_custom(_bleGapConnHandle, _characteristicValueAttribHandle, om);
+        rc = ble_gatts_indicate_custom(connHandle, _characteristicValueAttribHandle, om);
     }
     else
     {
-        rc = ble_gatts_notify_custom(_bleGapConnHandle, _characteristicValueAttribHandle, om);
+        rc = ble_gatts_notify_custom(connHandle, _characteristicValueAttribHandle, om);
     }
 
 #ifdef WARN_ON_BLE_CHAR_WRITE_TAKING_TOO_LONG
@@ -423,7 +545,7 @@ int BLEGattServer::start()
                         void *arg)
         {
             if (arg)
-                ((BLEGattServer *)arg)->commandCharAccess(conn_handle, attr_handle, ctxt, arg);
+                return ((BLEGattServer *)arg)->commandCharAccess(conn_handle, attr_handle, ctxt, arg);
             return 0;
         },
         .arg = this,
@@ -504,8 +626,9 @@ int BLEGattServer::start()
 
 void BLEGattServer::stop()
 {
-    // Stop outbound handler
-    getOutbound().stop();
+    // Stop outbound handlers
+    for (ConnSlot& slot : _connSlots)
+        slot.pOutbound->stop();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -517,21 +640,25 @@ void BLEGattServer::handleSubscription(struct ble_gap_event * pEvent, String& st
     // Check enabled
     if (!_isEnabled)
         return;
-    if (pEvent->subscribe.attr_handle == _characteristicValueAttribHandle) {
-        _responseNotifyState = pEvent->subscribe.cur_notify != 0;
-        // debug_test_nofify_reset();
-    } else if (pEvent->subscribe.attr_handle != _characteristicValueAttribHandle) {
-        _responseNotifyState = pEvent->subscribe.cur_notify != 0;
-        // debug_test_notify_stop();
+    int slotIdx = getConnSlotIdx(pEvent->subscribe.conn_handle);
+    if (slotIdx >= 0)
+    {
+        if (pEvent->subscribe.attr_handle == _characteristicValueAttribHandle) {
+            _connSlots[slotIdx].notifyState = pEvent->subscribe.cur_notify != 0;
+            // debug_test_nofify_reset();
+        } else if (pEvent->subscribe.attr_handle != _characteristicValueAttribHandle) {
+            _connSlots[slotIdx].notifyState = pEvent->subscribe.cur_notify != 0;
+            // debug_test_notify_stop();
+        }
     }
-    statusStr = "subscribe attr_handle=" + String(pEvent->subscribe.attr_handle) + 
+    statusStr = "subscribe slot=" + String(slotIdx) + " attr_handle=" + String(pEvent->subscribe.attr_handle) + 
                 " reason=" + getHSErrorMsg(pEvent->subscribe.reason) +
                 " prevNotify=" + String(pEvent->subscribe.prev_notify) +
                 " curNotify=" + String(pEvent->subscribe.cur_notify) +
                 " prevInd=" + String(pEvent->subscribe.prev_indicate) +
                 " curInd=" + String(pEvent->subscribe.cur_indicate);
 #ifdef DEBUG_RESP_SUBSCRIPTION
-    LOG_W(MODULE_PREFIX, "handleSubscription notify enabled %s", _responseNotifyState ? "YES" : "NO");
+    LOG_W(MODULE_PREFIX, "handleSubscription slot %d notify enabled %s", slotIdx, isNotificationEnabled(slotIdx) ? "YES" : "NO");
 #endif
 }
 
@@ -19,6 +19,7 @@
 
 #include "BLEStdServices.h"
 #include "BLEGattOutbound.h"
+#include "BLEInboundPool.h"
 #include "CommsChannelMsg.h"
 #include <vector>
 
@@ -30,8 +31,10 @@
 #undef max
 
 // Callback types
-typedef std::function<void (const char* characteristicName, bool readOp, 
-                std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> rxMsg)> BLEGattServerAccessCBType;
+// The access callback is called from loop() (not the host task) with the message in place in the inbound pool and
+// returns false if the message can't be accepted yet (it is then retained in the pool and offered again later)
+typedef std::function<bool (uint16_t connHandle, const char* characteristicName, bool readOp, 
+                const uint8_t* pData, uint32_t dataLen)> BLEGattServerAccessCBType;
 typedef int (*BLECharAccessFnType)(uint16_t conn_handle, uint16_t attr_handle,
                                               struct ble_gatt_access_ctxt *ctxt,
                                               void *arg);
@@ -61,15 +64,26 @@ public:
     // Service
     void loop(NamedValueProvider* pNamedValueProvider);
 
-    // Sending
-    bool isReadyToSend(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn);
-    bool sendMsg(CommsChannelMsg& msg);
+    // Sending (slotIdx identifies the connection)
+    bool isReadyToSend(uint32_t slotIdx, CommsMsgTypeCode msgType, bool& noConn);
+    bool sendMsg(uint32_t slotIdx, CommsChannelMsg& msg);
 
-    // Set connection handle
-    void setConnState(bool isConnected, uint16_t connHandle)
+    // Connection slots - each connection has its own outbound queue and flow control
+    // Open returns the slot index or -1 if all slots are in use, close returns the slot index or -1 if not found
+    int connSlotOpen(uint16_t connHandle);
+    int connSlotClose(uint16_t connHandle);
+    int getConnSlotIdx(uint16_t connHandle) const;
+    uint32_t getNumConnSlots() const
     {
-        _bleIsConnected = isConnected;
-        _bleGapConnHandle = connHandle;
+        return _connSlots.size();
+    }
+    bool isSlotConnected(uint32_t slotIdx) const
+    {
+        return (slotIdx < _connSlots.size()) && _connSlots[slotIdx].isConnected;
+    }
+    uint16_t getSlotConnHandle(uint32_t slotIdx) const
+    {
+        return slotIdx < _connSlots.size() ? _connSlots[slotIdx].connHandle : 0;
     }
 
     // Callback
@@ -79,12 +93,12 @@ public:
     void handleSubscription(struct ble_gap_event * pEvent, String& statusStr);
 
     // Send to central (using notification)
-    BLEGattServerSendResult sendToCentral(const uint8_t* pBuf, uint32_t bufLen);
+    BLEGattServerSendResult sendToCentral(uint16_t connHandle, const uint8_t* pBuf, uint32_t bufLen);
 
     // Check if notification is enabled
-    bool isNotificationEnabled()
+    bool isNotificationEnabled(uint32_t slotIdx) const
     {
-        return _responseNotifyState;
+        return isSlotConnected(slotIdx) && _connSlots[slotIdx].notifyState;
     }
     
     // Start and stop
@@ -94,10 +108,10 @@ public:
     // Get HS error message
     static String getHSErrorMsg(int errorCode);
 
-    // Outbound
-    BLEGattOutbound& getOutbound()
+    // Outbound handler for a connection slot (nullptr if invalid)
+    BLEGattOutbound* getOutbound(uint32_t slotIdx)
     {
-        return _bleOutbound;
+        return slotIdx < _connSlots.size() ? _connSlots[slotIdx].pOutbound : nullptr;
     }
 
     // Get UUID for main loop
@@ -115,7 +129,7 @@ public:
     // Get preferred MTU size
     uint32_t getPreferredMTUSize()
     {
-        return _bleOutbound.getPreferredMTUSize();
+        return _preferredMTUSize;
     }
 
 private:
@@ -132,18 +146,44 @@ private:
     // Max packet length
     uint32_t _maxPacketLen = 0;
 
+    // Preferred MTU size
+    uint32_t _preferredMTUSize = BLEConfig::PREFERRED_MTU_SIZE;
+
     // Access callback
     BLEGattServerAccessCBType _accessCallback = nullptr;
 
-    // Connection info
-    bool _bleIsConnected = false;
-    uint16_t _bleGapConnHandle = 0;
+    // Stats
+    BLEManStats& _bleStats;
 
-    // State of notify (send from peripheral)
-    bool _responseNotifyState = false;
+    // Connection slots (one for each connection allowed)
+    struct ConnSlot
+    {
+        bool isConnected = false;
+        uint16_t connHandle = 0;
+        // State of notify (send from peripheral)
+        bool notifyState = false;
+        // Outbound handler
+        BLEGattOutbound* pOutbound = nullptr;
+    };
+    std::vector<ConnSlot> _connSlots;
 
-    // Get data that has been written to characteristic (sent by central/client)
-    int getDataWrittenToCharacteristic(struct os_mbuf *om, std::vector<uint8_t, SpiramAwareAllocator<uint8_t>>& rxMsg);
+    // Slot serviced first in loop() (rotated so that connections share the stack's buffers fairly)
+    uint32_t _firstSlotToService = 0;
+
+    // Inbound pool - writes are flattened into the pool on the host task and handled in loop()
+    BLEInboundPool _inboundPool;
+    static const uint32_t MIN_TIME_BETWEEN_POOL_FULL_MSGS_MS = 1000;
+    uint32_t _lastPoolFullMsgMs = 0;
+
+    // Outbound queue depth sampling (for stats)
+    static const uint32_t QUEUE_DEPTH_SAMPLE_MS = 100;
+    uint32_t _lastQueueDepthSampleMs = 0;
+
+    // Add data that has been written to characteristic (sent by central/client) to the inbound pool
+    int poolDataWrittenToCharacteristic(uint16_t connHandle, struct os_mbuf *om);
+
+    // Handle messages waiting in the inbound pool
+    void serviceInboundPool();
 
     // Callback on access to characteristics
     int commandCharAccess(uint16_t conn_handle, uint16_t attr_handle,
@@ -158,9 +198,6 @@ private:
     uint32_t _lastBLEErrorMsgMs = 0;
     uint32_t _lastBLEErrorMsgCode = 0;
 
-    // Outbound handler
-    BLEGattOutbound _bleOutbound;
-
     // UUIDs
     ble_uuid128_t _mainServiceUUID128 = DEFAULT_MAIN_SERVICE_UUID;
     ble_uuid128_t _commandUUID128 = DEFAULT_MESSAGE_COMMAND_UUID;
@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEHistogram
+// Fixed-bucket histogram (no heap, constant time add) with approximate percentiles
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "RaftArduino.h"
+
+class BLEHistogram
+{
+public:
+    // Max number of bucket edges supported
+    static constexpr uint32_t MAX_BUCKET_EDGES = 20;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Constructor
+    /// @param pBucketEdges upper (inclusive) edge of each bucket in ascending order (must have static lifetime) -
+    ///                     values above the last edge are counted in an overflow bucket
+    /// @param numEdges number of edges (max MAX_BUCKET_EDGES)
+    BLEHistogram(const uint32_t* pBucketEdges, uint32_t numEdges) :
+            _pBucketEdges(pBucketEdges),
+            _numEdges(numEdges < MAX_BUCKET_EDGES ? numEdges : MAX_BUCKET_EDGES)
+    {
+        clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear the histogram
+    void clear()
+    {
+        for (uint32_t& count : _counts)
+            count = 0;
+        _numSamples = 0;
+        _sum = 0;
+        _maxVal = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add a sample
+    /// @param val sample value
+    void add(uint32_t val)
+    {
+        uint32_t bucketIdx = 0;
+        while ((bucketIdx < _numEdges) && (val > _pBucketEdges[bucketIdx]))
+            bucketIdx++;
+        _counts[bucketIdx]++;
+        _numSamples++;
+        _sum += val;
+        if (val > _maxVal)
+            _maxVal = val;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of samples
+    uint32_t count() const
+    {
+        return _numSamples;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get mean of samples
+    double mean() const
+    {
+        return _numSamples == 0 ? 0 : (double)_sum / _numSamples;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get max sample value
+    uint32_t maxVal() const
+    {
+        return _maxVal;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get approximate percentile
+    /// @param pct percentile (0..100)
+    /// @return upper edge of the bucket containing the percentile (or the max value for the overflow bucket)
+    uint32_t percentile(uint32_t pct) const
+    {
+        if (_numSamples == 0)
+            return 0;
+        uint64_t rank = ((uint64_t)_numSamples * pct + 99) / 100;
+        if (rank == 0)
+            rank = 1;
+        uint64_t cumulative = 0;
+        for (uint32_t i = 0; i < _numEdges; i++)
+        {
+            cumulative += _counts[i];
+            if (cumulative >= rank)
+                return _pBucketEdges[i] < _maxVal ? _pBucketEdges[i] : _maxVal;
+        }
+        return _maxVal;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get summary JSON
+    /// @return JSON object string (with braces) containing count, mean, p50, p90, p99 and max
+    String getSummaryJSON() const
+    {
+        char buf[120];
+        snprintf(buf, sizeof(buf), R"({"n":%d,"mean":%.1f,"p50":%d,"p90":%d,"p99":%d,"max":%d})",
+                (int)_numSamples, mean(), (int)percentile(50), (int)percentile(90), (int)percentile(99), (int)_maxVal);
+        return buf;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get bucket counts JSON
+    /// @return JSON object string (with braces) containing bucket edges and counts (last count is the overflow bucket)
+    String getBucketsJSON() const
+    {
+        String edgesStr;
+        String countsStr;
+        for (uint32_t i = 0; i <= _numEdges; i++)
+        {
+            if (i < _numEdges)
+                edgesStr += (i == 0 ? "" : ",") + String(_pBucketEdges[i]);
+            countsStr += (i == 0 ? "" : ",") + String(_counts[i]);
+        }
+        return R"({"edges":[)" + edgesStr + R"(],"counts":[)" + countsStr + "]}";
+    }
+
+private:
+    // Bucket edges and counts (the extra count is the overflow bucket)
+    const uint32_t* _pBucketEdges = nullptr;
+    uint32_t _numEdges = 0;
+    uint32_t _counts[MAX_BUCKET_EDGES + 1] = {};
+
+    // Summary
+    uint32_t _numSamples = 0;
+    uint64_t _sum = 0;
+    uint32_t _maxVal = 0;
+};
@@ -0,0 +1,168 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEInboundPool
+// Bounded pool of inbound messages (GATT writes) awaiting handling outside the NimBLE host task
+//
+// The host task flattens each write directly into a retained slot buffer (reserve() then commit()) and the
+// consumer handles the message in place from the slot before releasing it (peekFront() then popFront()) so
+// there is a single copy of each message and no heap churn once the pool has warmed up. When all slots are
+// in use reserve() fails which is reported back to the central as an ATT error.
+//
+// There must be a single producer (the host task) and a single consumer.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftThreading.h"
+#include "SpiramAwareAllocator.h"
+
+class BLEInboundPool
+{
+public:
+    BLEInboundPool()
+    {
+        _accessMutex = xSemaphoreCreateMutex();
+    }
+
+    virtual ~BLEInboundPool()
+    {
+        if (_accessMutex)
+            vSemaphoreDelete(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup the pool (clears the pool)
+    /// @param numSlots number of messages which can be held
+    void setup(uint32_t numSlots)
+    {
+        if (numSlots == 0)
+            numSlots = 1;
+        if (xSemaphoreTake(_accessMutex, portMAX_DELAY) != pdTRUE)
+            return;
+        _slots.resize(numSlots);
+        _frontIdx = 0;
+        _count = 0;
+        _reservedIdx = RESERVED_IDX_NONE;
+        xSemaphoreGive(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Reserve the next free slot for a message (producer only)
+    /// @param msgLen length of the message
+    /// @return pointer to msgLen bytes to fill with the message or nullptr if the pool is full
+    uint8_t* reserve(uint32_t msgLen)
+    {
+        // The back slot is found under the mutex (the consumer may be popping) and then isn't visible to the
+        // consumer until commit() so it can be filled without the mutex
+        if (xSemaphoreTake(_accessMutex, portMAX_DELAY) != pdTRUE)
+            return nullptr;
+        _reservedIdx = _count < _slots.size() ? (_frontIdx + _count) % _slots.size() : RESERVED_IDX_NONE;
+        xSemaphoreGive(_accessMutex);
+        if (_reservedIdx == RESERVED_IDX_NONE)
+            return nullptr;
+        Slot& slot = _slots[_reservedIdx];
+        slot.data.resize(msgLen);
+        return slot.data.data();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Commit the reserved slot so it can be handled by the consumer (producer only)
+    /// @param connHandle connection handle the message was received on
+    void commit(uint16_t connHandle)
+    {
+        if (xSemaphoreTake(_accessMutex, portMAX_DELAY) != pdTRUE)
+            return;
+        // Publish exactly the slot which was reserved (it is always the back slot as only the producer adds)
+        if ((_reservedIdx != RESERVED_IDX_NONE) && (_count < _slots.size()))
+        {
+            _slots[_reservedIdx].connHandle = connHandle;
+            _count = _count + 1;
+        }
+        _reservedIdx = RESERVED_IDX_NONE;
+        xSemaphoreGive(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the message at the front of the pool without removing it (consumer only)
+    /// @param connHandle (out) connection handle the message was received on
+    /// @param pBuf (out) message data - valid until popFront() is called
+    /// @param bufLen (out) message length
+    /// @return true if a message is available
+    bool peekFront(uint16_t& connHandle, const uint8_t*& pBuf, uint32_t& bufLen)
+    {
+        if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(ACCESS_MUTEX_WAIT_MS)) != pdTRUE)
+            return false;
+        bool isValid = _count > 0;
+        if (isValid)
+        {
+            const Slot& slot = _slots[_frontIdx];
+            connHandle = slot.connHandle;
+            pBuf = slot.data.data();
+            bufLen = slot.data.size();
+        }
+        xSemaphoreGive(_accessMutex);
+        return isValid;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Release the message at the front of the pool (consumer only)
+    void popFront()
+    {
+        if (xSemaphoreTake(_accessMutex, portMAX_DELAY) != pdTRUE)
+            return;
+        if (_count > 0)
+        {
+            // Release unusually large buffers rather than retaining them
+            Slot& slot = _slots[_frontIdx];
+            slot.data.clear();
+            if (slot.data.capacity() > SLOT_RETAIN_MAX_BYTES)
+                slot.data.shrink_to_fit();
+            _frontIdx = (_frontIdx + 1) % _slots.size();
+            _count = _count - 1;
+        }
+        xSemaphoreGive(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of messages waiting
+    uint32_t count() const
+    {
+        return _count;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of slots
+    uint32_t numSlots() const
+    {
+        return _slots.size();
+    }
+
+private:
+    // Slot
+    struct Slot
+    {
+        uint16_t connHandle = 0;
+        std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> data;
+    };
+
+    // Slots (circular, front at _frontIdx)
+    std::vector<Slot> _slots;
+    uint32_t _frontIdx = 0;
+    volatile uint32_t _count = 0;
+
+    // Slot reserved by the producer and not yet committed
+    static const uint32_t RESERVED_IDX_NONE = UINT32_MAX;
+    uint32_t _reservedIdx = RESERVED_IDX_NONE;
+
+    // Slot buffers larger than this are released when the message is removed
+    static const uint32_t SLOT_RETAIN_MAX_BYTES = 1024;
+
+    // Access mutex
+    SemaphoreHandle_t _accessMutex = nullptr;
+    static const uint32_t ACCESS_MUTEX_WAIT_MS = 5;
+};
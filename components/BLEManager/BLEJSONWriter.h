@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEJSONWriter
+// Streaming writer for JSON (or other text) into a caller-provided buffer without allocation
+//
+// The writer always counts the full length required (even when the buffer is too small or is nullptr) so it
+// can be used for a size pre-pass followed by a single write into a buffer of the required size.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+class BLEJSONWriter
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Constructor
+    /// @param pBuf buffer to write to (nullptr to only count the length)
+    /// @param bufSize size of buffer (including the terminator)
+    BLEJSONWriter(char* pBuf, uint32_t bufSize) :
+            _pBuf(pBuf),
+            _bufSize(pBuf ? bufSize : 0)
+    {
+        if (_pBuf && (_bufSize > 0))
+            _pBuf[0] = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Append a string
+    /// @param pStr string
+    /// @param len length (or -1 for null terminated)
+    void append(const char* pStr, int32_t len = -1)
+    {
+        if (!pStr)
+            return;
+        uint32_t strLen = len < 0 ? strlen(pStr) : len;
+        // Once the output doesn't fit the buffer holds a terminated prefix of it
+        if (_len + strLen < _bufSize)
+        {
+            memcpy(_pBuf + _len, pStr, strLen);
+            _pBuf[_len + strLen] = 0;
+        }
+        _len += strLen;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Append formatted text
+    /// @param pFormat printf style format
+    void appendf(const char* pFormat, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, pFormat);
+        uint32_t remaining = _len < _bufSize ? _bufSize - _len : 0;
+        int written = vsnprintf(remaining > 0 ? _pBuf + _len : nullptr, remaining, pFormat, args);
+        va_end(args);
+        if (written > 0)
+            _len += written;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Append a separator unless this is the first item
+    /// @param isFirst true if first item (is set false)
+    void appendSep(bool& isFirst)
+    {
+        if (!isFirst)
+            append(",", 1);
+        isFirst = false;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get length required for everything written (excluding the terminator)
+    uint32_t requiredLen() const
+    {
+        return _len;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if the output didn't fit in the buffer
+    bool isTruncated() const
+    {
+        return _len >= _bufSize;
+    }
+
+private:
+    char* _pBuf = nullptr;
+    uint32_t _bufSize = 0;
+    uint32_t _len = 0;
+};
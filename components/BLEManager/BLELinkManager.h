@@ -0,0 +1,210 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLELinkManager
+// Adapts the BLE connection parameters to the traffic on the link and records the negotiated parameters
+//
+// While there is an outbound backlog the preferred (fast) connection interval and latency are requested,
+// once the link has been idle for a while a longer interval with peripheral latency is requested to save
+// power. Requests are rate limited so a bursty link doesn't continually renegotiate.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include "RaftUtils.h"
+#include "BLEConfig.h"
+#include "BLEJSONWriter.h"
+
+class BLELinkManager
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param bleConfig BLE configuration
+    void setup(const BLEConfig& bleConfig)
+    {
+        _isAdaptive = bleConfig.linkAdaptive;
+        _connIntervalIdleBLEUnits = bleConfig.connIntervalIdleBLEUnits;
+        _connLatencyIdle = bleConfig.connLatencyIdle;
+        _idleAfterMs = bleConfig.linkIdleAfterMs;
+        onDisconnect();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if adaptive link management is enabled
+    bool isAdaptive() const
+    {
+        return _isAdaptive;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Handle a new connection (links start in fast mode)
+    /// @param nowMs current time in ms
+    void onConnect(uint32_t nowMs)
+    {
+        onDisconnect();
+        _isConnected = true;
+        _lastBusyMs = nowMs;
+        _lastRequestMs = nowMs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Handle disconnection
+    void onDisconnect()
+    {
+        _isConnected = false;
+        _isIdleMode = false;
+        _requestPending = false;
+        _connIntervalBLEUnits = 0;
+        _connLatency = 0;
+        _supvTimeout10ms = 0;
+        _txPhy = 0;
+        _rxPhy = 0;
+        _maxTxOctets = 0;
+        _maxRxOctets = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record negotiated connection parameters
+    /// @param connIntervalBLEUnits connection interval (1.25ms units)
+    /// @param connLatency peripheral latency (connection events)
+    /// @param supvTimeout10ms supervision timeout (10ms units)
+    void onConnParams(uint16_t connIntervalBLEUnits, uint16_t connLatency, uint16_t supvTimeout10ms)
+    {
+        _connIntervalBLEUnits = connIntervalBLEUnits;
+        _connLatency = connLatency;
+        _supvTimeout10ms = supvTimeout10ms;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record negotiated PHY
+    /// @param txPhy tx PHY (BLE_GAP_LE_PHY_1M, BLE_GAP_LE_PHY_2M or BLE_GAP_LE_PHY_CODED)
+    /// @param rxPhy rx PHY
+    void onPhy(uint8_t txPhy, uint8_t rxPhy)
+    {
+        _txPhy = txPhy;
+        _rxPhy = rxPhy;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record negotiated data length
+    /// @param maxTxOctets max LL payload tx octets
+    /// @param maxRxOctets max LL payload rx octets
+    void onDataLen(uint16_t maxTxOctets, uint16_t maxRxOctets)
+    {
+        _maxTxOctets = maxTxOctets;
+        _maxRxOctets = maxRxOctets;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Service the link manager
+    /// @param nowMs current time in ms
+    /// @param isBacklog true if there is outbound data waiting to be sent
+    /// @return true if the connection parameters should be re-requested (use getTargetConnParams())
+    bool loop(uint32_t nowMs, bool isBacklog)
+    {
+        if (!_isAdaptive || !_isConnected)
+            return false;
+
+        // Change mode on backlog (immediately) or idle (after a period without backlog)
+        if (isBacklog)
+        {
+            _lastBusyMs = nowMs;
+            if (_isIdleMode)
+            {
+                _isIdleMode = false;
+                _requestPending = true;
+            }
+        }
+        else if (!_isIdleMode && Raft::isTimeout(nowMs, _lastBusyMs, _idleAfterMs))
+        {
+            _isIdleMode = true;
+            _requestPending = true;
+        }
+
+        // Rate limit requests
+        if (!_requestPending || !Raft::isTimeout(nowMs, _lastRequestMs, MIN_MS_BETWEEN_REQUESTS))
+            return false;
+        _requestPending = false;
+        _lastRequestMs = nowMs;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the connection parameters to request
+    /// @param connIntervalBLEUnits (in/out) fast (preferred) interval on entry, target interval on exit
+    /// @param connLatency (in/out) fast (preferred) latency on entry, target latency on exit
+    void getTargetConnParams(uint16_t& connIntervalBLEUnits, uint16_t& connLatency) const
+    {
+        if (!_isAdaptive || !_isIdleMode)
+            return;
+        connIntervalBLEUnits = std::max(connIntervalBLEUnits, _connIntervalIdleBLEUnits);
+        connLatency = std::max(connLatency, _connLatencyIdle);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get minimum valid supervision timeout for connection parameters
+    /// @param connIntervalBLEUnits connection interval (1.25ms units)
+    /// @param connLatency peripheral latency
+    /// @return minimum supervision timeout in ms (spec requires > (1 + latency) * interval * 2)
+    static uint32_t getMinSupvTimeoutMs(uint16_t connIntervalBLEUnits, uint16_t connLatency)
+    {
+        return ((1 + connLatency) * connIntervalBLEUnits * 5 / 4) * 2 + SUPV_TIMEOUT_MARGIN_MS;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get link status as JSON
+    /// @return JSON string (without braces)
+    String getJSON() const
+    {
+        char buf[150];
+        BLEJSONWriter writer(buf, sizeof(buf));
+        writeJSON(writer);
+        return buf;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write link parameters JSON (without braces)
+    /// @param writer writer
+    void writeJSON(BLEJSONWriter& writer) const
+    {
+        writer.appendf(R"("link":{"mode":"%s","itvlMs":%.2f,"lat":%d,"supvMs":%d,"txPhy":%d,"rxPhy":%d,"txOct":%d,"rxOct":%d})",
+                !_isAdaptive ? "fixed" : (_isIdleMode ? "idle" : "fast"),
+                _connIntervalBLEUnits * 1.25,
+                _connLatency,
+                _supvTimeout10ms * 10,
+                _txPhy,
+                _rxPhy,
+                _maxTxOctets,
+                _maxRxOctets);
+    }
+
+private:
+    // Settings
+    bool _isAdaptive = false;
+    uint16_t _connIntervalIdleBLEUnits = BLEConfig::DEFAULT_CONN_INTERVAL_IDLE_BLE_UNITS;
+    uint16_t _connLatencyIdle = BLEConfig::DEFAULT_CONN_LATENCY_IDLE;
+    uint32_t _idleAfterMs = BLEConfig::DEFAULT_LINK_IDLE_AFTER_MS;
+
+    // State
+    bool _isConnected = false;
+    bool _isIdleMode = false;
+    bool _requestPending = false;
+    uint32_t _lastBusyMs = 0;
+    uint32_t _lastRequestMs = 0;
+    static const uint32_t MIN_MS_BETWEEN_REQUESTS = 1000;
+    static const uint32_t SUPV_TIMEOUT_MARGIN_MS = 500;
+
+    // Negotiated parameters
+    uint16_t _connIntervalBLEUnits = 0;
+    uint16_t _connLatency = 0;
+    uint16_t _supvTimeout10ms = 0;
+    uint8_t _txPhy = 0;
+    uint8_t _rxPhy = 0;
+    uint16_t _maxTxOctets = 0;
+    uint16_t _maxRxOctets = 0;
+};
@@ -10,11 +10,18 @@
 #pragma once
 #include <stdint.h>
 #include "MovingRate.h"
+#include "BLEHistogram.h"
+#include "BLEJSONWriter.h"
 
 class BLEManStats
 {
 public:
-    BLEManStats()
+    BLEManStats() :
+            _txQueueWaitMs(TX_TIME_BUCKET_EDGES_MS, sizeof(TX_TIME_BUCKET_EDGES_MS) / sizeof(TX_TIME_BUCKET_EDGES_MS[0])),
+            _txCompleteMs(TX_TIME_BUCKET_EDGES_MS, sizeof(TX_TIME_BUCKET_EDGES_MS) / sizeof(TX_TIME_BUCKET_EDGES_MS[0])),
+            _txChunksPerMsg(TX_CHUNKS_BUCKET_EDGES, sizeof(TX_CHUNKS_BUCKET_EDGES) / sizeof(TX_CHUNKS_BUCKET_EDGES[0])),
+            _txRetriesPerMsg(TX_RETRIES_BUCKET_EDGES, sizeof(TX_RETRIES_BUCKET_EDGES) / sizeof(TX_RETRIES_BUCKET_EDGES[0])),
+            _txQueueDepth(TX_QUEUE_DEPTH_BUCKET_EDGES, sizeof(TX_QUEUE_DEPTH_BUCKET_EDGES) / sizeof(TX_QUEUE_DEPTH_BUCKET_EDGES[0]))
     {
         clear();
     }
@@ -26,11 +33,18 @@ public:
         _rxTotalBytes = 0;
         _txTotalBytes = 0;
         _txErrCount = 0;
+        _txTimeoutCount = 0;
+        _rxDropCount = 0;
         _rxTestFrameCount = 0;
         _rxTestFrameBytes = 0;
         _rxRate.clear();
         _txRate.clear();
         _txErrRate.clear();
+        _txQueueWaitMs.clear();
+        _txCompleteMs.clear();
+        _txChunksPerMsg.clear();
+        _txRetriesPerMsg.clear();
+        _txQueueDepth.clear();
         clearTestPerfStats();
     }
     void clearTestPerfStats()
@@ -47,6 +61,11 @@ public:
         _rxRate.sample(_rxTotalBytes);
     }
 
+    void rxDropped()
+    {
+        _rxDropCount++;
+    }
+
     void txMsg(uint32_t msgSize, bool rslt)
     {
         _txMsgCount++;
@@ -56,6 +75,36 @@ public:
         _txErrRate.sample(_txErrCount);
     }
 
+    void txTimeout(uint32_t numChunks)
+    {
+        _txTimeoutCount += numChunks;
+    }
+
+    // Time from a message being queued to its first chunk being sent
+    void txQueueWait(uint32_t waitMs)
+    {
+        _txQueueWaitMs.add(waitMs);
+    }
+
+    // Time from a message being queued to tx complete (confirmation or notify tx event) of its last chunk
+    void txComplete(uint32_t elapsedMs)
+    {
+        _txCompleteMs.add(elapsedMs);
+    }
+
+    // Message sent - number of chunks and send retries (stack busy) for the message
+    void txMsgDone(uint32_t numChunks, uint32_t numRetries)
+    {
+        _txChunksPerMsg.add(numChunks);
+        _txRetriesPerMsg.add(numRetries);
+    }
+
+    // Outbound queue depth (sampled regularly)
+    void txQueueDepth(uint32_t depth)
+    {
+        _txQueueDepth.add(depth);
+    }
+
     void rxTestFrame(uint32_t msgSize, bool seqOK, bool dataOK)
     {
         _rxTestFrameCount++;
@@ -67,41 +116,62 @@ public:
 
     String getJSON(bool includeBraces, bool shortForm) const
     {
-        char buf[200];
+        char buf[400];
+        BLEJSONWriter writer(buf, sizeof(buf));
+        if (includeBraces)
+            writer.append("{", 1);
+        writeJSON(writer, shortForm);
+        if (includeBraces)
+            writer.append("}", 1);
+        return buf;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write stats JSON (without braces)
+    /// @param writer writer
+    /// @param shortForm true for short form
+    void writeJSON(BLEJSONWriter& writer, bool shortForm) const
+    {
         if (shortForm)
         {
-            snprintf(buf, sizeof(buf), R"("rxBPS":%.1f,"txBPS":%.1f)",
+            writer.appendf(R"("rxBPS":%.1f,"txBPS":%.1f)",
                 _rxRate.getRatePerSec(),
                 _txRate.getRatePerSec());
         }
         else
         {
-            snprintf(buf, sizeof(buf), R"("rxM":%d,"rxB":%d,"rxBPS":%.1f,"txM":%d,"txB":%d,"txBPS":%.1f,"txErr":%d,"txErrPS":%.1f)",
+            writer.appendf(R"("rxM":%d,"rxB":%d,"rxBPS":%.1f,"rxDrop":%d,"txM":%d,"txB":%d,"txBPS":%.1f,"txErr":%d,"txErrPS":%.1f,"txTO":%d)",
                 (int)_rxMsgCount,
                 (int)_rxTotalBytes,
                 _rxRate.getRatePerSec(),
+                (int)_rxDropCount,
                 (int)_txMsgCount,
                 (int)_txTotalBytes,
                 _txRate.getRatePerSec(),
                 (int)_txErrCount,
-                _txErrRate.getRatePerSec());
+                _txErrRate.getRatePerSec(),
+                (int)_txTimeoutCount);
         }
-        String json = buf;
         if (_rxTestFrameCount > 0)
         {
-            snprintf(buf, sizeof(buf), R"("tM":%d,"tB":%d,"tBPS":%.1f,"tSeqErrs":%d,"tDatErrs":%d)",
+            writer.appendf(R"(,"tM":%d,"tB":%d,"tBPS":%.1f,"tSeqErrs":%d,"tDatErrs":%d)",
                 (int)_rxTestFrameCount,
                 (int)_rxTestFrameBytes,
                 _rxTestFrameRate.getRatePerSec(),
                 (int)_rxTestSeqErrs,
                 (int)_rxTestDataErrs);
-            json += ",";
-            json += buf;
         }
+    }
+
+    String getHistogramsJSON(bool includeBraces) const
+    {
+        String json = R"("hist":{"qWaitMs":)" + getHistogramJSON(_txQueueWaitMs) +
+                    R"(,"txCmplMs":)" + getHistogramJSON(_txCompleteMs) +
+                    R"(,"chunks":)" + getHistogramJSON(_txChunksPerMsg) +
+                    R"(,"retries":)" + getHistogramJSON(_txRetriesPerMsg) +
+                    R"(,"qDepth":)" + getHistogramJSON(_txQueueDepth) + "}";
         if (includeBraces)
-        {
             return "{" + json + "}";
-        }
         return json;
     }
 
@@ -127,11 +197,29 @@ private:
     uint32_t _rxTotalBytes = 0;
     uint32_t _txTotalBytes = 0;
     uint32_t _txErrCount = 0;
+    uint32_t _txTimeoutCount = 0;
+    uint32_t _rxDropCount = 0;
     #define MOVING_AVERAGE_WINDOW_SIZE 5
     MovingRate<MOVING_AVERAGE_WINDOW_SIZE> _rxRate;
     MovingRate<MOVING_AVERAGE_WINDOW_SIZE> _txRate;
     MovingRate<MOVING_AVERAGE_WINDOW_SIZE> _txErrRate;
 
+    // Outbound distributions
+    static constexpr uint32_t TX_TIME_BUCKET_EDGES_MS[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+    static constexpr uint32_t TX_CHUNKS_BUCKET_EDGES[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 64 };
+    static constexpr uint32_t TX_RETRIES_BUCKET_EDGES[] = { 0, 1, 2, 3, 5, 10, 20, 50 };
+    static constexpr uint32_t TX_QUEUE_DEPTH_BUCKET_EDGES[] = { 0, 1, 2, 4, 8, 12, 16, 24, 32, 48, 64 };
+    BLEHistogram _txQueueWaitMs;
+    BLEHistogram _txCompleteMs;
+    BLEHistogram _txChunksPerMsg;
+    BLEHistogram _txRetriesPerMsg;
+    BLEHistogram _txQueueDepth;
+
+    static String getHistogramJSON(const BLEHistogram& histogram)
+    {
+        return R"({"sum":)" + histogram.getSummaryJSON() + R"(,"dist":)" + histogram.getBucketsJSON() + "}";
+    }
+
     // Test frames (used for performance testing)
     uint32_t _rxTestFrameCount = 0;
     uint32_t _rxTestFrameBytes = 0;
@@ -9,6 +9,7 @@
 
 #include "Logger.h"
 #include "BLEManager.h"
+#include "SysModTiming.h"
 #include "RestAPIEndpointManager.h"
 #include "SysManager.h"
 #include "BLEConfig.h"
@@ -119,6 +120,8 @@ void BLEManager::setup()
 
 void BLEManager::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
 #ifdef CONFIG_BT_ENABLED    
     // Check enabled
     if (!_enableBLE)
@@ -139,6 +142,12 @@ void BLEManager::addRestAPIEndpoints(RestAPIEndpointManager &endpointManager)
     endpointManager.addEndpoint("blerestart", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
                         std::bind(&BLEManager::apiBLERestart, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
                         "Restart BLE");
+    endpointManager.addEndpoint("bletest", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
+                        std::bind(&BLEManager::apiBLETest, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                        "BLE outbound throughput test, bletest/start?len=<frameLen>&frames=<numFrames>&secs=<maxSecs>, bletest/stop, bletest/status");
+    endpointManager.addEndpoint("blestats", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
+                        std::bind(&BLEManager::apiBLEStats, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                        "BLE stats and outbound histograms, blestats, blestats/reset");
 #endif
 }
 
@@ -149,12 +158,72 @@ void BLEManager::addRestAPIEndpoints(RestAPIEndpointManager &endpointManager)
 #ifdef CONFIG_BT_ENABLED
 RaftRetCode BLEManager::apiBLERestart(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("blerestart");
+
     // Restart BLE GAP Server
     _gapServer.restart();
 
     // Restart in progress
     return Raft::setJsonBoolResult(reqStr.c_str(), respStr, true);
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// API BLE outbound throughput test
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode BLEManager::apiBLETest(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
+{
+    SYSMOD_TIMED_API("bletest");
+
+    // Extract parameters
+    std::vector<String> params;
+    std::vector<RaftJson::NameValuePair> nameValues;
+    RestAPIEndpointManager::getParamsAndNameValues(reqStr.c_str(), params, nameValues);
+    RaftJson nvJson = RaftJson::getJSONFromNVPairs(nameValues, true);
+    String cmdStr = params.size() > 1 ? params[1] : "status";
+
+    // Handle command
+    if (cmdStr.equalsIgnoreCase("start"))
+    {
+        uint32_t frameLen = nvJson.getLong("len", DEFAULT_TEST_FRAME_LEN);
+        uint32_t numFrames = nvJson.getLong("frames", 0);
+        uint32_t maxSecs = nvJson.getLong("secs", (numFrames == 0) ? DEFAULT_TEST_DURATION_SECS : 0);
+        if (!_gapServer.startOutboundTest(frameLen, numFrames, maxSecs * 1000))
+            return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "notConnected");
+    }
+    else if (cmdStr.equalsIgnoreCase("stop"))
+    {
+        _gapServer.stopOutboundTest();
+    }
+    else if (!cmdStr.equalsIgnoreCase("status"))
+    {
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "unknownCommand");
+    }
+    return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, _gapServer.getOutboundTestJSON().c_str());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// API BLE stats
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode BLEManager::apiBLEStats(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
+{
+    SYSMOD_TIMED_API("blestats");
+
+    // Extract parameters
+    std::vector<String> params;
+    std::vector<RaftJson::NameValuePair> nameValues;
+    RestAPIEndpointManager::getParamsAndNameValues(reqStr.c_str(), params, nameValues);
+    String cmdStr = params.size() > 1 ? params[1] : "";
+
+    // Handle command (stats are returned before reset)
+    String statsJSON = _gapServer.getStatsJSON();
+    if (cmdStr.equalsIgnoreCase("reset"))
+        _gapServer.clearStats();
+    else if (cmdStr.length() > 0)
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "unknownCommand");
+    return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, statsJSON.c_str());
+}
 #endif
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 #include "sdkconfig.h"
 #include "BLEGapServer.h"
 
@@ -72,8 +73,19 @@ private:
 
     // Restart API
     RaftRetCode apiBLERestart(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
+
+    // Outbound throughput test API
+    static const uint32_t DEFAULT_TEST_FRAME_LEN = 200;
+    static const uint32_t DEFAULT_TEST_DURATION_SECS = 10;
+    RaftRetCode apiBLETest(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
+
+    // Stats API
+    RaftRetCode apiBLEStats(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
 #endif
 
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "BLEMan";
 };
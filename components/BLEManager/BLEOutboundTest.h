@@ -0,0 +1,236 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEOutboundTest
+// Outbound throughput test - generates PRBS test frames which are sent through the normal outbound path
+//
+// Test frames use the same format as the inbound test frames checked in BLEGapServer - byte 0 is zero,
+// bytes 1..4 are the frame index (big-endian), bytes 5..9 are the signature 1f 9d f4 7a b5 and the remaining
+// bytes are generated with the Park-Miller PRBS which continues from frame to frame (starting from 1).
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftUtils.h"
+#include "BLEHistogram.h"
+#include "BLEOutboundWindow.h"
+
+class BLEOutboundTest
+{
+public:
+    static const uint32_t TEST_FRAME_HEADER_LEN = 10;
+    static const uint32_t TEST_FRAME_MAX_LEN = 4096;
+
+    BLEOutboundTest() :
+            _latencyMs(LATENCY_BUCKET_EDGES_MS, sizeof(LATENCY_BUCKET_EDGES_MS) / sizeof(LATENCY_BUCKET_EDGES_MS[0]))
+    {
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Start a test
+    /// @param frameLen length of each test frame (clamped to TEST_FRAME_HEADER_LEN+1..TEST_FRAME_MAX_LEN)
+    /// @param numFrames number of frames to send (0 for no limit)
+    /// @param maxDurationMs max duration of the test (0 for no limit)
+    /// @param usingIndication true if the link is using indication (for reporting)
+    /// @param nowMs current time in ms
+    void start(uint32_t frameLen, uint32_t numFrames, uint32_t maxDurationMs, bool usingIndication, uint32_t nowMs)
+    {
+        _frameLen = Raft::clamp(frameLen, TEST_FRAME_HEADER_LEN + 1, TEST_FRAME_MAX_LEN);
+        _numFrames = numFrames;
+        _maxDurationMs = maxDurationMs;
+        _usingIndication = usingIndication;
+        _startMs = nowMs;
+        _lastSentMs = nowMs;
+        _prevLastSentMs = nowMs;
+        _prbsState = 1;
+        _framesGenerated = 0;
+        _chunksSent = 0;
+        _bytesSent = 0;
+        _retryCount = 0;
+        _timeoutCount = 0;
+        _latencyMs.clear();
+        _notifySentTimes.setup(BLEOutboundWindow::MAX_WINDOW_SIZE, NOTIFY_LATENCY_TIMEOUT_MS);
+        _isGenerating = true;
+        _isActive = true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Stop the test (results remain available)
+    void stop()
+    {
+        _isGenerating = false;
+        _isActive = false;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if test is active (frames are being generated or sent)
+    bool isActive() const
+    {
+        return _isActive;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if more frames should be generated (stops generating when the frame count or duration is reached)
+    /// @param nowMs current time in ms
+    /// @return true if another frame should be generated
+    bool isFrameRequired(uint32_t nowMs)
+    {
+        if (!_isGenerating)
+            return false;
+        if (((_numFrames != 0) && (_framesGenerated >= _numFrames)) ||
+                    ((_maxDurationMs != 0) && Raft::isTimeout(nowMs, _startMs, _maxDurationMs)))
+            _isGenerating = false;
+        return _isGenerating;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Generate the next test frame
+    /// @param frame (out) frame data
+    void genFrame(std::vector<uint8_t>& frame)
+    {
+        frame.resize(_frameLen);
+        frame[0] = 0;
+        frame[1] = (_framesGenerated >> 24) & 0xff;
+        frame[2] = (_framesGenerated >> 16) & 0xff;
+        frame[3] = (_framesGenerated >> 8) & 0xff;
+        frame[4] = _framesGenerated & 0xff;
+        frame[5] = 0x1f;
+        frame[6] = 0x9d;
+        frame[7] = 0xf4;
+        frame[8] = 0x7a;
+        frame[9] = 0xb5;
+        for (uint32_t i = TEST_FRAME_HEADER_LEN; i < _frameLen; i++)
+        {
+            _prbsState = Raft::parkMillerNext(_prbsState);
+            frame[i] = _prbsState & 0xff;
+        }
+        _framesGenerated++;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if the test is finished (all frames generated and the outbound queue is empty)
+    /// @param queueEmpty true if the outbound queue is empty
+    void checkFinished(bool queueEmpty)
+    {
+        if (_isActive && !_isGenerating && queueEmpty)
+            _isActive = false;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record a chunk sent
+    /// @param chunkLen length of chunk
+    /// @param nowMs current time in ms
+    void onChunkSent(uint32_t chunkLen, uint32_t nowMs)
+    {
+        _chunksSent++;
+        _bytesSent += chunkLen;
+        _prevLastSentMs = _lastSentMs;
+        _lastSentMs = nowMs;
+        if (!_usingIndication)
+            _notifySentTimes.takeCredit(nowMs);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Undo the last onChunkSent() (notifications are recorded before sending so this is called if the
+    ///        send didn't succeed)
+    /// @param chunkLen length of chunk
+    void onChunkUnsent(uint32_t chunkLen)
+    {
+        if (_chunksSent > 0)
+            _chunksSent--;
+        _bytesSent = _bytesSent > chunkLen ? _bytesSent - chunkLen : 0;
+        _lastSentMs = _prevLastSentMs;
+        if (!_usingIndication)
+            _notifySentTimes.cancelCredit();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record a send retry (stack busy)
+    void onRetry()
+    {
+        _retryCount++;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record indication confirmation timeouts
+    /// @param numChunks number of chunks timed out
+    void onTimeout(uint32_t numChunks)
+    {
+        _timeoutCount += numChunks;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record tx complete latency for an indication
+    /// @param latencyMs time from send to confirmation
+    void onIndicationComplete(uint32_t latencyMs)
+    {
+        _latencyMs.add(latencyMs);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record tx complete for a notification (notifications complete in order)
+    /// @param nowMs current time in ms
+    void onNotificationComplete(uint32_t nowMs)
+    {
+        _notifySentTimes.reclaimTimedOut(nowMs);
+        uint32_t latencyMs = 0;
+        if (_notifySentTimes.returnCredit(nowMs, latencyMs))
+            _latencyMs.add(latencyMs);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get test results JSON
+    /// @return JSON string (without braces)
+    String getJSON() const
+    {
+        uint32_t elapsedMs = Raft::timeElapsed(_lastSentMs, _startMs);
+        double bytesPerSec = elapsedMs == 0 ? 0 : _bytesSent * 1000.0 / elapsedMs;
+        char buf[220];
+        snprintf(buf, sizeof(buf), R"("active":%d,"mode":"%s","frameLen":%d,"frames":%d,"chunks":%d,"bytes":%d,"ms":%d,"BPS":%.1f,"retries":%d,"timeouts":%d)",
+                _isActive ? 1 : 0,
+                _usingIndication ? "ind" : "notify",
+                (int)_frameLen,
+                (int)_framesGenerated,
+                (int)_chunksSent,
+                (int)_bytesSent,
+                (int)elapsedMs,
+                bytesPerSec,
+                (int)_retryCount,
+                (int)_timeoutCount);
+        return String(buf) + R"(,"latMs":)" + _latencyMs.getSummaryJSON();
+    }
+
+private:
+    // Settings
+    uint32_t _frameLen = TEST_FRAME_HEADER_LEN + 1;
+    uint32_t _numFrames = 0;
+    uint32_t _maxDurationMs = 0;
+    bool _usingIndication = false;
+
+    // State
+    bool _isActive = false;
+    bool _isGenerating = false;
+    uint32_t _prbsState = 1;
+    uint32_t _startMs = 0;
+    uint32_t _lastSentMs = 0;
+    uint32_t _prevLastSentMs = 0;
+    uint32_t _framesGenerated = 0;
+
+    // Results
+    uint32_t _chunksSent = 0;
+    uint32_t _bytesSent = 0;
+    uint32_t _retryCount = 0;
+    uint32_t _timeoutCount = 0;
+
+    // Per-chunk tx complete latency
+    static constexpr uint32_t LATENCY_BUCKET_EDGES_MS[] = { 2, 5, 10, 15, 20, 30, 40, 50, 75, 100, 150, 200, 300, 500, 1000 };
+    BLEHistogram _latencyMs;
+
+    // Send times of notifications awaiting tx complete
+    BLEOutboundWindow _notifySentTimes;
+    static const uint32_t NOTIFY_LATENCY_TIMEOUT_MS = 1000;
+};
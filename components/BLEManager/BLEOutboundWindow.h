@@ -0,0 +1,148 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEOutboundWindow
+// Sliding window of outbound chunks awaiting confirmation (indication ACK)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftUtils.h"
+
+class BLEOutboundWindow
+{
+public:
+    // Max window size supported (fixed storage - no heap)
+    static constexpr uint32_t MAX_WINDOW_SIZE = 32;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup the window
+    /// @param windowSize max number of chunks in flight (clamped to 1..MAX_WINDOW_SIZE)
+    /// @param chunkTimeoutMs time after which an unconfirmed chunk is considered lost
+    void setup(uint32_t windowSize, uint32_t chunkTimeoutMs)
+    {
+        _windowSize = Raft::clamp(windowSize, (uint32_t)1, MAX_WINDOW_SIZE);
+        _chunkTimeoutMs = chunkTimeoutMs;
+        clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear all chunks in flight
+    void clear()
+    {
+        _oldestIdx = 0;
+        _inFlight = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if a credit is available to send another chunk
+    /// @return true if another chunk can be sent
+    bool canSend() const
+    {
+        return _inFlight < _windowSize;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of chunks in flight
+    uint32_t inFlight() const
+    {
+        return _inFlight;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get window size
+    uint32_t windowSize() const
+    {
+        return _windowSize;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Take a credit for a chunk about to be sent
+    /// @param nowMs current time in ms
+    /// @param isMsgEnd true if the chunk completes a message
+    /// @param msgQueuedMs time the message completed by the chunk was queued (if isMsgEnd)
+    /// @return false if no credit available
+    bool takeCredit(uint32_t nowMs, bool isMsgEnd = false, uint32_t msgQueuedMs = 0)
+    {
+        if (!canSend())
+            return false;
+        uint32_t idx = (_oldestIdx + _inFlight) % MAX_WINDOW_SIZE;
+        _sentMs[idx] = nowMs;
+        _isMsgEnd[idx] = isMsgEnd;
+        _msgQueuedMs[idx] = msgQueuedMs;
+        _inFlight++;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Return the most recently taken credit (the chunk was not actually sent)
+    void cancelCredit()
+    {
+        if (_inFlight > 0)
+            _inFlight--;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Return the credit of the oldest chunk in flight (confirmations arrive in order)
+    /// @param nowMs current time in ms
+    /// @param elapsedMs (out) time the chunk was in flight
+    /// @return false if nothing was in flight
+    bool returnCredit(uint32_t nowMs, uint32_t& elapsedMs)
+    {
+        bool isMsgEnd = false;
+        uint32_t msgQueuedMs = 0;
+        return returnCredit(nowMs, elapsedMs, isMsgEnd, msgQueuedMs);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Return the credit of the oldest chunk in flight (confirmations arrive in order)
+    /// @param nowMs current time in ms
+    /// @param elapsedMs (out) time the chunk was in flight
+    /// @param isMsgEnd (out) true if the chunk completed a message
+    /// @param msgQueuedMs (out) time the message completed by the chunk was queued (if isMsgEnd)
+    /// @return false if nothing was in flight
+    bool returnCredit(uint32_t nowMs, uint32_t& elapsedMs, bool& isMsgEnd, uint32_t& msgQueuedMs)
+    {
+        if (_inFlight == 0)
+            return false;
+        elapsedMs = Raft::timeElapsed(nowMs, _sentMs[_oldestIdx]);
+        isMsgEnd = _isMsgEnd[_oldestIdx];
+        msgQueuedMs = _msgQueuedMs[_oldestIdx];
+        _oldestIdx = (_oldestIdx + 1) % MAX_WINDOW_SIZE;
+        _inFlight--;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Reclaim credits for chunks that have been in flight for longer than the timeout
+    /// @param nowMs current time in ms
+    /// @return number of credits reclaimed
+    uint32_t reclaimTimedOut(uint32_t nowMs)
+    {
+        uint32_t numReclaimed = 0;
+        while ((_inFlight > 0) && Raft::isTimeout(nowMs, _sentMs[_oldestIdx], _chunkTimeoutMs))
+        {
+            _oldestIdx = (_oldestIdx + 1) % MAX_WINDOW_SIZE;
+            _inFlight--;
+            numReclaimed++;
+        }
+        return numReclaimed;
+    }
+
+private:
+    // Time each chunk in flight was sent (circular, oldest at _oldestIdx)
+    uint32_t _sentMs[MAX_WINDOW_SIZE] = {};
+
+    // Queued time of the message completed by each chunk (used for message latency stats)
+    bool _isMsgEnd[MAX_WINDOW_SIZE] = {};
+    uint32_t _msgQueuedMs[MAX_WINDOW_SIZE] = {};
+    uint32_t _oldestIdx = 0;
+    uint32_t _inFlight = 0;
+
+    // Settings
+    uint32_t _windowSize = 1;
+    uint32_t _chunkTimeoutMs = 500;
+};
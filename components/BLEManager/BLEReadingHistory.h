@@ -0,0 +1,133 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEReadingHistory
+// Bounded history of readings from a BLE device held in fixed slots (no allocation once setup)
+//
+// Readings are added as they arrive and the oldest is overwritten when all slots are in use. Readings which
+// haven't yet been consumed are returned oldest first by forEachUnread().
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+class BLEReadingHistory
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup (clears the history)
+    /// @param numSlots number of readings held
+    /// @param slotSize max length of a reading (max 255)
+    void setup(uint32_t numSlots, uint32_t slotSize)
+    {
+        _numSlots = numSlots == 0 ? 1 : numSlots;
+        _slotSize = slotSize > UINT8_MAX ? UINT8_MAX : slotSize;
+        _buf.assign(_numSlots * _slotSize, 0);
+        _lens.assign(_numSlots, 0);
+        _nextIdx = 0;
+        _numUnread = 0;
+        _numOverwritten = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add a reading (overwrites the oldest if all slots are used)
+    /// @param pData reading data
+    /// @param dataLen length of reading (truncated to the slot size)
+    void add(const uint8_t* pData, uint32_t dataLen)
+    {
+        if (_numSlots == 0)
+            return;
+        if (dataLen > _slotSize)
+            dataLen = _slotSize;
+        memcpy(_buf.data() + _nextIdx * _slotSize, pData, dataLen);
+        _lens[_nextIdx] = dataLen;
+        _nextIdx = (_nextIdx + 1) % _numSlots;
+        if (_numUnread < _numSlots)
+            _numUnread++;
+        else
+            _numOverwritten++;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of readings not yet consumed
+    uint32_t numUnread() const
+    {
+        return _numUnread;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get total length of readings not yet consumed
+    uint32_t numUnreadBytes() const
+    {
+        uint32_t numBytes = 0;
+        for (uint32_t i = 0; i < _numUnread; i++)
+            numBytes += _lens[(_nextIdx + _numSlots - 1 - i) % _numSlots];
+        return numBytes;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of unconsumed readings overwritten (lost) since setup
+    uint32_t numOverwritten() const
+    {
+        return _numOverwritten;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Call a function for each unconsumed reading (oldest first)
+    /// @param maxReadings max number of readings
+    /// @param fn function called with (pData, dataLen) - returns false to stop
+    /// @return number of readings for which the function returned true
+    template <typename FnType>
+    uint32_t forEachUnread(uint32_t maxReadings, FnType fn) const
+    {
+        uint32_t numDone = 0;
+        uint32_t idx = (_nextIdx + _numSlots - _numUnread) % _numSlots;
+        while ((numDone < _numUnread) && (numDone < maxReadings))
+        {
+            if (!fn(_buf.data() + idx * _slotSize, (uint32_t)_lens[idx]))
+                break;
+            idx = (idx + 1) % _numSlots;
+            numDone++;
+        }
+        return numDone;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Mark the oldest unconsumed readings as consumed
+    /// @param numReadings number of readings
+    void consume(uint32_t numReadings)
+    {
+        _numUnread = numReadings >= _numUnread ? 0 : _numUnread - numReadings;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the unconsumed readings concatenated (oldest first)
+    /// @param data (out) readings appended
+    /// @return number of readings
+    uint32_t getUnread(std::vector<uint8_t>& data) const
+    {
+        return forEachUnread(_numUnread, [&data](const uint8_t* pData, uint32_t dataLen) {
+            data.insert(data.end(), pData, pData + dataLen);
+            return true;
+        });
+    }
+
+private:
+    // Slots
+    std::vector<uint8_t> _buf;
+    std::vector<uint8_t> _lens;
+    uint32_t _numSlots = 0;
+    uint32_t _slotSize = 0;
+
+    // Next slot to write and number of unconsumed readings before it
+    uint32_t _nextIdx = 0;
+    uint32_t _numUnread = 0;
+
+    // Stats
+    uint32_t _numOverwritten = 0;
+};
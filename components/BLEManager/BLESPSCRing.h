@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLESPSCRing
+// Lock-free single-producer single-consumer ring of fixed-size elements
+//
+// The producer fills the element returned by getSlotForWrite() and then calls commitWrite(). The consumer
+// reads the element returned by peek() and then calls pop(). Neither side ever blocks so this is suitable
+// for handing data from the NimBLE host task to the main loop.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+template <typename ElemType>
+class BLESPSCRing
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup the ring (must not be called while the producer or consumer are active)
+    /// @param capacity number of elements (rounded up to a power of 2)
+    void setup(uint32_t capacity)
+    {
+        uint32_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        _elems.resize(size);
+        _mask = size - 1;
+        _head.store(0, std::memory_order_relaxed);
+        _tail.store(0, std::memory_order_relaxed);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the next element to write (producer only)
+    /// @return pointer to element or nullptr if the ring is full
+    ElemType* getSlotForWrite()
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (_elems.empty() || (head - _tail.load(std::memory_order_acquire) > _mask))
+            return nullptr;
+        return &_elems[head & _mask];
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Make the element returned by getSlotForWrite() available to the consumer (producer only)
+    void commitWrite()
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the oldest element (consumer only)
+    /// @return pointer to element (valid until pop()) or nullptr if the ring is empty
+    const ElemType* peek() const
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+            return nullptr;
+        return &_elems[tail & _mask];
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Remove the oldest element (consumer only)
+    void pop()
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail != _head.load(std::memory_order_acquire))
+            _tail.store(tail + 1, std::memory_order_release);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of elements waiting
+    uint32_t count() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get capacity
+    uint32_t capacity() const
+    {
+        return _elems.size();
+    }
+
+private:
+    std::vector<ElemType> _elems;
+    uint32_t _mask = 0;
+
+    // Free-running counts of elements written and read
+    std::atomic<uint32_t> _head = 0;
+    std::atomic<uint32_t> _tail = 0;
+};
@@ -0,0 +1,242 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEScanFilter
+// Filters advertisements received while scanning (central role) before any decoding is done
+//
+// Devices can be selected by MAC address (or MAC address prefix) and by advertised service UUID (16-bit service
+// UUID lists or service data) or manufacturer ID. Full MAC addresses can also be loaded into the controller's
+// filter accept list so that other advertisers never reach the host.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "BLEConfig.h"
+#include "BLEJSONWriter.h"
+
+class BLEScanFilter
+{
+public:
+    // Max number of controller filter accept list entries used (each full MAC is added as public and random)
+    static const uint32_t MAX_CONTROLLER_LIST_LEN = 12;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param bleConfig BLE configuration
+    void setup(const BLEConfig& bleConfig)
+    {
+        // MAC addresses and prefixes (in the order displayed, e.g. "aa:bb:cc" or "aa:bb:cc:dd:ee:ff")
+        _macs.clear();
+        for (const String& macStr : bleConfig.scanFilterMACs)
+        {
+            MACFilter macFilter;
+            if (parseMAC(macStr.c_str(), macFilter))
+                _macs.push_back(macFilter);
+        }
+
+        // Service UUIDs (16-bit hex) and manufacturer IDs (decimal or 0x prefixed hex)
+        _uuids.clear();
+        for (const String& uuidStr : bleConfig.scanFilterUUIDs)
+            _uuids.push_back(strtoul(uuidStr.c_str(), nullptr, 16));
+        _mfrIDs.clear();
+        for (const String& mfrIDStr : bleConfig.scanFilterMfrIDs)
+            _mfrIDs.push_back(strtoul(mfrIDStr.c_str(), nullptr, 0));
+        _useControllerList = bleConfig.scanFilterUseController;
+        _controllerListActive = false;
+        clearStats();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if any filtering is configured
+    bool isActive() const
+    {
+        return !_macs.empty() || !_uuids.empty() || !_mfrIDs.empty();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the MAC addresses to load into the controller filter accept list
+    /// @param addrs (out) addresses (6 bytes each in over-the-air order - least significant byte first)
+    /// @return true if the controller list can be used (all MAC filters are full addresses and they fit)
+    bool getControllerListAddrs(std::vector<uint8_t>& addrs) const
+    {
+        addrs.clear();
+        if (!_useControllerList || _macs.empty() || (_macs.size() * 2 > MAX_CONTROLLER_LIST_LEN))
+            return false;
+        for (const MACFilter& macFilter : _macs)
+        {
+            if (macFilter.len != MAC_LEN)
+                return false;
+            for (uint32_t i = 0; i < MAC_LEN; i++)
+                addrs.push_back(macFilter.addr[MAC_LEN - 1 - i]);
+        }
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record whether the controller filter accept list is in use
+    /// @param isActive true if in use
+    void setControllerListActive(bool isActive)
+    {
+        _controllerListActive = isActive;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if the controller filter accept list is in use
+    bool isControllerListActive() const
+    {
+        return _controllerListActive;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if an advertisement is accepted
+    /// @param pAddr advertiser address (6 bytes in over-the-air order - least significant byte first)
+    /// @param pAdData advertisement data
+    /// @param adDataLen advertisement data length
+    /// @return true if accepted
+    bool isAccepted(const uint8_t* pAddr, const uint8_t* pAdData, uint32_t adDataLen)
+    {
+        bool isOk = (_macs.empty() || matchMAC(pAddr)) &&
+                    ((_uuids.empty() && _mfrIDs.empty()) || matchAdData(pAdData, adDataLen));
+        if (isOk)
+            _numAccepted++;
+        else
+            _numRejected++;
+        return isOk;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear stats
+    void clearStats()
+    {
+        _numAccepted = 0;
+        _numRejected = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write scan filter JSON (without braces)
+    /// @param writer writer
+    void writeJSON(BLEJSONWriter& writer) const
+    {
+        writer.appendf(R"("scanFilt":{"macs":%d,"uuids":%d,"mfrs":%d,"ctrl":%d,"acc":%d,"rej":%d})",
+                (int)_macs.size(),
+                (int)_uuids.size(),
+                (int)_mfrIDs.size(),
+                _controllerListActive ? 1 : 0,
+                (int)_numAccepted,
+                (int)_numRejected);
+    }
+
+private:
+    // MAC filter (address bytes in the order displayed and number of bytes to match)
+    static const uint32_t MAC_LEN = 6;
+    struct MACFilter
+    {
+        uint8_t addr[MAC_LEN] = {};
+        uint8_t len = 0;
+    };
+    std::vector<MACFilter> _macs;
+
+    // Service UUIDs and manufacturer IDs
+    std::vector<uint16_t> _uuids;
+    std::vector<uint16_t> _mfrIDs;
+
+    // Controller filter accept list
+    bool _useControllerList = true;
+    bool _controllerListActive = false;
+
+    // Stats (updated in the NimBLE host task)
+    uint32_t _numAccepted = 0;
+    uint32_t _numRejected = 0;
+
+    // AD types
+    static const uint8_t AD_TYPE_UUID16_INCOMPLETE = 0x02;
+    static const uint8_t AD_TYPE_UUID16_COMPLETE = 0x03;
+    static const uint8_t AD_TYPE_SERVICE_DATA_UUID16 = 0x16;
+    static const uint8_t AD_TYPE_MFR_DATA = 0xff;
+
+    // Parse MAC address or prefix (hex bytes optionally separated by ':' or '-')
+    static bool parseMAC(const char* pStr, MACFilter& macFilter)
+    {
+        macFilter.len = 0;
+        while (*pStr && (macFilter.len < MAC_LEN))
+        {
+            if ((*pStr == ':') || (*pStr == '-'))
+            {
+                pStr++;
+                continue;
+            }
+            char* pEnd = nullptr;
+            char hexByte[3] = { pStr[0], pStr[1], 0 };
+            macFilter.addr[macFilter.len] = strtoul(hexByte, &pEnd, 16);
+            if (pEnd != hexByte + 2)
+                return false;
+            macFilter.len++;
+            pStr += 2;
+        }
+        return macFilter.len > 0;
+    }
+
+    // Match MAC address against filters
+    bool matchMAC(const uint8_t* pAddr) const
+    {
+        for (const MACFilter& macFilter : _macs)
+        {
+            uint32_t i = 0;
+            while ((i < macFilter.len) && (macFilter.addr[i] == pAddr[MAC_LEN - 1 - i]))
+                i++;
+            if (i == macFilter.len)
+                return true;
+        }
+        return false;
+    }
+
+    // Match advertisement data against service UUID and manufacturer ID filters (single pass over AD structures)
+    bool matchAdData(const uint8_t* pAdData, uint32_t adDataLen) const
+    {
+        if (!pAdData)
+            return false;
+        uint32_t pos = 0;
+        while (pos + 1 < adDataLen)
+        {
+            uint32_t len = pAdData[pos];
+            if ((len == 0) || (pos + 1 + len > adDataLen))
+                break;
+            const uint8_t* pData = pAdData + pos + 2;
+            uint32_t dataLen = len - 1;
+            switch (pAdData[pos + 1])
+            {
+                case AD_TYPE_UUID16_INCOMPLETE:
+                case AD_TYPE_UUID16_COMPLETE:
+                    for (uint32_t i = 0; i + 1 < dataLen; i += 2)
+                        if (isInList(_uuids, pData[i] | (pData[i + 1] << 8)))
+                            return true;
+                    break;
+                case AD_TYPE_SERVICE_DATA_UUID16:
+                    if ((dataLen >= 2) && isInList(_uuids, pData[0] | (pData[1] << 8)))
+                        return true;
+                    break;
+                case AD_TYPE_MFR_DATA:
+                    if ((dataLen >= 2) && isInList(_mfrIDs, pData[0] | (pData[1] << 8)))
+                        return true;
+                    break;
+            }
+            pos += len + 1;
+        }
+        return false;
+    }
+
+    // Check list membership
+    static bool isInList(const std::vector<uint16_t>& list, uint16_t val)
+    {
+        for (uint16_t listVal : list)
+            if (listVal == val)
+                return true;
+        return false;
+    }
+};
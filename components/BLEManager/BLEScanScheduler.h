@@ -0,0 +1,192 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLEScanScheduler
+// Adapts the scan duty cycle (central role) to the traffic on peripheral connections and records radio usage
+//
+// While a connection has outbound data queued or in flight the scan window is reduced so that the radio is
+// available for connection events. Once the links have been idle for a while the configured window is used
+// again. So that advertisers are still discovered while links are busy the configured window is restored
+// for a short sweep at regular intervals. Window changes are rate limited as each one restarts the scan.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftUtils.h"
+#include "BLEConfig.h"
+#include "BLEJSONWriter.h"
+
+class BLEScanScheduler
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param bleConfig BLE configuration
+    /// @param nowMs current time in ms
+    void setup(const BLEConfig& bleConfig, uint32_t nowMs)
+    {
+        _scanIntervalMs = bleConfig.scanningIntervalMs;
+        _scanWindowMs = bleConfig.scanningWindowMs;
+        _scanWindowBusyMs = bleConfig.scanWindowBusyMs < _scanWindowMs ? bleConfig.scanWindowBusyMs : _scanWindowMs;
+        _isAdaptive = bleConfig.scanAdaptive && (_scanWindowBusyMs < _scanWindowMs);
+        _idleAfterMs = bleConfig.scanIdleAfterMs;
+        _sweepEveryMs = bleConfig.scanSweepEveryMs;
+        _sweepForMs = bleConfig.scanSweepForMs;
+        _mode = SCAN_MODE_IDLE;
+        _modeStartMs = nowMs;
+        _lastBusyMs = nowMs;
+        _lastFullWindowMs = nowMs;
+        _lastChangeMs = nowMs;
+        _lastLoopMs = nowMs;
+        clearStats();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Service the scheduler (accounts radio usage and changes mode)
+    /// @param nowMs current time in ms
+    /// @param isBusy true if any connection has outbound data queued or in flight
+    /// @param isScanning true if scanning is active
+    /// @param isConnected true if any connection is active
+    /// @return true if the scan window has changed (scanning should be restarted with getScanWindowMs())
+    bool loop(uint32_t nowMs, bool isBusy, bool isScanning, bool isConnected)
+    {
+        // Account time since last call
+        uint32_t elapsedMs = nowMs - _lastLoopMs;
+        _lastLoopMs = nowMs;
+        if (isScanning)
+        {
+            _scanningMs += elapsedMs;
+            if (isConnected)
+                _scanningConnectedMs += elapsedMs;
+            if (_mode == SCAN_MODE_BUSY)
+                _scanningReducedMs += elapsedMs;
+        }
+        if (isConnected)
+            _connectedMs += elapsedMs;
+
+        if (!_isAdaptive)
+            return false;
+
+        // Determine the mode required
+        if (isBusy)
+            _lastBusyMs = nowMs;
+        ScanMode newMode = _mode;
+        switch (_mode)
+        {
+            case SCAN_MODE_IDLE:
+                _lastFullWindowMs = nowMs;
+                if (isBusy)
+                    newMode = SCAN_MODE_BUSY;
+                break;
+            case SCAN_MODE_BUSY:
+                if (!isBusy && Raft::isTimeout(nowMs, _lastBusyMs, _idleAfterMs))
+                    newMode = SCAN_MODE_IDLE;
+                else if ((_sweepEveryMs != 0) && Raft::isTimeout(nowMs, _lastFullWindowMs, _sweepEveryMs))
+                    newMode = SCAN_MODE_SWEEP;
+                break;
+            case SCAN_MODE_SWEEP:
+                _lastFullWindowMs = nowMs;
+                if (Raft::isTimeout(nowMs, _modeStartMs, _sweepForMs))
+                    newMode = isBusy ? SCAN_MODE_BUSY : SCAN_MODE_IDLE;
+                break;
+        }
+        if (newMode == _mode)
+            return false;
+
+        // Rate limit changes which need the scan to be restarted
+        bool windowChange = getWindowForMode(newMode) != getWindowForMode(_mode);
+        if (windowChange && !Raft::isTimeout(nowMs, _lastChangeMs, MIN_MS_BETWEEN_CHANGES))
+            return false;
+        _mode = newMode;
+        _modeStartMs = nowMs;
+        if (!windowChange)
+            return false;
+        _lastChangeMs = nowMs;
+        _windowChanges++;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the scan interval to use
+    uint32_t getScanIntervalMs() const
+    {
+        return _scanIntervalMs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the scan window to use
+    uint32_t getScanWindowMs() const
+    {
+        return getWindowForMode(_mode);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear radio usage stats
+    void clearStats()
+    {
+        _scanningMs = 0;
+        _scanningConnectedMs = 0;
+        _scanningReducedMs = 0;
+        _connectedMs = 0;
+        _windowChanges = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write scan scheduler JSON (without braces)
+    /// @param writer writer
+    void writeJSON(BLEJSONWriter& writer) const
+    {
+        writer.appendf(R"("scan":{"mode":"%s","itvlMs":%d,"winMs":%d,"scanS":%d,"scanConnS":%d,"scanRedS":%d,"connS":%d,"winChg":%d})",
+                !_isAdaptive ? "fixed" : (_mode == SCAN_MODE_IDLE ? "idle" : (_mode == SCAN_MODE_BUSY ? "busy" : "sweep")),
+                (int)_scanIntervalMs,
+                (int)getScanWindowMs(),
+                (int)(_scanningMs / 1000),
+                (int)(_scanningConnectedMs / 1000),
+                (int)(_scanningReducedMs / 1000),
+                (int)(_connectedMs / 1000),
+                (int)_windowChanges);
+    }
+
+private:
+    // Modes
+    enum ScanMode
+    {
+        SCAN_MODE_IDLE,
+        SCAN_MODE_BUSY,
+        SCAN_MODE_SWEEP
+    };
+
+    // Settings
+    bool _isAdaptive = false;
+    uint32_t _scanIntervalMs = BLEConfig::DEFAULT_SCAN_INTERVAL_MS;
+    uint32_t _scanWindowMs = BLEConfig::DEFAULT_SCAN_WINDOW_MS;
+    uint32_t _scanWindowBusyMs = BLEConfig::DEFAULT_SCAN_WINDOW_BUSY_MS;
+    uint32_t _idleAfterMs = BLEConfig::DEFAULT_SCAN_IDLE_AFTER_MS;
+    uint32_t _sweepEveryMs = BLEConfig::DEFAULT_SCAN_SWEEP_EVERY_MS;
+    uint32_t _sweepForMs = BLEConfig::DEFAULT_SCAN_SWEEP_FOR_MS;
+
+    // State
+    ScanMode _mode = SCAN_MODE_IDLE;
+    uint32_t _modeStartMs = 0;
+    uint32_t _lastBusyMs = 0;
+    uint32_t _lastFullWindowMs = 0;
+    uint32_t _lastChangeMs = 0;
+    uint32_t _lastLoopMs = 0;
+    static const uint32_t MIN_MS_BETWEEN_CHANGES = 500;
+
+    // Stats
+    uint64_t _scanningMs = 0;
+    uint64_t _scanningConnectedMs = 0;
+    uint64_t _scanningReducedMs = 0;
+    uint64_t _connectedMs = 0;
+    uint32_t _windowChanges = 0;
+
+    // Window for mode
+    uint32_t getWindowForMode(ScanMode mode) const
+    {
+        return mode == SCAN_MODE_BUSY ? _scanWindowBusyMs : _scanWindowMs;
+    }
+};
@@ -55,72 +55,56 @@ void BLEStdServices::setup(std::vector<BLEStandardServiceConfig>& serviceConfigs
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief updateStdServices
-/// @param gapConnHandle GAP connection handle
+/// @brief updateStdServices - samples the named values and notifies subscribed centrals of changes
 /// @param pNamedValueProvider named value provider
-void BLEStdServices::updateStdServices(uint16_t gapConnHandle, NamedValueProvider* pNamedValueProvider)
+/// The formatted value is cached and only updated when the value changes. Changes are signalled with
+/// ble_gatts_chr_updated() which sends a notification or indication to each connection that has subscribed
+/// (per its CCCD) and nothing to the others. All changes found in a pass are signalled together so they
+/// can go out in the same connection event.
+void BLEStdServices::updateStdServices(NamedValueProvider* pNamedValueProvider)
 {
     // Check if time to for services update
-    if (Raft::isTimeout(millis(), _lastServiceUpdateTimeMs, OVERALL_SERVICE_UPDATE_INTERVAL_MS))
-    {
-        // Update timeout
-        _lastServiceUpdateTimeMs = millis();
-
-        // Iterate through configured services
-        for (auto& stdService : _standardServices)
-        {
-            // Check if service is enabled and namedvalue provider is valid
-            if (!stdService.enable || !pNamedValueProvider)
-                continue;
-
-            // Check if time to for update
-            if ((stdService.updateIntervalMs != 0) && Raft::isTimeout(millis(), stdService.lastUpdateTimeMs, stdService.updateIntervalMs))
-            {
-                // Update last notify time
-                stdService.lastUpdateTimeMs = millis();
+    if (!pNamedValueProvider || !Raft::isTimeout(millis(), _lastServiceUpdateTimeMs, OVERALL_SERVICE_UPDATE_INTERVAL_MS))
+        return;
+    _lastServiceUpdateTimeMs = millis();
 
-                // Get SysMod and namedValue used to access the attribute
-                RaftJson settings(stdService.serviceSettings);
-                String sysModName = settings.getString("sysMod", "");
-                String namedValueName = settings.getString("namedValue", "");
+    // Iterate through configured services
+    for (auto& stdService : _standardServices)
+    {
+        // Check if service is enabled and has a value to sample
+        if (!stdService.enable || (stdService.namedValueName.length() == 0))
+            continue;
 
-                // Get attribute value
-                bool isValid = false;
-                stdService.attribValue = pNamedValueProvider->getNamedValue(sysModName.c_str(), namedValueName.c_str(), isValid);
-                if (!isValid)
-                    continue;
+        // Check if time to sample
+        if ((stdService.updateIntervalMs == 0) || !Raft::isTimeout(millis(), stdService.lastUpdateTimeMs, stdService.updateIntervalMs))
+            continue;
+        stdService.lastUpdateTimeMs = millis();
 
-                // Check if service is notify or indicate
-                if (stdService.notify || stdService.indicate)
-                {
+        // Get attribute value
+        bool isValid = false;
+        double attribValue = pNamedValueProvider->getNamedValue(stdService.sysModName.c_str(), stdService.namedValueName.c_str(), isValid);
+        if (!isValid)
+            continue;
 
-                    // Get mbuf based on service type
-                    std::vector<uint8_t> data;
-                    formatAttributeData(stdService, data);
-                    struct os_mbuf* pMbuf = ble_hs_mbuf_from_flat(data.data(), data.size());
-                    if (!pMbuf)
-                        continue;
+        // Format and check for change
+        uint8_t attribData[MAX_ATTRIB_DATA_LEN];
+        uint32_t attribDataLen = formatAttributeData(stdService.attribType, attribValue, attribData);
+        stdService.attribValue = attribValue;
+        if (stdService.attribDataValid && (memcmp(attribData, stdService.attribData, attribDataLen) == 0))
+            continue;
+        memcpy(stdService.attribData, attribData, attribDataLen);
+        stdService.attribDataLen = attribDataLen;
+        stdService.attribDataValid = true;
 
-                    // Send update
-                    if (stdService.notify)
-                    {
-                        // Notify
-                        ble_gatts_notify_custom(gapConnHandle, stdService.attribHandle, pMbuf);
-                    }
-                    else if (stdService.indicate)
-                    {
-                        // Indicate
-                        ble_gatts_indicate_custom(gapConnHandle, stdService.attribHandle, pMbuf);
-                    }
+        // Notify subscribed centrals
+        if (stdService.notify || stdService.indicate)
+            ble_gatts_chr_updated(stdService.attribHandle);
 
-                    // Debug
+        // Debug
 #ifdef DEBUG_BLE_STD_SERVICES
-                    LOG_I(MODULE_PREFIX, "updateStdServices service %s notify %d indicate %d read %d value %.2f",
-                        stdService.serviceName.c_str(), stdService.notify, stdService.indicate, stdService.read, stdService.attribValue);
+        LOG_I(MODULE_PREFIX, "updateStdServices service %s changed notify %d indicate %d read %d value %.2f",
+            stdService.serviceName.c_str(), stdService.notify, stdService.indicate, stdService.read, stdService.attribValue);
 #endif
-                }
-            }
-        }
     }
 }
 
@@ -171,6 +155,10 @@ void BLEStdServices::setupService(const BLEStandardServiceConfig& serviceConfig,
     service.attribType = attribDataType;
     service.serviceSettings = serviceConfig.serviceSettings;
     service.updateIntervalMs = serviceConfig.updateIntervalMs;
+    RaftJson settings(service.serviceSettings);
+    service.sysModName = settings.getString("sysMod", "");
+    service.namedValueName = settings.getString("namedValue", "");
+    service.attribDataLen = formatAttributeData(service.attribType, 0, service.attribData);
     _standardServices.push_back(service);
 
     // Service characteristics
@@ -180,9 +168,10 @@ void BLEStdServices::setupService(const BLEStandardServiceConfig& serviceConfig,
         {
             .uuid = pCharacteristicUUID,
             .access_cb = pAccessCb,
-            .arg = this,
+            .arg = &_standardServices.back(),
             .descriptors = nullptr,
-            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+            .flags = (uint16_t)(BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY | 
+                            (service.indicate ? BLE_GATT_CHR_F_INDICATE : 0)),
             .min_key_size = 0,
             .val_handle = &_standardServices.back().attribHandle,
             .cpfd = nullptr
@@ -24,9 +24,9 @@ public:
     /// @param servicesList List of services to add to
     void setup(std::vector<BLEStandardServiceConfig>& serviceConfigs, std::vector<struct ble_gatt_svc_def>& servicesList);
 
-    /// @brief updateStdServices
-    /// @param conn_handle GAP connection handle
-    void updateStdServices(uint16_t conn_handle, NamedValueProvider* pNamedValueProvider);
+    /// @brief updateStdServices - samples the named values and notifies subscribed centrals of changes
+    /// @param pNamedValueProvider named value provider
+    void updateStdServices(NamedValueProvider* pNamedValueProvider);
 
     // Fixed values for system information - must not be changed after setup
     static String systemManufacturer;
@@ -45,6 +45,7 @@ private:
     };
 
     // Standard services
+    static const uint32_t MAX_ATTRIB_DATA_LEN = 2;
     struct StandardService
     {
         String serviceName;
@@ -53,39 +54,43 @@ private:
         bool indicate:1 = false;
         bool read:1 = false;
         String serviceSettings;
+        String sysModName;
+        String namedValueName;
         uint16_t attribHandle = 0;
         ServiceDataType attribType = ServiceDataType::BYTE;
-        double attribValue;
+        double attribValue = 0;
         uint32_t updateIntervalMs = 0;
         uint32_t lastUpdateTimeMs = 0;
         std::vector<struct ble_gatt_chr_def> characteristicList;
+
+        // Formatted attribute value (returned for reads and notifications without re-formatting) - the length
+        // is fixed by the data type so the data can be updated while the NimBLE task is reading it
+        uint8_t attribData[MAX_ATTRIB_DATA_LEN] = {};
+        uint8_t attribDataLen = 0;
+        bool attribDataValid = false;
     };
     std::list<StandardService> _standardServices;
 
     // Format attribute data for BLE
-    static void formatAttributeData(StandardService& service, std::vector<uint8_t>& data)
+    static uint32_t formatAttributeData(ServiceDataType attribType, double attribValue, uint8_t* pData)
     {
         // Check data type
-        if (service.attribType == ServiceDataType::BYTE)
-        {
-            uint8_t byteVal = (uint8_t)service.attribValue;
-            data.push_back(byteVal);
-        }
-        else if (service.attribType == ServiceDataType::FLAG0_AND_BYTE)
+        if (attribType == ServiceDataType::FLAG0_AND_BYTE)
         {
-            uint8_t byteVal = (uint8_t)service.attribValue;
-            data.push_back(0);
-            data.push_back(byteVal);
+            pData[0] = 0;
+            pData[1] = (uint8_t)attribValue;
+            return 2;
         }
+        pData[0] = (uint8_t)attribValue;
+        return 1;
     }
 
-    // Static callback function to single byte values
+    // Static callback function for attribute values (arg is the StandardService)
     static int attribValueAccessCb(uint16_t conn_handle, uint16_t attr_handle,
                                             struct ble_gatt_access_ctxt *ctxt, void *arg) {
         if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-            std::vector<uint8_t> data;
-            formatAttributeData(static_cast<BLEStdServices*>(arg)->_standardServices.back(), data);
-            os_mbuf_append(ctxt->om, data.data(), data.size());
+            const StandardService* pService = static_cast<const StandardService*>(arg);
+            os_mbuf_append(ctxt->om, pService->attribData, pService->attribDataLen);
             return 0;
         }
         return BLE_ATT_ERR_UNLIKELY;
@@ -0,0 +1,171 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BLETimerWheel
+// Hashed timer wheel for per-entry timeouts (e.g. device offline detection) with O(1) schedule and cancel
+//
+// Timers are identified by a small integer ID (e.g. a device table entry number) and each ID has at most one
+// timer. Timers are held in doubly-linked lists hung from wheel slots chosen by expiry tick so servicing the
+// wheel only visits slots which have come due rather than every timer. Timeouts longer than a revolution of
+// the wheel stay in their slot until the tick they expire on comes round. Ticks are counted from the elapsed
+// time between calls (not derived from the absolute time) so the wheel keeps running when millis() wraps.
+//
+// Not thread safe - the owner must provide locking.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class BLETimerWheel
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup the wheel (cancels all timers)
+    /// @param maxIDs number of timer IDs (0..maxIDs-1)
+    /// @param numSlots number of wheel slots (rounded up to a power of 2)
+    /// @param tickMs resolution of timeouts in ms
+    /// @param nowMs current time in ms
+    void setup(uint32_t maxIDs, uint32_t numSlots, uint32_t tickMs, uint32_t nowMs)
+    {
+        uint32_t size = 2;
+        while (size < numSlots)
+            size <<= 1;
+        _slotHeads.assign(size, NO_ID);
+        _timers.assign(maxIDs > NO_ID ? NO_ID : maxIDs, Timer());
+        _tickMs = tickMs == 0 ? 1 : tickMs;
+        _curTick = 0;
+        _curTickMs = nowMs;
+        _numActive = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Start (or restart) the timer for an ID
+    /// @param id timer ID
+    /// @param nowMs current time in ms
+    /// @param timeoutMs timeout in ms
+    void schedule(uint32_t id, uint32_t nowMs, uint32_t timeoutMs)
+    {
+        if (id >= _timers.size())
+            return;
+        cancel(id);
+
+        // Expire on the first tick at or after the timeout (and never on the current tick)
+        uint32_t expiryTick = _curTick + (elapsedMs(nowMs) + timeoutMs + _tickMs - 1) / _tickMs;
+        if ((int32_t)(expiryTick - _curTick) <= 0)
+            expiryTick = _curTick + 1;
+
+        // Link at the head of the slot
+        Timer& timer = _timers[id];
+        uint32_t slotIdx = expiryTick & (_slotHeads.size() - 1);
+        timer.expiryTick = expiryTick;
+        timer.isActive = true;
+        timer.prevID = NO_ID;
+        timer.nextID = _slotHeads[slotIdx];
+        if (timer.nextID != NO_ID)
+            _timers[timer.nextID].prevID = id;
+        _slotHeads[slotIdx] = id;
+        _numActive++;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Cancel the timer for an ID (if active)
+    /// @param id timer ID
+    void cancel(uint32_t id)
+    {
+        if ((id >= _timers.size()) || !_timers[id].isActive)
+            return;
+        Timer& timer = _timers[id];
+        if (timer.prevID != NO_ID)
+            _timers[timer.prevID].nextID = timer.nextID;
+        else
+            _slotHeads[timer.expiryTick & (_slotHeads.size() - 1)] = timer.nextID;
+        if (timer.nextID != NO_ID)
+            _timers[timer.nextID].prevID = timer.prevID;
+        timer.isActive = false;
+        timer.prevID = NO_ID;
+        timer.nextID = NO_ID;
+        _numActive--;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Advance the wheel to the current time calling a function for each expired timer
+    /// @param nowMs current time in ms
+    /// @param fn function called with the ID of each expired timer (the timer is no longer active)
+    template <typename FnType>
+    void advance(uint32_t nowMs, FnType fn)
+    {
+        // Whole ticks elapsed (the remainder is carried to the next call)
+        uint32_t numTicks = elapsedMs(nowMs) / _tickMs;
+        if (_slotHeads.empty() || (numTicks == 0))
+            return;
+        uint32_t nowTick = _curTick + numTicks;
+        _curTickMs += numTicks * _tickMs;
+
+        // Each slot need only be visited once however long it has been since the last call
+        if (numTicks > _slotHeads.size())
+            numTicks = _slotHeads.size();
+        for (uint32_t i = 0; i < numTicks; i++)
+        {
+            uint32_t slotIdx = (nowTick - i) & (_slotHeads.size() - 1);
+            uint16_t id = _slotHeads[slotIdx];
+            while (id != NO_ID)
+            {
+                uint16_t nextID = _timers[id].nextID;
+                if ((int32_t)(_timers[id].expiryTick - nowTick) <= 0)
+                {
+                    cancel(id);
+                    fn(id);
+                }
+                id = nextID;
+            }
+        }
+        _curTick = nowTick;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if the timer for an ID is active
+    /// @param id timer ID
+    bool isActive(uint32_t id) const
+    {
+        return (id < _timers.size()) && _timers[id].isActive;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of active timers
+    uint32_t numActive() const
+    {
+        return _numActive;
+    }
+
+private:
+    // Timer for each ID
+    static constexpr uint16_t NO_ID = UINT16_MAX;
+    struct Timer
+    {
+        uint32_t expiryTick = 0;
+        uint16_t prevID = NO_ID;
+        uint16_t nextID = NO_ID;
+        bool isActive = false;
+    };
+    std::vector<Timer> _timers;
+
+    // First timer in each slot
+    std::vector<uint16_t> _slotHeads;
+
+    // Tick count and the time in ms at which the current tick started
+    uint32_t _tickMs = 1;
+    uint32_t _curTick = 0;
+    uint32_t _curTickMs = 0;
+    uint32_t _numActive = 0;
+
+    // Time since the current tick started (wrap safe - times before the current tick count as 0)
+    uint32_t elapsedMs(uint32_t nowMs) const
+    {
+        int32_t elapsed = (int32_t)(nowMs - _curTickMs);
+        return elapsed > 0 ? elapsed : 0;
+    }
+};
@@ -19,109 +19,220 @@
 #define PLACE_IN_SECTION(x)
 #endif
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoded BTHome record
+//
+// Fixed layout record passed to the bus device manager (multi-byte values are big-endian). Bytes 0..18 are
+// the original BLEBTHome record (time, packet ID, address, motion, battery, temperature, illuminance) with
+// the original encoding of absent values (motion 0, battery 0xff, temperature 0x7fff, illuminance 0xffffffff).
+// The device manager only passes the full record on for the BLEBTHomeExt device type - for BLEBTHome it is
+// truncated to the original 19 bytes and only adverts with motion are passed on (as before). Further slots
+// which weren't present in the advert are all 0xff (unsigned) or the max positive value (signed). Binary
+// sensor objects (0x0F..0x2D) are packed into a bitmask of values and a bitmask of which were present
+// (bit = object ID - 0x0F).
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Define the struct to hold length and factor
-struct BTHomeSensorType {
-    int8_t len;    // Length of the data in bytes
-    int8_t factor; // Factor as an encoded value (1=1, 2=0.1, 3=0.01, etc.)
+// Record header
+static const uint32_t BTHOME_RECORD_TIME_POS = 0;
+static const uint32_t BTHOME_RECORD_ADDR_POS = 3;
+static const uint32_t BTHOME_RECORD_ADDR_LEN = 8;
+static const uint32_t BTHOME_RECORD_LEN = 64;
+static const uint32_t BTHOME_LEGACY_RECORD_LEN = 19;
+
+// Record slots
+enum BTHomeRecordSlot : uint8_t
+{
+    BTHOME_SLOT_NONE,
+    BTHOME_SLOT_PACKET_ID,
+    BTHOME_SLOT_MOTION,
+    BTHOME_SLOT_BATTERY,
+    BTHOME_SLOT_TEMPERATURE,
+    BTHOME_SLOT_ILLUMINANCE,
+    BTHOME_SLOT_HUMIDITY,
+    BTHOME_SLOT_PRESSURE,
+    BTHOME_SLOT_CO2,
+    BTHOME_SLOT_TVOC,
+    BTHOME_SLOT_PM25,
+    BTHOME_SLOT_PM10,
+    BTHOME_SLOT_VOLTAGE,
+    BTHOME_SLOT_CURRENT,
+    BTHOME_SLOT_POWER,
+    BTHOME_SLOT_ENERGY,
+    BTHOME_SLOT_MOISTURE,
+    BTHOME_SLOT_COUNT,
+    BTHOME_SLOT_UV_INDEX,
+    BTHOME_SLOT_BUTTON,
+    BTHOME_SLOT_BINARY_VALUES,
+    BTHOME_SLOT_BINARY_PRESENT,
+    BTHOME_NUM_SLOTS
 };
 
-// BTHome sensor types
-static const BTHomeSensorType BTHOME_SENSOR_TYPES[] PLACE_IN_SECTION(".rodata") = {
-    {1, 1},  // 0x00 Packet ID
-    {1, 1},  // 0x01 Battery
-    {2, 3},  // 0x02 Temperature (0.01 factor)
-    {2, 3},  // 0x03 Humidity (0.01 factor)
-    {3, 3},  // 0x04 Pressure (0.01 factor)
-    {3, 3},  // 0x05 Illuminance (0.01 factor)
-    {2, 3},  // 0x06 Mass (kg) (0.01 factor)
-    {2, 3},  // 0x07 Mass (lb) (0.01 factor)
-    {2, 3},  // 0x08 Dewpoint (0.01 factor)
-    {1, 1},  // 0x09 Count
-    {3, 4},  // 0x0A Energy (0.001 factor)
-    {3, 3},  // 0x0B Power (0.01 factor)
-    {2, 4},  // 0x0C Voltage (0.001 factor)
-    {2, 1},  // 0x0D PM2.5
-    {2, 1},  // 0x0E PM10
-    {1, 1},  // 0x0F Generic Boolean
-    {1, 1},  // 0x10 Power
-    {1, 1},  // 0x11 Opening
-    {2, 1},  // 0x12 CO2
-    {2, 1},  // 0x13 TVOC
-    {2, 3},  // 0x14 Moisture (0.01 factor)
-    {1, 1},  // 0x15 Battery
-    {1, 1},  // 0x16 Battery Charging
-    {1, 1},  // 0x17 Carbon Monoxide
-    {1, 1},  // 0x18 Cold
-    {1, 1},  // 0x19 Connectivity
-    {1, 1},  // 0x1A Door
-    {1, 1},  // 0x1B Garage Door
-    {1, 1},  // 0x1C Gas
-    {1, 1},  // 0x1D Heat
-    {1, 1},  // 0x1E Light
-    {1, 1},  // 0x1F Lock
-    {1, 1},  // 0x20 Moisture
-    {1, 1},  // 0x21 Motion
-    {1, 1},  // 0x22 Moving
-    {1, 1},  // 0x23 Occupancy
-    {1, 1},  // 0x24 Plug
-    {1, 1},  // 0x25 Presence
-    {1, 1},  // 0x26 Problem
-    {1, 1},  // 0x27 Running
-    {1, 1},  // 0x28 Safety
-    {1, 1},  // 0x29 Smoke
-    {1, 1},  // 0x2A Sound
-    {1, 1},  // 0x2B Tamper
-    {1, 1},  // 0x2C Vibration
-    {1, 1},  // 0x2D Window
-    {1, 1},  // 0x2E Humidity
-    {1, 1},  // 0x2F Moisture
-    {-1, 0}, // 0x30 Unused
-    {-1, 0}, // 0x31 Unused
-    {-1, 0}, // 0x32 Unused
-    {-1, 0}, // 0x33 Unused
-    {-1, 0}, // 0x34 Unused
-    {-1, 0}, // 0x35 Unused
-    {-1, 0}, // 0x36 Unused
-    {-1, 0}, // 0x37 Unused
-    {-1, 0}, // 0x38 Unused
-    {-1, 0}, // 0x39 Unused
-    {3, 4},  // 0x3A Event Button
-    {-1, 0}, // 0x3B Unused
-    {2, 4},  // 0x3C Event Dimmer
-    {2, 1},  // 0x3D Count (16-bit, factor 1)
-    {4, 1},  // 0x3E Count (32-bit, factor 1)
-    {2, 2},  // 0x3F Rotation (0.1 factor)
-    {2, 1},  // 0x40 Distance (mm)
-    {2, 2},  // 0x41 Distance (m, 0.1 factor)
-    {3, 4},  // 0x42 Duration (0.001 factor)
-    {2, 4},  // 0x43 Current (0.001 factor)
-    {2, 3},  // 0x44 Speed (0.01 factor)
-    {2, 2},  // 0x45 Temperature (0.1 factor)
-    {1, 10}, // 0x46 UV Index (special case 0.35)
-    {2, 2},  // 0x47 Volume
-    {2, 1},  // 0x48 Volume (mL)
-    {2, 4},  // 0x49 Volume Flow Rate (0.001 factor)
-    {2, 4},  // 0x4A Voltage (2 bytes, 0.1 factor)
-    {3, 4},  // 0x4B Gas (3 bytes, 0.001 factor)
-    {4, 4},  // 0x4C Gas (4 bytes, 0.001 factor)
-    {4, 4},  // 0x4D Energy (4 bytes, 0.001 factor)
-    {4, 4},  // 0x4E Volume (4 bytes, 0.001 factor)
-    {4, 4},  // 0x4F Water (4 bytes, 0.001 factor)
-    {4, 1},  // 0x50 Timestamp (4 bytes, no factor)
-    {2, 4},  // 0x51 Acceleration (2 bytes, 0.001 factor)
-    {2, 4},  // 0x52 Gyroscope (2 bytes, 0.001 factor)
-    {-1, 0}, // 0x53 Text (variable length, no factor)
-    {-1, 0}, // 0x54 Raw (variable length, no factor)
-    {4, 4},  // 0x55 Volume Storage (4 bytes, 0.001 factor)
-    {2, 1},  // 0x56 Conductivity (2 bytes, no factor)
-    {1, 1},  // 0x57 Temperature (1 byte, 1 factor)
-    {1, 10}, // 0x58 Temperature (1 byte, 0.35 factor)
-    {1, 1},  // 0x59 Count (1 byte, signed)
-    {2, 1},  // 0x5A Count (2 bytes, signed)
-    {4, 1},  // 0x5B Count (4 bytes, signed)
-    {4, 3},  // 0x5C Power (4 bytes, 0.01 factor, signed)
-    {2, 4},  // 0x5D Current (2 bytes, 0.001 factor, signed)
+// Slot layout - factor is the units of the slot encoded as for objects (1=1, 2=0.1, 3=0.01, 4=0.001)
+// and maxCount is the number of repeated objects which can be held (e.g. one per button)
+struct BTHomeSlotLayout {
+    uint8_t pos;
+    uint8_t size;
+    uint8_t maxCount;
+    bool isSigned;
+    int8_t factor;
 };
 
-static const int BTHOME_SENSOR_TYPE_COUNT = sizeof(BTHOME_SENSOR_TYPES) / sizeof(BTHomeSensorType);
+static constexpr BTHomeSlotLayout BTHOME_SLOT_LAYOUTS[BTHOME_NUM_SLOTS] = {
+    {0, 0, 0, false, 1},    // None
+    {2, 1, 1, false, 1},    // Packet ID
+    {11, 1, 1, false, 1},   // Motion
+    {12, 1, 1, false, 1},   // Battery %
+    {13, 2, 1, true, 3},    // Temperature (0.01 C)
+    {15, 4, 1, false, 3},   // Illuminance (0.01 lux)
+    {19, 2, 1, false, 3},   // Humidity (0.01 %)
+    {21, 4, 1, false, 3},   // Pressure (0.01 hPa)
+    {25, 2, 1, false, 1},   // CO2 (ppm)
+    {27, 2, 1, false, 1},   // TVOC (ug/m3)
+    {29, 2, 1, false, 1},   // PM2.5 (ug/m3)
+    {31, 2, 1, false, 1},   // PM10 (ug/m3)
+    {33, 2, 1, false, 4},   // Voltage (mV)
+    {35, 2, 1, true, 4},    // Current (mA)
+    {37, 4, 1, true, 3},    // Power (0.01 W)
+    {41, 4, 1, false, 4},   // Energy (Wh)
+    {45, 2, 1, false, 3},   // Moisture (0.01 %)
+    {47, 4, 1, true, 1},    // Count
+    {51, 1, 1, false, 2},   // UV index (0.1)
+    {52, 1, 4, false, 1},   // Button events (up to 4 buttons)
+    {56, 4, 1, false, 1},   // Binary sensor values
+    {60, 4, 1, false, 1},   // Binary sensors present
+};
+
+// Binary sensor object ID range
+static const uint8_t BTHOME_BINARY_FIRST_ID = 0x0F;
+static const uint8_t BTHOME_BINARY_LAST_ID = 0x2D;
+static const uint8_t BTHOME_OBJ_MOTION = 0x21;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BTHome object descriptors
+//
+// len is the length of the object data in bytes (-1 for unused IDs, 0 for variable length where the first data
+// byte is the length), scalePow10 converts the raw value to the units of the slot (slotVal = raw * 10^scalePow10)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct BTHomeObjectDesc {
+    int8_t len;
+    bool isSigned;
+    BTHomeRecordSlot slot;
+    int8_t scalePow10;
+};
+
+/// @brief Create an object descriptor
+/// @param len length of the data in bytes
+/// @param isSigned true if the value is signed
+/// @param factor factor as an encoded value (1=1, 2=0.1, 3=0.01, etc.)
+/// @param slot record slot the value is written to
+static constexpr BTHomeObjectDesc btHomeObj(int8_t len, bool isSigned, int8_t factor, BTHomeRecordSlot slot = BTHOME_SLOT_NONE)
+{
+    return { len, isSigned, slot, (int8_t)(slot == BTHOME_SLOT_NONE ? 0 : BTHOME_SLOT_LAYOUTS[slot].factor - factor) };
+}
+
+// BTHome objects
+static constexpr BTHomeObjectDesc BTHOME_OBJECTS[] PLACE_IN_SECTION(".rodata") = {
+    btHomeObj(1, false, 1, BTHOME_SLOT_PACKET_ID),      // 0x00 Packet ID
+    btHomeObj(1, false, 1, BTHOME_SLOT_BATTERY),        // 0x01 Battery
+    btHomeObj(2, true, 3, BTHOME_SLOT_TEMPERATURE),     // 0x02 Temperature (0.01 factor)
+    btHomeObj(2, false, 3, BTHOME_SLOT_HUMIDITY),       // 0x03 Humidity (0.01 factor)
+    btHomeObj(3, false, 3, BTHOME_SLOT_PRESSURE),       // 0x04 Pressure (0.01 factor)
+    btHomeObj(3, false, 3, BTHOME_SLOT_ILLUMINANCE),    // 0x05 Illuminance (0.01 factor)
+    btHomeObj(2, false, 3),                             // 0x06 Mass (kg) (0.01 factor)
+    btHomeObj(2, false, 3),                             // 0x07 Mass (lb) (0.01 factor)
+    btHomeObj(2, true, 3),                              // 0x08 Dewpoint (0.01 factor)
+    btHomeObj(1, false, 1, BTHOME_SLOT_COUNT),          // 0x09 Count
+    btHomeObj(3, false, 4, BTHOME_SLOT_ENERGY),         // 0x0A Energy (0.001 factor)
+    btHomeObj(3, false, 3, BTHOME_SLOT_POWER),          // 0x0B Power (0.01 factor)
+    btHomeObj(2, false, 4, BTHOME_SLOT_VOLTAGE),        // 0x0C Voltage (0.001 factor)
+    btHomeObj(2, false, 1, BTHOME_SLOT_PM25),           // 0x0D PM2.5
+    btHomeObj(2, false, 1, BTHOME_SLOT_PM10),           // 0x0E PM10
+    btHomeObj(1, false, 1),                             // 0x0F Generic Boolean
+    btHomeObj(1, false, 1),                             // 0x10 Power
+    btHomeObj(1, false, 1),                             // 0x11 Opening
+    btHomeObj(2, false, 1, BTHOME_SLOT_CO2),            // 0x12 CO2
+    btHomeObj(2, false, 1, BTHOME_SLOT_TVOC),           // 0x13 TVOC
+    btHomeObj(2, false, 3, BTHOME_SLOT_MOISTURE),       // 0x14 Moisture (0.01 factor)
+    btHomeObj(1, false, 1),                             // 0x15 Battery
+    btHomeObj(1, false, 1),                             // 0x16 Battery Charging
+    btHomeObj(1, false, 1),                             // 0x17 Carbon Monoxide
+    btHomeObj(1, false, 1),                             // 0x18 Cold
+    btHomeObj(1, false, 1),                             // 0x19 Connectivity
+    btHomeObj(1, false, 1),                             // 0x1A Door
+    btHomeObj(1, false, 1),                             // 0x1B Garage Door
+    btHomeObj(1, false, 1),                             // 0x1C Gas
+    btHomeObj(1, false, 1),                             // 0x1D Heat
+    btHomeObj(1, false, 1),                             // 0x1E Light
+    btHomeObj(1, false, 1),                             // 0x1F Lock
+    btHomeObj(1, false, 1),                             // 0x20 Moisture
+    btHomeObj(1, false, 1, BTHOME_SLOT_MOTION),         // 0x21 Motion
+    btHomeObj(1, false, 1),                             // 0x22 Moving
+    btHomeObj(1, false, 1),                             // 0x23 Occupancy
+    btHomeObj(1, false, 1),                             // 0x24 Plug
+    btHomeObj(1, false, 1),                             // 0x25 Presence
+    btHomeObj(1, false, 1),                             // 0x26 Problem
+    btHomeObj(1, false, 1),                             // 0x27 Running
+    btHomeObj(1, false, 1),                             // 0x28 Safety
+    btHomeObj(1, false, 1),                             // 0x29 Smoke
+    btHomeObj(1, false, 1),                             // 0x2A Sound
+    btHomeObj(1, false, 1),                             // 0x2B Tamper
+    btHomeObj(1, false, 1),                             // 0x2C Vibration
+    btHomeObj(1, false, 1),                             // 0x2D Window
+    btHomeObj(1, false, 1, BTHOME_SLOT_HUMIDITY),       // 0x2E Humidity
+    btHomeObj(1, false, 1, BTHOME_SLOT_MOISTURE),       // 0x2F Moisture
+    btHomeObj(-1, false, 0),                            // 0x30 Unused
+    btHomeObj(-1, false, 0),                            // 0x31 Unused
+    btHomeObj(-1, false, 0),                            // 0x32 Unused
+    btHomeObj(-1, false, 0),                            // 0x33 Unused
+    btHomeObj(-1, false, 0),                            // 0x34 Unused
+    btHomeObj(-1, false, 0),                            // 0x35 Unused
+    btHomeObj(-1, false, 0),                            // 0x36 Unused
+    btHomeObj(-1, false, 0),                            // 0x37 Unused
+    btHomeObj(-1, false, 0),                            // 0x38 Unused
+    btHomeObj(-1, false, 0),                            // 0x39 Unused
+    btHomeObj(1, false, 1, BTHOME_SLOT_BUTTON),         // 0x3A Event Button
+    btHomeObj(-1, false, 0),                            // 0x3B Unused
+    btHomeObj(2, false, 1),                             // 0x3C Event Dimmer
+    btHomeObj(2, false, 1, BTHOME_SLOT_COUNT),          // 0x3D Count (16-bit, factor 1)
+    btHomeObj(4, false, 1, BTHOME_SLOT_COUNT),          // 0x3E Count (32-bit, factor 1)
+    btHomeObj(2, true, 2),                              // 0x3F Rotation (0.1 factor)
+    btHomeObj(2, false, 1),                             // 0x40 Distance (mm)
+    btHomeObj(2, false, 2),                             // 0x41 Distance (m, 0.1 factor)
+    btHomeObj(3, false, 4),                             // 0x42 Duration (0.001 factor)
+    btHomeObj(2, false, 4, BTHOME_SLOT_CURRENT),        // 0x43 Current (0.001 factor)
+    btHomeObj(2, false, 3),                             // 0x44 Speed (0.01 factor)
+    btHomeObj(2, true, 2, BTHOME_SLOT_TEMPERATURE),     // 0x45 Temperature (0.1 factor)
+    btHomeObj(1, false, 2, BTHOME_SLOT_UV_INDEX),       // 0x46 UV Index (0.1 factor)
+    btHomeObj(2, false, 2),                             // 0x47 Volume
+    btHomeObj(2, false, 1),                             // 0x48 Volume (mL)
+    btHomeObj(2, false, 4),                             // 0x49 Volume Flow Rate (0.001 factor)
+    btHomeObj(2, false, 2, BTHOME_SLOT_VOLTAGE),        // 0x4A Voltage (2 bytes, 0.1 factor)
+    btHomeObj(3, false, 4),                             // 0x4B Gas (3 bytes, 0.001 factor)
+    btHomeObj(4, false, 4),                             // 0x4C Gas (4 bytes, 0.001 factor)
+    btHomeObj(4, false, 4, BTHOME_SLOT_ENERGY),         // 0x4D Energy (4 bytes, 0.001 factor)
+    btHomeObj(4, false, 4),                             // 0x4E Volume (4 bytes, 0.001 factor)
+    btHomeObj(4, false, 4),                             // 0x4F Water (4 bytes, 0.001 factor)
+    btHomeObj(4, false, 1),                             // 0x50 Timestamp (4 bytes, no factor)
+    btHomeObj(2, false, 4),                             // 0x51 Acceleration (2 bytes, 0.001 factor)
+    btHomeObj(2, false, 4),                             // 0x52 Gyroscope (2 bytes, 0.001 factor)
+    btHomeObj(0, false, 1),                             // 0x53 Text (variable length, no factor)
+    btHomeObj(0, false, 1),                             // 0x54 Raw (variable length, no factor)
+    btHomeObj(4, false, 4),                             // 0x55 Volume Storage (4 bytes, 0.001 factor)
+    btHomeObj(2, false, 1),                             // 0x56 Conductivity (2 bytes, no factor)
+    btHomeObj(1, true, 1, BTHOME_SLOT_TEMPERATURE),     // 0x57 Temperature (1 byte, 1 factor)
+    btHomeObj(1, true, 1),                              // 0x58 Temperature (1 byte, 0.35 factor)
+    btHomeObj(1, true, 1, BTHOME_SLOT_COUNT),           // 0x59 Count (1 byte, signed)
+    btHomeObj(2, true, 1, BTHOME_SLOT_COUNT),           // 0x5A Count (2 bytes, signed)
+    btHomeObj(4, true, 1, BTHOME_SLOT_COUNT),           // 0x5B Count (4 bytes, signed)
+    btHomeObj(4, true, 3, BTHOME_SLOT_POWER),           // 0x5C Power (4 bytes, 0.01 factor, signed)
+    btHomeObj(2, true, 4, BTHOME_SLOT_CURRENT),         // 0x5D Current (2 bytes, 0.001 factor, signed)
+};
+
+static constexpr int BTHOME_OBJECT_COUNT = sizeof(BTHOME_OBJECTS) / sizeof(BTHomeObjectDesc);
+static_assert(BTHOME_OBJECT_COUNT == 0x5E, "BTHome object table must cover IDs 0x00..0x5D");
+
+// Device information objects (not in the table)
+static const uint8_t BTHOME_OBJ_DEVICE_TYPE_ID = 0xF0;
+static const uint8_t BTHOME_OBJ_FIRMWARE_VERSION_4 = 0xF1;
+static const uint8_t BTHOME_OBJ_FIRMWARE_VERSION_3 = 0xF2;
@@ -41,6 +41,13 @@ public:
     /// @return true if setup was successful
     virtual bool setup(const RaftJsonIF& config) override final;
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief loop
+    virtual void loop() override final
+    {
+        _bleBusDeviceManager.loop();
+    }
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Get bus devices interface
     virtual RaftBusDevicesIF* getBusDevicesIF() override final
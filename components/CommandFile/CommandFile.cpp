@@ -8,6 +8,7 @@
 
 #include "Logger.h"
 #include "CommandFile.h"
+#include "SysModTiming.h"
 #include "RaftUtils.h"
 #include "FileSystem.h"
 #include "RestAPIEndpointManager.h"
@@ -22,7 +23,6 @@
 CommandFile::CommandFile(const char *pModuleName, RaftJsonIF& sysConfig)
     : RaftSysMod(pModuleName, sysConfig)
 {
-    _curState = API_STATE_IDLE;
 }
 
 CommandFile::~CommandFile()
@@ -49,35 +49,11 @@ void CommandFile::applySetup()
 
 void CommandFile::loop()
 {
-    // Cycle goes IDLE <-> PROCESSING <-> SLEEPING 
-    // IDLE - Nothing to process
-    // SLEEPING - Waiting for current request to time out before sending next one
-    // PROCESSING - Ready to send next request
-    switch(_curState)
-    {
-        case API_STATE_IDLE:
-        {
-            break;
-        }
-        case API_STATE_SLEEPING:
-        {
-            if (Raft::isTimeout(millis(), _stateTimerMilis, _sleepTimeMilis))
-            {
-                _curState = API_STATE_PROCESSING;
-            }
-            break;
-        }
-        case API_STATE_PROCESSING:
-        {
-            //If no more reps left process next line
-            if (_repsLeft == 0) {
-                processAPILine();
-            } else {
-                exec();
-            }
-            break;
-        }
-    }
+    SYSMOD_TIMED_LOOP();
+
+    // Execute the next command when due
+    if (_isRunning && ((int64_t)(micros() - _nextDueUs) >= 0))
+        exec();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -100,6 +76,8 @@ void CommandFile::addRestAPIEndpoints(RestAPIEndpointManager &endpointManager)
 
 RaftRetCode CommandFile::apiFileRun(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("filerun");
+
     // File
     String fileName = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
     String extraPath = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 2);
@@ -154,119 +132,141 @@ bool CommandFile::handleAPIFile(String& fileName)
         LOG_W(MODULE_PREFIX, "handleAPIFile unable to read file %s", fileName.c_str());
         return false;
     }
-    _APICode = pAPICode;
-    free(pAPICode);
 
-    // Start the processing of the file
-    _curState = API_STATE_PROCESSING;
-    _curLine = 0;
-    _curPosition = 0;
+    // Parse into instructions
+    _isRunning = false;
+    bool parseOk = parseAPICode(pAPICode);
+    free(pAPICode);
+    if (!parseOk)
+        return false;
 
 #ifdef DEBUG_COMMAND_FILE
-    LOG_I(MODULE_PREFIX, "handleAPIFile fileName %s", fileName.c_str());
-    LOG_I(MODULE_PREFIX, "handleAPIFile _APICode %s", _APICode.c_str());
+    LOG_I(MODULE_PREFIX, "handleAPIFile fileName %s instructions %d", fileName.c_str(), _instructions.size());
 #endif
 
-    // Process the first line
-    return processAPILine();
+    // Start with the first command
+    if (_instructions.empty())
+        return true;
+    _curInstrIdx = 0;
+    _repsLeft = _instructions[0].reps;
+    _execCount = 0;
+    _jitterTotalUs = 0;
+    _jitterMaxUs = 0;
+    _nextDueUs = micros();
+    _isRunning = true;
+    exec();
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Process one line
+// Parse API code into instructions (blank lines are ignored)
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool CommandFile::processAPILine() 
+bool CommandFile::parseAPICode(const char* pAPICode)
 {
-    // Clean slate with each line
-    _curCommand = "";
-    String curTimer = "";
-    String curRep = "";
-
-    // Which stage are we in
-    enum Part {
-        COMMAND,
-        TIMER,
-        REP
-    };
-
-    Part part = COMMAND;
-
-    // Parse Line
-    char c= 0;
-    while (_curPosition < _APICode.length() && c != '\r' && c != '\n') {
-
-        // Set char
-        c = _APICode[_curPosition];
-        // Update current position
-        _curPosition++;
-
-        // On space we switch to next stage
-        if (c == ' ') {
-            if (part == COMMAND) {
-                part = TIMER;
-            } else {
-                part = REP;
+    _generation++;
+    _instructions.clear();
+    _cmdText.clear();
+    const char* p = pAPICode;
+    while (*p)
+    {
+        // Line
+        const char* pLineEnd = p;
+        while (*pLineEnd && (*pLineEnd != '\r') && (*pLineEnd != '\n'))
+            pLineEnd++;
+
+        // Command
+        const char* pCmdEnd = p;
+        while ((pCmdEnd < pLineEnd) && (*pCmdEnd != ' '))
+            pCmdEnd++;
+        if (pCmdEnd > p)
+        {
+            Instruction instr;
+            instr.cmdOffset = _cmdText.size();
+            _cmdText.append(p, pCmdEnd - p);
+            _cmdText.push_back(0);
+
+            // Delay and reps
+            const char* pArg = pCmdEnd < pLineEnd ? pCmdEnd + 1 : pLineEnd;
+            char* pArgEnd = nullptr;
+            instr.delayMs = strtoul(pArg, &pArgEnd, 10);
+            if ((pArgEnd < pLineEnd) && (*pArgEnd == ' '))
+            {
+                long reps = strtol(pArgEnd + 1, nullptr, 10);
+                if (reps < 1)
+                {
+                    LOG_E(MODULE_PREFIX, "parseAPICode Need all reps > 0 where specified (line %d)", 
+                                (int)_instructions.size() + 1);
+                    _instructions.clear();
+                    _cmdText.clear();
+                    return false;
+                }
+                instr.reps = reps;
             }
-            continue;
+            _instructions.push_back(instr);
         }
 
-        // Add current char to appropriate variable
-        if (part == COMMAND) {
-            _curCommand.concat(c);
-        } else if (part == TIMER) {
-            curTimer.concat(c);
-        } else {
-            curRep.concat(c);
-        }
+        // Next line
+        p = pLineEnd;
+        while ((*p == '\r') || (*p == '\n'))
+            p++;
     }
-
-    // Set sleep time between each rep
-    _sleepTimeMilis = curTimer.toInt();
-
-    // Number of times to run - default is one
-    if (curRep == "") {
-        _repsLeft = 1;
-    } else {
-        _repsLeft = curRep.toInt();
-        if (_repsLeft < 1) {
-            _repsLeft = 0;
-            LOG_E(MODULE_PREFIX, "processAPILine Need all reps > 0 where specified");
-            return false;
-        }
-    }
-
-    //Next line
-    _curLine++;
-
-    //Execute processed line
-    return exec();
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Execute current command
+// Execute current command and schedule the next
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool CommandFile::exec() {
-    _repsLeft -= 1;
-
-    // Send API request
+void CommandFile::exec()
+{
+    // Jitter
+    uint64_t nowUs = micros();
+    uint32_t jitterUs = nowUs > _nextDueUs ? nowUs - _nextDueUs : 0;
+    _jitterTotalUs += jitterUs;
+    if (jitterUs > _jitterMaxUs)
+        _jitterMaxUs = jitterUs;
+    _execCount++;
+
+    // Send API request - the command may run another api file (which replaces the instructions) so the
+    // command and delay are copied first and nothing more is done if a new file was started
+    const Instruction& instr = _instructions[_curInstrIdx];
+    uint32_t delayMs = instr.delayMs;
+    String command = _cmdText.c_str() + instr.cmdOffset;
+    uint32_t generation = _generation;
     String s = "";
     if (_pRestAPIEndpointManager)
-        _pRestAPIEndpointManager->handleApiRequest(_curCommand.c_str(), s, 
+        _pRestAPIEndpointManager->handleApiRequest(command.c_str(), s, 
                         APISourceInfo(RestAPIEndpointManager::CHANNEL_ID_COMMAND_FILE));
 
-    // Change API State
-    if (_curPosition == _APICode.length() && _repsLeft == 0) {
-        _curState = API_STATE_IDLE;
-    } else {
-        _curState = API_STATE_SLEEPING;
-        _stateTimerMilis = millis();
-    }
-
 #ifdef DEBUG_COMMAND_FILE
-    LOG_I(MODULE_PREFIX, "exec _curCommand %s", _curCommand.c_str());
+    LOG_I(MODULE_PREFIX, "exec command %s jitterUs %d", command.c_str(), jitterUs);
     LOG_I(MODULE_PREFIX, "exec s %s", s.c_str());
 #endif
+    if (generation != _generation)
+        return;
+
+    // Next command (the delay of a line follows each of its reps)
+    _nextDueUs += (uint64_t)delayMs * 1000;
+    if (--_repsLeft > 0)
+        return;
+    if (++_curInstrIdx >= _instructions.size())
+    {
+        _isRunning = false;
+        return;
+    }
+    _repsLeft = _instructions[_curInstrIdx].reps;
+}
 
-    return true;
-}
\ No newline at end of file
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String CommandFile::getDebugJSON() const
+{
+    char jsonStr[150];
+    snprintf(jsonStr, sizeof(jsonStr), R"({"run":%d,"idx":%d,"num":%d,"execs":%d,"jitAvgUs":%d,"jitMaxUs":%d})",
+                _isRunning ? 1 : 0, (int)_curInstrIdx, (int)_instructions.size(), (int)_execCount,
+                _execCount > 0 ? (int)(_jitterTotalUs / _execCount) : 0, (int)_jitterMaxUs);
+    return jsonStr;
+}
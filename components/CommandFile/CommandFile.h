@@ -8,8 +8,11 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
 #include "RestAPIEndpointManager.h"
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 
 class CommandFile : public RaftSysMod
 {
@@ -34,6 +37,9 @@ protected:
     // Add endpoints
     virtual void addRestAPIEndpoints(RestAPIEndpointManager &endpointManager) override final;
 
+    // Get debug string
+    virtual String getDebugJSON() const override final;
+
 private:
     // Helpers
     void applySetup();
@@ -41,33 +47,41 @@ private:
 
     //API Processing
     bool handleAPIFile(String& fileName);
-    bool processAPILine();
-    bool exec();
+    bool parseAPICode(const char* pAPICode);
+    void exec();
 
-    //State control
-    enum State
+    // Instructions - each line of an api file is "<command> [<delayMs> [<reps>]]" and is parsed once into an
+    // instruction with the command text held (null terminated) in _cmdText
+    class Instruction
     {
-        API_STATE_PROCESSING,
-        API_STATE_SLEEPING,
-        API_STATE_IDLE
+    public:
+        uint32_t cmdOffset = 0;
+        uint32_t delayMs = 0;
+        uint32_t reps = 1;
     };
-
-    State _curState;
-
-    //Commands
-    String _APICode;
-    int _curLine;
-    int _curPosition;
-    int _repsLeft = 0;
-    String _curCommand;
+    std::vector<Instruction> _instructions;
+    std::string _cmdText;
+
+    // Execution - the next command is due at _nextDueUs (advanced by the delay from when it was due so that
+    // loop-rate jitter doesn't accumulate) - the generation is incremented whenever a file is parsed (a command
+    // may run another file)
+    bool _isRunning = false;
+    uint32_t _generation = 0;
+    uint32_t _curInstrIdx = 0;
+    uint32_t _repsLeft = 0;
+    uint64_t _nextDueUs = 0;
+
+    // Jitter (lateness of each command relative to when it was due)
+    uint32_t _execCount = 0;
+    uint64_t _jitterTotalUs = 0;
+    uint32_t _jitterMaxUs = 0;
 
     static const int MAX_API_FILE_LENGTH = 5000;
 
-    RestAPIEndpointManager* _pRestAPIEndpointManager;
+    RestAPIEndpointManager* _pRestAPIEndpointManager = nullptr;
 
-    //Sleep
-    long _stateTimerMilis;
-    int _sleepTimeMilis;
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
 
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "CmdFile";
@@ -8,6 +8,7 @@
 
 #include "Logger.h"
 #include "CommandSerial.h"
+#include "SysModTiming.h"
 #include "RaftUtils.h"
 #include "CommsChannelMsg.h"
 #include "CommsChannelSettings.h"
@@ -57,11 +58,12 @@ void CommandSerial::setup()
     _serialPorts.resize(arrayLen);
 
     // Iterate through serial port configs creating ports
-    for (int i = 0; i < arrayLen; i++)
+    int portIdx = 0;
+    for (auto& serialPort : _serialPorts)
     {
         // Configure the port
-        RaftJsonPrefixed portConfig(modConfig(), "ports[" + String(i) + "]");
-        _serialPorts.back().setup(portConfig, modName());
+        RaftJsonPrefixed portConfig(modConfig(), "ports[" + String(portIdx++) + "]");
+        serialPort.setup(portConfig, modName());
     }
 }
 
@@ -71,26 +73,27 @@ void CommandSerial::setup()
 
 void CommandSerial::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
     // Check comms channel manager
     if (!_pCommsCoreIF)
         return;
 
-    // Iterate through serial ports
-    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> charBuf;
+    // Iterate through serial ports (ports with an RX task pass received data directly to the comms core)
     for (auto& serialPort : _serialPorts)
     {
         // Get received data
-        if (serialPort.getData(charBuf))
+        if (serialPort.getData(_rxBuf))
         {
             // Handle data
-            if (charBuf.size() > 0)
+            if (_rxBuf.size() > 0)
             {
                 // Send to comms channel
-                _pCommsCoreIF->inboundHandleMsg(serialPort.getChannelID(), charBuf.data(), charBuf.size());
+                _pCommsCoreIF->inboundHandleMsg(serialPort.getChannelID(), _rxBuf.data(), _rxBuf.size());
 
 #ifdef DEBUG_COMMAND_SERIAL_RX
                 // Debug
-                LOG_I(MODULE_PREFIX, "loop channelID %d, len %d", serialPort.getChannelID(), charBuf.size());
+                LOG_I(MODULE_PREFIX, "loop channelID %d, len %d", serialPort.getChannelID(), _rxBuf.size());
 #endif
             }
         }
@@ -137,6 +140,11 @@ void CommandSerial::addCommsChannels(CommsCoreIF& commsCoreIF)
         // Set the channel ID
         serialPort.setChannelID(channelID);
 
+        // Start the RX task if enabled (received data is passed to the comms core from the RX task)
+        serialPort.startRxTask([this, &serialPort](const uint8_t* pData, uint32_t dataLen) {
+                _pCommsCoreIF->inboundHandleMsg(serialPort.getChannelID(), pData, dataLen);
+            });
+
         // Debug
 #ifdef DEBUG_COMMAND_SERIAL
         LOG_I(MODULE_PREFIX, "addCommsChannels channelID %d name %s uart %d",
@@ -145,6 +153,22 @@ void CommandSerial::addCommsChannels(CommsCoreIF& commsCoreIF)
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String CommandSerial::getDebugJSON() const
+{
+    String jsonStr;
+    for (auto& serialPort : _serialPorts)
+    {
+        if (!serialPort.isRxTaskRunning())
+            continue;
+        jsonStr += (jsonStr.isEmpty() ? "\"" : ",\"") + serialPort.getName() + "\":" + serialPort.getDebugJSON();
+    }
+    return "{" + jsonStr + "}";
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Send message
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -192,6 +216,8 @@ bool CommandSerial::sendMsg(CommsChannelMsg& msg)
 
 RaftRetCode CommandSerial::apiCommandSerial(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("commandserial");
+
     // Check valid
     if (!_pCommsCoreIF)
     {
@@ -14,6 +14,7 @@
 #include "CommandSerialPort.h"
 #include "CommsBridgeMsg.h"
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 
 class CommsChannelMsg;
 
@@ -43,6 +44,9 @@ protected:
     // Add comms channels
     virtual void addCommsChannels(CommsCoreIF& commsCore) override final;
 
+    // Get debug string
+    virtual String getDebugJSON() const override final;
+
 private:
 
     static const int MAX_SERIAL_PORTS = 4;
@@ -53,6 +57,9 @@ private:
     // Comms core IF
     CommsCoreIF* _pCommsCoreIF = nullptr;
 
+    // Received data (polled ports - reused between loop calls)
+    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> _rxBuf;
+
     // EndpointID used to identify this message channel to the CommsCoreIF
     uint32_t _commsChannelID = CommsCoreIF::CHANNEL_ID_UNDEFINED;
     uint32_t _bridgeID = COMMS_BRIDGE_ID_COM_SERIAL_0;
@@ -61,6 +68,9 @@ private:
     bool sendMsg(CommsChannelMsg& msg);
     RaftRetCode apiCommandSerial(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
 
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "CmdSerial";
 };
@@ -25,6 +25,8 @@ CommandSerialPort::CommandSerialPort()
 
 CommandSerialPort::~CommandSerialPort()
 {
+    // The RX task must have exited before the driver (and its event queue) is deleted
+    _uartRx.stop(UINT32_MAX);
     if (_isInitialised)
         uart_driver_delete((uart_port_t)_uartNum);
 }
@@ -35,7 +37,12 @@ CommandSerialPort::~CommandSerialPort()
 
 void CommandSerialPort::setup(RaftJsonIF& config, const char* pModName)
 {
-    // Clear previous config if we've been here before
+    // Clear previous config if we've been here before (the driver can't be deleted while the RX task is using it)
+    if (!_uartRx.stop())
+    {
+        LOG_E(MODULE_PREFIX, "setup %s RX task didn't stop - config unchanged", _name.c_str());
+        return;
+    }
     if (_isInitialised)
         uart_driver_delete((uart_port_t)_uartNum);
     _isInitialised = false;
@@ -67,6 +74,13 @@ void CommandSerialPort::setup(RaftJsonIF& config, const char* pModName)
     _rxBufSize = config.getLong("rxBufSize", 1024);
     _txBufSize = config.getLong("txBufSize", 1024);
 
+    // RX task
+    _rxTaskEnabled = config.getBool("rxTask", false);
+    _rxBlockLen = config.getLong("rxBlockLen", DEFAULT_RX_BLOCK_LEN);
+    _rxTaskCore = config.getLong("rxTaskCore", UartEventRx::DEFAULT_TASK_CORE);
+    _rxTaskPriority = config.getLong("rxTaskPriority", UartEventRx::DEFAULT_TASK_PRIORITY);
+    _rxTaskStack = config.getLong("rxTaskStack", UartEventRx::DEFAULT_TASK_STACK_SIZE_BYTES);
+
     // Setup
     if (_isEnabled && (_rxPin != -1) && (_txPin != -1))
     {
@@ -113,7 +127,10 @@ void CommandSerialPort::setup(RaftJsonIF& config, const char* pModName)
         vTaskDelay(1);
 
         // Install UART driver for interrupt-driven reads and writes
-        err = uart_driver_install((uart_port_t)_uartNum, _rxBufSize, _txBufSize, 0, NULL, 0);
+        _uartEventQueue = nullptr;
+        err = uart_driver_install((uart_port_t)_uartNum, _rxBufSize, _txBufSize, 
+                        _rxTaskEnabled ? UartEventRx::EVENT_QUEUE_LEN : 0, 
+                        _rxTaskEnabled ? &_uartEventQueue : NULL, 0);
         if (err != ESP_OK)
         {
             LOG_E(MODULE_PREFIX, "Failed to install uart %s driver, uartNum %d rxBufSize %d txBufSize %d err %d", 
@@ -125,9 +142,9 @@ void CommandSerialPort::setup(RaftJsonIF& config, const char* pModName)
         _isInitialised = true;
 
         // Log
-        LOG_I(MODULE_PREFIX, "setup ok %s uartNum %d baudRate %d txPin %d rxPin %d%s rxBufSize %d txBufSize %d protocol %s", 
+        LOG_I(MODULE_PREFIX, "setup ok %s uartNum %d baudRate %d txPin %d rxPin %d%s rxBufSize %d txBufSize %d protocol %s rxTask %s", 
                     _name.c_str(), _uartNum, _baudRate, _txPin, _rxPin, rxPullup ? "(pullup)" : "", 
-                    (int)_rxBufSize, (int)_txBufSize, _protocol.c_str());
+                    (int)_rxBufSize, (int)_txBufSize, _protocol.c_str(), _rxTaskEnabled ? "YES" : "NO");
     } else {
         LOG_I(MODULE_PREFIX, "setup %s enabled %s uartNum %d txPin %d rxPin %d", 
                     _name.c_str(), _isEnabled ? "YES" : "NO", _uartNum, _txPin, _rxPin);
@@ -140,8 +157,8 @@ void CommandSerialPort::setup(RaftJsonIF& config, const char* pModName)
 
 bool CommandSerialPort::getData(std::vector<uint8_t, SpiramAwareAllocator<uint8_t>>& data)
 {
-    // Check if initialised
-    if (!_isInitialised)
+    // Check if initialised (and not in RX task mode)
+    if (!_isInitialised || _uartRx.isRunning())
         return false;
 
     // Check anything available
@@ -172,6 +189,22 @@ bool CommandSerialPort::getData(std::vector<uint8_t, SpiramAwareAllocator<uint8_
     return false;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Start the RX task (if enabled)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommandSerialPort::startRxTask(UartEventRx::RxDataCB rxDataCB)
+{
+    if (!_isInitialised || !_rxTaskEnabled)
+        return false;
+    if (!_uartRx.start(_uartNum, _uartEventQueue, rxDataCB, _rxBlockLen, _rxTaskCore, _rxTaskPriority, _rxTaskStack))
+    {
+        LOG_E(MODULE_PREFIX, "startRxTask %s FAILED uartNum %d - polling", _name.c_str(), _uartNum);
+        return false;
+    }
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Put data
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
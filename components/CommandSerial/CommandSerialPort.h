@@ -11,6 +11,7 @@
 #include <list>
 #include "RaftJsonIF.h"
 #include "SpiramAwareAllocator.h"
+#include "UartEventRx.h"
 
 class CommandSerialPort
 {
@@ -31,9 +32,23 @@ public:
     // Get name
     const String& getName() const { return _name; }
 
-    // Get data
+    // Get data (polled mode)
     bool getData(std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> &data);
 
+    // Start the RX task if enabled in config (received data is then passed to rxDataCB from the RX task
+    // rather than returned by getData)
+    bool startRxTask(UartEventRx::RxDataCB rxDataCB);
+    bool isRxTaskRunning() const
+    {
+        return _uartRx.isRunning();
+    }
+
+    // Get debug JSON (RX task stats)
+    String getDebugJSON() const
+    {
+        return _uartRx.getDebugJSON();
+    }
+
     // Put data
     uint32_t putData(const uint8_t *pMsg, uint32_t msgLen);
 
@@ -64,6 +79,16 @@ private:
     // Flag indicating begun
     bool _isInitialised = false;
 
+    // RX task mode - the UART driver is installed with an event queue and a task reads received data in blocks
+    static const uint32_t DEFAULT_RX_BLOCK_LEN = 1024;
+    bool _rxTaskEnabled = false;
+    uint32_t _rxBlockLen = DEFAULT_RX_BLOCK_LEN;
+    int _rxTaskCore = UartEventRx::DEFAULT_TASK_CORE;
+    int _rxTaskPriority = UartEventRx::DEFAULT_TASK_PRIORITY;
+    int _rxTaskStack = UartEventRx::DEFAULT_TASK_STACK_SIZE_BYTES;
+    QueueHandle_t _uartEventQueue = nullptr;
+    UartEventRx _uartRx;
+
     // Protocol and name
     String _protocol;
     String _name;
@@ -8,6 +8,7 @@
 
 #include "Logger.h"
 #include "CommandSocket.h"
+#include "SysModTiming.h"
 #include "RaftUtils.h"
 #include "RestAPIEndpointManager.h"
 #include "NetworkSystem.h"
@@ -68,6 +69,10 @@ void CommandSocket::applySetup()
     // Protocol
     _protocol = configGetString("protocol", "RICSerial");
 
+    // Sending - queue length per client and Nagle (noDelay disables it for lowest latency)
+    _sendQueueLen = configGetLong("sendQueueLen", DEFAULT_SEND_QUEUE_LEN);
+    _noDelay = configGetBool("noDelay", true);
+
     // Check if already setup
 #ifdef USE_ASYNC_SOCKET_FOR_COMMAND_SOCKET
     if (_pTcpServer)
@@ -85,6 +90,7 @@ void CommandSocket::applySetup()
             if (c == NULL)
                 return;
             c->setRxTimeout(3);
+            c->setNoDelay(_noDelay);
             this->addClient(c);
 
             // Verbose
@@ -107,8 +113,8 @@ void CommandSocket::applySetup()
 #endif
 
     // Debug
-    LOG_I(MODULE_PREFIX, "setup isEnabled %s TCP port %d", 
-            _isEnabled ? "YES" : "NO", _port);
+    LOG_I(MODULE_PREFIX, "setup isEnabled %s TCP port %d sendQueueLen %d noDelay %s", 
+            _isEnabled ? "YES" : "NO", _port, _sendQueueLen, _noDelay ? "YES" : "NO");
 
 }
 
@@ -118,11 +124,23 @@ void CommandSocket::applySetup()
 
 void CommandSocket::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
     // Check if WiFi is connected and begin if so
     if ((!_begun) && networkSystem.isIPConnected())
     {
         begin();
     }
+
+#ifdef USE_ASYNC_SOCKET_FOR_COMMAND_SOCKET
+    // Send messages queued since the last loop (coalesced)
+    if (xSemaphoreTake(_clientMutex, portMAX_DELAY) == pdTRUE)
+    {
+        for (ClientRec& clientRec : _clientList)
+            flushClient(clientRec);
+        xSemaphoreGive(_clientMutex);
+    }
+#endif
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -148,7 +166,7 @@ void CommandSocket::addCommsChannels(CommsCoreIF &commsCore)
             modName(),
             std::bind(&CommandSocket::sendMsg, this, std::placeholders::_1),
             [this](uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn) {
-                return true;
+                return readyToSend(noConn);
             },
             &commsChannelSettings);
 }
@@ -162,7 +180,7 @@ void CommandSocket::begin()
 #ifdef USE_ASYNC_SOCKET_FOR_COMMAND_SOCKET
     if (_pTcpServer && !_begun)
     {
-        _pTcpServer->setNoDelay(true);
+        _pTcpServer->setNoDelay(_noDelay);
         _pTcpServer->begin();
         _begun = true;
 
@@ -193,81 +211,78 @@ void CommandSocket::end()
 void CommandSocket::addClient(AsyncClient* pClient)
 {
     // Add to client list if enough space
-    if (_clientList.size() < MAX_CLIENTS)
+    bool isAdded = false;
+    if (xSemaphoreTake(_clientMutex, portMAX_DELAY) == pdTRUE)
     {
-        pClient->onError([](void *r, AsyncClient* pClient, int8_t error)
-        {
-            // TODO - handle
-            LOG_I(MODULE_PREFIX, "onError");
-            // handleError(error);
-        }, this);
-        pClient->onAck([](void *r, AsyncClient* pClient, size_t len, uint32_t time)
-        {
-            // TODO - handle
-            LOG_I(MODULE_PREFIX, "onAck");
-            // handleAck(len, time); 
-        }, this);
-        pClient->onDisconnect([this](void *r, AsyncClient* pClient)
-        {
-            // TODO - handle
-            LOG_I(MODULE_PREFIX, "onDisconnect");
-            // handleDisconnect();
-            delete pClient;
-            this->removeFromClientList(pClient);
-        }, this);
-        pClient->onTimeout([](void *r, AsyncClient* pClient, uint32_t time)
-        {
-            // TODO - handle
-            LOG_I(MODULE_PREFIX, "onTimeout");
-            // handleTimeout(time);
-        }, this);
-        pClient->onData([this](void *r, AsyncClient* pClient, void *buf, size_t len)
-        {
-            // Received data
-            uint8_t* pRxData = (uint8_t*)buf;
-
-            // Debug
-            // TODO - _DEBUG_COMMAND_SOCKET_ON_DATA
-            // char outBuf[400];
-            // strcpy(outBuf, "");
-            // char tmpBuf[10];
-            // for (int i = 0; i < len; i++)
-            // {
-            //     sprintf(tmpBuf, "%02x ", pRxData[i]);
-            //     strlcat(outBuf, tmpBuf, sizeof(outBuf));
-            // }
-            // LOG_I(MODULE_PREFIX, "onData RX len %d %s", len, outBuf);
-
-            // Send the message to the CommsCoreIF
-            if (getCommsCore())
-                getCommsCore()->inboundHandleMsg(this->_commsChannelID, pRxData, len);
-
-            // Handle the data
-            // handleData(buf, len);
-        }, this);
-        pClient->onPoll([](void *r, AsyncClient* pClient)
-        {
-            // TODO - handle
-            LOG_I(MODULE_PREFIX, "onPoll");
-            // handlePoll(); 
-        }, this);
-
-        // Take mutex
-        if (xSemaphoreTake(_clientMutex, portMAX_DELAY) == pdTRUE)
+        if (_clientList.size() < MAX_CLIENTS)
         {
-            // Add to list of clients
-            _clientList.push_back(pClient);
-            // Return the mutex
-            xSemaphoreGive(_clientMutex);
+            _clientList.emplace_back(pClient, _sendQueueLen);
+            isAdded = true;
         }
+        xSemaphoreGive(_clientMutex);
     }
-    else
+    if (!isAdded)
     {
         // TODO remove after finished with only
         pClient->close(true);
         pClient->free();
         delete pClient;
+        return;
     }
+
+    // Client callbacks
+    pClient->onError([](void *r, AsyncClient* pClient, int8_t error)
+    {
+        // TODO - handle
+        LOG_I(MODULE_PREFIX, "onError");
+        // handleError(error);
+    }, this);
+    pClient->onAck([this](void *r, AsyncClient* pClient, size_t len, uint32_t time)
+    {
+        // Space in the socket buffer so send more
+        this->flushClient(pClient);
+    }, this);
+    pClient->onDisconnect([this](void *r, AsyncClient* pClient)
+    {
+        LOG_I(MODULE_PREFIX, "onDisconnect");
+        this->removeFromClientList(pClient);
+        delete pClient;
+    }, this);
+    pClient->onTimeout([](void *r, AsyncClient* pClient, uint32_t time)
+    {
+        // TODO - handle
+        LOG_I(MODULE_PREFIX, "onTimeout");
+        // handleTimeout(time);
+    }, this);
+    pClient->onData([this](void *r, AsyncClient* pClient, void *buf, size_t len)
+    {
+        // Received data
+        uint8_t* pRxData = (uint8_t*)buf;
+
+        // Debug
+        // TODO - _DEBUG_COMMAND_SOCKET_ON_DATA
+        // char outBuf[400];
+        // strcpy(outBuf, "");
+        // char tmpBuf[10];
+        // for (int i = 0; i < len; i++)
+        // {
+        //     sprintf(tmpBuf, "%02x ", pRxData[i]);
+        //     strlcat(outBuf, tmpBuf, sizeof(outBuf));
+        // }
+        // LOG_I(MODULE_PREFIX, "onData RX len %d %s", len, outBuf);
+
+        // Send the message to the CommsCoreIF
+        if (getCommsCore())
+            getCommsCore()->inboundHandleMsg(this->_commsChannelID, pRxData, len);
+
+        // Handle the data
+        // handleData(buf, len);
+    }, this);
+    pClient->onPoll([this](void *r, AsyncClient* pClient)
+    {
+        // Send anything still queued
+        this->flushClient(pClient);
+    }, this);
 }
 
 void CommandSocket::removeFromClientList(AsyncClient* pClient)
@@ -276,20 +291,122 @@ void CommandSocket::removeFromClientList(AsyncClient* pClient)
     if (xSemaphoreTake(_clientMutex, portMAX_DELAY) == pdTRUE)
     {
         // Remove from list of clients
-        _clientList.remove(pClient);
+        _clientList.remove_if([pClient](const ClientRec& clientRec) { return clientRec.pClient == pClient; });
         // Return the mutex
         xSemaphoreGive(_clientMutex);
     }
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send queued messages to a client - as much as fits in the socket buffer is added (messages are split
+// if necessary) and then sent together (client mutex must be held)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CommandSocket::flushClient(ClientRec& clientRec)
+{
+    uint32_t bytesAdded = 0;
+    const uint8_t* pBuf = nullptr;
+    uint32_t bufLen = 0;
+    while (clientRec.pClient->connected() && clientRec.sendQueue.peekFront(pBuf, bufLen))
+    {
+        uint32_t space = clientRec.pClient->space();
+        uint32_t toAdd = bufLen - clientRec.frontOffset < space ? bufLen - clientRec.frontOffset : space;
+        if (toAdd == 0)
+            break;
+        uint32_t added = clientRec.pClient->add((const char*)pBuf + clientRec.frontOffset, toAdd);
+        clientRec.frontOffset += added;
+        bytesAdded += added;
+        if (clientRec.frontOffset < bufLen)
+            break;
+        clientRec.sendQueue.popFront();
+        clientRec.frontOffset = 0;
+        _msgsSent++;
+    }
+    if (bytesAdded == 0)
+        return;
+    clientRec.pClient->send();
+    _segmentsSent++;
+    _bytesSent += bytesAdded;
+}
+
+void CommandSocket::flushClient(AsyncClient* pClient)
+{
+    if (xSemaphoreTake(_clientMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    for (ClientRec& clientRec : _clientList)
+    {
+        if (clientRec.pClient == pClient)
+            flushClient(clientRec);
+    }
+    xSemaphoreGive(_clientMutex);
+}
 #endif
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Send message over socket
+// Send message over socket - the message is queued for each connected client and sent from loop() (so
+// messages queued together are coalesced) or as the client acks data
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool CommandSocket::sendMsg(CommsChannelMsg& msg)
 {
-    // LOG_D(MODULE_PREFIX, "sendBLEMsg channelID %d, msgType %s msgNum %d, len %d",
+    // LOG_D(MODULE_PREFIX, "sendMsg channelID %d, msgType %s msgNum %d, len %d",
     //         msg.getChannelID(), msg.getMsgTypeAsString(msg.getMsgTypeCode()), msg.getMsgNumber(), msg.getBufLen());
+#ifdef USE_ASYNC_SOCKET_FOR_COMMAND_SOCKET
+    if (xSemaphoreTake(_clientMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+    bool isQueued = false;
+    for (ClientRec& clientRec : _clientList)
+    {
+        if (clientRec.sendQueue.put(msg.getBuf(), msg.getBufLen()))
+        {
+            isQueued = true;
+            _msgsQueued++;
+        }
+        else
+        {
+            _msgsDropped++;
+        }
+    }
+    xSemaphoreGive(_clientMutex);
+    return isQueued;
+#else
+    // No socket server so the message is discarded
     return true;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if ready to send - all connected clients must have space in their send queues
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CommandSocket::readyToSend(bool& noConn)
+{
+#ifdef USE_ASYNC_SOCKET_FOR_COMMAND_SOCKET
+    if (xSemaphoreTake(_clientMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+    noConn = _clientList.empty();
+    bool isReady = !noConn;
+    for (ClientRec& clientRec : _clientList)
+    {
+        if (clientRec.sendQueue.count() >= clientRec.sendQueue.maxLen())
+            isReady = false;
+    }
+    xSemaphoreGive(_clientMutex);
+    return isReady;
+#else
+    // No socket server so messages are always accepted (and discarded by sendMsg)
+    return true;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String CommandSocket::getDebugJSON() const
+{
+    char jsonStr[150];
+    snprintf(jsonStr, sizeof(jsonStr), R"({"queued":%d,"sent":%d,"dropped":%d,"segs":%d,"bytes":%d})",
+                (int)_msgsQueued, (int)_msgsSent, (int)_msgsDropped, (int)_segmentsSent, (int)_bytesSent);
+    return jsonStr;
 }
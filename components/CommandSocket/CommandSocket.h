@@ -11,6 +11,8 @@
 #include <list>
 #include "RestAPIEndpointManager.h"
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
+#include "OutboundMsgQueue.h"
 
 // #define USE_ASYNC_SOCKET_FOR_COMMAND_SOCKET
 #ifdef USE_ASYNC_SOCKET_FOR_COMMAND_SOCKET
@@ -45,12 +47,16 @@ protected:
     // Add comms channels
     virtual void addCommsChannels(CommsCoreIF& commsCoreIF) override final;
 
+    // Get debug string
+    virtual String getDebugJSON() const override final;
+
 private:
     // Helpers
     void applySetup();
     void begin();
     void end();
     bool sendMsg(CommsChannelMsg& msg);
+    bool readyToSend(bool& noConn);
 
     // Vars
     bool _isEnabled;
@@ -71,17 +77,47 @@ private:
     // Remove client
     void removeFromClientList(AsyncClient* pClient);
 
-    // Client list
+    // Clients - messages are queued per client and the queued messages are coalesced into the socket buffer
+    // (so small messages share a TCP segment) when the buffer has space - in loop() and as data is acked
+    class ClientRec
+    {
+    public:
+        ClientRec(AsyncClient* pClient, uint32_t sendQueueLen)
+            : pClient(pClient), sendQueue(sendQueueLen)
+        {
+        }
+        AsyncClient* pClient = nullptr;
+        OutboundMsgQueue sendQueue;
+        // Bytes of the front message already added to the socket buffer
+        uint32_t frontOffset = 0;
+    };
     static const uint32_t MAX_CLIENTS = 2;
-    std::list<AsyncClient*> _clientList;
+    std::list<ClientRec> _clientList;
 
     // Mutex controlling access to clients
     SemaphoreHandle_t _clientMutex;
+
+    // Send to a client (client mutex must be held)
+    void flushClient(ClientRec& clientRec);
+    void flushClient(AsyncClient* pClient);
 #endif
 
+    // Send settings and stats
+    static const uint32_t DEFAULT_SEND_QUEUE_LEN = 10;
+    uint32_t _sendQueueLen = DEFAULT_SEND_QUEUE_LEN;
+    bool _noDelay = true;
+    uint32_t _msgsQueued = 0;
+    uint32_t _msgsSent = 0;
+    uint32_t _msgsDropped = 0;
+    uint32_t _segmentsSent = 0;
+    uint32_t _bytesSent = 0;
+
     // // Handles websocket events
     // static void webSocketCallback(uint8_t num, WEBSOCKET_TYPE_t type, const char* msg, uint64_t len);
 
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "CmdSock";
 };
@@ -0,0 +1,191 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// OutboundMsgQueue
+// Fixed-slot queue of outbound messages which are sent from in place
+//
+// Messages are copied into a slot once (slot buffers are retained so there is no heap churn once the queue
+// has warmed up) and the consumer then sends directly from the front slot in whatever slice sizes the
+// channel requires - there is no copy of the message on each peek.
+//
+// Any number of producers may put() but there must be a single consumer (peekFront/popFront). The buffer
+// returned by peekFront() remains valid until popFront() is called.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftThreading.h"
+#include "RaftArduino.h"
+#include "SpiramAwareAllocator.h"
+
+class OutboundMsgQueue
+{
+public:
+    typedef std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> MsgBufType;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Constructor
+    /// @param maxMsgs maximum number of messages in the queue
+    OutboundMsgQueue(uint32_t maxMsgs)
+    {
+        _accessMutex = xSemaphoreCreateMutex();
+        setMaxLen(maxMsgs);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Destructor
+    virtual ~OutboundMsgQueue()
+    {
+        if (_accessMutex)
+            vSemaphoreDelete(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set maximum number of messages (clears the queue)
+    /// @param maxMsgs maximum number of messages
+    void setMaxLen(uint32_t maxMsgs)
+    {
+        if (maxMsgs == 0)
+            maxMsgs = 1;
+        if (xSemaphoreTake(_accessMutex, portMAX_DELAY) != pdTRUE)
+            return;
+        _slots.resize(maxMsgs);
+        _putMs.resize(maxMsgs);
+        _frontIdx = 0;
+        _count = 0;
+        xSemaphoreGive(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add a message to the back of the queue
+    /// @param pBuf message data
+    /// @param bufLen message length
+    /// @return true if added (false if the queue is full)
+    bool put(const uint8_t* pBuf, uint32_t bufLen)
+    {
+        if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(ACCESS_MUTEX_WAIT_MS)) != pdTRUE)
+            return false;
+        if (_count >= _slots.size())
+        {
+            xSemaphoreGive(_accessMutex);
+            return false;
+        }
+        uint32_t backIdx = (_frontIdx + _count) % _slots.size();
+        _slots[backIdx].assign(pBuf, pBuf + bufLen);
+        _putMs[backIdx] = millis();
+        _count = _count + 1;
+        xSemaphoreGive(_accessMutex);
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the message at the front of the queue without removing it
+    /// @param pBuf (out) message data - valid until popFront() is called
+    /// @param bufLen (out) message length
+    /// @return true if a message is available
+    bool peekFront(const uint8_t*& pBuf, uint32_t& bufLen)
+    {
+        return peekAt(0, pBuf, bufLen);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get a message in the queue without removing it
+    /// @param idx index from the front of the queue (0 is the front)
+    /// @param pBuf (out) message data - valid until the message is removed with popFront()
+    /// @param bufLen (out) message length
+    /// @return true if a message is available at idx
+    bool peekAt(uint32_t idx, const uint8_t*& pBuf, uint32_t& bufLen)
+    {
+        if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(ACCESS_MUTEX_WAIT_MS)) != pdTRUE)
+            return false;
+        bool isValid = idx < _count;
+        if (isValid)
+        {
+            const MsgBufType& slot = _slots[(_frontIdx + idx) % _slots.size()];
+            pBuf = slot.data();
+            bufLen = slot.size();
+        }
+        xSemaphoreGive(_accessMutex);
+        return isValid;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the time a message was added to the queue
+    /// @param idx index from the front of the queue (0 is the front)
+    /// @param putMs (out) time in ms the message was added
+    /// @return true if a message is available at idx
+    bool getPutMs(uint32_t idx, uint32_t& putMs)
+    {
+        if (xSemaphoreTake(_accessMutex, pdMS_TO_TICKS(ACCESS_MUTEX_WAIT_MS)) != pdTRUE)
+            return false;
+        bool isValid = idx < _count;
+        if (isValid)
+            putMs = _putMs[(_frontIdx + idx) % _slots.size()];
+        xSemaphoreGive(_accessMutex);
+        return isValid;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Remove the message at the front of the queue
+    void popFront()
+    {
+        if (xSemaphoreTake(_accessMutex, portMAX_DELAY) != pdTRUE)
+            return;
+        if (_count > 0)
+        {
+            // Release unusually large buffers rather than retaining them
+            MsgBufType& slot = _slots[_frontIdx];
+            slot.clear();
+            if (slot.capacity() > SLOT_RETAIN_MAX_BYTES)
+                slot.shrink_to_fit();
+            _frontIdx = (_frontIdx + 1) % _slots.size();
+            _count = _count - 1;
+        }
+        xSemaphoreGive(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear the queue
+    void clear()
+    {
+        if (xSemaphoreTake(_accessMutex, portMAX_DELAY) != pdTRUE)
+            return;
+        for (auto& slot : _slots)
+            slot.clear();
+        _frontIdx = 0;
+        _count = 0;
+        xSemaphoreGive(_accessMutex);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of messages in the queue
+    uint32_t count() const
+    {
+        return _count;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get maximum number of messages in the queue
+    uint32_t maxLen() const
+    {
+        return _slots.size();
+    }
+
+private:
+    // Message slots (circular, front at _frontIdx)
+    std::vector<MsgBufType> _slots;
+    std::vector<uint32_t> _putMs;
+    uint32_t _frontIdx = 0;
+    volatile uint32_t _count = 0;
+
+    // Slot buffers larger than this are released when the message is removed
+    static const uint32_t SLOT_RETAIN_MAX_BYTES = 2048;
+
+    // Access mutex
+    SemaphoreHandle_t _accessMutex = nullptr;
+    static const uint32_t ACCESS_MUTEX_WAIT_MS = 5;
+};
@@ -0,0 +1,86 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// TimeStats
+// Count, min, average, percentile and max of durations - cheap enough to update on every call
+//
+// Times are accumulated in a log2 histogram so that a percentile can be estimated without keeping samples
+// (the estimate is the upper bound of the bucket containing the percentile).
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "RaftArduino.h"
+
+class TimeStats
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add a sample
+    /// @param us time in microseconds
+    void add(uint32_t us)
+    {
+        if ((_count == 0) || (us < _minUs))
+            _minUs = us;
+        if (us > _maxUs)
+            _maxUs = us;
+        _totalUs += us;
+        _count++;
+        uint32_t bucketIdx = 0;
+        while ((bucketIdx < NUM_BUCKETS - 1) && (us >= (2u << bucketIdx)))
+            bucketIdx++;
+        _buckets[bucketIdx]++;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear
+    void clear()
+    {
+        *this = TimeStats();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get JSON
+    /// @return JSON object {"n":N,"minUs":N,"avgUs":N,"p99Us":N,"maxUs":N}
+    String getJSON() const
+    {
+        char jsonStr[100];
+        snprintf(jsonStr, sizeof(jsonStr), R"({"n":%u,"minUs":%u,"avgUs":%u,"p99Us":%u,"maxUs":%u})",
+                    (unsigned)_count, (unsigned)_minUs, (unsigned)(_count == 0 ? 0 : _totalUs / _count),
+                    (unsigned)getPercentileUs(99), (unsigned)_maxUs);
+        return jsonStr;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Estimate a percentile
+    /// @param percentile (0..100)
+    /// @return time in microseconds (upper bound of the bucket containing the percentile capped at the max)
+    uint32_t getPercentileUs(uint32_t percentile) const
+    {
+        uint64_t target = ((uint64_t)_count * percentile + 99) / 100;
+        uint64_t cumulative = 0;
+        for (uint32_t bucketIdx = 0; bucketIdx < NUM_BUCKETS; bucketIdx++)
+        {
+            cumulative += _buckets[bucketIdx];
+            if ((cumulative >= target) && (cumulative > 0))
+            {
+                uint32_t upperUs = (2u << bucketIdx) - 1;
+                return upperUs < _maxUs ? upperUs : _maxUs;
+            }
+        }
+        return _maxUs;
+    }
+
+private:
+    // Bucket N holds samples < 2^(N+1) us (the last bucket holds everything larger)
+    static const uint32_t NUM_BUCKETS = 24;
+    uint32_t _buckets[NUM_BUCKETS] = {};
+    uint32_t _count = 0;
+    uint32_t _minUs = 0;
+    uint32_t _maxUs = 0;
+    uint64_t _totalUs = 0;
+};
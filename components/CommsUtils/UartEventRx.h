@@ -0,0 +1,241 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// UartEventRx
+// Event driven UART receive using the ESP-IDF UART event queue and a dedicated task
+//
+// The task waits on the UART event queue (from uart_driver_install) and reads whatever the driver has
+// buffered in large blocks. Received data is either passed to a callback (called from the RX task with a
+// reused block buffer) or placed in a ring buffer for a single consumer to read(). FIFO overflow and driver
+// buffer full events flush the driver input and are counted along with the bytes discarded. When the ring is
+// full data is left in the driver (and read when space is available) so the driver buffer absorbs bursts.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "RaftThreading.h"
+#include "RaftArduino.h"
+#include "SpiramAwareAllocator.h"
+#include "driver/uart.h"
+
+class UartEventRx
+{
+public:
+    typedef std::function<void(const uint8_t* pData, uint32_t dataLen)> RxDataCB;
+
+    static const uint32_t EVENT_QUEUE_LEN = 20;
+    static const uint32_t DEFAULT_BLOCK_LEN = 512;
+    static const int DEFAULT_TASK_CORE = 0;
+    static const int DEFAULT_TASK_PRIORITY = 5;
+    static const int DEFAULT_TASK_STACK_SIZE_BYTES = 3000;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Destructor
+    virtual ~UartEventRx()
+    {
+        stop(UINT32_MAX);
+        if (_exitedSem)
+            vSemaphoreDelete(_exitedSem);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Start the RX task
+    /// @param uartNum UART (the driver must be installed with an event queue)
+    /// @param eventQueue event queue from uart_driver_install
+    /// @param rxDataCB callback for received data (nullptr to hold received data in the ring buffer)
+    /// @param bufLen block length (callback) or ring buffer length
+    /// @param taskCore task core
+    /// @param taskPriority task priority
+    /// @param taskStackSize task stack size in bytes
+    /// @return true if started
+    bool start(int uartNum, QueueHandle_t eventQueue, RxDataCB rxDataCB, uint32_t bufLen,
+                int taskCore = DEFAULT_TASK_CORE, int taskPriority = DEFAULT_TASK_PRIORITY,
+                int taskStackSize = DEFAULT_TASK_STACK_SIZE_BYTES)
+    {
+        if (!stop() || !eventQueue || (bufLen < 2))
+            return false;
+        if (!_exitedSem)
+            _exitedSem = xSemaphoreCreateBinary();
+        if (!_exitedSem)
+            return false;
+        _uartNum = uartNum;
+        _eventQueue = eventQueue;
+        _rxDataCB = rxDataCB;
+        _buf.resize(bufLen);
+        _putPos = 0;
+        _getPos = 0;
+        _stopReq = false;
+        BaseType_t retc = xTaskCreatePinnedToCore(rxTaskStatic, "UartRxTask", taskStackSize, this, taskPriority,
+                    &_taskHandle, taskCore);
+        if (retc != pdPASS)
+        {
+            _taskHandle = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Stop the RX task (must be called before the UART driver is deleted)
+    /// @param waitMs time to wait for the task to exit (UINT32_MAX to wait until it exits)
+    /// @return true if the task isn't running - if false the task is still using the event queue so the UART
+    ///         driver must not be deleted
+    bool stop(uint32_t waitMs = STOP_WAIT_MS)
+    {
+        if (!_taskHandle)
+            return true;
+        _stopReq = true;
+        if (xSemaphoreTake(_exitedSem, waitMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(waitMs)) != pdTRUE)
+            return false;
+        _taskHandle = nullptr;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if running
+    bool isRunning() const
+    {
+        return _taskHandle != nullptr;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Read from the ring buffer (single consumer - ring buffer mode only)
+    /// @param pBuf buffer
+    /// @param maxLen max bytes to read
+    /// @return number of bytes read
+    uint32_t read(uint8_t* pBuf, uint32_t maxLen)
+    {
+        uint32_t putPos = _putPos.load(std::memory_order_acquire);
+        uint32_t getPos = _getPos.load(std::memory_order_relaxed);
+        uint32_t bytesRead = 0;
+        while ((bytesRead < maxLen) && (getPos != putPos))
+        {
+            uint32_t contigLen = (putPos > getPos ? putPos : _buf.size()) - getPos;
+            if (contigLen > maxLen - bytesRead)
+                contigLen = maxLen - bytesRead;
+            memcpy(pBuf + bytesRead, _buf.data() + getPos, contigLen);
+            bytesRead += contigLen;
+            getPos = (getPos + contigLen) % _buf.size();
+        }
+        _getPos.store(getPos, std::memory_order_release);
+        return bytesRead;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get debug JSON
+    /// @return JSON object {"rx":N,"ovf":N,"drop":N}
+    String getDebugJSON() const
+    {
+        char jsonStr[80];
+        snprintf(jsonStr, sizeof(jsonStr), R"({"rx":%u,"ovf":%u,"drop":%u})",
+                    (unsigned)_rxBytes, (unsigned)_overflows, (unsigned)_droppedBytes);
+        return jsonStr;
+    }
+
+private:
+    // Time to wait for the task to stop and the poll interval (data left in the driver when the ring was full)
+    static const uint32_t STOP_WAIT_MS = 100;
+    static const uint32_t EVENT_WAIT_MS = 10;
+
+    // UART
+    int _uartNum = 0;
+    QueueHandle_t _eventQueue = nullptr;
+
+    // Task (the task gives the exited semaphore as its last access to this object)
+    TaskHandle_t _taskHandle = nullptr;
+    volatile bool _stopReq = false;
+    SemaphoreHandle_t _exitedSem = nullptr;
+
+    // Received data callback or ring buffer (block buffer in callback mode)
+    RxDataCB _rxDataCB = nullptr;
+    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> _buf;
+    std::atomic<uint32_t> _putPos = 0;
+    std::atomic<uint32_t> _getPos = 0;
+
+    // Stats
+    uint32_t _rxBytes = 0;
+    uint32_t _overflows = 0;
+    uint32_t _droppedBytes = 0;
+
+    // Task
+    static void rxTaskStatic(void* pvParameters)
+    {
+        UartEventRx* pThis = (UartEventRx*)pvParameters;
+        pThis->rxTask();
+        xSemaphoreGive(pThis->_exitedSem);
+        vTaskDelete(NULL);
+    }
+    void rxTask()
+    {
+        while (!_stopReq)
+        {
+            uart_event_t event;
+            if (xQueueReceive(_eventQueue, &event, pdMS_TO_TICKS(EVENT_WAIT_MS)) != pdTRUE)
+            {
+                readBuffered();
+                continue;
+            }
+            switch (event.type)
+            {
+                case UART_FIFO_OVF:
+                case UART_BUFFER_FULL:
+                {
+                    size_t bufferedLen = 0;
+                    uart_get_buffered_data_len((uart_port_t)_uartNum, &bufferedLen);
+                    _droppedBytes += bufferedLen;
+                    _overflows++;
+                    uart_flush_input((uart_port_t)_uartNum);
+                    xQueueReset(_eventQueue);
+                    break;
+                }
+                default:
+                    readBuffered();
+                    break;
+            }
+        }
+    }
+
+    // Read the data buffered by the driver
+    void readBuffered()
+    {
+        while (true)
+        {
+            size_t bufferedLen = 0;
+            if ((uart_get_buffered_data_len((uart_port_t)_uartNum, &bufferedLen) != ESP_OK) || (bufferedLen == 0))
+                return;
+
+            // Callback mode
+            if (_rxDataCB)
+            {
+                uint32_t toRead = bufferedLen < _buf.size() ? bufferedLen : _buf.size();
+                int bytesRead = uart_read_bytes((uart_port_t)_uartNum, _buf.data(), toRead, 0);
+                if (bytesRead <= 0)
+                    return;
+                _rxBytes += bytesRead;
+                _rxDataCB(_buf.data(), bytesRead);
+                continue;
+            }
+
+            // Ring buffer mode - read into the contiguous free space (one slot is kept empty)
+            uint32_t getPos = _getPos.load(std::memory_order_acquire);
+            uint32_t putPos = _putPos.load(std::memory_order_relaxed);
+            uint32_t freeLen = putPos >= getPos ? (getPos == 0 ? _buf.size() - 1 : _buf.size()) - putPos :
+                        getPos - putPos - 1;
+            if (freeLen == 0)
+                return;
+            uint32_t toRead = bufferedLen < freeLen ? bufferedLen : freeLen;
+            int bytesRead = uart_read_bytes((uart_port_t)_uartNum, _buf.data() + putPos, toRead, 0);
+            if (bytesRead <= 0)
+                return;
+            _rxBytes += bytesRead;
+            _putPos.store((putPos + bytesRead) % _buf.size(), std::memory_order_release);
+        }
+    }
+};
@@ -0,0 +1,243 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SampleAggregator
+// Windowed aggregation (min, max, mean, RMS) and decimation of sample values
+//
+// Fields are declared in config with the statistics required and optionally a window length in samples
+// e.g. "aggFields":[{"name":"ax","stats":["min","max","mean","rms"]},{"name":"t","stats":["last"],"window":10}]
+// Fields without a window use the default window (in samples or, if windowMs is set, in time). The "last"
+// statistic is the final value in the window so a window of N samples with "last" decimates by N.
+//
+// State per field is a few running totals so adding a sample is O(1) whatever the window length. When the
+// window of any field completes a JSON object is produced with the fields completed at that sample:
+//   {"t":<ms>,"ax_min":N,"ax_max":N,"ax_mean":N,"ax_rms":N,"t_last":N}
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftJson.h"
+
+class SampleAggregator
+{
+public:
+    enum StatFlags
+    {
+        STAT_MIN = 0x01,
+        STAT_MAX = 0x02,
+        STAT_MEAN = 0x04,
+        STAT_RMS = 0x08,
+        STAT_LAST = 0x10
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup from config
+    /// @param fieldConfigs field definitions (JSON objects with name, stats and optionally window)
+    /// @param defaultWindow default window length in samples (used if windowMs is 0)
+    /// @param windowMs default window length in ms (0 to use defaultWindow)
+    /// @return false if any field is invalid (aggregation is then disabled)
+    bool setup(const std::vector<String>& fieldConfigs, uint32_t defaultWindow, uint32_t windowMs)
+    {
+        _fields.clear();
+        _windowUs = (uint64_t)windowMs * 1000;
+        for (const String& fieldConfig : fieldConfigs)
+        {
+            RaftJson fieldJson(fieldConfig);
+            Field field;
+            field.name = fieldJson.getString("name", "");
+            std::vector<String> statNames;
+            fieldJson.getArrayElems("stats", statNames);
+            for (const String& statName : statNames)
+            {
+                uint32_t statIdx = 0;
+                while ((statIdx < NUM_STATS) && !statName.equalsIgnoreCase(STAT_NAMES[statIdx]))
+                    statIdx++;
+                if (statIdx == NUM_STATS)
+                {
+                    field.stats = 0;
+                    break;
+                }
+                field.stats |= 1 << statIdx;
+            }
+            field.window = fieldJson.getLong("window", _windowUs == 0 ? defaultWindow : 0);
+            if (field.name.isEmpty() || (field.stats == 0) || ((field.window == 0) && (_windowUs == 0)))
+            {
+                _fields.clear();
+                return false;
+            }
+            field.reset();
+            _fields.push_back(field);
+        }
+        _values.assign(_fields.size(), NAN);
+        _windowStartUs = 0;
+        _windowStarted = false;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if enabled (any fields)
+    bool isEnabled() const
+    {
+        return !_fields.empty();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of fields
+    uint32_t getNumFields() const
+    {
+        return _fields.size();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add values
+    /// @param pValues values in the order of the fields (NaN for a field with no value in this sample)
+    /// @param numValues number of values (missing values are treated as NaN)
+    /// @param timeUs time of the sample
+    /// @param outJSON (out) aggregates JSON if any window has completed
+    /// @return true if a window has completed
+    bool addValues(const double* pValues, uint32_t numValues, uint64_t timeUs, String& outJSON)
+    {
+        // Close time windows which have elapsed (before adding this sample to the next window)
+        std::string aggStr;
+        if (_windowUs != 0)
+        {
+            if (!_windowStarted)
+            {
+                _windowStartUs = timeUs;
+                _windowStarted = true;
+            }
+            else if (timeUs - _windowStartUs >= _windowUs)
+            {
+                for (Field& field : _fields)
+                {
+                    if ((field.window == 0) && (field.count > 0))
+                        field.appendJSON(aggStr);
+                }
+                _windowStartUs = timeUs;
+            }
+        }
+
+        // Add values closing sample count windows which are complete
+        for (uint32_t fieldIdx = 0; fieldIdx < _fields.size(); fieldIdx++)
+        {
+            Field& field = _fields[fieldIdx];
+            double val = fieldIdx < numValues ? pValues[fieldIdx] : NAN;
+            if (isnan(val))
+                continue;
+            field.add(val);
+            if ((field.window != 0) && (field.count >= field.window))
+                field.appendJSON(aggStr);
+        }
+        if (aggStr.empty())
+            return false;
+
+        // Aggregates
+        char timeStr[30];
+        snprintf(timeStr, sizeof(timeStr), R"({"t":%llu)", (unsigned long long)(timeUs / 1000));
+        aggStr.insert(0, timeStr);
+        aggStr += "}";
+        outJSON = aggStr.c_str();
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add a JSON sample (values are members with the field names)
+    /// @param sampleJSON sample
+    /// @param timeUs time of the sample
+    /// @param outJSON (out) aggregates JSON if any window has completed
+    /// @return true if a window has completed
+    bool addJSON(const RaftJson& sampleJSON, uint64_t timeUs, String& outJSON)
+    {
+        for (uint32_t fieldIdx = 0; fieldIdx < _fields.size(); fieldIdx++)
+            _values[fieldIdx] = sampleJSON.getDouble(_fields[fieldIdx].name.c_str(), NAN);
+        return addValues(_values.data(), _values.size(), timeUs, outJSON);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Discard partial windows
+    void reset()
+    {
+        for (Field& field : _fields)
+            field.reset();
+        _windowStarted = false;
+    }
+
+private:
+    static const uint32_t NUM_STATS = 5;
+    static constexpr const char* STAT_NAMES[NUM_STATS] = { "min", "max", "mean", "rms", "last" };
+
+    class Field
+    {
+    public:
+        String name;
+        uint32_t stats = 0;
+        uint32_t window = 0;
+
+        // Running state for the current window
+        uint32_t count = 0;
+        double minVal = 0;
+        double maxVal = 0;
+        double sum = 0;
+        double sumSq = 0;
+        double lastVal = 0;
+
+        void reset()
+        {
+            count = 0;
+            sum = 0;
+            sumSq = 0;
+        }
+        void add(double val)
+        {
+            minVal = (count == 0) || (val < minVal) ? val : minVal;
+            maxVal = (count == 0) || (val > maxVal) ? val : maxVal;
+            sum += val;
+            sumSq += val * val;
+            lastVal = val;
+            count++;
+        }
+
+        // Append the aggregates as JSON members (each preceded by a comma, null if not finite) and start a new
+        // window
+        void appendJSON(std::string& jsonStr)
+        {
+            const double statVals[NUM_STATS] = { minVal, maxVal, sum / count, sqrt(sumSq / count), lastVal };
+            for (uint32_t statIdx = 0; statIdx < NUM_STATS; statIdx++)
+            {
+                if (!(stats & (1 << statIdx)))
+                    continue;
+                jsonStr += ",\"";
+                jsonStr += name.c_str();
+                jsonStr += "_";
+                jsonStr += STAT_NAMES[statIdx];
+                jsonStr += "\":";
+
+                // Non-finite values (e.g. overflow) aren't valid JSON numbers
+                if (!isfinite(statVals[statIdx]))
+                {
+                    jsonStr += "null";
+                    continue;
+                }
+                char valStr[30];
+                snprintf(valStr, sizeof(valStr), "%.6g", statVals[statIdx]);
+                jsonStr += valStr;
+            }
+            reset();
+        }
+    };
+    std::vector<Field> _fields;
+    std::vector<double> _values;
+
+    // Time window
+    uint64_t _windowUs = 0;
+    uint64_t _windowStartUs = 0;
+    bool _windowStarted = false;
+};
@@ -8,6 +8,9 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "SampleCollectorJSON.h"
+#include "CommsCoreIF.h"
+#include "CommsChannelMsg.h"
+#include "SysManager.h"
 
 // #define DEBUG_ADD_SAMPLE
 // #define DEBUG_WRITE_TO_FILE
@@ -25,13 +28,38 @@ void SampleCollectorJSON::setup()
     _dumpToConsoleWhenFull = config.getBool("dumpToConsole", false);
     _dumpToFileName = config.getString("dumpToFile", "");
     _maxFileSize = config.getLong("maxFileSize", 0);
+    _maxStreamChunkLen = config.getLong("maxStreamChunk", DEFAULT_STREAM_CHUNK_LEN);
+    if (!_bufferMutex)
+        _bufferMutex = xSemaphoreCreateMutex();
+
+    // Binary mode
+    std::vector<String> fieldConfigs;
+    config.getArrayElems("binFields", fieldConfigs);
+    if (!_recordFormat.setup(fieldConfigs))
+        LOG_E(MODULE_PREFIX, "setup binFields invalid - using JSON samples");
+    _isBinary = _recordFormat.getRecordLen() > 0;
+    _jsonRecord.assign(_recordFormat.getRecordLen(), 0);
+
+    // Aggregation
+    std::vector<String> aggFieldConfigs;
+    config.getArrayElems("aggFields", aggFieldConfigs);
+    if (!_aggregator.setup(aggFieldConfigs, config.getLong("aggWindow", 0), config.getLong("aggWindowMs", 0)))
+        LOG_E(MODULE_PREFIX, "setup aggFields invalid - aggregation disabled");
+    _aggToBuffer = config.getBool("aggToBuffer", true);
+    _aggTopic = config.getString("aggTopic", "");
+    _aggPublisher = config.getString("aggPublisher", "Publish");
+
+    // Background writer
+    _bgWriterEnabled = (_dumpToFileName.length() > 0) && !_dumpToConsoleWhenFull && config.getBool("bgWrite", true);
+    if (_bgWriterEnabled)
+        startBgWriter();
 
     // Settings
     if (_sampleRateLimitHz > 0)
         _minTimeBetweenSamplesUs = 1000000 / _sampleRateLimitHz;
 
     // Debug
-    LOG_I(MODULE_PREFIX, "setup sampleRateLimitHz %d maxTotalJSONStringSize %d sampleHeader %s sampleAPIName %s allocateAtStart %s dumpToConsole %d dumpToFileName %s maxFileSize %d",
+    LOG_I(MODULE_PREFIX, "setup sampleRateLimitHz %d maxTotalJSONStringSize %d sampleHeader %s sampleAPIName %s allocateAtStart %s dumpToConsole %d dumpToFileName %s maxFileSize %d binRecLen %d aggFields %d",
                 _sampleRateLimitHz, 
                 _maxTotalJSONStringSize, 
                 _sampleHeader.c_str(), 
@@ -39,7 +67,9 @@ void SampleCollectorJSON::setup()
                 _allocateAtStart ? "Y" : "N", 
                 _dumpToConsoleWhenFull,
                 _dumpToFileName.c_str(),
-                _maxFileSize);
+                _maxFileSize,
+                _recordFormat.getRecordLen(),
+                _aggregator.getNumFields());
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -54,7 +84,8 @@ void SampleCollectorJSON::addRestAPIEndpoints(RestAPIEndpointManager& pEndpoints
     pEndpoints.addEndpoint(_sampleAPIName.c_str(), 
             RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
                         std::bind(&SampleCollectorJSON::apiSample, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
-                        "handle samples, e.g. sample/start, sample/stop, sample/clear, sample/write/<filename>");
+                        "handle samples, e.g. sample/start, sample/stop, sample/clear, sample/write/<filename>, "
+                        "sample/chunk?max=<bytes>, sample/stream?chunk=<bytes>, sample/endstream");
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -64,6 +95,8 @@ void SampleCollectorJSON::addRestAPIEndpoints(RestAPIEndpointManager& pEndpoints
 /// @param sourceInfo Source info
 RaftRetCode SampleCollectorJSON::apiSample(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API_REF(_sampleAPITiming, _sampleAPIName.c_str());
+
     // Extract params
     std::vector<String> params;
     std::vector<RaftJson::NameValuePair> nameValues;
@@ -73,24 +106,45 @@ RaftRetCode SampleCollectorJSON::apiSample(const String &reqStr, String &respStr
     // Handle commands
     bool rslt = true;
     String rsltStr;
+    RaftJson jsonParams(paramsJSON);
+    if (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE)
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failBusy");
     if (params.size() > 0)
     {
         // Start
         if (params[1].equalsIgnoreCase("start"))
         {
             _samplingEnabled = true;
+            _aggregator.reset();
             rsltStr = "Ok";
         }
-        // Stop
+        // Stop (samples collected so far are written out by the background writer if enabled - or sent if
+        // streaming after which the stream ends)
         else if (params[1].equalsIgnoreCase("stop"))
         {
             _samplingEnabled = false;
-            rsltStr = "Ok";
+            rslt = !_bgWriterEnabled || _streamActive || queueActiveBuffer(true);
+            rsltStr = rslt ? "Ok" : "failFlush";
+        }
+        // Flush buffer to the dump file (background writer)
+        else if (params[1].equalsIgnoreCase("flush"))
+        {
+            rslt = _bgWriterEnabled && !_streamActive && queueActiveBuffer(true);
+            rsltStr = rslt ? "Ok" : "failFlush";
+        }
+        // Clear, write and get take the buffer contents so aren't allowed while streaming (the stream reads
+        // from the buffer)
+        else if (_streamActive && (params[1].equalsIgnoreCase("clear") || params[1].equalsIgnoreCase("write") ||
+                    params[1].equalsIgnoreCase("get")))
+        {
+            rslt = false;
+            rsltStr = "failStreaming";
         }
         // Clear buffer
         else if (params[1].equalsIgnoreCase("clear"))
         {
             _sampleBuffer.clear();
+            _readPos = 0;
             rsltStr = "Ok";
         }
         // Write to file
@@ -98,14 +152,81 @@ RaftRetCode SampleCollectorJSON::apiSample(const String &reqStr, String &respStr
         {
             rslt = writeToFile(params[2], false, rsltStr);
         }
-        // Get buffer
+        // Get buffer (binary records are returned as hex along with the format)
         else if (params[1].equalsIgnoreCase("get"))
         {
+            compactBuffer();
+            if (_isBinary)
+            {
+                String hexStr;
+                Raft::getHexStrFromBytes((const uint8_t*)_sampleBuffer.data(), _sampleBuffer.size(), hexStr);
+                String fmtStr = R"("fmt":)" + _recordFormat.getHeaderJSON(_sampleHeader) + R"(,"hex":")" + hexStr + "\"";
+                _sampleBuffer.clear();
+                xSemaphoreGive(_bufferMutex);
+                return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, fmtStr.c_str());
+            }
             respStr = String(_sampleBuffer.data(), _sampleBuffer.size());
             _sampleBuffer.clear();
+            xSemaphoreGive(_bufferMutex);
             return RAFT_OK;
         }
+        // Get the next chunk of samples (the space is released for new samples)
+        else if (params[1].equalsIgnoreCase("chunk"))
+        {
+            if (_streamActive)
+            {
+                rslt = false;
+                rsltStr = "failStreaming";
+            }
+            else
+            {
+                String chunkJSON;
+                getChunkJSON(jsonParams.getLong("max", DEFAULT_CHUNK_MAX_LEN), chunkJSON);
+                xSemaphoreGive(_bufferMutex);
+                return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, chunkJSON.c_str());
+            }
+        }
+        // Stream samples to the requesting channel
+        else if (params[1].equalsIgnoreCase("stream"))
+        {
+            if (_streamActive)
+            {
+                rslt = false;
+                rsltStr = "failBusy";
+            }
+            else if (!getCommsCore())
+            {
+                rslt = false;
+                rsltStr = "failNoComms";
+            }
+            else
+            {
+                uint32_t chunkLen = jsonParams.getLong("chunk", 0);
+                _streamChunkLen = (chunkLen == 0) || (chunkLen > _maxStreamChunkLen) ? _maxStreamChunkLen : chunkLen;
+                if (_isBinary && (_streamChunkLen < _recordFormat.getRecordLen()))
+                    _streamChunkLen = _recordFormat.getRecordLen();
+                _streamChannelID = sourceInfo.channelID;
+                _streamPos = 0;
+                _streamLastSendMs = millis();
+                _streamEndReq = false;
+                _streamActive = true;
+                LOG_I(MODULE_PREFIX, "apiSample stream channelID %d chunk %d", _streamChannelID, _streamChunkLen);
+                String streamJSON = R"("chunk":)" + String(_streamChunkLen);
+                if (_isBinary)
+                    streamJSON += R"(,"fmt":)" + _recordFormat.getHeaderJSON(_sampleHeader);
+                xSemaphoreGive(_bufferMutex);
+                return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, streamJSON.c_str());
+            }
+        }
+        // End stream (after the samples already buffered have been sent)
+        else if (params[1].equalsIgnoreCase("endstream"))
+        {
+            rslt = _streamActive;
+            _streamEndReq = true;
+            rsltStr = rslt ? "Ok" : "failNotStreaming";
+        }
     }
+    xSemaphoreGive(_bufferMutex);
     // Result
     if (rslt)
     {
@@ -122,6 +243,9 @@ RaftRetCode SampleCollectorJSON::apiSample(const String &reqStr, String &respStr
 /// @param errMsg Error message
 bool SampleCollectorJSON::writeToFile(const String& filename, bool append, String& errMsg)
 {
+    // Samples already retrieved aren't written
+    compactBuffer();
+
     // Get file size
     uint32_t fileSizeStart = 0;
     bool isFsOkStart = fileSystem.getFileInfo("", filename, fileSizeStart);
@@ -134,9 +258,19 @@ bool SampleCollectorJSON::writeToFile(const String& filename, bool append, Strin
         return false;
     }
 
-    // Write header
+    // Write header (binary files always have a header describing the records)
     bool rslt = true;
-    if ((!append || (fileSizeStart == 0)) && !_sampleHeader.isEmpty())
+    if (_isBinary && (!append || (fileSizeStart == 0)))
+    {
+        std::vector<uint8_t> fileHeader;
+        _recordFormat.getFileHeader(_sampleHeader, fileHeader);
+        if (fileSystem.fileWrite(pFile, fileHeader.data(), fileHeader.size()) != fileHeader.size())
+        {
+            errMsg = "failWriteHdr";
+            rslt = false;
+        }
+    }
+    else if ((!append || (fileSizeStart == 0)) && !_sampleHeader.isEmpty())
     {
         uint32_t bytesWritten = fileSystem.fileWrite(pFile, (uint8_t*)(_sampleHeader + "\n").c_str(), _sampleHeader.length()+1);
         if (bytesWritten != _sampleHeader.length() + 1)
@@ -183,9 +317,31 @@ bool SampleCollectorJSON::writeToFile(const String& filename, bool append, Strin
 /// @brief Write to console
 void SampleCollectorJSON::writeToConsole()
 {
+    // Samples already retrieved aren't written
+    compactBuffer();
+
     // Write header
     LOG_I("S", "SampleCollector: %s", _sampleHeader.c_str());
 
+    // Binary records are written as comma separated values
+    if (_isBinary)
+    {
+        LOG_I("S", "%s", _recordFormat.getHeaderJSON("").c_str());
+        uint32_t recordLen = _recordFormat.getRecordLen();
+        for (uint32_t recPos = 0; recPos + recordLen <= _sampleBuffer.size(); recPos += recordLen)
+        {
+            String lineStr;
+            for (uint32_t fieldIdx = 0; fieldIdx < _recordFormat.getFields().size(); fieldIdx++)
+            {
+                double val = _recordFormat.getValue((const uint8_t*)&_sampleBuffer[recPos], fieldIdx);
+                lineStr += (fieldIdx == 0 ? "" : ",") + String(val, 
+                            _recordFormat.getFields()[fieldIdx].type == SampleRecordFormat::FIELD_F32 ? 4 : 0);
+            }
+            LOG_I("S", "%s", lineStr.c_str());
+        }
+        return;
+    }
+
     // Write lines
     uint32_t strPos = 0;
     while (strPos < _sampleBuffer.size())
@@ -217,6 +373,124 @@ bool SampleCollectorJSON::addSample(const String& sampleJSON)
     if (!_samplingEnabled)
         return false;
 
+    // Aggregation - only the aggregates are stored (the aggregator is reset by the API so is accessed under the
+    // buffer mutex)
+    if (_aggregator.isEnabled())
+    {
+        RaftJson sampleJson(sampleJSON);
+        String aggJSON;
+        if (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE)
+            return false;
+        bool isAggregate = _aggregator.addJSON(sampleJson, micros(), aggJSON);
+        xSemaphoreGive(_bufferMutex);
+        if (isAggregate)
+            handleAggregate(aggJSON);
+        return true;
+    }
+    return storeSample(sampleJSON);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add sample values for aggregation
+/// @param pValues Values (in the order of the aggregation fields)
+/// @param numValues Number of values
+bool SampleCollectorJSON::addSampleValues(const double* pValues, uint32_t numValues)
+{
+    // Check enabled
+    if (!_samplingEnabled || !_aggregator.isEnabled() || !pValues)
+        return false;
+    String aggJSON;
+    if (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+    bool isAggregate = _aggregator.addValues(pValues, numValues, micros(), aggJSON);
+    xSemaphoreGive(_bufferMutex);
+    if (isAggregate)
+        handleAggregate(aggJSON);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Store a sample in the buffer
+/// @param sampleJSON Sample JSON
+bool SampleCollectorJSON::storeSample(const String& sampleJSON)
+{
+    // Binary mode
+    if (_isBinary)
+    {
+        RaftJson sampleJson(sampleJSON);
+        for (uint32_t fieldIdx = 0; fieldIdx < _recordFormat.getFields().size(); fieldIdx++)
+        {
+            _recordFormat.setValue(_jsonRecord.data(), fieldIdx, 
+                        sampleJson.getDouble(_recordFormat.getFields()[fieldIdx].name.c_str(), 0));
+        }
+        return addSampleBinary(_jsonRecord.data(), _jsonRecord.size());
+    }
+
+    // Check time since last sample and space in the buffer
+    uint64_t timeNowUs = micros();
+    if (!checkSampleRate(timeNowUs) || (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE))
+        return false;
+    if (!makeSpace(sampleJSON.length() + 1))
+    {
+        xSemaphoreGive(_bufferMutex);
+        return false;
+    }
+
+    // Add sample to buffer
+    _sampleBuffer.insert(_sampleBuffer.end(), sampleJSON.c_str(), sampleJSON.c_str() + sampleJSON.length());
+    _sampleBuffer.push_back('\n');
+    xSemaphoreGive(_bufferMutex);
+
+    // Update time since last sample
+    _timeSinceLastSampleUs = timeNowUs;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add binary sample record
+/// @param pRecord Record
+/// @param recordLen Record length (must match the record format)
+bool SampleCollectorJSON::addSampleBinary(const uint8_t* pRecord, uint32_t recordLen)
+{
+    // Check enabled and the record is valid
+    if (!_samplingEnabled || !_isBinary || !pRecord || (recordLen != _recordFormat.getRecordLen()))
+        return false;
+
+    // Check time since last sample and space in the buffer
+    uint64_t timeNowUs = micros();
+    if (!checkSampleRate(timeNowUs) || (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE))
+        return false;
+    if (!makeSpace(recordLen))
+    {
+        xSemaphoreGive(_bufferMutex);
+        return false;
+    }
+
+    // Add record to buffer
+    _sampleBuffer.insert(_sampleBuffer.end(), (const char*)pRecord, (const char*)pRecord + recordLen);
+    xSemaphoreGive(_bufferMutex);
+
+    // Update time since last sample
+    _timeSinceLastSampleUs = timeNowUs;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check the sample rate limit
+/// @param timeNowUs Time now
+/// @return true if a sample can be added
+bool SampleCollectorJSON::checkSampleRate(uint64_t timeNowUs)
+{
+    return (_minTimeBetweenSamplesUs == 0) || 
+                Raft::isTimeout(timeNowUs, _timeSinceLastSampleUs, _minTimeBetweenSamplesUs);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Make space in the buffer for a sample (dumping to console or file if full)
+/// @param sampleLen Sample length
+/// @return true if there is space
+bool SampleCollectorJSON::makeSpace(uint32_t sampleLen)
+{
     // Allocate buffer
     if (_allocateAtStart)
     {
@@ -224,9 +498,29 @@ bool SampleCollectorJSON::addSample(const String& sampleJSON)
         _allocateAtStart = false;
     }
 
+    // Reclaim the space used by samples already retrieved
+    if ((_readPos > 0) && (_sampleBuffer.size() + sampleLen >= _maxTotalJSONStringSize))
+        compactBuffer();
+
     // Check if buffer will be full
-    if (_sampleBuffer.size() + sampleJSON.length() + 1 >= _maxTotalJSONStringSize)
+    if (_sampleBuffer.size() + sampleLen >= _maxTotalJSONStringSize)
     {
+        // While streaming the buffer is only emptied by the stream
+        if (_streamActive)
+        {
+            _droppedSamples++;
+            return false;
+        }
+
+        // Swap for a spare buffer and queue the full one to the background writer
+        if (_bgWriterEnabled)
+        {
+            if (queueActiveBuffer(false))
+                return true;
+            _droppedSamples++;
+            return false;
+        }
+
         // Dump to console
         if (_dumpToConsoleWhenFull)
         {
@@ -235,11 +529,12 @@ bool SampleCollectorJSON::addSample(const String& sampleJSON)
         }
         else if (_dumpToFileName.length() > 0)
         {
-            // Check size of file
+            // Check size of file (maxFileSize 0 is unlimited)
             uint32_t fileSize = 0;
-            if (fileSystem.getFileInfo("", _dumpToFileName, fileSize) && (fileSize > _maxFileSize))
+            if ((_maxFileSize != 0) && fileSystem.getFileInfo("", _dumpToFileName, fileSize) && (fileSize > _maxFileSize))
             {
                 LOG_I(MODULE_PREFIX, "addSample: file %s size %d exceeds max %d", _dumpToFileName.c_str(), fileSize, _maxFileSize);
+                _droppedSamples++;
                 return false;
             }
 
@@ -248,6 +543,7 @@ bool SampleCollectorJSON::addSample(const String& sampleJSON)
             if (!writeToFile(_dumpToFileName, true, errMsg))
             {
                 LOG_E(MODULE_PREFIX, "addSample: FAILED to write to file %s", errMsg.c_str());
+                _droppedSamples++;
                 return false;
             }
 
@@ -256,20 +552,397 @@ bool SampleCollectorJSON::addSample(const String& sampleJSON)
         }
         else
         {
+            _droppedSamples++;
             return false;
         }
     }
+    return true;
+}
 
-    // Check time since last sample
-    uint64_t timeNowUs = micros();
-    if ((_minTimeBetweenSamplesUs != 0) && (Raft::isTimeout(timeNowUs, _timeSinceLastSampleUs, _minTimeBetweenSamplesUs)))
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+String SampleCollectorJSON::getDebugJSON() const
+{
+    char jsonStr[250];
+    snprintf(jsonStr, sizeof(jsonStr), 
+                R"({"bufLen":%d,"drop":%d,"dropBytes":%d,"flushes":%d,"flushAvgUs":%d,"flushMaxUs":%d,"flushLastUs":%d,"freeBufs":%d,"strm":%d,"strmPos":%d,"agg":%d})",
+                (int)(_sampleBuffer.size() - _readPos), (int)_droppedSamples, (int)_droppedBytes, (int)_numFlushes, 
+                _numFlushes == 0 ? 0 : (int)(_flushTotalUs / _numFlushes), (int)_flushMaxUs, (int)_flushLastUs,
+                _freeBufQueue ? (int)uxQueueMessagesWaiting(_freeBufQueue) : 0,
+                _streamActive ? 1 : 0, (int)_streamPos, (int)_aggCount);
+    return jsonStr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start the background writer (creates the spare buffers, queues and task)
+void SampleCollectorJSON::startBgWriter()
+{
+    // Spare buffers
+    uint32_t numBuffers = config.getLong("numBuffers", DEFAULT_NUM_BUFFERS);
+    if (numBuffers < 2)
+        numBuffers = 2;
+    _writeChunkSize = config.getLong("writeChunkSize", DEFAULT_WRITE_CHUNK_SIZE);
+    if (_writeChunkSize < 1)
+        _writeChunkSize = 1;
+    _spareBuffers.resize(numBuffers - 1);
+    _freeBufQueue = xQueueCreate(_spareBuffers.size(), sizeof(SampleBuffer*));
+    _fullBufQueue = xQueueCreate(_spareBuffers.size() + 1, sizeof(SampleBuffer*));
+    for (SampleBuffer& buffer : _spareBuffers)
+    {
+        if (_allocateAtStart)
+            buffer.reserve(_maxTotalJSONStringSize);
+        SampleBuffer* pBuffer = &buffer;
+        xQueueSend(_freeBufQueue, &pBuffer, 0);
+    }
+    _writeCarry.reserve(_writeChunkSize);
+
+    // Task
+    BaseType_t retc = xTaskCreatePinnedToCore(
+                SampleCollectorJSON::writerTaskStatic,
+                "SampleWrTask",
+                config.getLong("taskStack", DEFAULT_TASK_STACK_SIZE_BYTES),
+                this,
+                config.getLong("taskPriority", DEFAULT_TASK_PRIORITY),
+                &_writerTaskHandle,
+                config.getLong("taskCore", DEFAULT_TASK_CORE));
+    if (retc != pdPASS)
+    {
+        LOG_E(MODULE_PREFIX, "startBgWriter failed to create task - writing synchronously");
+        _bgWriterEnabled = false;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Swap the active buffer for a spare and queue it to the background writer
+/// @param flushFile true to write any held data and close the file after writing the buffer - this waits
+///        (up to FLUSH_WAIT_MS) for the writer to free a spare buffer and the flush request is always queued
+/// @return false if no spare buffer is free (or the flush request could not be queued)
+bool SampleCollectorJSON::queueActiveBuffer(bool flushFile)
+{
+    TickType_t waitTicks = flushFile ? pdMS_TO_TICKS(FLUSH_WAIT_MS) : 0;
+    bool rslt = true;
+    SampleBuffer* pBuffer = nullptr;
+    compactBuffer();
+    if (!_sampleBuffer.empty())
+    {
+        if (xQueueReceive(_freeBufQueue, &pBuffer, waitTicks) == pdPASS)
+        {
+            _sampleBuffer.swap(*pBuffer);
+            xQueueSend(_fullBufQueue, &pBuffer, 0);
+        }
+        else
+        {
+            rslt = false;
+        }
+    }
+    if (flushFile)
+    {
+        pBuffer = nullptr;
+        if (xQueueSend(_fullBufQueue, &pBuffer, waitTicks) != pdPASS)
+            rslt = false;
+        if (!rslt)
+            LOG_W(MODULE_PREFIX, "queueActiveBuffer flush timed out waiting for the writer");
+    }
+    return rslt;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Background writer task
+void SampleCollectorJSON::writerTaskStatic(void* pvParameters)
+{
+    ((SampleCollectorJSON*)pvParameters)->writerTask();
+}
+
+void SampleCollectorJSON::writerTask()
+{
+    while (true)
+    {
+        SampleBuffer* pBuffer = nullptr;
+        if (xQueueReceive(_fullBufQueue, &pBuffer, portMAX_DELAY) != pdPASS)
+            continue;
+
+        // Flush request
+        if (!pBuffer)
+        {
+            appendToDumpFile(nullptr, 0, true);
+            closeDumpFile();
+            continue;
+        }
+
+        // Append buffer to file
+        uint64_t startUs = micros();
+        if (!appendToDumpFile((const uint8_t*)pBuffer->data(), pBuffer->size(), false))
+            _droppedBytes += pBuffer->size();
+        uint32_t flushUs = micros() - startUs;
+        _flushLastUs = flushUs;
+        _flushTotalUs += flushUs;
+        _flushMaxUs = flushUs > _flushMaxUs ? flushUs : _flushMaxUs;
+        _numFlushes++;
+
+        // Return buffer to the free queue
+        pBuffer->clear();
+        xQueueSend(_freeBufQueue, &pBuffer, 0);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Append data to the dump file (writer task only) - the file is opened (and the header written if
+///        the file is empty) as required and data is written in whole chunks with the remainder held
+/// @param pData Data
+/// @param len Length
+/// @param flush true to write any held data
+/// @return false if the data could not be written
+bool SampleCollectorJSON::appendToDumpFile(const uint8_t* pData, uint32_t len, bool flush)
+{
+    // Open file
+    if (!_pDumpFile)
+    {
+        if ((len == 0) && _writeCarry.empty())
+            return true;
+        _dumpFileSize = 0;
+        fileSystem.getFileInfo("", _dumpToFileName, _dumpFileSize);
+        _pDumpFile = fileSystem.fileOpen("", _dumpToFileName, true, 0, true);
+        if (!_pDumpFile)
+        {
+            LOG_E(MODULE_PREFIX, "appendToDumpFile failed to open %s", _dumpToFileName.c_str());
+            return false;
+        }
+        if (_dumpFileSize == 0)
+        {
+            std::vector<uint8_t> fileHeader;
+            if (_isBinary)
+                _recordFormat.getFileHeader(_sampleHeader, fileHeader);
+            else if (!_sampleHeader.isEmpty())
+            {
+                fileHeader.assign(_sampleHeader.c_str(), _sampleHeader.c_str() + _sampleHeader.length());
+                fileHeader.push_back('\n');
+            }
+            fileSystem.fileWrite(_pDumpFile, fileHeader.data(), fileHeader.size());
+            _dumpFileSize += fileHeader.size();
+        }
+    }
+
+    // Check max file size (0 is unlimited as for the synchronous dump)
+    if ((_maxFileSize != 0) && (_dumpFileSize + _writeCarry.size() + len > _maxFileSize))
+    {
+        LOG_W(MODULE_PREFIX, "appendToDumpFile file %s would exceed max size %d", _dumpToFileName.c_str(), _maxFileSize);
         return false;
+    }
 
-    // Add sample to buffer
-    _sampleBuffer.insert(_sampleBuffer.end(), sampleJSON.c_str(), sampleJSON.c_str() + sampleJSON.length());
-    _sampleBuffer.push_back('\n');
+    // Top up held data to a whole chunk
+    if (!_writeCarry.empty())
+    {
+        uint32_t toCopy = _writeChunkSize - _writeCarry.size();
+        if (toCopy > len)
+            toCopy = len;
+        _writeCarry.insert(_writeCarry.end(), pData, pData + toCopy);
+        pData += toCopy;
+        len -= toCopy;
+        if ((_writeCarry.size() < _writeChunkSize) && !flush)
+            return true;
+        uint32_t written = fileSystem.fileWrite(_pDumpFile, _writeCarry.data(), _writeCarry.size());
+        _dumpFileSize += written;
+        bool writeOk = written == _writeCarry.size();
+        _writeCarry.clear();
+        if (!writeOk)
+            return false;
+    }
 
-    // Update time since last sample
-    _timeSinceLastSampleUs = timeNowUs;
+    // Write whole chunks directly and hold the remainder
+    uint32_t directLen = flush ? len : len - (len % _writeChunkSize);
+    if (directLen > 0)
+    {
+        uint32_t written = fileSystem.fileWrite(_pDumpFile, pData, directLen);
+        _dumpFileSize += written;
+        if (written != directLen)
+            return false;
+    }
+    _writeCarry.insert(_writeCarry.end(), pData + directLen, pData + len);
     return true;
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Close the dump file (writer task only)
+void SampleCollectorJSON::closeDumpFile()
+{
+    if (!_pDumpFile)
+        return;
+    fileSystem.fileClose(_pDumpFile, "", _dumpToFileName, true);
+    _pDumpFile = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Discard samples already retrieved from the start of the buffer (buffer mutex must be held)
+void SampleCollectorJSON::compactBuffer()
+{
+    if (_readPos == 0)
+        return;
+    _sampleBuffer.erase(_sampleBuffer.begin(), _sampleBuffer.begin() + _readPos);
+    _readPos = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the next chunk of samples and advance the read position (buffer mutex must be held)
+/// @param maxLen Max number of bytes of samples (at least one sample is returned if available)
+/// @param jsonStr (out) JSON members - "samples":[...] (or "hex":"..." in binary mode) and "remain":<bytes>
+void SampleCollectorJSON::getChunkJSON(uint32_t maxLen, String& jsonStr)
+{
+    uint32_t avail = _sampleBuffer.size() - _readPos;
+    uint32_t chunkLen = avail < maxLen ? avail : maxLen;
+    if (_isBinary)
+    {
+        // Whole records
+        uint32_t recordLen = _recordFormat.getRecordLen();
+        chunkLen -= chunkLen % recordLen;
+        if ((chunkLen == 0) && (avail >= recordLen))
+            chunkLen = recordLen;
+        String hexStr;
+        Raft::getHexStrFromBytes((const uint8_t*)_sampleBuffer.data() + _readPos, chunkLen, hexStr);
+        jsonStr = R"("hex":")" + hexStr + "\"";
+    }
+    else
+    {
+        // Whole lines (each is a JSON sample)
+        const char* pStart = _sampleBuffer.data() + _readPos;
+        while ((chunkLen > 0) && (pStart[chunkLen - 1] != '\n'))
+            chunkLen--;
+        if (chunkLen == 0)
+        {
+            while ((chunkLen < avail) && (pStart[chunkLen] != '\n'))
+                chunkLen++;
+            chunkLen = chunkLen < avail ? chunkLen + 1 : 0;
+        }
+        std::string samplesStr;
+        samplesStr.reserve(chunkLen + 20);
+        samplesStr = R"("samples":[)";
+        if (chunkLen > 0)
+        {
+            samplesStr.append(pStart, chunkLen - 1);
+            for (uint32_t i = 11; i < samplesStr.length(); i++)
+            {
+                if (samplesStr[i] == '\n')
+                    samplesStr[i] = ',';
+            }
+        }
+        samplesStr += "]";
+        jsonStr = samplesStr.c_str();
+    }
+
+    // Release the space
+    _readPos += chunkLen;
+    if (_readPos >= _sampleBuffer.size())
+    {
+        _sampleBuffer.clear();
+        _readPos = 0;
+    }
+    jsonStr += R"(,"remain":)" + String((int)(_sampleBuffer.size() - _readPos));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Service the stream - sends the next chunk if there are samples and the channel can accept it
+void SampleCollectorJSON::serviceStream()
+{
+    if (!_streamActive)
+        return;
+
+    // Check the channel can accept a message (giving up if it stalls)
+    bool noConn = false;
+    bool canSend = getCommsCore() && getCommsCore()->outboundCanAccept(_streamChannelID, MSG_TYPE_PUBLISH, noConn);
+    bool isStalled = noConn || Raft::isTimeout(millis(), _streamLastSendMs, STREAM_STALL_TIMEOUT_MS);
+    if (!canSend && !isStalled)
+        return;
+
+    // Get the next chunk (the stream ends when everything has been sent after an end request or sampling stops)
+    if (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    uint32_t avail = _sampleBuffer.size() - _readPos;
+    uint32_t toSend = avail < _streamChunkLen ? avail : _streamChunkLen;
+    if (_isBinary)
+        toSend -= toSend % _recordFormat.getRecordLen();
+    uint8_t flags = 0;
+    if (!canSend)
+    {
+        flags = SAMPLE_CHUNK_FLAG_FINAL | SAMPLE_CHUNK_FLAG_ERROR;
+        toSend = 0;
+    }
+    else if ((toSend == avail) && (_streamEndReq || !_samplingEnabled))
+        flags = SAMPLE_CHUNK_FLAG_FINAL;
+    if ((toSend == 0) && !(flags & SAMPLE_CHUNK_FLAG_FINAL))
+    {
+        xSemaphoreGive(_bufferMutex);
+        _streamLastSendMs = millis();
+        return;
+    }
+    _chunkBuf.resize(SAMPLE_CHUNK_HEADER_LEN + toSend);
+    _chunkBuf[0] = SAMPLE_CHUNK_MARKER;
+    _chunkBuf[1] = flags;
+    _chunkBuf[2] = (_streamPos >> 24) & 0xff;
+    _chunkBuf[3] = (_streamPos >> 16) & 0xff;
+    _chunkBuf[4] = (_streamPos >> 8) & 0xff;
+    _chunkBuf[5] = _streamPos & 0xff;
+    memcpy(_chunkBuf.data() + SAMPLE_CHUNK_HEADER_LEN, _sampleBuffer.data() + _readPos, toSend);
+
+    // Release the space
+    _readPos += toSend;
+    if (_readPos >= _sampleBuffer.size())
+    {
+        _sampleBuffer.clear();
+        _readPos = 0;
+    }
+    if (flags & SAMPLE_CHUNK_FLAG_FINAL)
+        _streamActive = false;
+    xSemaphoreGive(_bufferMutex);
+
+    // Send (the error chunk is attempted even if the channel is stalled)
+    if (!noConn)
+    {
+        CommsChannelMsg chunkMsg(_streamChannelID, MSG_PROTOCOL_ROSSERIAL, 0, MSG_TYPE_PUBLISH);
+        chunkMsg.setFromBuffer(_chunkBuf.data(), _chunkBuf.size());
+        getCommsCore()->outboundHandleMsg(chunkMsg);
+    }
+    _streamPos += toSend;
+    _streamLastSendMs = millis();
+    if (flags & SAMPLE_CHUNK_FLAG_FINAL)
+        LOG_I(MODULE_PREFIX, "serviceStream %s at pos %d", (flags & SAMPLE_CHUNK_FLAG_ERROR) ? "FAILED" : "done", _streamPos);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle aggregates from the aggregator (store and/or make available to the publisher)
+/// @param aggJSON Aggregates JSON
+void SampleCollectorJSON::handleAggregate(const String& aggJSON)
+{
+    if (_aggToBuffer)
+        storeSample(aggJSON);
+    if (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    if (!_aggTopic.isEmpty())
+        _lastAggJSON = aggJSON;
+    _aggCount++;
+    xSemaphoreGive(_bufferMutex);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Register the latest aggregates as a data source for the publisher (published when they change)
+void SampleCollectorJSON::registerAggPublisher()
+{
+    if (!getSysManager())
+        return;
+    _aggPubRegistered = true;
+    bool rslt = getSysManager()->registerDataSource(_aggPublisher.c_str(), _aggTopic.c_str(), 
+        [this](const char* messageName, CommsChannelMsg& msg) {
+            if (xSemaphoreTake(_bufferMutex, portMAX_DELAY) != pdTRUE)
+                return false;
+            String aggJSON = _lastAggJSON;
+            xSemaphoreGive(_bufferMutex);
+            if (aggJSON.isEmpty())
+                return false;
+            msg.setFromBuffer((uint8_t*)aggJSON.c_str(), aggJSON.length());
+            return true;
+        },
+        [this](const char* messageName, std::vector<uint8_t>& stateHash) {
+            uint32_t aggCount = _aggCount;
+            stateHash.assign((uint8_t*)&aggCount, (uint8_t*)&aggCount + sizeof(aggCount));
+        });
+    LOG_I(MODULE_PREFIX, "registerAggPublisher %s topic %s %s", _aggPublisher.c_str(), _aggTopic.c_str(), 
+                rslt ? "OK" : "FAILED");
+}
@@ -16,6 +16,10 @@
 #include "RestAPIEndpointManager.h"
 #include "RaftUtils.h"
 #include "FileSystem.h"
+#include "SampleRecordFormat.h"
+#include "SampleAggregator.h"
+#include "RaftThreading.h"
+#include "SysModTiming.h"
 
 class SampleCollectorJSON : public RaftSysMod
 {
@@ -34,9 +38,26 @@ public:
         return new SampleCollectorJSON(pModuleName, sysConfig);
     }    
 
-    // Add sample
+    // Add sample (in binary mode the JSON members named as fields are packed into a record - if aggregation
+    // is configured the sample is aggregated and only the aggregates are stored)
     bool addSample(const String& sampleJSON);
 
+    // Add binary sample record (binary mode only - the record must be getRecordLen() bytes - records are
+    // stored directly even if aggregation is configured)
+    bool addSampleBinary(const uint8_t* pRecord, uint32_t recordLen);
+
+    // Add sample values for aggregation (in the order of aggFields - NaN for a field with no value)
+    bool addSampleValues(const double* pValues, uint32_t numValues);
+
+    // Binary mode record format
+    const SampleRecordFormat& getRecordFormat() const
+    {
+        return _recordFormat;
+    }
+
+    // Get debug string
+    virtual String getDebugJSON() const override final;
+
 protected:
 
     // Setup
@@ -44,7 +65,12 @@ protected:
 
     // Loop
     virtual void loop() override final
-    {}
+    {
+        SYSMOD_TIMED_LOOP();
+        if (!_aggTopic.isEmpty() && !_aggPubRegistered)
+            registerAggPublisher();
+        serviceStream();
+    }
 
     // Add endpoints
     virtual void addRestAPIEndpoints(RestAPIEndpointManager& pEndpoints) override final;
@@ -57,8 +83,9 @@ protected:
     }
 
 private:
-    // Sample API name
+    // Sample API name (and its timing entry)
     String _sampleAPIName;
+    SysModTiming::EntryRef _sampleAPITiming;
 
     // Header string
     String _sampleHeader;
@@ -67,7 +94,7 @@ private:
     uint32_t _sampleRateLimitHz = 0;
     uint32_t _maxTotalJSONStringSize = 0;
 
-    // Dumping
+    // Dumping - when the dump file exceeds maxFileSize (bytes, 0 for unlimited) further samples are dropped
     bool _dumpToConsoleWhenFull = false;
     String _dumpToFileName;
     uint32_t _maxFileSize = 0;
@@ -85,11 +112,107 @@ private:
     // Sample buffer
     std::vector<char, SpiramAwareAllocator<char>> _sampleBuffer;
 
+    // Binary mode - fixed-width records (layout from binFields config) are stored instead of JSON lines
+    bool _isBinary = false;
+    SampleRecordFormat _recordFormat;
+    std::vector<uint8_t> _jsonRecord;
+
+    // Background file writer - when the buffer is full (and dumpToFile is set) it is swapped for a spare
+    // buffer in O(1) and the full buffer is queued to a task which appends it to the dump file (kept open)
+    // in sector sized writes and then returns it to the free queue - samples are only dropped if no spare
+    // buffer is free
+    typedef std::vector<char, SpiramAwareAllocator<char>> SampleBuffer;
+    static const uint32_t DEFAULT_NUM_BUFFERS = 2;
+    static const uint32_t DEFAULT_WRITE_CHUNK_SIZE = 4096;
+    static const int DEFAULT_TASK_CORE = 0;
+    static const int DEFAULT_TASK_PRIORITY = 3;
+    static const int DEFAULT_TASK_STACK_SIZE_BYTES = 4000;
+    static const uint32_t FLUSH_WAIT_MS = 1000;
+    bool _bgWriterEnabled = false;
+    std::vector<SampleBuffer> _spareBuffers;
+    QueueHandle_t _freeBufQueue = nullptr;
+    QueueHandle_t _fullBufQueue = nullptr;
+    TaskHandle_t _writerTaskHandle = nullptr;
+    void startBgWriter();
+    bool queueActiveBuffer(bool flushFile);
+    static void writerTaskStatic(void* pvParameters);
+    void writerTask();
+
+    // Writer task state - a queued nullptr requests the held data is written and the file closed
+    FILE* _pDumpFile = nullptr;
+    uint32_t _dumpFileSize = 0;
+    uint32_t _writeChunkSize = DEFAULT_WRITE_CHUNK_SIZE;
+    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> _writeCarry;
+    bool appendToDumpFile(const uint8_t* pData, uint32_t len, bool flush);
+    void closeDumpFile();
+
+    // Aggregation - samples are aggregated over windows and the aggregates stored in the buffer (if aggToBuffer)
+    // and/or published as the latest aggregates on a topic of the publisher (if aggTopic is set)
+    SampleAggregator _aggregator;
+    bool _aggToBuffer = true;
+    String _aggTopic;
+    String _aggPublisher;
+    bool _aggPubRegistered = false;
+    String _lastAggJSON;
+    uint32_t _aggCount = 0;
+    void handleAggregate(const String& aggJSON);
+    void registerAggPublisher();
+
+    // Buffer access (samples can be added, retrieved and streamed from different tasks)
+    SemaphoreHandle_t _bufferMutex = nullptr;
+
+    // Samples at the start of the buffer which have already been retrieved (in chunks or by the stream) - the
+    // space is reclaimed when the buffer is full (or emptied when everything has been retrieved)
+    uint32_t _readPos = 0;
+    void compactBuffer();
+
+    // Chunked retrieval - sample/chunk returns samples (whole lines or records) from the read position
+    static const uint32_t DEFAULT_CHUNK_MAX_LEN = 2000;
+
+    // Streaming to a comms channel - sample/stream sends samples to the requesting channel as the channel
+    // can accept them (continuing as samples are added) until sample/endstream or sampling is stopped.
+    // Each chunk is sent as a binary message:
+    //   SAMPLE_CHUNK_MARKER, flags, stream position (4 bytes MSB first), data
+    // Data is the buffer contents (JSON lines or binary records) so chunks are joined to get the samples. The
+    // final chunk (which may be empty) has SAMPLE_CHUNK_FLAG_FINAL set and SAMPLE_CHUNK_FLAG_ERROR is added if
+    // the channel stopped accepting messages. While streaming the buffer isn't dumped when full - samples are
+    // dropped if the stream can't keep up - and sample/get, clear and write fail with failStreaming.
+    static const uint8_t SAMPLE_CHUNK_MARKER = 0xbd;
+    static const uint8_t SAMPLE_CHUNK_FLAG_FINAL = 0x01;
+    static const uint8_t SAMPLE_CHUNK_FLAG_ERROR = 0x02;
+    static const uint32_t SAMPLE_CHUNK_HEADER_LEN = 6;
+    static const uint32_t DEFAULT_STREAM_CHUNK_LEN = 400;
+    static const uint32_t STREAM_STALL_TIMEOUT_MS = 10000;
+    bool _streamActive = false;
+    bool _streamEndReq = false;
+    uint32_t _streamChannelID = 0;
+    uint32_t _streamChunkLen = DEFAULT_STREAM_CHUNK_LEN;
+    uint32_t _maxStreamChunkLen = DEFAULT_STREAM_CHUNK_LEN;
+    uint32_t _streamPos = 0;
+    uint32_t _streamLastSendMs = 0;
+    std::vector<uint8_t> _chunkBuf;
+    void serviceStream();
+    void getChunkJSON(uint32_t maxLen, String& jsonStr);
+
+    // Stats
+    uint32_t _droppedSamples = 0;
+    uint32_t _droppedBytes = 0;
+    uint32_t _numFlushes = 0;
+    uint32_t _flushMaxUs = 0;
+    uint64_t _flushTotalUs = 0;
+    uint32_t _flushLastUs = 0;
+
     // Helpers
+    bool storeSample(const String& sampleJSON);
+    bool checkSampleRate(uint64_t timeNowUs);
+    bool makeSpace(uint32_t sampleLen);
     RaftRetCode apiSample(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
     bool writeToFile(const String& filename, bool append, String& errMsg);
     void writeToConsole();
 
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "SampleColl";
 };
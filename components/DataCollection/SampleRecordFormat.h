@@ -0,0 +1,215 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SampleRecordFormat
+// Fixed-width binary sample record layout declared in config
+//
+// Fields are packed in the order declared with no padding, little-endian. Field types are u8, i8, u16, i16,
+// u32, i32 and f32 e.g. "binFields":[{"name":"t","type":"u32"},{"name":"ax","type":"i16"}]
+//
+// Binary sample files start with a header describing the records followed by the records unchanged:
+//   'R','S','B',0x01, header JSON length (2 bytes LSB first), header JSON
+// where the header JSON is {"recLen":N,"fields":[{"name":"t","type":"u32"},...],"info":<jsonHdr>} so a file
+// can be converted to JSON or CSV without any other information.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftJson.h"
+
+class SampleRecordFormat
+{
+public:
+    static const uint32_t FILE_HEADER_PREFIX_LEN = 6;
+
+    enum FieldType
+    {
+        FIELD_U8,
+        FIELD_I8,
+        FIELD_U16,
+        FIELD_I16,
+        FIELD_U32,
+        FIELD_I32,
+        FIELD_F32
+    };
+
+    class Field
+    {
+    public:
+        String name;
+        FieldType type = FIELD_U8;
+        uint32_t offset = 0;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup from config
+    /// @param fieldConfigs field definitions (JSON objects with name and type)
+    /// @return false if any field is invalid (the format is then empty)
+    bool setup(const std::vector<String>& fieldConfigs)
+    {
+        _fields.clear();
+        _recordLen = 0;
+        for (const String& fieldConfig : fieldConfigs)
+        {
+            RaftJson fieldJson(fieldConfig);
+            Field field;
+            field.name = fieldJson.getString("name", "");
+            String typeStr = fieldJson.getString("type", "");
+            uint32_t typeIdx = 0;
+            while ((typeIdx < NUM_TYPES) && !typeStr.equalsIgnoreCase(TYPE_NAMES[typeIdx]))
+                typeIdx++;
+            if (field.name.isEmpty() || (typeIdx == NUM_TYPES))
+            {
+                _fields.clear();
+                _recordLen = 0;
+                return false;
+            }
+            field.type = (FieldType)typeIdx;
+            field.offset = _recordLen;
+            _recordLen += TYPE_SIZES[typeIdx];
+            _fields.push_back(field);
+        }
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get record length (0 if no fields)
+    uint32_t getRecordLen() const
+    {
+        return _recordLen;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get fields
+    const std::vector<Field>& getFields() const
+    {
+        return _fields;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Find a field by name
+    /// @return field index or -1 if not found
+    int32_t findField(const char* pName) const
+    {
+        for (uint32_t i = 0; i < _fields.size(); i++)
+        {
+            if (strcmp(_fields[i].name.c_str(), pName) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set a field in a record (integer values are rounded and clamped to the range of the type)
+    /// @param pRecord record (getRecordLen() bytes)
+    /// @param fieldIdx field index
+    /// @param val value
+    void setValue(uint8_t* pRecord, uint32_t fieldIdx, double val) const
+    {
+        const Field& field = _fields[fieldIdx];
+        uint8_t* p = pRecord + field.offset;
+        if (field.type == FIELD_F32)
+        {
+            float fVal = val;
+            memcpy(p, &fVal, sizeof(fVal));
+            return;
+        }
+        static const double MIN_VALS[] = { 0, INT8_MIN, 0, INT16_MIN, 0, (double)INT32_MIN };
+        static const double MAX_VALS[] = { UINT8_MAX, INT8_MAX, UINT16_MAX, INT16_MAX, (double)UINT32_MAX, (double)INT32_MAX };
+        val = isnan(val) ? 0 : round(val);
+        val = val < MIN_VALS[field.type] ? MIN_VALS[field.type] : (val > MAX_VALS[field.type] ? MAX_VALS[field.type] : val);
+        uint32_t uVal = (field.type == FIELD_U32) ? (uint32_t)val : (uint32_t)(int32_t)val;
+        for (uint32_t i = 0; i < TYPE_SIZES[field.type]; i++)
+            p[i] = (uVal >> (i * 8)) & 0xff;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get a field from a record
+    /// @param pRecord record (getRecordLen() bytes)
+    /// @param fieldIdx field index
+    /// @return value
+    double getValue(const uint8_t* pRecord, uint32_t fieldIdx) const
+    {
+        const Field& field = _fields[fieldIdx];
+        const uint8_t* p = pRecord + field.offset;
+        if (field.type == FIELD_F32)
+        {
+            float fVal = 0;
+            memcpy(&fVal, p, sizeof(fVal));
+            return fVal;
+        }
+        uint32_t uVal = 0;
+        for (uint32_t i = 0; i < TYPE_SIZES[field.type]; i++)
+            uVal |= (uint32_t)p[i] << (i * 8);
+        switch (field.type)
+        {
+            case FIELD_I8: return (int8_t)uVal;
+            case FIELD_I16: return (int16_t)uVal;
+            case FIELD_I32: return (int32_t)uVal;
+            default: return uVal;
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get header JSON describing the records
+    /// @param infoStr additional info (included as JSON if it is an object or array, otherwise as a string)
+    String getHeaderJSON(const String& infoStr) const
+    {
+        String jsonStr = R"({"recLen":)" + String(_recordLen) + R"(,"fields":[)";
+        for (uint32_t i = 0; i < _fields.size(); i++)
+        {
+            jsonStr += (i == 0 ? "" : ",");
+            jsonStr += R"({"name":")" + _fields[i].name + R"(","type":")" + TYPE_NAMES[_fields[i].type] + R"("})";
+        }
+        jsonStr += "]";
+        if (!infoStr.isEmpty())
+        {
+            jsonStr += R"(,"info":)";
+            if (infoStr.startsWith("{") || infoStr.startsWith("["))
+            {
+                jsonStr += infoStr;
+            }
+            else
+            {
+                jsonStr += "\"";
+                for (uint32_t i = 0; i < infoStr.length(); i++)
+                {
+                    if ((infoStr[i] == '"') || (infoStr[i] == '\\'))
+                        jsonStr += '\\';
+                    jsonStr += infoStr[i];
+                }
+                jsonStr += "\"";
+            }
+        }
+        return jsonStr + "}";
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get file header
+    /// @param infoStr additional info (see getHeaderJSON)
+    /// @param fileHeader (out) file header
+    void getFileHeader(const String& infoStr, std::vector<uint8_t>& fileHeader) const
+    {
+        String headerJSON = getHeaderJSON(infoStr);
+        fileHeader.assign(FILE_HEADER_MAGIC, FILE_HEADER_MAGIC + sizeof(FILE_HEADER_MAGIC));
+        fileHeader.push_back(headerJSON.length() & 0xff);
+        fileHeader.push_back((headerJSON.length() >> 8) & 0xff);
+        fileHeader.insert(fileHeader.end(), headerJSON.c_str(), headerJSON.c_str() + headerJSON.length());
+    }
+
+private:
+    static constexpr uint8_t FILE_HEADER_MAGIC[4] = { 'R', 'S', 'B', 0x01 };
+    static const uint32_t NUM_TYPES = 7;
+    static constexpr const char* TYPE_NAMES[NUM_TYPES] = { "u8", "i8", "u16", "i16", "u32", "i32", "f32" };
+    static constexpr uint8_t TYPE_SIZES[NUM_TYPES] = { 1, 1, 2, 2, 4, 4, 4 };
+
+    std::vector<Field> _fields;
+    uint32_t _recordLen = 0;
+};
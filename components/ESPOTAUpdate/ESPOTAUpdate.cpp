@@ -8,6 +8,7 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "ESPOTAUpdate.h"
+#include "SysModTiming.h"
 #include "RestAPIEndpointManager.h"
 #include "Logger.h"
 #include "esp_system.h"
@@ -40,6 +41,9 @@ void ESPOTAUpdate::setup()
 {
     // Extract info from config
     _otaDirectEnabled = configGetBool("OTADirect", true);
+    _compressedEnabled = configGetBool("compressedOTA", true);
+    _resumeEnabled = configGetBool("resumeOTA", true);
+    _resumeTimeoutMs = configGetLong("resumeTimeoutS", DEFAULT_RESUME_TIMEOUT_SECS) * 1000;
     LOG_I(MODULE_PREFIX, "setup otaDirect %s", _otaDirectEnabled ? "YES" : "NO");
 
     // Get the protocol exchange from the system manager
@@ -62,6 +66,8 @@ void ESPOTAUpdate::setup()
 
 void ESPOTAUpdate::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
     // Check if restart is pending
     if (_restartPending && 
             Raft::isTimeout(millis(), _restartPendingStartMs, TIME_TO_WAIT_BEFORE_RESTART_MS))
@@ -91,14 +97,23 @@ String ESPOTAUpdate::getDebugJSON() const
     uint32_t fwUpdateElapsedMs = (micros() - otaStatus.startUs) / 1000;
     if (_otaDirectInProgress)
         otaStatus.updateRateBps = (fwUpdateElapsedMs != 0) ? 1000.0*otaStatus.totalBytes/fwUpdateElapsedMs : 0;
-    char tmpBuf[200];
-    snprintf(tmpBuf, sizeof(tmpBuf)-1, R"({"Bps":%.1f,"stMs":%d,"bytes":%d,"wrPS":%.1f,"elapS":%.1f,"blk":%d})",
+    char tmpBuf[300];
+    snprintf(tmpBuf, sizeof(tmpBuf)-1, R"({"Bps":%.1f,"stMs":%d,"bytes":%d,"imgBytes":%d,"cmp":%d,"wrPS":%.1f,"elapS":%.1f,"blk":%d,"wrMs":%d,"wrs":%d,"waitMs":%d,"bufs":%d,"bufFree":%d,"bufWaits":%d,"rsm":%d})",
         otaStatus.updateRateBps, 
         (int)(otaStatus.espOTABeginFnUs / 1000),
         (int)otaStatus.totalBytes,
+        (int)otaStatus.imageBytes,
+        otaStatus.isCompressed ? 1 : 0,
         otaStatus.totalWriteUs != 0 ? otaStatus.totalBytes / (otaStatus.totalWriteUs / 1000000.0) : 0.0,
         fwUpdateElapsedMs / 1000.0,
-        (int)otaStatus.lastBlockSize);
+        (int)otaStatus.lastBlockSize,
+        (int)(otaStatus.totalWriteUs / 1000),
+        (int)otaStatus.numWrites,
+        (int)(otaStatus.totalWaitUs / 1000),
+        (int)_blockPoolSize,
+        _otaFreeBlockQueue ? (int)uxQueueMessagesWaiting(_otaFreeBlockQueue) : 0,
+        (int)_blockPoolWaits,
+        (int)_numResumes);
 
     return tmpBuf;
 }
@@ -124,6 +139,12 @@ void ESPOTAUpdate::addRestAPIEndpoints(RestAPIEndpointManager& endpointManager)
                                 std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
                         std::bind(&ESPOTAUpdate::apiReadyToReceiveData, this,
                                 std::placeholders::_1));
+    endpointManager.addEndpoint("espFwResume",
+                        RestAPIEndpoint::ENDPOINT_CALLBACK, 
+                        RestAPIEndpoint::ENDPOINT_GET,
+                        std::bind(&ESPOTAUpdate::apiFirmwareResume, this, 
+                                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                        "Get position to resume an interrupted ESP32 firmware update from");
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -132,6 +153,8 @@ void ESPOTAUpdate::addRestAPIEndpoints(RestAPIEndpointManager& endpointManager)
 
 RaftRetCode ESPOTAUpdate::apiFirmwareMain(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("espFwUpdate");
+
     // This is a POST request so the body will contain the firmware and this method 
 #ifdef DEBUG_ESP_OTA_UPDATE_API_MAIN
     // Debug
@@ -152,6 +175,24 @@ RaftRetCode ESPOTAUpdate::apiFirmwareMain(const String &reqStr, String &respStr,
     return Raft::setJsonResult(reqStr.c_str(), respStr, otaStatus.lastOTAUpdateOK, otaStatus.lastOTAUpdateResult.c_str());
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Resume info - resumable is 1 if an interrupted update of an image of length len can continue from pos
+// (hdrCRC is the CRC of the first hdrLen bytes of the image which a sender can check before resuming)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode ESPOTAUpdate::apiFirmwareResume(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
+{
+    SYSMOD_TIMED_API("espFwResume");
+
+    bool resumable = _resumeEnabled && _rxSuspended && !_resumeDiscarded &&
+                !Raft::isTimeout(millis(), _rxSuspendedMs, _resumeTimeoutMs);
+    char jsonStr[100];
+    snprintf(jsonStr, sizeof(jsonStr), R"("resumable":%d,"len":%d,"pos":%d,"hdrLen":%d,"hdrCRC":%d)",
+                resumable ? 1 : 0, (int)_rxImageLen, resumable ? (int)_rxPos : 0, (int)_rxHeaderLen,
+                MiniHDLC::crcUpdateCCITT(MiniHDLC::crcInitCCITT(), _rxHeader, _rxHeaderLen));
+    return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, jsonStr);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // ESP Firmware update
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -179,20 +220,20 @@ RaftRetCode ESPOTAUpdate::apiFirmwarePart(const String& reqStr, FileStreamBlock&
 bool ESPOTAUpdate::apiReadyToReceiveData(const APISourceInfo& sourceInfo)
 {
     // Check if queue is valid
-    bool queueValid = _otaUpdateQueue != nullptr;
+    bool queueValid = _otaFreeBlockQueue != nullptr;
 
-    // Check if queue is empty
-    bool queueEmpty = queueValid && (uxQueueMessagesWaiting(_otaUpdateQueue) == 0);
+    // Ready if there is a free block buffer
+    bool bufferFree = queueValid && (uxQueueMessagesWaiting(_otaFreeBlockQueue) > 0);
 #ifdef DEBUG_ESP_OTA_UPDATE_NOT_READY
     // Debug
-    if (queueValid && !queueEmpty)
+    if (queueValid && !bufferFree)
     {
-        LOG_I(MODULE_PREFIX, "apiRdy qV %s qE %s",
-                queueValid ? "Y" : "N", queueEmpty ? "Y" : "N");
+        LOG_I(MODULE_PREFIX, "apiRdy qV %s bufFree %s",
+                queueValid ? "Y" : "N", bufferFree ? "Y" : "N");
     }
 #endif
     // If invalid then return true so we don't block indefinitely
-    return !queueValid || queueEmpty;
+    return !queueValid || bufferFree;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -213,9 +254,24 @@ bool ESPOTAUpdate::fileStreamStart(const char* fileName, size_t fileLen)
     BaseType_t taskPriority = config.getLong("taskPriority", DEFAULT_TASK_PRIORITY);
     int taskStackSize = config.getLong("taskStack", DEFAULT_TASK_STACK_SIZE_BYTES);
 
-    // Create a queue for the task
+    // Create the block buffer pool and the queues of free and filled buffers
     if (_otaUpdateQueue == nullptr)
-        _otaUpdateQueue = xQueueCreate(1, sizeof(OTAUpdateFileBlock*));
+    {
+        _writeChunkSize = config.getLong("writeChunkSize", DEFAULT_WRITE_CHUNK_SIZE);
+        if (_writeChunkSize < 1)
+            _writeChunkSize = 1;
+        _blockPoolSize = config.getLong("blockPoolSize", DEFAULT_BLOCK_POOL_SIZE);
+        if (_blockPoolSize < 1)
+            _blockPoolSize = 1;
+        _blockPool.resize(_blockPoolSize);
+        _otaFreeBlockQueue = xQueueCreate(_blockPoolSize, sizeof(OTAUpdateFileBlock*));
+        _otaUpdateQueue = xQueueCreate(_blockPoolSize, sizeof(OTAUpdateFileBlock*));
+        for (OTAUpdateFileBlock& block : _blockPool)
+        {
+            OTAUpdateFileBlock* pBlock = &block;
+            xQueueSend(_otaFreeBlockQueue, &pBlock, 0);
+        }
+    }
 
     // Start a task to handle the update
     BaseType_t retc = pdPASS;
@@ -244,19 +300,76 @@ bool ESPOTAUpdate::fileStreamStart(const char* fileName, size_t fileLen)
 
 RaftRetCode ESPOTAUpdate::fileStreamDataBlock(FileStreamBlock& fileStreamBlock)
 {
+    // Check if this stream continues an interrupted update (a resuming sender may start part way through)
+    uint32_t imageLen = fileStreamBlock.fileLenValid ? fileStreamBlock.fileLen : fileStreamBlock.contentLen;
+    bool resume = (fileStreamBlock.firstBlock || !_rxStreamActive) && checkResume(fileStreamBlock, imageLen);
+
     // Check if this is the start of a new update
     if (!_otaWorkerTaskHandle || (!_otaDirectInProgress && fileStreamBlock.firstBlock))
     {
-        if (!fileStreamStart(fileStreamBlock.filename, 
-                    fileStreamBlock.fileLenValid ? fileStreamBlock.fileLen : fileStreamBlock.contentLen))
+        if (!fileStreamStart(fileStreamBlock.filename, imageLen))
             return RAFT_INVALID_OPERATION;
     }
 
-    // Send block to worker queue
-    OTAUpdateFileBlock* pReqRec = new OTAUpdateFileBlock(fileStreamBlock);
+    // Trim any data already received in a resumed stream
+    uint32_t skipBytes = 0;
+    if (resume)
+    {
+        LOG_I(MODULE_PREFIX, "fileStreamDataBlock resuming at %d (block pos %d)", _rxPos, fileStreamBlock.filePos);
+        _rxStreamActive = true;
+        _rxSuspended = false;
+        _rxResumed = true;
+    }
+    else if (fileStreamBlock.firstBlock)
+    {
+        _rxStreamActive = true;
+        _rxSuspended = false;
+        _rxImageLen = imageLen;
+        _rxPos = 0;
+        _rxHeaderLen = 0;
+        _rxResumed = false;
+        _rxCRC = MiniHDLC::crcInitCCITT();
+    }
+    if (_rxResumed && (fileStreamBlock.filePos != _rxPos))
+    {
+        if (fileStreamBlock.filePos > _rxPos)
+        {
+            LOG_E(MODULE_PREFIX, "fileStreamDataBlock gap in stream pos %d expected %d", fileStreamBlock.filePos, _rxPos);
+            return RAFT_INVALID_DATA;
+        }
+        skipBytes = _rxPos - fileStreamBlock.filePos;
+    }
 
-    // Add request to queue (prepare to wait a long time here is the process is busy)
-    if (xQueueSend(_otaUpdateQueue, &pReqRec, 5000) == pdPASS)
+    // Get a free block buffer (prepare to wait a long time here if the process is busy - flow control
+    // should mean a buffer is normally free)
+    OTAUpdateFileBlock* pReqRec = getFreeBlock(FREE_BLOCK_WAIT_TICKS);
+    if (!pReqRec)
+    {
+        LOG_E(MODULE_PREFIX, "fileStreamDataBlock no free block buffer");
+        return RAFT_OTHER_FAILURE;
+    }
+    pReqRec->set(fileStreamBlock, _rxCRC, skipBytes, resume);
+    if (pReqRec->fsb.blockLen > 0)
+    {
+        _rxCRC = MiniHDLC::crcUpdateCCITT(_rxCRC, pReqRec->fsb.pBlock, pReqRec->fsb.blockLen);
+        pReqRec->rxCRC = _rxCRC;
+
+        // Keep the start of the image to match a resumed stream against
+        if (_rxHeaderLen < RESUME_HEADER_LEN)
+        {
+            uint32_t hdrBytes = RESUME_HEADER_LEN - _rxHeaderLen;
+            if (hdrBytes > pReqRec->fsb.blockLen)
+                hdrBytes = pReqRec->fsb.blockLen;
+            memcpy(_rxHeader + _rxHeaderLen, pReqRec->fsb.pBlock, hdrBytes);
+            _rxHeaderLen += hdrBytes;
+        }
+        _rxPos += pReqRec->fsb.blockLen;
+    }
+    if (fileStreamBlock.finalBlock)
+        _rxStreamActive = false;
+
+    // Add request to queue (there is always space as the queue is as long as the pool)
+    if (xQueueSend(_otaUpdateQueue, &pReqRec, 0) == pdPASS)
     {
 #ifdef DEBUG_ESP_OTA_UPDATE_SEND_OK
         // Debug
@@ -266,7 +379,7 @@ RaftRetCode ESPOTAUpdate::fileStreamDataBlock(FileStreamBlock& fileStreamBlock)
     else
     {
         LOG_E(MODULE_PREFIX, "fileStreamDataBlock xQueueSend failed");
-        delete pReqRec;
+        xQueueSend(_otaFreeBlockQueue, &pReqRec, 0);
         return RAFT_OTHER_FAILURE;
     }
  
@@ -280,11 +393,22 @@ RaftRetCode ESPOTAUpdate::fileStreamDataBlock(FileStreamBlock& fileStreamBlock)
 
 bool ESPOTAUpdate::fileStreamCancelEnd(bool isNormalEnd)
 {
+    // A stream which ends abnormally can be resumed
+    _rxSuspended = _resumeEnabled && _rxStreamActive && !isNormalEnd;
+    _rxSuspendedMs = millis();
+    _rxStreamActive = false;
+
     // Create a cancel request
-    OTAUpdateFileBlock* pReqRec = new OTAUpdateFileBlock(true);
+    OTAUpdateFileBlock* pReqRec = getFreeBlock(1);
+    if (!pReqRec)
+    {
+        LOG_E(MODULE_PREFIX, "fileStreamCancelEnd no free block buffer");
+        return false;
+    }
+    pReqRec->setCancel(isNormalEnd);
 
     // Add request to queue
-    if (xQueueSend(_otaUpdateQueue, &pReqRec, 1) == pdPASS)
+    if (xQueueSend(_otaUpdateQueue, &pReqRec, 0) == pdPASS)
     {
 #ifdef DEBUG_ESP_OTA_UPDATE_SEND_OK
         // Debug
@@ -295,12 +419,55 @@ bool ESPOTAUpdate::fileStreamCancelEnd(bool isNormalEnd)
     else
     {
         LOG_E(MODULE_PREFIX, "fileStreamCancelEnd xQueueSend failed");
-        delete pReqRec;
+        xQueueSend(_otaFreeBlockQueue, &pReqRec, 0);
+        return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if a stream continues the suspended update
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool ESPOTAUpdate::checkResume(const FileStreamBlock& fileStreamBlock, uint32_t imageLen)
+{
+    if (!_resumeEnabled || !_rxSuspended || _resumeDiscarded || (imageLen != _rxImageLen) || 
+                (fileStreamBlock.filePos > _rxPos) ||
+                Raft::isTimeout(millis(), _rxSuspendedMs, _resumeTimeoutMs))
         return false;
+
+    // Compare any part of the block which overlaps the saved start of the image
+    if (fileStreamBlock.filePos < _rxHeaderLen)
+    {
+        uint32_t cmpLen = _rxHeaderLen - fileStreamBlock.filePos;
+        if (cmpLen > fileStreamBlock.blockLen)
+            cmpLen = fileStreamBlock.blockLen;
+        if (!fileStreamBlock.pBlock || (memcmp(fileStreamBlock.pBlock, _rxHeader + fileStreamBlock.filePos, cmpLen) != 0))
+        {
+            LOG_I(MODULE_PREFIX, "checkResume different image - restarting");
+            return false;
+        }
     }
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get a free block buffer from the pool
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ESPOTAUpdate::OTAUpdateFileBlock* ESPOTAUpdate::getFreeBlock(TickType_t waitTicks)
+{
+    if (!_otaFreeBlockQueue)
+        return nullptr;
+    OTAUpdateFileBlock* pBlock = nullptr;
+    if (xQueueReceive(_otaFreeBlockQueue, &pBlock, 0) == pdPASS)
+        return pBlock;
+    _blockPoolWaits++;
+    if (xQueueReceive(_otaFreeBlockQueue, &pBlock, waitTicks) == pdPASS)
+        return pBlock;
+    return nullptr;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Worker task (static version calls the other)
 void ESPOTAUpdate::otaWorkerTaskStatic(void* pvParameters)
@@ -316,20 +483,42 @@ void ESPOTAUpdate::otaWorkerTask()
     // Loop forever
     while (true)
     {
-        // Peek the queue to see if there is a request
+        // Wait for a request (while an update is in progress this is time waiting on the transport)
         OTAUpdateFileBlock* pReqRec = nullptr;
-        if (xQueuePeek(_otaUpdateQueue, &pReqRec, portMAX_DELAY) != pdPASS)
+        uint64_t waitStartUs = micros();
+        if (xQueueReceive(_otaUpdateQueue, &pReqRec, portMAX_DELAY) != pdPASS)
         {
-            LOG_E(MODULE_PREFIX, "otaWorkerTask xQueuePeek failed");
+            LOG_E(MODULE_PREFIX, "otaWorkerTask xQueueReceive failed");
             continue;
         }
+        uint64_t waitUs = _otaDirectInProgress ? micros() - waitStartUs : 0;
 
         // Handle the request
         if (pReqRec->fsb.isCancelUpdate())
         {
-            // Cancel update
-            LOG_I(MODULE_PREFIX, "otaWorkerTask cancel update");
-            completeOTAUpdate(true);
+            if (_resumeEnabled && _otaDirectInProgress && !pReqRec->normalEnd)
+            {
+                // Suspend update (keeping the OTA handle open) so it can be resumed
+                LOG_I(MODULE_PREFIX, "otaWorkerTask suspend update");
+                _otaDirectInProgress = false;
+                _otaSuspended = true;
+                if (_fwUpdateStatusSemaphore && (xSemaphoreTake(_fwUpdateStatusSemaphore, 1) == pdTRUE))
+                {
+                    _otaStatus.lastOTAUpdateResult = "Suspended";
+                    xSemaphoreGive(_fwUpdateStatusSemaphore);
+                }
+            }
+            else
+            {
+                // Cancel update
+                LOG_I(MODULE_PREFIX, "otaWorkerTask cancel update");
+                if (_otaDirectInProgress)
+                    esp_ota_abort(_espOTAHandle);
+                _resumeDiscarded = true;
+                abortSuspendedUpdate();
+                _writeBuf.clear();
+                completeOTAUpdate(true);
+            }
         }
         else
         {
@@ -363,23 +552,49 @@ void ESPOTAUpdate::otaWorkerTask()
             // Check for start
             bool isOk = true;
             String failReason;
-            if (pReqRec->fsb.firstBlock)
+            if (pReqRec->resumeUpdate)
             {
+                // Continue the suspended update
+                isOk = _otaSuspended;
+                if (isOk)
+                {
+                    _otaSuspended = false;
+                    _otaDirectInProgress = true;
+                    _numResumes++;
+                    if (_fwUpdateStatusSemaphore && (xSemaphoreTake(_fwUpdateStatusSemaphore, 1) == pdTRUE))
+                    {
+                        _otaStatus.lastOTAUpdateResult = "InProgress";
+                        xSemaphoreGive(_fwUpdateStatusSemaphore);
+                    }
+                }
+                else
+                {
+                    failReason = "FailedResume";
+                }
+            }
+            else if (pReqRec->fsb.firstBlock)
+            {
+                abortSuspendedUpdate();
                 isOk = startOTAUpdate(pReqRec->fsb.fileLenValid ? pReqRec->fsb.fileLen : pReqRec->fsb.contentLen);
                 if (!isOk)
                 {
                     failReason = "FailedStartOTA";
                 }
+
+                // Check for compressed image
+                _isCompressedImage = _compressedEnabled && 
+                            OTAStreamDecoder::isCompressedImage(pReqRec->fsb.pBlock, pReqRec->fsb.blockLen);
+                if (_isCompressedImage)
+                    _streamDecoder.reset();
             }
 
             // Check if update in progress
             const uint8_t* pBlock = pReqRec->fsb.pBlock;
-            uint32_t blockLen = pReqRec->fsb.blockLen;
-            if (isOk && _otaDirectInProgress && pBlock && (blockLen > 0))
+            uint32_t blockLen = pBlock ? pReqRec->fsb.blockLen : 0;
+            if (isOk && _otaDirectInProgress && ((blockLen > 0) || pReqRec->fsb.finalBlock))
             {
-                // Write block
-                uint64_t fwStart = micros();
-                esp_err_t err = esp_ota_write(_espOTAHandle, (const void *)pBlock, blockLen);
+                // Write block (coalesced into sector sized writes - the remainder is flushed on the final block)
+                esp_err_t err = writeImageData(pBlock, blockLen, pReqRec->fsb.finalBlock);
 
                 // Check result
                 if (err == ESP_OK) 
@@ -387,10 +602,14 @@ void ESPOTAUpdate::otaWorkerTask()
                     // Update status
                     if (_fwUpdateStatusSemaphore && (xSemaphoreTake(_fwUpdateStatusSemaphore, 1) == pdTRUE))
                     {
-                        _otaStatus.totalWriteUs += micros() - fwStart;
+                        _otaStatus.totalWriteUs = _writeUs;
+                        _otaStatus.numWrites = _numWrites;
+                        _otaStatus.totalWaitUs += waitUs;
                         _otaStatus.totalBytes += blockLen;
                         _otaStatus.lastBlockSize = blockLen;
-                        _otaStatus.totalCRC = MiniHDLC::crcUpdateCCITT(_otaStatus.totalCRC, pBlock, blockLen);
+                        _otaStatus.totalCRC = pReqRec->rxCRC;
+                        _otaStatus.isCompressed = _isCompressedImage;
+                        _otaStatus.imageBytes = _isCompressedImage ? _streamDecoder.getOutputLen() : _otaStatus.totalBytes;
                         xSemaphoreGive(_fwUpdateStatusSemaphore);
                     }
                 }
@@ -413,7 +632,11 @@ void ESPOTAUpdate::otaWorkerTask()
             if (!isOk)
             {
                 // No longer in progress
+                if (_otaDirectInProgress)
+                    esp_ota_abort(_espOTAHandle);
                 _otaDirectInProgress = false;
+                _resumeDiscarded = true;
+                _writeBuf.clear();
 
                 // Update status
                 if (_fwUpdateStatusSemaphore && (xSemaphoreTake(_fwUpdateStatusSemaphore, 1) == pdTRUE))
@@ -425,12 +648,106 @@ void ESPOTAUpdate::otaWorkerTask()
             }
         }
 
-        // Remove the item from the queue (should not fail as we already know there is an item)
-        xQueueReceive(_otaUpdateQueue, &pReqRec, 0);
+        // Return the block buffer to the pool
+        xQueueSend(_otaFreeBlockQueue, &pReqRec, 0);
+    }
+}
 
-        // Delete the request
-        delete pReqRec;
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Abort a suspended update (if any)
+void ESPOTAUpdate::abortSuspendedUpdate()
+{
+    if (!_otaSuspended)
+        return;
+    LOG_I(MODULE_PREFIX, "abortSuspendedUpdate");
+    esp_ota_abort(_espOTAHandle);
+    _otaSuspended = false;
+    _writeBuf.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Write image data (decompressing if required)
+esp_err_t ESPOTAUpdate::writeImageData(const uint8_t* pData, uint32_t len, bool isFinal)
+{
+    if (!_isCompressedImage)
+        return writeCoalesced(pData, len, isFinal);
+
+    // Decompress
+    esp_err_t err = ESP_OK;
+    if (pData && (len > 0))
+    {
+        bool decodeOk = _streamDecoder.decode(pData, len, [this, &err](const uint8_t* pOut, uint32_t outLen) {
+                err = writeCoalesced(pOut, outLen, false);
+                return err == ESP_OK;
+            });
+        if (err != ESP_OK)
+            return err;
+        if (!decodeOk)
+        {
+            LOG_E(MODULE_PREFIX, "writeImageData decompress FAILED at output pos %d", _streamDecoder.getOutputLen());
+            return ESP_FAIL;
+        }
+    }
+    if (!isFinal)
+        return ESP_OK;
+
+    // Check the whole image was decompressed
+    if (!_streamDecoder.isComplete())
+    {
+        LOG_E(MODULE_PREFIX, "writeImageData compressed image incomplete %d of %d bytes", 
+                    _streamDecoder.getOutputLen(), _streamDecoder.getImageLen());
+        return ESP_FAIL;
+    }
+    return writeCoalesced(nullptr, 0, true);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Write data coalesced into chunks of the write chunk size (flush writes any remainder)
+esp_err_t ESPOTAUpdate::writeCoalesced(const uint8_t* pData, uint32_t len, bool flush)
+{
+    // Top up a partly filled chunk
+    if (!_writeBuf.empty())
+    {
+        uint32_t toCopy = _writeChunkSize - _writeBuf.size();
+        if (toCopy > len)
+            toCopy = len;
+        _writeBuf.insert(_writeBuf.end(), pData, pData + toCopy);
+        pData += toCopy;
+        len -= toCopy;
+        if ((_writeBuf.size() < _writeChunkSize) && !(flush && (len == 0)))
+            return ESP_OK;
+        esp_err_t err = writeFlash(_writeBuf.data(), _writeBuf.size());
+        _writeBuf.clear();
+        if (err != ESP_OK)
+            return err;
+    }
+
+    // Write whole chunks directly from the block
+    uint32_t directLen = flush ? len : len - (len % _writeChunkSize);
+    if (directLen > 0)
+    {
+        esp_err_t err = writeFlash(pData, directLen);
+        if (err != ESP_OK)
+            return err;
+        pData += directLen;
+        len -= directLen;
     }
+
+    // Hold the remainder
+    if (len > 0)
+        _writeBuf.insert(_writeBuf.end(), pData, pData + len);
+    return ESP_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Write to flash (timed)
+esp_err_t ESPOTAUpdate::writeFlash(const uint8_t* pData, uint32_t len)
+{
+    uint64_t startUs = micros();
+    esp_err_t err = esp_ota_write(_espOTAHandle, (const void *)pData, len);
+    _writeUs += micros() - startUs;
+    _numWrites++;
+    return err;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -445,7 +762,11 @@ bool ESPOTAUpdate::startOTAUpdate(size_t fileLen)
     _otaStatus.startUs = micros();
     _otaStatus.espOTABeginFnUs = 0;
     _otaStatus.totalWriteUs = 0;
+    _otaStatus.totalWaitUs = 0;
     _otaStatus.totalBytes = 0;
+    _otaStatus.numWrites = 0;
+    _otaStatus.imageBytes = 0;
+    _otaStatus.isCompressed = false;
     _otaStatus.lastBlockSize = 0;
     _otaStatus.totalCRC = MiniHDLC::crcInitCCITT();
     _otaStatus.lastOTAUpdateOK = false;
@@ -454,6 +775,12 @@ bool ESPOTAUpdate::startOTAUpdate(size_t fileLen)
     // Release semaphore
     xSemaphoreGive(_fwUpdateStatusSemaphore);
 
+    // Write coalescing
+    _writeBuf.clear();
+    _writeBuf.reserve(_writeChunkSize);
+    _writeUs = 0;
+    _numWrites = 0;
+
     // Get update partition
     const esp_partition_t* update_partition = esp_ota_get_next_update_partition(NULL);
     if (!update_partition)
@@ -496,6 +823,7 @@ bool ESPOTAUpdate::startOTAUpdate(size_t fileLen)
     if (err == ESP_OK) 
     {
         _otaDirectInProgress = true;
+        _resumeDiscarded = false;
 #ifdef DEBUG_ESP_OTA_UPDATE
         // Debug
         LOG_I(MODULE_PREFIX, "startOTAUpdate esp_ota_begin succeeded");
@@ -520,6 +848,7 @@ bool ESPOTAUpdate::completeOTAUpdate(bool updateCancelled)
 {
     // Finish OTA
     _otaDirectInProgress = false;
+    _resumeDiscarded = true;
 
     // Check if cancelled
     if (updateCancelled)
@@ -11,10 +11,12 @@
 
 #include "RaftUtils.h"
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 #include "FileStreamBlock.h"
 #include "SpiramAwareAllocator.h"
 #include "MiniHDLC.h"
 #include "RaftThreading.h"
+#include "OTAStreamDecoder.h"
 #include "esp_ota_ops.h"
 
 class RestAPIEndpointManager;
@@ -78,7 +80,11 @@ private:
         uint64_t startUs = 0;
         uint64_t espOTABeginFnUs = 0;
         uint64_t totalWriteUs = 0;
+        uint64_t totalWaitUs = 0;
         uint32_t totalBytes = 0;
+        uint32_t numWrites = 0;
+        uint32_t imageBytes = 0;
+        bool isCompressed = false;
         float updateRateBps = 0;
         uint16_t lastBlockSize = 0;
         uint16_t totalCRC = MiniHDLC::crcInitCCITT();
@@ -98,6 +104,64 @@ private:
     // Queue of OTA update requests
     QueueHandle_t _otaUpdateQueue = nullptr;
 
+    // Pool of block buffers - blocks are copied into a free buffer from the pool and handed to the worker
+    // which returns the buffer to the pool once the block is written (buffers grow to the transport's block
+    // size on first use and are then reused so there is no allocation per block)
+    static const int DEFAULT_BLOCK_POOL_SIZE = 3;
+    static const int FREE_BLOCK_WAIT_TICKS = 5000;
+    QueueHandle_t _otaFreeBlockQueue = nullptr;
+    uint32_t _blockPoolSize = 0;
+    uint32_t _blockPoolWaits = 0;
+
+    // Running CRC of blocks received (computed as blocks are copied into the pool so it overlaps with the
+    // worker writing earlier blocks to flash)
+    uint16_t _rxCRC = MiniHDLC::crcInitCCITT();
+
+    // Blocks are coalesced into flash sector sized (and aligned) writes - data is written directly from the
+    // block where possible and only the remainder is held over (worker task only)
+    static const uint32_t DEFAULT_WRITE_CHUNK_SIZE = 4096;
+    uint32_t _writeChunkSize = DEFAULT_WRITE_CHUNK_SIZE;
+    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> _writeBuf;
+    uint64_t _writeUs = 0;
+    uint32_t _numWrites = 0;
+    esp_err_t writeCoalesced(const uint8_t* pData, uint32_t len, bool flush);
+    esp_err_t writeImageData(const uint8_t* pData, uint32_t len, bool isFinal);
+
+    // Compressed images (detected from the header at the start of the image) are decompressed in a
+    // streaming stage before being written (worker task only)
+    bool _compressedEnabled = true;
+    bool _isCompressedImage = false;
+    OTAStreamDecoder _streamDecoder;
+    esp_err_t writeFlash(const uint8_t* pData, uint32_t len);
+
+    // Resumable updates - when the transport drops mid-update the OTA handle (and any data held for
+    // coalescing or decompression) is kept and a new stream for the same image (matched by length and the
+    // start of the image - which for an app image includes the app descriptor with the ELF SHA256) carries
+    // on from the last byte received rather than restarting. Blocks of a resumed stream which overlap data
+    // already received are trimmed so a sender can restart from 0 or start at the resume position (espFwResume).
+    static const uint32_t RESUME_HEADER_LEN = 256;
+    static const uint32_t DEFAULT_RESUME_TIMEOUT_SECS = 600;
+    bool _resumeEnabled = true;
+    uint32_t _resumeTimeoutMs = DEFAULT_RESUME_TIMEOUT_SECS * 1000;
+    uint32_t _numResumes = 0;
+
+    // Receive side stream state (task calling fileStreamDataBlock)
+    uint32_t _rxImageLen = 0;
+    uint32_t _rxPos = 0;
+    uint8_t _rxHeader[RESUME_HEADER_LEN] = {};
+    uint32_t _rxHeaderLen = 0;
+    bool _rxStreamActive = false;
+    bool _rxSuspended = false;
+    bool _rxResumed = false;
+    uint32_t _rxSuspendedMs = 0;
+    bool checkResume(const FileStreamBlock& fileStreamBlock, uint32_t imageLen);
+
+    // Set by the worker when the OTA handle is no longer usable for a resume (failed, completed or aborted)
+    volatile bool _resumeDiscarded = true;
+
+    // Update suspended with the OTA handle open (worker task only)
+    bool _otaSuspended = false;
+
 private:
     // Handle received data
     void onDataReceived(uint8_t *pDataReceived, size_t dataReceivedLen);
@@ -106,6 +170,7 @@ private:
     RaftRetCode apiFirmwarePart(const String& req, FileStreamBlock& fileStreamBlock, const APISourceInfo& sourceInfo);
     RaftRetCode apiFirmwareMain(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
     bool apiReadyToReceiveData(const APISourceInfo& sourceInfo);
+    RaftRetCode apiFirmwareResume(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
 
     // Worker task
     static void otaWorkerTaskStatic(void* pvParameters);
@@ -114,27 +179,54 @@ private:
     // Functions used by task
     bool startOTAUpdate(size_t fileLen);
     bool completeOTAUpdate(bool cancelUpdate);
+    void abortSuspendedUpdate();
 
     class OTAUpdateFileBlock
     {
     public:
-        OTAUpdateFileBlock(FileStreamBlock& fileStreamBlock) : fsb(fileStreamBlock)
+        OTAUpdateFileBlock() : fsb(false)
+        {
+        }
+        void set(FileStreamBlock& fileStreamBlock, uint16_t crc, uint32_t skipBytes, bool resume)
         {
-            if (fileStreamBlock.filename)
-                fileName = fileStreamBlock.filename;
-            if (fileStreamBlock.pBlock)
-                blockData.assign(fileStreamBlock.pBlock, fileStreamBlock.pBlock + fileStreamBlock.blockLen);
+            rxCRC = crc;
+            resumeUpdate = resume;
+            fsb = fileStreamBlock;
+            fileName = fileStreamBlock.filename ? fileStreamBlock.filename : "";
+            blockData.clear();
+            if (fileStreamBlock.pBlock && (skipBytes < fileStreamBlock.blockLen))
+                blockData.assign(fileStreamBlock.pBlock + skipBytes, fileStreamBlock.pBlock + fileStreamBlock.blockLen);
             fsb.pBlock = blockData.data();
+            fsb.blockLen = blockData.size();
+            fsb.filePos += skipBytes;
             fsb.filename = fileName.c_str();
         }
-        OTAUpdateFileBlock(bool cancelUpdate) : fsb(cancelUpdate)
+        void setCancel(bool isNormalEnd)
         {
+            fsb = FileStreamBlock(true);
+            resumeUpdate = false;
+            normalEnd = isNormalEnd;
         }
         FileStreamBlock fsb;
+        // Running CRC of the file up to and including this block
+        uint16_t rxCRC = 0;
+        // First block continues a suspended update
+        bool resumeUpdate = false;
+        // Cancel is the normal end of the stream (rather than the transport dropping)
+        bool normalEnd = false;
         String fileName;
         std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> blockData;
     };
 
+    // Block buffers (created once - the queues hold pointers to them)
+    std::vector<OTAUpdateFileBlock> _blockPool;
+
+    // Get a free block buffer (waiting up to waitTicks)
+    OTAUpdateFileBlock* getFreeBlock(TickType_t waitTicks);
+
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "ESPOTAUpdate";
 
@@ -0,0 +1,221 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// OTAStreamDecoder
+// Streaming decompression of LZSS (heatshrink format) compressed firmware images
+//
+// A compressed image is a header followed by heatshrink compressed data:
+//   'H','S','Z',0x01, windowBits, lookaheadBits, decompressed length (4 bytes, LSB first)
+// The compressed data is a bit stream (MSB first) of tagged items - a 1 bit followed by an 8 bit literal or
+// a 0 bit followed by a back-reference of windowBits (offset - 1) and lookaheadBits (count - 1). Images can
+// be produced with the heatshrink tool (heatshrink -e -w <windowBits> -l <lookaheadBits>) and the header
+// prepended.
+//
+// Data can be fed in blocks of any size. Only the window (2^windowBits bytes) and a small output buffer are
+// held so memory use is bounded whatever the image size.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "SpiramAwareAllocator.h"
+
+class OTAStreamDecoder
+{
+public:
+    static const uint32_t HEADER_LEN = 10;
+    static const uint32_t MIN_WINDOW_BITS = 4;
+    static const uint32_t MAX_WINDOW_BITS = 14;
+    static const uint32_t MIN_LOOKAHEAD_BITS = 3;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if data starts with the compressed image header magic
+    /// @param pData data
+    /// @param len length of data
+    static bool isCompressedImage(const uint8_t* pData, uint32_t len)
+    {
+        return pData && (len >= sizeof(HEADER_MAGIC)) && (memcmp(pData, HEADER_MAGIC, sizeof(HEADER_MAGIC)) == 0);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Reset ready for a new image
+    void reset()
+    {
+        _state = STATE_HEADER;
+        _headerPos = 0;
+        _bitBuf = 0;
+        _bitCount = 0;
+        _outTotal = 0;
+        _outLen = 0;
+        _winPos = 0;
+        _backrefOffset = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Decode a block of compressed data
+    /// @param pData compressed data
+    /// @param len length of compressed data
+    /// @param outFn function called with decompressed data (const uint8_t* pData, uint32_t len) - returns false
+    ///              to abort
+    /// @return false if the data is invalid or outFn failed
+    template <typename FnType>
+    bool decode(const uint8_t* pData, uint32_t len, FnType outFn)
+    {
+        uint32_t pos = 0;
+        while ((pos < len) && (_state == STATE_HEADER))
+        {
+            _header[_headerPos++] = pData[pos++];
+            if ((_headerPos == HEADER_LEN) && !parseHeader())
+                return false;
+        }
+        while ((_state != STATE_HEADER) && (_state != STATE_ERROR) && (_outTotal < _imageLen))
+        {
+            // Get the bits needed in the current state
+            uint32_t needBits = _state == STATE_TAG ? 1 :
+                        (_state == STATE_LITERAL ? 8 : (_state == STATE_BACKREF_INDEX ? _windowBits : _lookaheadBits));
+            while (_bitCount < needBits)
+            {
+                if (pos >= len)
+                    return flushOut(outFn);
+                _bitBuf = (_bitBuf << 8) | pData[pos++];
+                _bitCount += 8;
+            }
+            _bitCount -= needBits;
+            uint32_t val = (_bitBuf >> _bitCount) & ((1u << needBits) - 1);
+            _bitBuf &= (1u << _bitCount) - 1;
+
+            // Handle
+            switch (_state)
+            {
+                case STATE_TAG:
+                    _state = val ? STATE_LITERAL : STATE_BACKREF_INDEX;
+                    break;
+                case STATE_LITERAL:
+                    if (!outByte(val, outFn))
+                        return false;
+                    _state = STATE_TAG;
+                    break;
+                case STATE_BACKREF_INDEX:
+                    _backrefOffset = val + 1;
+                    _state = STATE_BACKREF_COUNT;
+                    break;
+                default:
+                    for (uint32_t i = 0; (i < val + 1) && (_outTotal < _imageLen); i++)
+                    {
+                        if (!outByte(_window[(_winPos - _backrefOffset) & _winMask], outFn))
+                            return false;
+                    }
+                    _state = STATE_TAG;
+                    break;
+            }
+        }
+        return (_state != STATE_ERROR) && flushOut(outFn);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if the whole image has been decompressed
+    bool isComplete() const
+    {
+        return (_state != STATE_HEADER) && (_state != STATE_ERROR) && (_outTotal == _imageLen);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of bytes decompressed
+    uint32_t getOutputLen() const
+    {
+        return _outTotal;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get decompressed image length (from the header)
+    uint32_t getImageLen() const
+    {
+        return _imageLen;
+    }
+
+private:
+    static constexpr uint8_t HEADER_MAGIC[4] = { 'H', 'S', 'Z', 0x01 };
+    static const uint32_t OUT_BUF_LEN = 256;
+
+    // State
+    enum State
+    {
+        STATE_HEADER,
+        STATE_TAG,
+        STATE_LITERAL,
+        STATE_BACKREF_INDEX,
+        STATE_BACKREF_COUNT,
+        STATE_ERROR
+    };
+    State _state = STATE_HEADER;
+
+    // Header
+    uint8_t _header[HEADER_LEN] = {};
+    uint32_t _headerPos = 0;
+    uint32_t _windowBits = 0;
+    uint32_t _lookaheadBits = 0;
+    uint32_t _imageLen = 0;
+
+    // Bit reader
+    uint32_t _bitBuf = 0;
+    uint32_t _bitCount = 0;
+
+    // Window (previous output)
+    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> _window;
+    uint32_t _winMask = 0;
+    uint32_t _winPos = 0;
+    uint32_t _backrefOffset = 0;
+
+    // Output
+    uint8_t _outBuf[OUT_BUF_LEN] = {};
+    uint32_t _outLen = 0;
+    uint32_t _outTotal = 0;
+
+    // Parse header
+    bool parseHeader()
+    {
+        _windowBits = _header[4];
+        _lookaheadBits = _header[5];
+        _imageLen = _header[6] | (_header[7] << 8) | (_header[8] << 16) | ((uint32_t)_header[9] << 24);
+        if ((memcmp(_header, HEADER_MAGIC, sizeof(HEADER_MAGIC)) != 0) ||
+                    (_windowBits < MIN_WINDOW_BITS) || (_windowBits > MAX_WINDOW_BITS) ||
+                    (_lookaheadBits < MIN_LOOKAHEAD_BITS) || (_lookaheadBits >= _windowBits))
+        {
+            _state = STATE_ERROR;
+            return false;
+        }
+        _window.assign(1u << _windowBits, 0);
+        _winMask = (1u << _windowBits) - 1;
+        _state = STATE_TAG;
+        return true;
+    }
+
+    // Output a byte
+    template <typename FnType>
+    bool outByte(uint8_t val, FnType& outFn)
+    {
+        _window[_winPos++ & _winMask] = val;
+        _outBuf[_outLen++] = val;
+        _outTotal++;
+        if (_outLen == OUT_BUF_LEN)
+            return flushOut(outFn);
+        return true;
+    }
+
+    // Flush output buffer
+    template <typename FnType>
+    bool flushOut(FnType& outFn)
+    {
+        if (_outLen == 0)
+            return true;
+        bool isOk = outFn((const uint8_t*)_outBuf, _outLen);
+        _outLen = 0;
+        if (!isOk)
+            _state = STATE_ERROR;
+        return isOk;
+    }
+};
@@ -0,0 +1,305 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// FileListCache
+// Index of the entries in folder listings so that a listing can be paged through (and totals obtained)
+// without enumerating the folder each time
+//
+// The index is built from the JSON produced by the file system folder listing - the file entries are held
+// as JSON text in a single buffer with an offset per entry along with the rest of the listing (file system
+// info etc). Entries are discarded when invalidated (e.g. on upload or delete), when too old or when space
+// is needed for another folder (least recently used first).
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftUtils.h"
+#include "SpiramAwareAllocator.h"
+
+class FileListCache
+{
+public:
+    class FolderIndex
+    {
+    public:
+        String fileSystemStr;
+        String folderStr;
+
+        // Members of the listing which precede and follow the files array (excluding the request)
+        std::string headJSON;
+        std::string tailJSON;
+
+        // File entries (JSON objects) held end to end
+        std::vector<char, SpiramAwareAllocator<char>> entriesText;
+        std::vector<uint32_t> entryOffsets;
+
+        // Totals
+        uint64_t totalBytes = 0;
+        uint32_t createdMs = 0;
+        uint32_t lastUsedMs = 0;
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get number of files
+        uint32_t numFiles() const
+        {
+            return entryOffsets.size();
+        }
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get a page of the listing as JSON (in the same form as the full listing with paging info added)
+        /// @param reqStr request (for the req member)
+        /// @param start index of first entry
+        /// @param count max number of entries
+        /// @param jsonStr (out) listing
+        void getPageJSON(const char* reqStr, uint32_t start, uint32_t count, String& jsonStr) const
+        {
+            if (start > numFiles())
+                start = numFiles();
+            if (count > numFiles() - start)
+                count = numFiles() - start;
+            uint32_t startOffset = start < numFiles() ? entryOffsets[start] : entriesText.size();
+            // Entries are separated by commas so a page ends before the comma preceding the next entry
+            uint32_t endOffset = count == 0 ? startOffset :
+                        (start + count < numFiles() ? entryOffsets[start + count] - 1 : entriesText.size());
+            std::string pageJSON;
+            pageJSON.reserve(strlen(reqStr) + headJSON.length() + tailJSON.length() + (endOffset - startOffset) + 100);
+            pageJSON = R"({"req":")";
+            pageJSON += reqStr;
+            pageJSON += R"(",)";
+            pageJSON += headJSON;
+            pageJSON += R"("files":[)";
+            pageJSON.append(entriesText.data() + startOffset, endOffset - startOffset);
+            char pageInfo[100];
+            snprintf(pageInfo, sizeof(pageInfo), R"(],"start":%d,"count":%d,"total":%d,"totalBytes":%llu)",
+                        (int)start, (int)count, (int)numFiles(), (unsigned long long)totalBytes);
+            pageJSON += pageInfo;
+            pageJSON += tailJSON;
+            jsonStr = pageJSON.c_str();
+        }
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param maxFolders max number of folders indexed (0 to disable the cache)
+    /// @param maxAgeMs max age of an index before the folder is enumerated again
+    void setup(uint32_t maxFolders, uint32_t maxAgeMs)
+    {
+        _maxFolders = maxFolders;
+        _maxAgeMs = maxAgeMs;
+        _folders.clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Find a folder index
+    /// @param fileSystemStr file system
+    /// @param folderStr folder
+    /// @return index or nullptr if not cached (or too old)
+    const FolderIndex* find(const String& fileSystemStr, const String& folderStr)
+    {
+        String folderKey = getFolderKey(folderStr);
+        for (auto it = _folders.begin(); it != _folders.end(); ++it)
+        {
+            if (!it->fileSystemStr.equals(fileSystemStr) || !it->folderStr.equals(folderKey))
+                continue;
+            if (Raft::isTimeout(millis(), it->createdMs, _maxAgeMs))
+            {
+                _folders.erase(it);
+                return nullptr;
+            }
+            it->lastUsedMs = millis();
+            return &(*it);
+        }
+        return nullptr;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Build an index from a folder listing
+    /// @param fileSystemStr file system
+    /// @param folderStr folder
+    /// @param listJSON folder listing JSON (object with a files array of objects each with a size member)
+    /// @param index (out) index
+    /// @return false if the listing isn't in the expected form
+    static bool buildIndex(const String& fileSystemStr, const String& folderStr, const String& listJSON,
+                FolderIndex& index)
+    {
+        // Find the files array
+        const char* pJSON = listJSON.c_str();
+        const char* pFiles = strstr(pJSON, R"("files":[)");
+        if ((*pJSON != '{') || !pFiles)
+            return false;
+        index.fileSystemStr = fileSystemStr;
+        index.folderStr = getFolderKey(folderStr);
+
+        // Members before the files array without the request (which is replaced in each page)
+        const char* pHead = pJSON + 1;
+        if (strncmp(pHead, R"("req":)", 6) == 0)
+        {
+            const char* pReqEnd = skipString(pHead + 6);
+            if (!pReqEnd)
+                return false;
+            pHead = (*pReqEnd == ',') ? pReqEnd + 1 : pReqEnd;
+        }
+        index.headJSON.assign(pHead, pHead < pFiles ? pFiles - pHead : 0);
+
+        // File entries
+        index.entriesText.clear();
+        index.entryOffsets.clear();
+        index.totalBytes = 0;
+        const char* p = pFiles + 9;
+        while (true)
+        {
+            while ((*p == ',') || (*p == ' ') || (*p == '\r') || (*p == '\n') || (*p == '\t'))
+                p++;
+            if (*p == ']')
+                break;
+            const char* pEntryEnd = (*p == '{') ? skipObject(p) : nullptr;
+            if (!pEntryEnd)
+                return false;
+            if (!index.entryOffsets.empty())
+                index.entriesText.push_back(',');
+            index.entryOffsets.push_back(index.entriesText.size());
+            index.entriesText.insert(index.entriesText.end(), p, pEntryEnd);
+            for (const char* pSize = p; pSize + 7 < pEntryEnd; pSize++)
+            {
+                if (strncmp(pSize, R"("size":)", 7) == 0)
+                {
+                    index.totalBytes += strtoul(pSize + 7, nullptr, 10);
+                    break;
+                }
+            }
+            p = pEntryEnd;
+        }
+        index.tailJSON = p + 1;
+        index.createdMs = millis();
+        index.lastUsedMs = index.createdMs;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add an index (replacing the least recently used if full)
+    /// @param index index (moved into the cache)
+    /// @return index in the cache (nullptr if the cache is disabled)
+    const FolderIndex* add(FolderIndex& index)
+    {
+        if (_maxFolders == 0)
+            return nullptr;
+        invalidate(index.fileSystemStr, index.folderStr);
+        if (_folders.size() >= _maxFolders)
+        {
+            auto lruIt = _folders.begin();
+            for (auto it = _folders.begin(); it != _folders.end(); ++it)
+            {
+                if ((int32_t)(it->lastUsedMs - lruIt->lastUsedMs) < 0)
+                    lruIt = it;
+            }
+            _folders.erase(lruIt);
+        }
+        _folders.push_back(std::move(index));
+        return &_folders.back();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Invalidate a folder (on any file system)
+    /// @param folderStr folder
+    void invalidateFolder(const String& folderStr)
+    {
+        String folderKey = getFolderKey(folderStr);
+        for (auto it = _folders.begin(); it != _folders.end();)
+        {
+            if (it->folderStr.equals(folderKey))
+                it = _folders.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Invalidate all folders
+    void invalidateAll()
+    {
+        _folders.clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if enabled
+    bool isEnabled() const
+    {
+        return _maxFolders > 0;
+    }
+
+private:
+    std::vector<FolderIndex> _folders;
+    uint32_t _maxFolders = 0;
+    uint32_t _maxAgeMs = 0;
+
+    // Folder key (with a leading / and without a trailing /)
+    static String getFolderKey(const String& folderStr)
+    {
+        String folderKey = folderStr.startsWith("/") ? folderStr : "/" + folderStr;
+        if ((folderKey.length() > 1) && folderKey.endsWith("/"))
+            folderKey = folderKey.substring(0, folderKey.length() - 1);
+        return folderKey;
+    }
+
+    // Invalidate a folder on a file system (folderStr is a folder key)
+    void invalidate(const String& fileSystemStr, const String& folderStr)
+    {
+        for (auto it = _folders.begin(); it != _folders.end();)
+        {
+            if (it->fileSystemStr.equals(fileSystemStr) && it->folderStr.equals(folderStr))
+                it = _folders.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // Skip a string (starting at the opening quote) - returns nullptr if unterminated
+    static const char* skipString(const char* p)
+    {
+        if (*p != '"')
+            return nullptr;
+        for (p++; *p; p++)
+        {
+            if (*p == '\\')
+            {
+                if (!*(++p))
+                    return nullptr;
+            }
+            else if (*p == '"')
+            {
+                return p + 1;
+            }
+        }
+        return nullptr;
+    }
+
+    // Skip an object (starting at the opening brace) - returns nullptr if unterminated
+    static const char* skipObject(const char* p)
+    {
+        int32_t depth = 0;
+        while (*p)
+        {
+            if (*p == '"')
+            {
+                p = skipString(p);
+                if (!p)
+                    return nullptr;
+                continue;
+            }
+            if (*p == '{')
+                depth++;
+            else if ((*p == '}') && (--depth == 0))
+                return p + 1;
+            p++;
+        }
+        return nullptr;
+    }
+};
@@ -7,11 +7,15 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "FileManager.h"
+#include "SysModTiming.h"
 #include "FileSystem.h"
 #include "ConfigPinMap.h"
 #include "RestAPIEndpointManager.h"
 #include "Logger.h"
 #include "SysManager.h"
+#include "esp_idf_version.h"
+#include "esp_rom_crc.h"
+#include "mbedtls/sha256.h"
 
 // #define DEBUG_FILE_MANAGER_FILE_LIST
 // #define DEBUG_FILE_MANAGER_FILE_LIST_DETAIL
@@ -54,6 +58,14 @@ void FileManager::applySetup()
     bool enableSD = configGetBool("SDEnabled", false);
     bool defaultToSDIfAvailable = configGetBool("DefaultSD", false);
     bool cacheFileSystemInfo = configGetBool("CacheFileSysInfo", false);
+    _maxReadStreams = configGetLong("maxReadStreams", DEFAULT_MAX_READ_STREAMS);
+    _maxStreamChunkLen = configGetLong("maxStreamChunk", DEFAULT_STREAM_CHUNK_LEN);
+    if (_maxStreamChunkLen < 1)
+        _maxStreamChunkLen = 1;
+    _fileHashCacheSize = configGetLong("hashCacheSize", DEFAULT_HASH_CACHE_SIZE);
+    _fileHashCacheMaxAgeMs = configGetLong("hashCacheMaxAgeS", DEFAULT_HASH_CACHE_MAX_AGE_SECS) * 1000;
+    _fileListCache.setup(configGetLong("listCacheFolders", DEFAULT_LIST_CACHE_FOLDERS),
+                configGetLong("listCacheMaxAgeS", DEFAULT_LIST_CACHE_MAX_AGE_SECS) * 1000);
 
     // SD pins
     String pinName = configGetString("SDMOSI", "");
@@ -81,8 +93,19 @@ void FileManager::applySetup()
 
 void FileManager::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
     // Service the file system
     fileSystem.loop();
+
+    // Service read streams
+    for (auto it = _readStreams.begin(); it != _readStreams.end();)
+    {
+        if (serviceReadStream(*it))
+            ++it;
+        else
+            it = _readStreams.erase(it);
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -99,7 +122,13 @@ void FileManager::addRestAPIEndpoints(RestAPIEndpointManager& endpointManager)
                     "List files in folder e.g. /local/folder ... ~ for / in folder");
     endpointManager.addEndpoint("fileread", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET, 
                     std::bind(&FileManager::apiFileRead, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), 
-                    "Read file ... name", "text/plain");
+                    "Read file ... name ... optional ?offset=N&length=N (negative offset is from end)", "text/plain");
+    endpointManager.addEndpoint("filestream", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET, 
+                    std::bind(&FileManager::apiFileStream, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), 
+                    "Stream file to channel in chunks e.g. /local/filename ... optional ?offset=N&length=N&chunk=N");
+    endpointManager.addEndpoint("filehash", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET, 
+                    std::bind(&FileManager::apiFileHash, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), 
+                    "Hash of file e.g. /local/filename ... optional ?alg=crc32|sha256&offset=N&length=N");
     endpointManager.addEndpoint("filedelete", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET, 
                     std::bind(&FileManager::apiDeleteFile, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), 
                     "Delete file e.g. /local/filename ... ~ for / in filename");
@@ -124,10 +153,14 @@ void FileManager::addRestAPIEndpoints(RestAPIEndpointManager& endpointManager)
 
 RaftRetCode FileManager::apiReformatFS(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("reformatfs");
+
     // File system
     String fileSystemStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
     String forceFormat = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 2);
     bool restartRequired = fileSystem.reformat(fileSystemStr, respStr, forceFormat.equalsIgnoreCase("force"));
+    _fileListCache.invalidateAll();
+    _fileHashCache.clear();
     if (restartRequired)
     {
         // Restart required
@@ -146,6 +179,8 @@ RaftRetCode FileManager::apiReformatFS(const String &reqStr, String& respStr, co
 
 RaftRetCode FileManager::apiFileList(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("filelist");
+
     // File system
     String fileSystemStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
     // Folder
@@ -161,7 +196,45 @@ RaftRetCode FileManager::apiFileList(const String &reqStr, String& respStr, cons
     folderStr.replace("~", "/");
     if (folderStr.length() == 0)
         folderStr = "/";
-    fileSystem.getFilesJSON(reqStr.c_str(), fileSystemStr, folderStr, respStr);
+
+    // Paging
+    std::vector<String> params;
+    std::vector<RaftJson::NameValuePair> nameValues;
+    RestAPIEndpointManager::getParamsAndNameValues(reqStr.c_str(), params, nameValues);
+    RaftJson jsonParams = RaftJson::getJSONFromNVPairs(nameValues, true);
+    int32_t start = jsonParams.getLong("start", -1);
+    int32_t count = jsonParams.getLong("count", -1);
+    bool isPaged = (start >= 0) || (count >= 0);
+
+    // Non-paged requests are served with a full listing (as before paging was added)
+    if (!isPaged)
+    {
+        fileSystem.getFilesJSON(reqStr.c_str(), fileSystemStr, folderStr, respStr);
+#ifdef DEBUG_FILE_MANAGER_FILE_LIST_DETAIL
+        LOG_W(MODULE_PREFIX, "apiFileList respStr %s", respStr.c_str());
+#endif
+        return RaftRetCode::RAFT_OK;
+    }
+
+    // Use the index for the folder if there is one
+    const FileListCache::FolderIndex* pIndex = nullptr;
+    if (jsonParams.getBool("refresh", false))
+        _fileListCache.invalidateFolder(folderStr);
+    else
+        pIndex = _fileListCache.find(fileSystemStr, folderStr);
+
+    // Index the listing if needed (a page is returned from a temporary index if the cache is disabled)
+    FileListCache::FolderIndex tmpIndex;
+    if (!pIndex)
+    {
+        fileSystem.getFilesJSON(reqStr.c_str(), fileSystemStr, folderStr, respStr);
+        if (!FileListCache::buildIndex(fileSystemStr, folderStr, respStr, tmpIndex))
+            return RaftRetCode::RAFT_OK;
+        pIndex = _fileListCache.add(tmpIndex);
+        if (!pIndex)
+            pIndex = &tmpIndex;
+    }
+    pIndex->getPageJSON(reqStr.c_str(), start < 0 ? 0 : start, count < 0 ? pIndex->numFiles() : count, respStr);
 
 #ifdef DEBUG_FILE_MANAGER_FILE_LIST_DETAIL
     LOG_W(MODULE_PREFIX, "apiFileList respStr %s", respStr.c_str());
@@ -176,24 +249,337 @@ RaftRetCode FileManager::apiFileList(const String &reqStr, String& respStr, cons
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 RaftRetCode FileManager::apiFileRead(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
+{
+    SYSMOD_TIMED_API("fileread");
+
+    // Args
+    String fileSystemStr, fileNameStr;
+    uint32_t startPos = 0, readLen = 0, chunkLen = 0;
+    respStr = "";
+    if (!getFileReadArgs(reqStr, fileSystemStr, fileNameStr, startPos, readLen, chunkLen))
+        return RaftRetCode::RAFT_CANNOT_START;
+    FILE* pFile = fileSystem.fileOpen(fileSystemStr, fileNameStr, false, startPos);
+    if (!pFile)
+        return RaftRetCode::RAFT_CANNOT_START;
+
+    // Read directly into the response a block at a time (rather than reading the whole file into a
+    // buffer and copying it) - blocks are appended by length so the data may contain NULs
+    static const uint32_t READ_BLOCK_LEN = 256;
+    char readBuf[READ_BLOCK_LEN];
+    respStr.reserve(readLen);
+    while (readLen > 0)
+    {
+        uint32_t toRead = readLen < READ_BLOCK_LEN ? readLen : READ_BLOCK_LEN;
+        uint32_t bytesRead = fileSystem.fileRead(pFile, (uint8_t*)readBuf, toRead);
+        if (bytesRead == 0)
+            break;
+        respStr.concat(readBuf, bytesRead);
+        readLen -= bytesRead;
+    }
+    fileSystem.fileClose(pFile, fileSystemStr, fileNameStr, false);
+    return RaftRetCode::RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Stream file contents to the requesting channel
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode FileManager::apiFileStream(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
+{
+    SYSMOD_TIMED_API("filestream");
+
+    // Args
+    String fileSystemStr, fileNameStr;
+    uint32_t startPos = 0, readLen = 0, chunkLen = 0;
+    if (!getFileReadArgs(reqStr, fileSystemStr, fileNameStr, startPos, readLen, chunkLen))
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failNotFound");
+    if (!getCommsCore())
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failNoComms");
+    if (_readStreams.size() >= _maxReadStreams)
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failBusy");
+    FILE* pFile = fileSystem.fileOpen(fileSystemStr, fileNameStr, false, startPos);
+    if (!pFile)
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failOpen");
+
+    // Add stream
+    _readStreams.emplace_back();
+    FileReadStream& stream = _readStreams.back();
+    stream.streamID = _nextStreamID++;
+    stream.channelID = sourceInfo.channelID;
+    stream.fileSystemStr = fileSystemStr;
+    stream.fileNameStr = fileNameStr;
+    stream.pFile = pFile;
+    stream.filePos = startPos;
+    stream.endPos = startPos + readLen;
+    stream.chunkLen = (chunkLen == 0) || (chunkLen > _maxStreamChunkLen) ? _maxStreamChunkLen : chunkLen;
+    stream.lastSendMs = millis();
+    LOG_I(MODULE_PREFIX, "apiFileStream streamID %d channelID %d fs %s filename %s offset %d length %d chunk %d",
+                stream.streamID, stream.channelID, fileSystemStr.c_str(), fileNameStr.c_str(), 
+                startPos, readLen, stream.chunkLen);
+
+    // Response
+    char jsonStr[100];
+    snprintf(jsonStr, sizeof(jsonStr), R"("streamID":%d,"offset":%d,"length":%d,"chunk":%d)",
+                stream.streamID, (int)startPos, (int)readLen, (int)stream.chunkLen);
+    return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, jsonStr);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get the hash of a file (or range of a file)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode FileManager::apiFileHash(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
+{
+    SYSMOD_TIMED_API("filehash");
+
+    // Args
+    String fileSystemStr, fileNameStr;
+    uint32_t startPos = 0, readLen = 0, chunkLen = 0;
+    uint32_t fileLen = 0;
+    if (!getFileReadArgs(reqStr, fileSystemStr, fileNameStr, startPos, readLen, chunkLen) ||
+                !fileSystem.getFileInfo(fileSystemStr, fileNameStr, fileLen))
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failNotFound");
+    std::vector<String> params;
+    std::vector<RaftJson::NameValuePair> nameValues;
+    RestAPIEndpointManager::getParamsAndNameValues(reqStr.c_str(), params, nameValues);
+    RaftJson jsonParams = RaftJson::getJSONFromNVPairs(nameValues, true);
+    String algStr = jsonParams.getString("alg", "crc32");
+    bool isSHA256 = algStr.equalsIgnoreCase("sha256");
+    if (!isSHA256 && !algStr.equalsIgnoreCase("crc32"))
+        return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failUnknownAlg");
+
+    // Check the cache
+    const FileHashRec* pHashRec = nullptr;
+    for (auto it = _fileHashCache.begin(); it != _fileHashCache.end(); ++it)
+    {
+        if (it->fileNameStr.equals(fileNameStr) && it->fileSystemStr.equals(fileSystemStr) &&
+                    (it->isSHA256 == isSHA256) && (it->startPos == startPos) && (it->readLen == readLen))
+        {
+            if ((it->fileLen == fileLen) && !Raft::isTimeout(millis(), it->calcMs, _fileHashCacheMaxAgeMs))
+                pHashRec = &(*it);
+            else
+                _fileHashCache.erase(it);
+            break;
+        }
+    }
+    bool isCached = pHashRec != nullptr;
+
+    // Calculate (replacing the oldest cache entry if full)
+    FileHashRec hashRec;
+    if (!pHashRec)
+    {
+        if (!calcFileHash(fileSystemStr, fileNameStr, isSHA256, startPos, readLen, hashRec.hashStr))
+            return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "failRead");
+        hashRec.fileSystemStr = fileSystemStr;
+        hashRec.fileNameStr = fileNameStr;
+        hashRec.isSHA256 = isSHA256;
+        hashRec.startPos = startPos;
+        hashRec.readLen = readLen;
+        hashRec.fileLen = fileLen;
+        hashRec.calcMs = millis();
+        pHashRec = &hashRec;
+    }
+
+    // Response
+    char jsonStr[200];
+    snprintf(jsonStr, sizeof(jsonStr), R"("alg":"%s","offset":%d,"length":%d,"fileLen":%d,"hash":"%s","cached":%d)",
+                isSHA256 ? "sha256" : "crc32", (int)startPos, (int)readLen, (int)fileLen, 
+                pHashRec->hashStr.c_str(), isCached ? 1 : 0);
+    if (!isCached && (_fileHashCacheSize > 0) && (_fileHashCacheMaxAgeMs > 0))
+    {
+        if (_fileHashCache.size() >= _fileHashCacheSize)
+            _fileHashCache.erase(_fileHashCache.begin());
+        _fileHashCache.push_back(hashRec);
+    }
+    return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, jsonStr);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Calculate the hash of a file range reading through it with a small fixed buffer
+// The hash is returned as a hex string (CRC32 is the standard zlib/IEEE 802.3 form)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool FileManager::calcFileHash(const String& fileSystemStr, const String& fileNameStr, bool isSHA256,
+            uint32_t startPos, uint32_t readLen, String& hashStr)
+{
+    FILE* pFile = fileSystem.fileOpen(fileSystemStr, fileNameStr, false, startPos);
+    if (!pFile)
+        return false;
+
+    // Hash state
+    uint32_t crc32 = 0;
+    mbedtls_sha256_context shaCtx;
+    if (isSHA256)
+    {
+        mbedtls_sha256_init(&shaCtx);
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+        mbedtls_sha256_starts_ret(&shaCtx, 0);
+#else
+        mbedtls_sha256_starts(&shaCtx, 0);
+#endif
+    }
+
+    // Read through the file
+    uint8_t readBuf[HASH_READ_BUF_LEN];
+    uint32_t bytesLeft = readLen;
+    while (bytesLeft > 0)
+    {
+        uint32_t toRead = bytesLeft < sizeof(readBuf) ? bytesLeft : sizeof(readBuf);
+        uint32_t bytesRead = fileSystem.fileRead(pFile, readBuf, toRead);
+        if (bytesRead == 0)
+            break;
+        if (isSHA256)
+        {
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+            mbedtls_sha256_update_ret(&shaCtx, readBuf, bytesRead);
+#else
+            mbedtls_sha256_update(&shaCtx, readBuf, bytesRead);
+#endif
+        }
+        else
+        {
+            crc32 = esp_rom_crc32_le(crc32, readBuf, bytesRead);
+        }
+        bytesLeft -= bytesRead;
+    }
+    fileSystem.fileClose(pFile, fileSystemStr, fileNameStr, false);
+
+    // Result
+    if (isSHA256)
+    {
+        uint8_t shaResult[32];
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+        mbedtls_sha256_finish_ret(&shaCtx, shaResult);
+#else
+        mbedtls_sha256_finish(&shaCtx, shaResult);
+#endif
+        mbedtls_sha256_free(&shaCtx);
+        Raft::getHexStrFromBytes(shaResult, sizeof(shaResult), hashStr);
+    }
+    else
+    {
+        char crcStr[10];
+        snprintf(crcStr, sizeof(crcStr), "%08x", (unsigned)crc32);
+        hashStr = crcStr;
+    }
+    return bytesLeft == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Invalidate cached hashes of a file
+// A blank file system name is the default file system so matches entries on any file system
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void FileManager::invalidateFileHashes(const String& fileSystemStr, const String& fileNameStr)
+{
+    for (auto it = _fileHashCache.begin(); it != _fileHashCache.end();)
+    {
+        if (it->fileNameStr.equals(fileNameStr) && (fileSystemStr.isEmpty() || it->fileSystemStr.isEmpty() ||
+                    it->fileSystemStr.equals(fileSystemStr)))
+            it = _fileHashCache.erase(it);
+        else
+            ++it;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get file read args
+// Returns false if the file doesn't exist
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool FileManager::getFileReadArgs(const String& reqStr, String& fileSystemStr, String& fileNameStr, 
+            uint32_t& startPos, uint32_t& readLen, uint32_t& chunkLen)
 {
     // File system
-    String fileSystemStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
+    fileSystemStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
     // Filename
-    String fileNameStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 2);
+    fileNameStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 2);
     String extraPath = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 3);
     if (extraPath.length() > 0)
         fileNameStr += "/" + extraPath;
     fileNameStr.replace("~", "/");
-    char* pFileContents = (char*)fileSystem.getFileContents(fileSystemStr, fileNameStr);
-    if (!pFileContents)
+    uint32_t fileLen = 0;
+    if ((fileNameStr.length() == 0) || !fileSystem.getFileInfo(fileSystemStr, fileNameStr, fileLen))
+        return false;
+
+    // Range (offset and length are clipped to the file)
+    std::vector<String> params;
+    std::vector<RaftJson::NameValuePair> nameValues;
+    RestAPIEndpointManager::getParamsAndNameValues(reqStr.c_str(), params, nameValues);
+    RaftJson jsonParams = RaftJson::getJSONFromNVPairs(nameValues, true);
+    int32_t offset = jsonParams.getLong("offset", 0);
+    if (offset < 0)
+        startPos = (uint64_t)(-(int64_t)offset) > fileLen ? 0 : fileLen - (uint32_t)(-(int64_t)offset);
+    else
+        startPos = (uint32_t)offset > fileLen ? fileLen : offset;
+    readLen = fileLen - startPos;
+    int32_t length = jsonParams.getLong("length", -1);
+    if ((length >= 0) && ((uint32_t)length < readLen))
+        readLen = length;
+    chunkLen = jsonParams.getLong("chunk", 0);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service a read stream - sends the next chunk if the channel can accept it
+// Returns false when the stream is finished (and the file closed)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool FileManager::serviceReadStream(FileReadStream& stream)
+{
+    // Check the channel can accept a message (giving up if it stalls)
+    bool noConn = false;
+    bool canSend = getCommsCore() && getCommsCore()->outboundCanAccept(stream.channelID, MSG_TYPE_PUBLISH, noConn);
+    bool isStalled = noConn || Raft::isTimeout(millis(), stream.lastSendMs, STREAM_STALL_TIMEOUT_MS);
+    if (!canSend && !isStalled)
+        return true;
+
+    // Read the next chunk into the message buffer
+    uint8_t flags = 0;
+    uint32_t bytesRead = 0;
+    uint32_t toRead = stream.endPos - stream.filePos;
+    if (toRead > stream.chunkLen)
+        toRead = stream.chunkLen;
+    _chunkBuf.resize(FILE_CHUNK_HEADER_LEN + toRead);
+    if (!canSend)
     {
-        respStr = "";
-        return RaftRetCode::RAFT_CANNOT_START;
+        flags = FILE_CHUNK_FLAG_FINAL | FILE_CHUNK_FLAG_ERROR;
     }
-    respStr = pFileContents;
-    free(pFileContents);
-    return RaftRetCode::RAFT_OK;
+    else if (toRead > 0)
+    {
+        bytesRead = fileSystem.fileRead(stream.pFile, _chunkBuf.data() + FILE_CHUNK_HEADER_LEN, toRead);
+        if (bytesRead != toRead)
+            flags = FILE_CHUNK_FLAG_FINAL | FILE_CHUNK_FLAG_ERROR;
+    }
+    if (stream.filePos + bytesRead >= stream.endPos)
+        flags |= FILE_CHUNK_FLAG_FINAL;
+    _chunkBuf.resize(FILE_CHUNK_HEADER_LEN + bytesRead);
+    _chunkBuf[0] = FILE_CHUNK_MARKER;
+    _chunkBuf[1] = stream.streamID;
+    _chunkBuf[2] = flags;
+    _chunkBuf[3] = (stream.filePos >> 24) & 0xff;
+    _chunkBuf[4] = (stream.filePos >> 16) & 0xff;
+    _chunkBuf[5] = (stream.filePos >> 8) & 0xff;
+    _chunkBuf[6] = stream.filePos & 0xff;
+
+    // Send (the error chunk is attempted even if the channel is stalled)
+    if (!noConn)
+    {
+        CommsChannelMsg chunkMsg(stream.channelID, MSG_PROTOCOL_ROSSERIAL, 0, MSG_TYPE_PUBLISH);
+        chunkMsg.setFromBuffer(_chunkBuf.data(), _chunkBuf.size());
+        getCommsCore()->outboundHandleMsg(chunkMsg);
+    }
+    stream.filePos += bytesRead;
+    stream.lastSendMs = millis();
+    if (!(flags & FILE_CHUNK_FLAG_FINAL))
+        return true;
+
+    // Finished
+    LOG_I(MODULE_PREFIX, "serviceReadStream streamID %d %s at pos %d", stream.streamID, 
+                (flags & FILE_CHUNK_FLAG_ERROR) ? "FAILED" : "done", stream.filePos);
+    fileSystem.fileClose(stream.pFile, stream.fileSystemStr, stream.fileNameStr, false);
+    stream.pFile = nullptr;
+    return false;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -204,6 +590,8 @@ RaftRetCode FileManager::apiFileRead(const String &reqStr, String& respStr, cons
 
 RaftRetCode FileManager::apiDeleteFile(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("filedelete");
+
     // File system
     String fileSystemStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
     // Filename
@@ -215,6 +603,11 @@ RaftRetCode FileManager::apiDeleteFile(const String &reqStr, String& respStr, co
     filenameStr.replace("~", "/");
     if (filenameStr.length() != 0)
         rslt = fileSystem.deleteFile(fileSystemStr, filenameStr);
+
+    // Invalidate any hashes of the file and the listing of the folder containing it
+    invalidateFileHashes(fileSystemStr, filenameStr);
+    int folderEndIdx = filenameStr.lastIndexOf('/');
+    _fileListCache.invalidateFolder(folderEndIdx <= 0 ? String("/") : filenameStr.substring(0, folderEndIdx));
     LOG_I(MODULE_PREFIX, "deleteFile reqStr %s fs %s, filename %s rslt %s", 
                         reqStr.c_str(), fileSystemStr.c_str(), filenameStr.c_str(),
                         rslt ? "ok" : "fail");
@@ -227,6 +620,8 @@ RaftRetCode FileManager::apiDeleteFile(const String &reqStr, String& respStr, co
 
 RaftRetCode FileManager::apiUploadFileComplete(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("fileupload");
+
 #ifdef DEBUG_FILE_MANAGER_UPLOAD
     LOG_I(MODULE_PREFIX, "uploadFileComplete %s", reqStr.c_str());
 #endif
@@ -239,6 +634,12 @@ RaftRetCode FileManager::apiUploadFileComplete(const String &reqStr, String &res
 
 RaftRetCode FileManager::apiUploadFileBlock(const String& req, FileStreamBlock& fileStreamBlock, const APISourceInfo& sourceInfo)
 {
+    // The destination folder is determined by the protocol exchange so invalidate all listings
+    if (fileStreamBlock.firstBlock || fileStreamBlock.finalBlock)
+    {
+        _fileListCache.invalidateAll();
+        _fileHashCache.clear();
+    }
     if (_pProtocolExchange)
         return _pProtocolExchange->handleFileUploadBlock(req, fileStreamBlock, sourceInfo, 
                     FileStreamBase::FILE_STREAM_CONTENT_TYPE_FILE, "fileupload");
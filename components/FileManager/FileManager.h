@@ -10,10 +10,13 @@
 #pragma once
 
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 #include "RaftThreading.h"
 #include "RaftUtils.h"
 #include "FileStreamBlock.h"
 #include "ProtocolExchange.h"
+#include "FileListCache.h"
+#include <vector>
 
 class RestAPIEndpointManager;
 class APISourceInfo;
@@ -55,13 +58,29 @@ private:
     // List files on a file system
     // In the reqStr the first part of the path is the file system name (e.g. sd or local, can be blank to default)
     // The second part of the path is the folder - note that / must be replaced with ~ in folder
+    // Optional start and count parameters (e.g. ?start=100&count=50) return a page of the listing along with
+    // the total number of files and bytes (count=0 returns just the totals) - refresh=1 re-reads the folder
+    // Requests without start or count always return a full (uncached) listing
     RaftRetCode apiFileList(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
 
     // Read file contents
     // In the reqStr the first part of the path is the file system name (e.g. sd or local)
     // The second part of the path is the folder and filename - note that / must be replaced with ~ in folder
+    // Optional offset and length parameters (e.g. ?offset=100&length=200) read part of the file - a negative
+    // offset is relative to the end of the file (e.g. ?offset=-1000 for the last 1000 bytes)
     RaftRetCode apiFileRead(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
 
+    // Stream file contents to the requesting channel in chunks (parameters as for apiFileRead plus an
+    // optional chunk size e.g. ?chunk=400) - the response contains the streamID and the range to be sent
+    RaftRetCode apiFileStream(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
+
+    // Get the hash of a file or part of a file (parameters as for apiFileRead plus alg=crc32 or alg=sha256)
+    RaftRetCode apiFileHash(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
+
+    // Get the file system, filename and range to read from a request
+    bool getFileReadArgs(const String& reqStr, String& fileSystemStr, String& fileNameStr, 
+                uint32_t& startPos, uint32_t& readLen, uint32_t& chunkLen);
+
     // Delete file on the file system
     // In the reqStr the first part of the path is the file system name (e.g. sd or local)
     // The second part of the path is the filename - note that / must be replaced with ~ in filename
@@ -73,6 +92,75 @@ private:
     // Upload file to file system - part of file (from HTTP POST file)
     RaftRetCode apiUploadFileBlock(const String& req, FileStreamBlock& fileStreamBlock, const APISourceInfo& sourceInfo);
 
+    // File read streams - the file is read and sent a chunk at a time from loop() when the channel can
+    // accept a message so only one chunk is held in memory whatever the size of the file
+    // Each chunk is sent as a binary message:
+    //   FILE_CHUNK_MARKER, streamID, flags, file position (4 bytes MSB first), data
+    // The final chunk (which may be empty) has the FILE_CHUNK_FLAG_FINAL flag set and FILE_CHUNK_FLAG_ERROR
+    // is added if the stream ended early (read failure or the channel not accepting messages)
+    static const uint8_t FILE_CHUNK_MARKER = 0xbe;
+    static const uint8_t FILE_CHUNK_FLAG_FINAL = 0x01;
+    static const uint8_t FILE_CHUNK_FLAG_ERROR = 0x02;
+    static const uint32_t FILE_CHUNK_HEADER_LEN = 7;
+    static const uint32_t DEFAULT_STREAM_CHUNK_LEN = 400;
+    static const uint32_t DEFAULT_MAX_READ_STREAMS = 2;
+    static const uint32_t STREAM_STALL_TIMEOUT_MS = 10000;
+    class FileReadStream
+    {
+    public:
+        uint8_t streamID = 0;
+        uint32_t channelID = 0;
+        String fileSystemStr;
+        String fileNameStr;
+        FILE* pFile = nullptr;
+        uint32_t filePos = 0;
+        uint32_t endPos = 0;
+        uint32_t chunkLen = DEFAULT_STREAM_CHUNK_LEN;
+        uint32_t lastSendMs = 0;
+    };
+    std::vector<FileReadStream> _readStreams;
+    uint32_t _maxReadStreams = DEFAULT_MAX_READ_STREAMS;
+    uint32_t _maxStreamChunkLen = DEFAULT_STREAM_CHUNK_LEN;
+    uint8_t _nextStreamID = 0;
+    std::vector<uint8_t> _chunkBuf;
+
+    // Service read streams (returns false when the stream is finished)
+    bool serviceReadStream(FileReadStream& stream);
+
+    // File hashes - results are cached by file system, file, range and file size. The file system doesn't
+    // provide modification times so a file rewritten with the same length (other than through this module's
+    // delete and reformat APIs) would return a stale hash until the entry reaches its max age - caching is
+    // therefore off unless hashCacheMaxAgeS is configured (non-zero)
+    static const uint32_t HASH_READ_BUF_LEN = 512;
+    static const uint32_t DEFAULT_HASH_CACHE_SIZE = 8;
+    static const uint32_t DEFAULT_HASH_CACHE_MAX_AGE_SECS = 0;
+    class FileHashRec
+    {
+    public:
+        String fileSystemStr;
+        String fileNameStr;
+        bool isSHA256 = false;
+        uint32_t startPos = 0;
+        uint32_t readLen = 0;
+        uint32_t fileLen = 0;
+        String hashStr;
+        uint32_t calcMs = 0;
+    };
+    std::vector<FileHashRec> _fileHashCache;
+    uint32_t _fileHashCacheSize = DEFAULT_HASH_CACHE_SIZE;
+    uint32_t _fileHashCacheMaxAgeMs = DEFAULT_HASH_CACHE_MAX_AGE_SECS * 1000;
+    bool calcFileHash(const String& fileSystemStr, const String& fileNameStr, bool isSHA256,
+                uint32_t startPos, uint32_t readLen, String& hashStr);
+    void invalidateFileHashes(const String& fileSystemStr, const String& fileNameStr);
+
+    // Folder listings index (for paging through large folders)
+    static const uint32_t DEFAULT_LIST_CACHE_FOLDERS = 2;
+    static const uint32_t DEFAULT_LIST_CACHE_MAX_AGE_SECS = 60;
+    FileListCache _fileListCache;
+
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "FileMan";
 
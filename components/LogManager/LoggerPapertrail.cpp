@@ -28,13 +28,66 @@ LoggerPapertrail::LoggerPapertrail(const RaftJsonIF& logDestConfig, const String
     _port = logDestConfig.getLong("port", 0);
     _sysName = logDestConfig.getString("sysName", systemName.c_str());
     _sysName += "_" + systemUniqueString;
+    _linePrefix = "<22>" + _sysName + ": ";
+
+    // Datagram packing
+    _maxDatagramLen = logDestConfig.getLong("maxDatagram", DEFAULT_MAX_DATAGRAM_LEN);
+    _maxLinesPerDatagram = logDestConfig.getLong("linesPerDatagram", DEFAULT_MAX_LINES_PER_DATAGRAM);
+    _batchMs = logDestConfig.getLong("batchMs", DEFAULT_BATCH_MS);
+    if (_maxLinesPerDatagram == 0)
+        _maxLinesPerDatagram = 1;
+    _datagram.reserve(_maxDatagramLen > MAX_LINE_LEN ? _maxDatagramLen : MAX_LINE_LEN);
 
     // Setup resolver
     _dnsResolver.setHostname(_hostname.c_str());
+
+    // Ring buffer and sender task
+    _lineRing = xRingbufferCreate(logDestConfig.getLong("bufSize", DEFAULT_RING_BUFFER_SIZE), RINGBUF_TYPE_NOSPLIT);
+    if (!_lineRing)
+    {
+        ESP_LOGE(MODULE_PREFIX, "failed to create ring buffer");
+        return;
+    }
+    _senderExitedSem = xSemaphoreCreateBinary();
+    if (!_senderExitedSem)
+    {
+        ESP_LOGE(MODULE_PREFIX, "failed to create sender semaphore");
+        vRingbufferDelete(_lineRing);
+        _lineRing = nullptr;
+        return;
+    }
+    BaseType_t retc = xTaskCreatePinnedToCore(
+                LoggerPapertrail::senderTaskStatic,
+                "LogPTTask",
+                logDestConfig.getLong("taskStack", DEFAULT_TASK_STACK_SIZE_BYTES),
+                this,
+                logDestConfig.getLong("taskPriority", DEFAULT_TASK_PRIORITY),
+                &_senderTaskHandle,
+                logDestConfig.getLong("taskCore", DEFAULT_TASK_CORE));
+    if (retc != pdPASS)
+    {
+        ESP_LOGE(MODULE_PREFIX, "failed to create sender task");
+        _senderTaskHandle = nullptr;
+        vRingbufferDelete(_lineRing);
+        _lineRing = nullptr;
+    }
 }
 
 LoggerPapertrail::~LoggerPapertrail()
 {
+    // Stop the sender task - it uses this object until it gives the exited semaphore so the wait can't be
+    // abandoned (it is normally within SENDER_WAIT_MS unless a send is blocked)
+    if (_senderTaskHandle)
+    {
+        _senderStopReq = true;
+        while (xSemaphoreTake(_senderExitedSem, pdMS_TO_TICKS(SENDER_STOP_WAIT_MS)) != pdTRUE)
+            ESP_LOGW(MODULE_PREFIX, "waiting for sender task to exit");
+        _senderTaskHandle = nullptr;
+    }
+    if (_senderExitedSem)
+        vSemaphoreDelete(_senderExitedSem);
+    if (_lineRing)
+        vRingbufferDelete(_lineRing);
     if (_socketFd >= 0)
     {
         close(_socketFd);
@@ -42,7 +95,7 @@ LoggerPapertrail::~LoggerPapertrail()
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Logging
+// Logging - the line is formatted into the ring buffer and sent by the sender task
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void LOGGING_FUNCTION_DECORATOR LoggerPapertrail::log(esp_log_level_t level, const char *tag, const char* msg)
@@ -51,18 +104,9 @@ void LOGGING_FUNCTION_DECORATOR LoggerPapertrail::log(esp_log_level_t level, con
     if (level > _level)
         return;
 
-    // Check for recusion (e.g. if the log function itself logs)
-    if (_inLog)
-        return;
-    _inLog = true;
-
-    // Check socket
-    ip_addr_t hostIPAddr;
-    if (!checkSocket(hostIPAddr))
-    {
-        _inLog = false;
+    // Lines logged by the sender task itself (e.g. socket errors) are not sent
+    if (!_lineRing || (xTaskGetCurrentTaskHandle() == _senderTaskHandle))
         return;
-    }
 
     // Start of log window?
     if (Raft::isTimeout(millis(), _logWindowStartMs, LOG_WINDOW_SIZE_MS))
@@ -76,56 +120,170 @@ void LOGGING_FUNCTION_DECORATOR LoggerPapertrail::log(esp_log_level_t level, con
         _logWindowCount++;
         if (_logWindowCount >= LOG_WINDOW_MAX_COUNT)
         {
-            // Discard
-            _inLog = false;
+            _windowDropCount++;
             return;
         }
     }
 
-    // Format message
-    String logMsg = "<22>" + _sysName + ": " + msg;
+    // Line length (without line endings as lines are newline separated in the datagram)
+    uint32_t msgLen = strlen(msg);
+    while ((msgLen > 0) && ((msg[msgLen-1] == '\n') || (msg[msgLen-1] == '\r')))
+        msgLen--;
+    uint32_t prefixLen = _linePrefix.length();
+    if (prefixLen + msgLen > MAX_LINE_LEN)
+        msgLen = MAX_LINE_LEN - prefixLen;
+
+    // Format into the ring buffer
+    void* pItem = nullptr;
+    if ((xRingbufferSendAcquire(_lineRing, &pItem, prefixLen + msgLen, 0) != pdTRUE) || !pItem)
+    {
+        _ringDropCount++;
+        return;
+    }
+    memcpy(pItem, _linePrefix.c_str(), prefixLen);
+    memcpy((char*)pItem + prefixLen, msg, msgLen);
+    xRingbufferSendComplete(_lineRing, pItem);
+}
 
-    // Form the IP address
-    struct sockaddr_in destAddr;
-    destAddr.sin_addr.s_addr = hostIPAddr.u_addr.ip4.addr;
-    destAddr.sin_family = AF_INET;
-    destAddr.sin_port = htons(atoi(_port.c_str()));
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sender task - lines are left in the ring buffer until the socket is ready and then packed into datagrams
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // Send to papertrail using UDP socket
-    int ret = sendto(_socketFd, logMsg.c_str(), logMsg.length(), 0, (struct sockaddr *)&destAddr, sizeof(destAddr));
-    if (ret < 0)
+void LoggerPapertrail::senderTaskStatic(void* pvParameters)
+{
+    LoggerPapertrail* pThis = (LoggerPapertrail*)pvParameters;
+    pThis->senderTask();
+    xSemaphoreGive(pThis->_senderExitedSem);
+    vTaskDelete(NULL);
+}
+
+void LoggerPapertrail::senderTask()
+{
+    while (!_senderStopReq)
     {
-        if (Raft::isTimeout(millis(), _internalLoggingFailedErrorLastTime, INTERNAL_ERROR_LOG_MIN_GAP_MS))
+        // Check socket
+        if (!checkSocket())
+        {
+            vTaskDelay(pdMS_TO_TICKS(SENDER_WAIT_MS));
+            continue;
+        }
+
+        // Collect lines until the line limit, the datagram is full or batchMs after the first line
+        _datagram.clear();
+        uint32_t numLines = 0;
+        uint32_t batchStartMs = millis();
+        while (!_senderStopReq && (numLines < _maxLinesPerDatagram))
         {
-            ESP_LOGI(MODULE_PREFIX, "log failed: %d errno %d socketFd %d ipAddr %s msgLen %d",
-                        ret, errno, _socketFd, ipaddr_ntoa(&hostIPAddr), logMsg.length());
-            _internalLoggingFailedErrorLastTime = millis();
+            uint32_t elapsedMs = millis() - batchStartMs;
+            uint32_t waitMs = numLines == 0 ? SENDER_WAIT_MS : (elapsedMs < _batchMs ? _batchMs - elapsedMs : 0);
+            size_t lineLen = 0;
+            char* pLine = (char*)xRingbufferReceive(_lineRing, &lineLen, pdMS_TO_TICKS(waitMs));
+            if (!pLine)
+                break;
+            if ((numLines > 0) && (_datagram.size() + 1 + lineLen > _maxDatagramLen))
+            {
+                sendDatagram(numLines);
+                _datagram.clear();
+                numLines = 0;
+            }
+            if (numLines == 0)
+                batchStartMs = millis();
+            else
+                _datagram.push_back('\n');
+            _datagram.insert(_datagram.end(), pLine, pLine + lineLen);
+            vRingbufferReturnItem(_lineRing, pLine);
+            numLines++;
         }
+        if (numLines > 0)
+            sendDatagram(numLines);
+
+        // Report dropped lines
+        reportDrops();
     }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send the datagram
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // Done
-    _inLog = false;
+void LoggerPapertrail::sendDatagram(uint32_t numLines)
+{
+    int ret = sendto(_socketFd, _datagram.data(), _datagram.size(), 0, (struct sockaddr *)&_destAddr, sizeof(_destAddr));
+    if (ret >= 0)
+        return;
+    _sendDropCount += numLines;
+    if (Raft::isTimeout(millis(), _internalLoggingFailedErrorLastTime, INTERNAL_ERROR_LOG_MIN_GAP_MS))
+    {
+        ESP_LOGI(MODULE_PREFIX, "log failed: %d errno %d socketFd %d msgLen %d lines %d",
+                    ret, errno, _socketFd, (int)_datagram.size(), (int)numLines);
+        _internalLoggingFailedErrorLastTime = millis();
+    }
+
+    // Resolve the address again unless the failure is transient
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != ENOMEM))
+        _destAddrValid = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Report dropped lines (cumulative counts) when the count has changed
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LoggerPapertrail::reportDrops()
+{
+    uint32_t windowDrops = _windowDropCount;
+    uint32_t ringDrops = _ringDropCount;
+    uint32_t dropTotal = windowDrops + ringDrops + _sendDropCount;
+    if ((dropTotal == _reportedDropTotal) || !Raft::isTimeout(millis(), _dropReportLastTimeMs, DROP_REPORT_MIN_GAP_MS))
+        return;
+    char reportStr[100];
+    snprintf(reportStr, sizeof(reportStr), "<20>%s: %s dropped window %u ring %u send %u", 
+                _sysName.c_str(), MODULE_PREFIX, (unsigned)windowDrops, (unsigned)ringDrops, (unsigned)_sendDropCount);
+    _datagram.assign(reportStr, reportStr + strlen(reportStr));
+    sendDatagram(0);
+    _reportedDropTotal = dropTotal;
+    _dropReportLastTimeMs = millis();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Check socket connected
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool LoggerPapertrail::checkSocket(ip_addr_t& hostIPAddr)
+bool LoggerPapertrail::checkSocket()
 {
     // Check if we're connected to IP
     if (!networkSystem.isIPConnected())
         return false;
 
-    // Get IP address
-    if (!_dnsResolver.getIPAddr(hostIPAddr))
+    // Resolve the destination address if not already done
+    if (!_destAddrValid)
     {
-        if (Raft::isTimeout(millis(), _internalDNSResolveErrorLastTimeMs, INTERNAL_ERROR_LOG_MIN_GAP_MS))
+        ip_addr_t hostIPAddr;
+        if (!_dnsResolver.getIPAddr(hostIPAddr))
         {
-            ESP_LOGI(MODULE_PREFIX, "checkSocketCreated dns not resolved");
-            _internalDNSResolveErrorLastTimeMs = millis();
+            if (Raft::isTimeout(millis(), _internalDNSResolveErrorLastTimeMs, INTERNAL_ERROR_LOG_MIN_GAP_MS))
+            {
+                ESP_LOGI(MODULE_PREFIX, "checkSocketCreated dns not resolved");
+                _internalDNSResolveErrorLastTimeMs = millis();
+            }
+            return false;
         }
-        return false;
+
+        // Check address family
+        if (hostIPAddr.type != IPADDR_TYPE_V4)
+        {
+            if (Raft::isTimeout(millis(), _internalSocketCreateErrorLastTimeMs, INTERNAL_ERROR_LOG_MIN_GAP_MS))
+            {
+                ESP_LOGI(MODULE_PREFIX, "checkSocketCreated invalid address family %d != IPADDR_TYPE_V4", hostIPAddr.type);
+                _internalSocketCreateErrorLastTimeMs = millis();
+            }
+            return false;
+        }
+
+        // Form the destination address
+        _destAddr.sin_addr.s_addr = hostIPAddr.u_addr.ip4.addr;
+        _destAddr.sin_family = AF_INET;
+        _destAddr.sin_port = htons(_port);
+        _destAddrValid = true;
     }
 
     // Check if socket already connected
@@ -137,16 +295,6 @@ bool LoggerPapertrail::checkSocket(ip_addr_t& hostIPAddr)
     ESP_LOGI(MODULE_PREFIX, "checkSocketCreated creating udp socket");
 #endif
 
-    // Check address family
-    if (hostIPAddr.type != IPADDR_TYPE_V4)
-    {
-        if (Raft::isTimeout(millis(), _internalSocketCreateErrorLastTimeMs, INTERNAL_ERROR_LOG_MIN_GAP_MS))
-        {
-            ESP_LOGI(MODULE_PREFIX, "checkSocketCreated invalid address family %d != IPADDR_TYPE_V4", hostIPAddr.type);
-            _internalSocketCreateErrorLastTimeMs = millis();
-        }
-        return false;
-    }
     
     // Create UDP socket
     _socketFd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
@@ -191,8 +339,8 @@ bool LoggerPapertrail::checkSocket(ip_addr_t& hostIPAddr)
 #endif
 
     // Debug
-    ESP_LOGI(MODULE_PREFIX, "checkSocket OK hostname %s port %s level %s sysName %s socketFd %d socketFlags %04x", 
-                        _hostname.c_str(), _port.c_str(), getLevelStr(), _sysName.c_str(), _socketFd, 
+    ESP_LOGI(MODULE_PREFIX, "checkSocket OK hostname %s port %d level %s sysName %s socketFd %d socketFlags %04x", 
+                        _hostname.c_str(), _port, getLevelStr(), _sysName.c_str(), _socketFd, 
                         fcntl(_socketFd, F_GETFL, 0));
     return true;
 }
@@ -2,15 +2,24 @@
 //
 // Papertrail logger
 //
+// log() formats each line directly into a preallocated ring buffer (no heap allocation or network access
+// in the calling task) and a low priority task drains the ring packing several syslog lines (newline
+// separated) into each UDP datagram. Lines dropped (rate window, ring full or send failure) are counted
+// and the counts are shipped in a log line.
+//
 // Rob Dobson 2021
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #pragma once
 
+#include <atomic>
+#include <vector>
 #include "LoggerBase.h"
 #include "RaftArduino.h"
+#include "RaftThreading.h"
 #include "DNSResolver.h"
+#include "freertos/ringbuf.h"
 #include "sys/types.h"
 #include "sys/socket.h"
 #include "netdb.h"
@@ -27,23 +36,55 @@ public:
 private:
     // Config
     String _hostname;
-    String _port;
+    uint16_t _port = 0;
     String _sysName;
     DNSResolver _dnsResolver;
 
-    // Socket
-    int _socketFd = -1;
+    // Syslog line prefix (priority and system name)
+    String _linePrefix;
+
+    // Ring buffer of formatted lines (written by log() from any task, read by the sender task)
+    RingbufHandle_t _lineRing = nullptr;
+    static const uint32_t DEFAULT_RING_BUFFER_SIZE = 4096;
+    static const uint32_t MAX_LINE_LEN = 512;
+
+    // Sender task (the task gives the exited semaphore as its last access to this object)
+    TaskHandle_t _senderTaskHandle = nullptr;
+    volatile bool _senderStopReq = false;
+    SemaphoreHandle_t _senderExitedSem = nullptr;
+    static const int DEFAULT_TASK_CORE = 0;
+    static const int DEFAULT_TASK_PRIORITY = 1;
+    static const int DEFAULT_TASK_STACK_SIZE_BYTES = 3000;
+    static const uint32_t SENDER_WAIT_MS = 100;
+    static const uint32_t SENDER_STOP_WAIT_MS = 500;
 
-    // Recursion detector
-    bool _inLog = false;
+    // Datagram - lines are collected for up to batchMs after the first line
+    std::vector<char> _datagram;
+    static const uint32_t DEFAULT_MAX_DATAGRAM_LEN = 1200;
+    static const uint32_t DEFAULT_MAX_LINES_PER_DATAGRAM = 10;
+    static const uint32_t DEFAULT_BATCH_MS = 200;
+    uint32_t _maxDatagramLen = DEFAULT_MAX_DATAGRAM_LEN;
+    uint32_t _maxLinesPerDatagram = DEFAULT_MAX_LINES_PER_DATAGRAM;
+    uint32_t _batchMs = DEFAULT_BATCH_MS;
+
+    // Socket and destination address (resolved once)
+    int _socketFd = -1;
+    struct sockaddr_in _destAddr = {};
+    bool _destAddrValid = false;
 
     // Avoid swamping the network
     uint32_t _logWindowStartMs = 0;
     uint32_t _logWindowCount = 0;
     static const uint32_t LOG_WINDOW_SIZE_MS = 60000;
     static const uint32_t LOG_WINDOW_MAX_COUNT = 60;
-    uint32_t _logWindowThrottleStartMs = 0;
-    static const uint32_t LOG_WINDOW_THROTTLE_BACKOFF_MS = 30000;
+
+    // Dropped line counts and the total when last reported
+    std::atomic<uint32_t> _windowDropCount = 0;
+    std::atomic<uint32_t> _ringDropCount = 0;
+    uint32_t _sendDropCount = 0;
+    uint32_t _reportedDropTotal = 0;
+    uint32_t _dropReportLastTimeMs = 0;
+    static const uint32_t DROP_REPORT_MIN_GAP_MS = 10000;
 
     // Avoid logging internal errors too often
     uint32_t _internalDNSResolveErrorLastTimeMs = 0;
@@ -52,7 +93,11 @@ private:
     static const uint32_t INTERNAL_ERROR_LOG_MIN_GAP_MS = 10000;
 
     // Helpers
-    bool checkSocket(ip_addr_t& hostIPAddr);
+    bool checkSocket();
+    static void senderTaskStatic(void* pvParameters);
+    void senderTask();
+    void sendDatagram(uint32_t numLines);
+    void reportDrops();
 
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "LogPapertrail";
@@ -8,6 +8,7 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "MQTTManager.h"
+#include "SysModTiming.h"
 #include "Logger.h"
 #include "RaftUtils.h"
 #include "CommsCoreIF.h"
@@ -49,6 +50,12 @@ void MQTTManager::setup()
     // Form unique client ID
     mqttClientID += getSystemUniqueString();
 
+    // Send queue
+    _sendQueueLen = configGetLong("sendQueueLen", DEFAULT_SEND_QUEUE_LEN);
+    _maxQueuedBytes = configGetLong("maxQueuedBytes", DEFAULT_MAX_QUEUED_BYTES);
+    _maxPublishPerLoop = configGetLong("maxPublishPerLoop", DEFAULT_MAX_PUBLISH_PER_LOOP);
+    _batchMs = configGetLong("batchMs", 0);
+
     // Setup client
     _mqttClient.setup(isMQTTEnabled, brokerHostname.c_str(), brokerPort, mqttClientID.c_str());
 
@@ -81,6 +88,11 @@ void MQTTManager::setup()
 
 void MQTTManager::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
+    // Publish queued messages
+    publishQueued();
+
     // Service client
     _mqttClient.loop();
 }
@@ -106,41 +118,126 @@ void MQTTManager::addCommsChannels(CommsCoreIF& commsCoreIF)
     static const CommsChannelSettings commsChannelSettings;
 
     // Register an endpoint for each
+    _outTopics.clear();
+    _queuedBytes = 0;
     for (String& topicName : topicNames)
     {
 #ifdef DEBUG_MQTT_MAN_COMMS_CHANNELS        
         LOG_I(MODULE_PREFIX, "addCommsChannels %s", topicName.c_str());
 #endif
+        // Send queue for the topic
+        _outTopics.emplace_back(topicName, _sendQueueLen);
+        OutTopic* pOutTopic = &_outTopics.back();
+
         // Register as a channel
         _commsChannelID = commsCoreIF.registerChannel("RICJSON", 
                 "MQTT",
                 topicName.c_str(),
-                [this, topicName](CommsChannelMsg& msg) { return sendMQTTMsg(topicName, msg); },
+                [this, pOutTopic](CommsChannelMsg& msg) { return sendMQTTMsg(*pOutTopic, msg); },
                 std::bind(&MQTTManager::readyToSend, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
                 &commsChannelSettings);
+        pOutTopic->channelID = _commsChannelID;
     }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Send message over MQTT
+// Send message over MQTT - the message is queued for the topic and published from loop()
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool MQTTManager::sendMQTTMsg(const String& topicName, CommsChannelMsg& msg)
+bool MQTTManager::sendMQTTMsg(OutTopic& outTopic, CommsChannelMsg& msg)
 {
-    String msgStr(msg.getBuf(), msg.getBufLen());
 #ifdef DEBUG_MQTT_MAN_SEND
-    LOG_I(MODULE_PREFIX, "sendMQTTMsg topicName %s msg %s", topicName.c_str(), msgStr.c_str());
+    LOG_I(MODULE_PREFIX, "sendMQTTMsg topicName %s len %d queued %d", 
+            outTopic.topicName.c_str(), msg.getBufLen(), outTopic.sendQueue.count());
 #endif
 
-    // Publish using client
-    return _mqttClient.publishToTopic(topicName, msgStr);
+    // A message larger than the byte limit is only accepted when nothing else is queued
+    uint32_t queuedBytes = _queuedBytes;
+    if (((queuedBytes > 0) && (queuedBytes + msg.getBufLen() > _maxQueuedBytes)) ||
+                !outTopic.sendQueue.put(msg.getBuf(), msg.getBufLen()))
+    {
+        _droppedCount++;
+        return false;
+    }
+    _queuedBytes.fetch_add(msg.getBufLen());
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Check if ready to message over MQTT
+// Check if ready to message over MQTT - the topic queue must have space and the total queued below the limit
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool MQTTManager::readyToSend(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn)
 {
-    return true;
+    noConn = false;
+    if (_queuedBytes >= _maxQueuedBytes)
+        return false;
+    for (OutTopic& outTopic : _outTopics)
+    {
+        if (outTopic.channelID == channelID)
+            return outTopic.sendQueue.count() < outTopic.sendQueue.maxLen();
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Publish queued messages (when batching only once the batch is due so the publishes are written together)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MQTTManager::publishQueued()
+{
+    if (_queuedBytes == 0)
+        return;
+
+    // Check if batch is due
+    if ((_batchMs > 0) && (_queuedBytes < _maxQueuedBytes / 2))
+    {
+        bool isBatchDue = false;
+        for (OutTopic& outTopic : _outTopics)
+        {
+            uint32_t putMs = 0;
+            if ((outTopic.sendQueue.getPutMs(0, putMs) && Raft::isTimeout(millis(), putMs, _batchMs)) ||
+                        (outTopic.sendQueue.count() >= outTopic.sendQueue.maxLen()))
+            {
+                isBatchDue = true;
+                break;
+            }
+        }
+        if (!isBatchDue)
+            return;
+    }
+
+    // Publish
+    uint32_t numPublished = 0;
+    for (OutTopic& outTopic : _outTopics)
+    {
+        const uint8_t* pBuf = nullptr;
+        uint32_t bufLen = 0;
+        while ((numPublished < _maxPublishPerLoop) && outTopic.sendQueue.peekFront(pBuf, bufLen))
+        {
+            String msgStr((const char*)pBuf, bufLen);
+            if (_mqttClient.publishToTopic(outTopic.topicName, msgStr))
+                _publishCount++;
+            else
+                _publishFailCount++;
+            _queuedBytes.fetch_sub(bufLen);
+            outTopic.sendQueue.popFront();
+            numPublished++;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String MQTTManager::getDebugJSON() const
+{
+    uint32_t queuedMsgs = 0;
+    for (const OutTopic& outTopic : _outTopics)
+        queuedMsgs += outTopic.sendQueue.count();
+    char jsonStr[120];
+    snprintf(jsonStr, sizeof(jsonStr), R"({"queued":%d,"bytes":%d,"pub":%d,"fail":%d,"drop":%d})",
+                (int)queuedMsgs, (int)_queuedBytes.load(), (int)_publishCount, (int)_publishFailCount, (int)_droppedCount);
+    return jsonStr;
 }
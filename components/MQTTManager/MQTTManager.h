@@ -9,9 +9,13 @@
 
 #pragma once
 
+#include <list>
+#include <atomic>
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 #include "RaftMQTTClient.h"
 #include "CommsChannelMsg.h"
+#include "OutboundMsgQueue.h"
 
 class RaftJsonIF;
 class RestAPIEndpointManager;
@@ -41,6 +45,9 @@ protected:
     // Add protocol endpoints
     virtual void addCommsChannels(CommsCoreIF& commsCoreIF) override final;
 
+    // Get debug string
+    virtual String getDebugJSON() const override final;
+
 private:
     // MQTT client
     RaftMQTTClient _mqttClient;
@@ -48,9 +55,45 @@ private:
     // EndpointID used to identify this message channel to the CommsCoreIF object
     uint32_t _commsChannelID;
 
+    // Outbound topics - messages are queued per topic and published from loop() so memory use is bounded
+    // by the queues and readyToSend reflects the backlog
+    class OutTopic
+    {
+    public:
+        OutTopic(const String& topicName, uint32_t sendQueueLen)
+            : topicName(topicName), sendQueue(sendQueueLen)
+        {
+        }
+        String topicName;
+        uint32_t channelID = 0;
+        OutboundMsgQueue sendQueue;
+    };
+    std::list<OutTopic> _outTopics;
+
+    // Send queue settings - when batchMs is non-zero messages are held until the oldest has waited batchMs
+    // (or a queue limit is reached) and then published together before the client is serviced
+    static const uint32_t DEFAULT_SEND_QUEUE_LEN = 5;
+    static const uint32_t DEFAULT_MAX_QUEUED_BYTES = 8192;
+    static const uint32_t DEFAULT_MAX_PUBLISH_PER_LOOP = 10;
+    uint32_t _sendQueueLen = DEFAULT_SEND_QUEUE_LEN;
+    uint32_t _maxQueuedBytes = DEFAULT_MAX_QUEUED_BYTES;
+    uint32_t _maxPublishPerLoop = DEFAULT_MAX_PUBLISH_PER_LOOP;
+    uint32_t _batchMs = 0;
+    // Total bytes queued (added by senders on other tasks and removed by the loop)
+    std::atomic<uint32_t> _queuedBytes = 0;
+
+    // Stats
+    uint32_t _publishCount = 0;
+    uint32_t _publishFailCount = 0;
+    uint32_t _droppedCount = 0;
+
     // Helpers
-    bool sendMQTTMsg(const String& topicName, CommsChannelMsg& msg);
+    bool sendMQTTMsg(OutTopic& outTopic, CommsChannelMsg& msg);
     bool readyToSend(uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn);
+    void publishQueued();
+
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
 
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "MQTTMan";
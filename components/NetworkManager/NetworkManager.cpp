@@ -9,6 +9,7 @@
 
 #include "Logger.h"
 #include "NetworkManager.h"
+#include "SysModTiming.h"
 #include "RaftUtils.h"
 #include "RestAPIEndpointManager.h"
 #include "SysManager.h"
@@ -91,6 +92,8 @@ void NetworkManager::setup()
 
 void NetworkManager::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
     // Service network system
     networkSystem.loop();
 
@@ -175,6 +178,8 @@ void NetworkManager::addRestAPIEndpoints(RestAPIEndpointManager &endpointManager
 
 RaftRetCode NetworkManager::apiWifiSTASet(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("w");
+
     // LOG_I(MODULE_PREFIX, "apiWifiSTASet incoming %s", reqStr.c_str());
 
     // Get SSID - note that ? is valid in SSIDs so don't split on ? character
@@ -213,6 +218,8 @@ RaftRetCode NetworkManager::apiWifiSTASet(const String &reqStr, String &respStr,
 
 RaftRetCode NetworkManager::apiWifiAPSet(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("wap");
+
     // Get SSID - note that ? is valid in SSIDs so don't split on ? character
     String ssid = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1, false);
     // Get pw - as above
@@ -241,6 +248,8 @@ RaftRetCode NetworkManager::apiWifiAPSet(const String &reqStr, String &respStr,
 
 RaftRetCode NetworkManager::apiWifiClear(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("wc");
+
     // See if system restart required
     String sysRestartStr = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
     bool sysRestart = !sysRestartStr.equalsIgnoreCase("norestart");
@@ -282,6 +291,8 @@ RaftRetCode NetworkManager::apiWifiClear(const String &reqStr, String &respStr,
 
 RaftRetCode NetworkManager::apiWiFiPause(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("wifipause");
+
     // Get pause arg
     String arg = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1, false);
 
@@ -304,6 +315,8 @@ RaftRetCode NetworkManager::apiWiFiPause(const String &reqStr, String& respStr,
 
 RaftRetCode NetworkManager::apiWifiScan(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("wifiscan");
+
     LOG_I(MODULE_PREFIX, "apiWifiScan %s", reqStr.c_str());
 
     // Get arg
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 #include "NetworkSystem.h"
 
 class RaftJsonIF;
@@ -60,6 +61,9 @@ private:
     RaftRetCode apiWiFiPause(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
     RaftRetCode apiWifiScan(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
 
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "NetMan";
 };
@@ -23,6 +23,7 @@
 #include "SampleCollectorJSON.h"
 #include "SerialConsole.h"
 #include "StatePublisher.h"
+#include "TimingMonitor.h"
 
 // Check if networking is enabled
 #if defined(CONFIG_ESP_WIFI_ENABLED) || defined(CONFIG_ETH_USE_ESP32_EMAC) || defined(CONFIG_ETH_USE_SPI_ETHERNET) || defined(CONFIG_ETH_USE_OPENETH) || defined(CONFIG_ETH_USE_RMII_ETHERNET)
@@ -77,5 +78,8 @@ namespace RegisterSysMods
         
         // StatePublisher
         sysManager.registerSysMod("Publish", StatePublisher::create);
+
+        // TimingMonitor
+        sysManager.registerSysMod("TimingMon", TimingMonitor::create);
     }
 }
@@ -9,6 +9,7 @@
 
 #include "Logger.h"
 #include "SerialConsole.h"
+#include "SysModTiming.h"
 #include "RestAPIEndpointManager.h"
 #include "CommsChannelSettings.h"
 #include "CommsCoreIF.h"
@@ -38,6 +39,15 @@ SerialConsole::SerialConsole(const char* pModuleName, RaftJsonIF& sysConfig)
 
     // ChannelID
     _commsChannelID = CommsCoreIF::CHANNEL_ID_UNDEFINED;    
+
+    // Send mutex
+    _sendMutex = xSemaphoreCreateMutex();
+}
+
+SerialConsole::~SerialConsole()
+{
+    if (_sendMutex)
+        vSemaphoreDelete(_sendMutex);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -53,6 +63,8 @@ void SerialConsole::setup()
     _baudRate = configGetLong("baudRate", 0);
     _rxBufferSize = configGetLong("rxBuf", DEFAULT_RX_BUFFER_SIZE);
     _txBufferSize = configGetLong("txBuf", DEFAULT_TX_BUFFER_SIZE);
+    _rxTaskEnabled = configGetBool("rxTask", false);
+    _rxRingSize = configGetLong("rxRingSize", DEFAULT_RX_RING_SIZE);
 
     // Protocol
     _protocol = configGetString("protocol", "RICSerial");
@@ -86,20 +98,9 @@ void SerialConsole::setup()
     // Config required if baud rate specified
     bool configRequired = _baudRate != 0;
 
-    // Check for interrupt allocation flags (IRAM)
-    int intr_alloc_flags = 0;
-#if CONFIG_UART_ISR_IN_IRAM
-    intr_alloc_flags = ESP_INTR_FLAG_IRAM;
-#endif
-
     // Install UART driver for interrupt-driven reads and writes
-    esp_err_t err = uart_driver_install((uart_port_t)_uartNum, _rxBufferSize, _txBufferSize, 0, 
-                            NULL, intr_alloc_flags);
-    if (err != ESP_OK)
-    {
-        LOG_E(MODULE_PREFIX, "setup FAILED uartNum %d can't install uart driver, err %d", _uartNum, err);
+    if (!installUartDriver())
         return;
-    }
 
     // Check if a config required
     if (configRequired)
@@ -143,15 +144,50 @@ void SerialConsole::setup()
     }
 
     // Debug
-    LOG_I(MODULE_PREFIX, "setup OK enabled %s uartNum %d crlfOnTx %s rxBufLen %d txBufLen %d", 
+    LOG_I(MODULE_PREFIX, "setup OK enabled %s uartNum %d crlfOnTx %s rxBufLen %d txBufLen %d rxTask %s", 
                 _isEnabled ? "YES" : "NO", _uartNum, _crlfOnTx ? "YES" : "NO",
-                _rxBufferSize, _txBufferSize);
+                _rxBufferSize, _txBufferSize, _uartRx.isRunning() ? "YES" : "NO");
 
 #endif // CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
 
     _isInitialised = true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Install UART driver (with an event queue and RX task if enabled)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool SerialConsole::installUartDriver()
+{
+#ifdef CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    return false;
+#else
+    // Check for interrupt allocation flags (IRAM)
+    int intr_alloc_flags = 0;
+#if CONFIG_UART_ISR_IN_IRAM
+    intr_alloc_flags = ESP_INTR_FLAG_IRAM;
+#endif
+
+    // Install UART driver for interrupt-driven reads and writes
+    _uartEventQueue = nullptr;
+    esp_err_t err = uart_driver_install((uart_port_t)_uartNum, _rxBufferSize, _txBufferSize, 
+                            _rxTaskEnabled ? UartEventRx::EVENT_QUEUE_LEN : 0, 
+                            _rxTaskEnabled ? &_uartEventQueue : NULL, intr_alloc_flags);
+    if (err != ESP_OK)
+    {
+        LOG_E(MODULE_PREFIX, "installUartDriver FAILED uartNum %d can't install uart driver, err %d", _uartNum, err);
+        return false;
+    }
+
+    // Start RX task
+    _rxBlockLen = 0;
+    _rxBlockPos = 0;
+    if (_rxTaskEnabled && !_uartRx.start(_uartNum, _uartEventQueue, nullptr, _rxRingSize))
+        LOG_E(MODULE_PREFIX, "installUartDriver FAILED to start RX task uartNum %d - polling", _uartNum);
+    return true;
+#endif
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Endpoints
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -178,7 +214,7 @@ void SerialConsole::addCommsChannels(CommsCoreIF& commsCore)
             modName(),
             std::bind(&SerialConsole::sendMsg, this, std::placeholders::_1),
             [this](uint32_t channelID, CommsMsgTypeCode msgType, bool& noConn) {
-                return true;
+                return canAcceptMsg();
             },
             &commsChannelSettings);
 }
@@ -191,6 +227,19 @@ int SerialConsole::getChar()
 {
     if (_isEnabled)
     {
+        // RX task mode - get from the current block (reading the next block from the ring buffer if needed)
+        if (_uartRx.isRunning())
+        {
+            if (_rxBlockPos >= _rxBlockLen)
+            {
+                _rxBlockLen = _uartRx.read(_rxBlock, sizeof(_rxBlock));
+                _rxBlockPos = 0;
+                if (_rxBlockLen == 0)
+                    return -1;
+            }
+            return _rxBlock[_rxBlockPos++];
+        }
+
         // Check anything available
         size_t numCharsAvailable = 0;
 #ifdef CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
@@ -285,9 +334,12 @@ SerialConsole::CommandRxState SerialConsole::getXonXoff()
 
 void SerialConsole::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
     // Process received data
-    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> inboundMessage;
-    for (uint32_t chIdx = 0; chIdx < MAX_BYTES_TO_PROCESS_IN_LOOP; chIdx++)
+    _inboundMsg.clear();
+    uint32_t maxBytesToProcess = _uartRx.isRunning() ? RX_TASK_MAX_BYTES_IN_LOOP : MAX_BYTES_TO_PROCESS_IN_LOOP;
+    for (uint32_t chIdx = 0; chIdx < maxBytesToProcess; chIdx++)
     {
         // Check for char
         int ch = getChar();
@@ -301,7 +353,7 @@ void SerialConsole::loop()
             int decodedByte = _protocolOverAscii.decodeByte(ch);
             if (decodedByte != -1)
             {
-                inboundMessage.push_back((uint8_t)decodedByte);
+                _inboundMsg.push_back((uint8_t)decodedByte);
                 // LOG_I(MODULE_PREFIX, "byte rx %02x", rxBuf[0]);
             }
             continue;
@@ -392,7 +444,7 @@ void SerialConsole::loop()
     }
 
     // Process any message received
-    processReceivedData(inboundMessage);
+    processReceivedData(_inboundMsg);
 }
 
 void SerialConsole::processReceivedData(std::vector<uint8_t, SpiramAwareAllocator<uint8_t>>& rxData)
@@ -434,27 +486,94 @@ bool SerialConsole::sendMsg(CommsChannelMsg& msg)
     if (!_isInitialised)
         return false;
 
+    // Only one frame is encoded and written at a time
+    if (!_sendMutex || (xSemaphoreTake(_sendMutex, pdMS_TO_TICKS(TX_SEND_LOCK_WAIT_MS)) != pdTRUE))
+        return false;
+
     // Encode
     uint32_t encodedFrameMax = msg.getBufLen() * 2 > PROTOCOL_OVER_ASCII_MSG_MAX_LEN ? msg.getBufLen() * 2 : PROTOCOL_OVER_ASCII_MSG_MAX_LEN;
-    uint8_t encodedFrame[encodedFrameMax];
-    uint32_t encodedFrameLen = _protocolOverAscii.encodeFrame(msg.getBuf(), msg.getBufLen(), encodedFrame, encodedFrameMax);
+    if (_encodedFrame.size() < encodedFrameMax)
+        _encodedFrame.resize(encodedFrameMax);
+    uint32_t encodedFrameLen = _protocolOverAscii.encodeFrame(msg.getBuf(), msg.getBufLen(), _encodedFrame.data(), encodedFrameMax);
+
+    // Send the message in chunks (retrying short writes until the timeout)
+    uint32_t bytesSent = 0;
+    uint32_t sendStartMs = millis();
+    while (bytesSent < encodedFrameLen)
+    {
+        uint32_t toWrite = encodedFrameLen - bytesSent < TX_WRITE_CHUNK_LEN ? encodedFrameLen - bytesSent : TX_WRITE_CHUNK_LEN;
+        uint32_t bytesWritten = writeBytes(_encodedFrame.data() + bytesSent, toWrite);
+        bytesSent += bytesWritten;
+        if (bytesWritten < toWrite)
+        {
+            _txShortWrites++;
+            if (Raft::isTimeout(millis(), sendStartMs, TX_WRITE_TIMEOUT_MS))
+                break;
+            vTaskDelay(1);
+        }
+    }
+    _txBytesWritten += bytesSent;
 
-    // Send the message
-#ifdef CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
-    int bytesSent = usb_serial_jtag_write_bytes((const char*)encodedFrame, encodedFrameLen, 1);
-#else
-    int bytesSent = uart_write_bytes((uart_port_t)_uartNum, (const char*)encodedFrame, encodedFrameLen);
-#endif
+    // Release the buffer if it was grown for a large message
+    if (_encodedFrame.size() > PROTOCOL_OVER_ASCII_MSG_MAX_LEN * 2)
+    {
+        _encodedFrame.clear();
+        _encodedFrame.shrink_to_fit();
+    }
+
+    // Check all sent
     if (bytesSent != encodedFrameLen)
     {
         LOG_W(MODULE_PREFIX, "sendMsg channelID %d, msgType %s msgNum %d, len %d only wrote %d bytes",
                 msg.getChannelID(), msg.getMsgTypeAsString(msg.getMsgTypeCode()), msg.getMsgNumber(), encodedFrameLen, bytesSent);
-
+        _txMsgsFailed++;
+        _txBackoff = true;
+        _txBackoffStartMs = millis();
+        xSemaphoreGive(_sendMutex);
         return false;
     }
+    _txMsgsSent++;
+    xSemaphoreGive(_sendMutex);
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Write bytes to the UART (or USB-JTAG) TX buffer - returns the number of bytes written
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t SerialConsole::writeBytes(const uint8_t* pData, uint32_t len)
+{
+#ifdef CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    int bytesWritten = usb_serial_jtag_write_bytes((const char*)pData, len, 1);
+#else
+    int bytesWritten = uart_write_bytes((uart_port_t)_uartNum, (const char*)pData, len);
+#endif
+    return bytesWritten > 0 ? bytesWritten : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if a message can be accepted (not backing off after a failed message)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool SerialConsole::canAcceptMsg()
+{
+    if (_txBackoff && Raft::isTimeout(millis(), _txBackoffStartMs, TX_BACKOFF_MS))
+        _txBackoff = false;
+    return !_txBackoff;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String SerialConsole::getDebugJSON() const
+{
+    char jsonStr[150];
+    snprintf(jsonStr, sizeof(jsonStr), R"({"txMsgs":%d,"txFail":%d,"txBytes":%d,"txShort":%d,"backoff":%d,"rxTask":)",
+                (int)_txMsgsSent, (int)_txMsgsFailed, (int)_txBytesWritten, (int)_txShortWrites, _txBackoff ? 1 : 0);
+    return String(jsonStr) + (_uartRx.isRunning() ? _uartRx.getDebugJSON() : String("null")) + "}";
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Handle JSON command
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -483,7 +602,12 @@ RaftRetCode SerialConsole::receiveCmdJSON(const char* cmdJSON)
             if (rxBufSize > 0)
                 _rxBufferSize = rxBufSize;
 
-            // Remove existing driver
+            // Remove existing driver (the RX task must have exited first)
+            if (!_uartRx.stop())
+            {
+                LOG_E(MODULE_PREFIX, "receiveCmdJson RX task didn't stop so uart driver not removed from port %d", _uartNum);
+                return RAFT_BUSY;
+            }
             esp_err_t err = uart_driver_delete((uart_port_t)_uartNum);
             if (err != ESP_OK)
             {
@@ -492,12 +616,8 @@ RaftRetCode SerialConsole::receiveCmdJSON(const char* cmdJSON)
             }
 
             // Install uart driver            
-            err = uart_driver_install((uart_port_t)_uartNum, _rxBufferSize, _txBufferSize, 0, NULL, 0);
-            if (err != ESP_OK)
-            {
-                LOG_E(MODULE_PREFIX, "receiveCmdJson FAILED to install uart driver to port %d, err %d", _uartNum, err);
+            if (!installUartDriver())
                 return RAFT_INVALID_DATA;
-            }
         }
         return RAFT_OK;
     }
@@ -511,6 +631,8 @@ RaftRetCode SerialConsole::receiveCmdJSON(const char* cmdJSON)
 
 RaftRetCode SerialConsole::apiConsole(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("console");
+
     // Extract parameters
     std::vector<String> params;
     std::vector<RaftJson::NameValuePair> nameValues;
@@ -10,8 +10,10 @@
 #pragma once
 
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 #include "ProtocolOverAscii.h"
 #include "SpiramAwareAllocator.h"
+#include "UartEventRx.h"
 
 class RestAPIEndpointManager;
 class CommsCoreIF;
@@ -22,6 +24,7 @@ class SerialConsole : public RaftSysMod
 {
 public:
     SerialConsole(const char* pModuleName, RaftJsonIF& sysConfig);
+    virtual ~SerialConsole();
 
     // Create function (for use by SysManager factory)
     static RaftSysMod* create(const char* pModuleName, RaftJsonIF& sysConfig)
@@ -68,6 +71,9 @@ protected:
     // Handle JSON command
     virtual RaftRetCode receiveCmdJSON(const char* cmdJSON) override final;
 
+    // Get debug string
+    virtual String getDebugJSON() const override final;
+
 public:
     // XON/XOFF hadnling
     static constexpr char ASCII_XOFF = 0x13;
@@ -98,6 +104,23 @@ private:
     // Bytes to process in loop call
     static const uint32_t MAX_BYTES_TO_PROCESS_IN_LOOP = 100;
 
+    // RX task mode (UART only) - received data is read in blocks by a task driven by the UART event queue
+    // into a ring buffer and processed in loop() a block at a time
+    static const uint32_t DEFAULT_RX_RING_SIZE = 4096;
+    static const uint32_t RX_TASK_MAX_BYTES_IN_LOOP = 2000;
+    static const uint32_t RX_BLOCK_LEN = 256;
+    bool _rxTaskEnabled = false;
+    uint32_t _rxRingSize = DEFAULT_RX_RING_SIZE;
+    QueueHandle_t _uartEventQueue = nullptr;
+    UartEventRx _uartRx;
+    uint8_t _rxBlock[RX_BLOCK_LEN];
+    uint32_t _rxBlockLen = 0;
+    uint32_t _rxBlockPos = 0;
+    bool installUartDriver();
+
+    // Protocol message being received (reused between loop calls)
+    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> _inboundMsg;
+
     // Procotol
     String _protocol;
 
@@ -121,12 +144,37 @@ private:
     static const uint32_t PROTOCOL_OVER_ASCII_MSG_MAX_LEN = 1000;
     ProtocolOverAscii _protocolOverAscii;
 
+    // Encoded frame buffer - reused between messages (rather than a stack buffer of twice the message size)
+    // and released after an unusually large message. Messages can be sent from different tasks so the buffer
+    // and the write of each frame are serialised by the send mutex (a sender waits for up to
+    // TX_SEND_LOCK_WAIT_MS for a frame in progress)
+    std::vector<uint8_t, SpiramAwareAllocator<uint8_t>> _encodedFrame;
+    SemaphoreHandle_t _sendMutex = nullptr;
+    static const uint32_t TX_SEND_LOCK_WAIT_MS = 100;
+
+    // Frames are written in chunks so the TX buffer is fed as it drains - a short write is retried until
+    // TX_WRITE_TIMEOUT_MS and after a failed message the channel doesn't accept messages for TX_BACKOFF_MS
+    static const uint32_t TX_WRITE_CHUNK_LEN = 256;
+    static const uint32_t TX_WRITE_TIMEOUT_MS = 50;
+    static const uint32_t TX_BACKOFF_MS = 20;
+    uint32_t _txBytesWritten = 0;
+    uint32_t _txShortWrites = 0;
+    uint32_t _txMsgsSent = 0;
+    uint32_t _txMsgsFailed = 0;
+    bool _txBackoff = false;
+    uint32_t _txBackoffStartMs = 0;
+    uint32_t writeBytes(const uint8_t* pData, uint32_t len);
+    bool canAcceptMsg();
+
     // Helpers
     void showEndpoints();
     bool sendMsg(CommsChannelMsg& msg);
     void processReceivedData(std::vector<uint8_t, SpiramAwareAllocator<uint8_t>>& rxData);
     RaftRetCode apiConsole(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
 
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
+
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "SerialConsole";
 };
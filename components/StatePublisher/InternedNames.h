@@ -0,0 +1,91 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// InternedNames
+// Table of names held once and referred to by small integer IDs
+//
+// Names are never removed so IDs remain valid. Lookups compare a hash before comparing the name itself.
+// Not thread safe - a table which is only added to during setup can be searched from any task.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "RaftArduino.h"
+
+class InternedNames
+{
+public:
+    static const int32_t NAME_ID_NOT_FOUND = -1;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the ID of a name (adding it if not already present)
+    /// @param pName name
+    /// @return name ID
+    uint16_t intern(const char* pName)
+    {
+        int32_t nameID = find(pName);
+        if (nameID != NAME_ID_NOT_FOUND)
+            return nameID;
+        _names.push_back({ getHash(pName), pName });
+        return _names.size() - 1;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Find the ID of a name
+    /// @param pName name
+    /// @return name ID or NAME_ID_NOT_FOUND
+    int32_t find(const char* pName) const
+    {
+        uint32_t hash = getHash(pName);
+        for (uint32_t nameID = 0; nameID < _names.size(); nameID++)
+        {
+            if ((_names[nameID].hash == hash) && (strcmp(_names[nameID].name.c_str(), pName) == 0))
+                return nameID;
+        }
+        return NAME_ID_NOT_FOUND;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get a name from its ID
+    /// @param nameID name ID (must be valid)
+    const String& getName(uint16_t nameID) const
+    {
+        return _names[nameID].name;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear all names (invalidates IDs)
+    void clear()
+    {
+        _names.clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get number of names
+    uint32_t size() const
+    {
+        return _names.size();
+    }
+
+private:
+    struct Name
+    {
+        uint32_t hash;
+        String name;
+    };
+    std::vector<Name> _names;
+
+    // FNV-1a 32 bit
+    static uint32_t getHash(const char* pName)
+    {
+        uint32_t hash = 0x811c9dc5;
+        while (*pName)
+            hash = (hash ^ (uint8_t)*pName++) * 0x01000193;
+        return hash;
+    }
+};
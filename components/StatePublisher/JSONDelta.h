@@ -0,0 +1,211 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// JSONDelta
+// Finds the members of a JSON object which have changed since a previous version of the object
+//
+// Members are compared as text (publish message generators are expected to format unchanged values
+// identically). Nested objects are compared member by member down to a maximum depth so that, for instance,
+// only the devices on a bus whose data has changed are included. Members which have been removed are
+// written with a null value.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+class JSONDelta
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the members of a JSON object which differ from a previous version of the object
+    /// @param pPrev previous JSON object
+    /// @param prevLen length of previous JSON object
+    /// @param pCur current JSON object
+    /// @param curLen length of current JSON object
+    /// @param maxDepth levels of nested objects which are compared member by member (deeper objects are
+    ///                 included whole if they differ in any way)
+    /// @param out (out) changed members are appended separated by commas (without enclosing braces)
+    /// @return false if either version is not a valid JSON object
+    static bool getChangedMembers(const char* pPrev, uint32_t prevLen, const char* pCur, uint32_t curLen,
+                uint32_t maxDepth, std::string& out)
+    {
+        std::vector<Member> prevMembers;
+        std::vector<Member> curMembers;
+        if (!getMembers(pPrev, pPrev + prevLen, prevMembers) || !getMembers(pCur, pCur + curLen, curMembers))
+            return false;
+
+        // Changed or added members (members are usually in the same order so check the same position first)
+        std::vector<bool> prevMatched(prevMembers.size(), false);
+        bool isFirst = out.empty();
+        for (uint32_t curIdx = 0; curIdx < curMembers.size(); curIdx++)
+        {
+            const Member& cur = curMembers[curIdx];
+            int32_t prevIdx = findMember(prevMembers, cur, curIdx);
+            if (prevIdx >= 0)
+            {
+                prevMatched[prevIdx] = true;
+                const Member& prev = prevMembers[prevIdx];
+                if ((prev.valLen == cur.valLen) && (memcmp(prev.pVal, cur.pVal, cur.valLen) == 0))
+                    continue;
+
+                // Compare nested objects member by member
+                if ((maxDepth > 1) && (*prev.pVal == '{') && (*cur.pVal == '{'))
+                {
+                    std::string nested;
+                    if (getChangedMembers(prev.pVal, prev.valLen, cur.pVal, cur.valLen, maxDepth - 1, nested))
+                    {
+                        if (nested.empty())
+                            continue;
+                        appendSep(out, isFirst);
+                        out.append(cur.pKey, cur.keyLen);
+                        out += ":{";
+                        out += nested;
+                        out += "}";
+                        continue;
+                    }
+                }
+            }
+            appendSep(out, isFirst);
+            out.append(cur.pKey, cur.keyLen);
+            out += ":";
+            out.append(cur.pVal, cur.valLen);
+        }
+
+        // Removed members
+        for (uint32_t prevIdx = 0; prevIdx < prevMembers.size(); prevIdx++)
+        {
+            if (prevMatched[prevIdx])
+                continue;
+            appendSep(out, isFirst);
+            out.append(prevMembers[prevIdx].pKey, prevMembers[prevIdx].keyLen);
+            out += ":null";
+        }
+        return true;
+    }
+
+private:
+    // Member of an object (key includes the quotes)
+    struct Member
+    {
+        const char* pKey = nullptr;
+        uint32_t keyLen = 0;
+        const char* pVal = nullptr;
+        uint32_t valLen = 0;
+    };
+
+    // Find a member with the same key (checking the hint position first)
+    static int32_t findMember(const std::vector<Member>& members, const Member& toFind, uint32_t hintIdx)
+    {
+        for (uint32_t i = 0; i < members.size(); i++)
+        {
+            uint32_t idx = (hintIdx + i) % members.size();
+            if ((members[idx].keyLen == toFind.keyLen) && (memcmp(members[idx].pKey, toFind.pKey, toFind.keyLen) == 0))
+                return idx;
+        }
+        return -1;
+    }
+
+    // Split an object into members
+    static bool getMembers(const char* p, const char* pEnd, std::vector<Member>& members)
+    {
+        p = skipSpace(p, pEnd);
+        if ((p >= pEnd) || (*p != '{'))
+            return false;
+        p = skipSpace(p + 1, pEnd);
+        if ((p < pEnd) && (*p == '}'))
+            return true;
+        while (p < pEnd)
+        {
+            Member member;
+            member.pKey = p;
+            const char* pKeyEnd = (*p == '"') ? skipString(p, pEnd) : nullptr;
+            if (!pKeyEnd)
+                return false;
+            member.keyLen = pKeyEnd - p;
+            p = skipSpace(pKeyEnd, pEnd);
+            if ((p >= pEnd) || (*p != ':'))
+                return false;
+            p = skipSpace(p + 1, pEnd);
+            const char* pValEnd = skipValue(p, pEnd);
+            if (!pValEnd || (pValEnd == p))
+                return false;
+            member.pVal = p;
+            member.valLen = pValEnd - p;
+            members.push_back(member);
+            p = skipSpace(pValEnd, pEnd);
+            if ((p < pEnd) && (*p == '}'))
+                return true;
+            if ((p >= pEnd) || (*p != ','))
+                return false;
+            p = skipSpace(p + 1, pEnd);
+        }
+        return false;
+    }
+
+    // Skip whitespace
+    static const char* skipSpace(const char* p, const char* pEnd)
+    {
+        while ((p < pEnd) && ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')))
+            p++;
+        return p;
+    }
+
+    // Skip a string (starting at the opening quote) - returns nullptr if unterminated
+    static const char* skipString(const char* p, const char* pEnd)
+    {
+        for (p++; p < pEnd; p++)
+        {
+            if (*p == '\\')
+                p++;
+            else if (*p == '"')
+                return p + 1;
+        }
+        return nullptr;
+    }
+
+    // Skip a value - returns nullptr if invalid
+    static const char* skipValue(const char* p, const char* pEnd)
+    {
+        if (p >= pEnd)
+            return nullptr;
+        if (*p == '"')
+            return skipString(p, pEnd);
+        if ((*p == '{') || (*p == '['))
+        {
+            int32_t depth = 0;
+            while (p < pEnd)
+            {
+                if (*p == '"')
+                {
+                    p = skipString(p, pEnd);
+                    if (!p)
+                        return nullptr;
+                    continue;
+                }
+                if ((*p == '{') || (*p == '['))
+                    depth++;
+                else if (((*p == '}') || (*p == ']')) && (--depth == 0))
+                    return p + 1;
+                p++;
+            }
+            return nullptr;
+        }
+        while ((p < pEnd) && (*p != ',') && (*p != '}') && (*p != ']') && (*p != ' ') && (*p != '\r') && (*p != '\n') && (*p != '\t'))
+            p++;
+        return p;
+    }
+
+    // Append separator
+    static void appendSep(std::string& out, bool& isFirst)
+    {
+        if (!isFirst)
+            out += ",";
+        isFirst = false;
+    }
+};
@@ -7,6 +7,7 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "StatePublisher.h"
+#include "SysModTiming.h"
 #include "Logger.h"
 #include "RaftArduino.h"
 #include "RaftUtils.h"
@@ -14,6 +15,9 @@
 #include "CommsChannelMsg.h"
 #include "RestAPIEndpointManager.h"
 #include "RaftJson.h"
+#include "JSONDelta.h"
+#include <algorithm>
+#include <string.h>
 
 // Debug
 // #define DEBUG_PUBLISHING_HANDLE
@@ -32,6 +36,7 @@
 // Debug
 #ifdef DEBUG_ONLY_THIS_ROSTOPIC
 #include <algorithm>
+#include <string.h>
 #endif
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -41,6 +46,9 @@
 StatePublisher::StatePublisher(const char* pModuleName, RaftJsonIF& sysConfig)
         : RaftSysMod(pModuleName, sysConfig)
 {
+    // Interface and protocol name ID 0 is the empty name (any interface or protocol)
+    _ifNames.intern("");
+
 #ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
     _debugLastShowPerfTimeMs = 0;
     _debugSlowestPublishUs = 0;
@@ -70,17 +78,30 @@ void StatePublisher::setup()
         return;
     }
 
-    // Iterate over pubList
-    for (int pubIdx = 0; pubIdx < pubList.size(); pubIdx++)
+    // Only publications with interfaces are used
+    std::vector<RaftJson> pubInfos;
+    for (const String& pubStr : pubList)
     {
-        // Get the publication info
-        RaftJson pubInfo = pubList[pubIdx];
+        RaftJson pubInfo = pubStr;
+        int numInterfaces = 0;
+        RaftJson interfacesJson = pubInfo.getString("ifs", pubInfo.getString("rates", "").c_str());
+        if (interfacesJson.getType("", numInterfaces) == RaftJson::RAFT_JSON_ARRAY)
+            pubInfos.push_back(pubInfo);
+    }
 
-        // Create pubrec
-        PubRec pubRec;
+    // Create the publication records in place (they hold atomic flags so can't be moved)
+    std::vector<PubRec>(pubInfos.size()).swap(_publicationRecs);
+
+    // Iterate over publications
+    for (uint32_t pubIdx = 0; pubIdx < pubInfos.size(); pubIdx++)
+    {
+        // Get the publication info
+        RaftJson& pubInfo = pubInfos[pubIdx];
+        PubRec& pubRec = _publicationRecs[pubIdx];
 
         // Get settings
-        pubRec._pubTopic = pubInfo.getString("topic", pubInfo.getString("name", "").c_str());
+        pubRec._topicID = _topicNames.intern(pubInfo.getString("topic", pubInfo.getString("name", "").c_str()).c_str());
+        pubRec._topicIdx = pubIdx;
         pubRec._trigger = TRIGGER_NONE;
         String triggerStr = pubInfo.getString("trigger", "timeorchange");
         triggerStr.toLowerCase();
@@ -98,43 +119,49 @@ void StatePublisher::setup()
 
         RaftJson interfacesJson = pubInfo.getString("ifs", pubInfo.getString("rates", "").c_str());
 
-        // Check for interfaces
+        // Iterate interfaces
         int numInterfaces = 0;
-        if (interfacesJson.getType("", numInterfaces) == RaftJson::RAFT_JSON_ARRAY)
+        interfacesJson.getType("", numInterfaces);
+        pubRec._interfaceRecs.reserve(numInterfaces);
+        for (int rateIdx = 0; rateIdx < numInterfaces; rateIdx++)
         {
-            // Iterate interfaces
-            for (int rateIdx = 0; rateIdx < numInterfaces; rateIdx++)
-            {
-                // Get the interface info
-                RaftJson interfaceInfo = interfacesJson.getString(("["+String(rateIdx)+"]").c_str(), "{}");
-                String interface = interfaceInfo.getString("if", "");
-                String protocol = interfaceInfo.getString("protocol", "");
-                double rateHz = interfaceInfo.getDouble("rateHz", 1.0);
-
-                // Add to list
-                PubInterfaceRec ifRec;
-                ifRec._interface = interface;
-                ifRec._protocol = protocol;
-                ifRec.setRateHz(rateHz);
-                ifRec._lastPublishMs = millis();
-                ifRec._isPersistent = true;
-                ifRec._isSuppressed = false;
-                pubRec._interfaceRecs.push_back(ifRec);
-
-                // Debug
+            // Get the interface info
+            RaftJson interfaceInfo = interfacesJson.getString(("["+String(rateIdx)+"]").c_str(), "{}");
+            String interface = interfaceInfo.getString("if", "");
+            String protocol = interfaceInfo.getString("protocol", "");
+            double rateHz = interfaceInfo.getDouble("rateHz", 1.0);
+
+            // Add to list
+            PubInterfaceRec ifRec;
+            ifRec._interfaceID = _ifNames.intern(interface.c_str());
+            ifRec._protocolID = _ifNames.intern(protocol.c_str());
+            ifRec.setRateHz(rateHz);
+            ifRec._lastPublishMs = millis();
+            ifRec._isPersistent = true;
+            ifRec._isSuppressed = false;
+            ifRec._isBundled = interfaceInfo.getBool("bundle", false);
+            pubRec._interfaceRecs.push_back(ifRec);
+
+            // Debug
 #ifdef DEBUG_STATE_PUBLISHER_SETUP
-                LOG_I(MODULE_PREFIX, "setup publishIF %s rateHz %.1f msBetween %d topic %s protocol %s", interface.c_str(),
-                                rateHz, ifRec._betweenPubsMs, pubRec._pubTopic.c_str(), ifRec._protocol.c_str());
+            LOG_I(MODULE_PREFIX, "setup publishIF %s rateHz %.1f msBetween %d topic %s protocol %s", interface.c_str(),
+                            rateHz, ifRec._betweenPubsMs, getTopic(pubRec).c_str(), protocol.c_str());
 #endif
-            }
-
-            // Add to the list of publication records
-            _publicationRecs.push_back(pubRec);
         }
     }
 
+    // Deadline scheduling
+    _deadlineSched = configGetBool("deadlineSched", false);
+    _adaptiveRate = configGetBool("adaptiveRate", true);
+    _bundleMaxBytes = configGetLong("bundleMaxBytes", BUNDLE_MAX_BYTES_DEFAULT);
+    if (_bundleMaxBytes > UINT16_MAX)
+        _bundleMaxBytes = UINT16_MAX;
+    _schedReducedRate = false;
+    rebuildSchedule();
+
     // Debug
-    LOG_I(MODULE_PREFIX, "setup num publication recs %d", _publicationRecs.size());
+    LOG_I(MODULE_PREFIX, "setup num publication recs %d deadlineSched %d adaptiveRate %d", 
+                _publicationRecs.size(), _deadlineSched, _adaptiveRate);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -143,6 +170,8 @@ void StatePublisher::setup()
 
 void StatePublisher::loop()
 {
+    SYSMOD_TIMED_LOOP();
+
     // Check valid
     if (!getCommsCore())
         return;
@@ -150,14 +179,25 @@ void StatePublisher::loop()
     // Check if publishing rate is to be throttled back
     bool reducePublishingRate = isSystemMainFWUpdate() || isSystemFileTransferring();
 
+    // Messages generated are only reused within a loop pass
+    _loopCount++;
+
+    // State changes signalled by data sources
+    if (_anyStateChangeSignalled.load())
+        serviceSignalledStateChanges(reducePublishingRate);
+
+    // Deadline scheduling only services records which are due
+    if (_deadlineSched)
+    {
+        loopDeadlineSched(reducePublishingRate);
+        sendBundles();
+        return;
+    }
+
     // Check through publishers
     for (PubRec& pubRec : _publicationRecs)
     {
-#ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
-        uint64_t getStateHashUs = 0;
-#endif
-
-        // Check for state change detection callback
+        // Check for state change
         bool publishDueToStateChange = false;
         if (pubRec._stateDetectFn)
         {
@@ -168,161 +208,365 @@ void StatePublisher::loop()
             if (Raft::isTimeout(millis(), pubRec._lastHashCheckMs, pubRec._minStateChangeMs))
 #endif
             {
-                // Last hash check time
-                pubRec._lastHashCheckMs = millis();
+                publishDueToStateChange = checkStateChange(pubRec);
+            }
+        }
 
+        // And each interface
+        for (PubInterfaceRec& rateRec : pubRec._interfaceRecs)
+            serviceInterface(pubRec, rateRec, publishDueToStateChange, reducePublishingRate);
+    }
+
+    // Send messages for bundled interfaces
+    sendBundles();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check for state change using the state detect callback
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool StatePublisher::checkStateChange(PubRec& pubRec)
+{
 #ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
-                uint64_t startUs = micros();
+    uint64_t getStateHashUs = 0;
 #endif
 
-                // Callback function generates a hash in the form of a std::vector<uint8_t>
-                // If this is not identical to previously returned hash then force message generation
-                std::vector<uint8_t> newStateHash;
-                pubRec._stateDetectFn(pubRec._pubTopic.c_str(), newStateHash);
+    // Last hash check time
+    pubRec._lastHashCheckMs = millis();
 
 #ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
-                getStateHashUs = micros() - startUs;
-                if (_debugSlowestGetHashUs < getStateHashUs)
-                    _debugSlowestGetHashUs = getStateHashUs;
+    uint64_t startUs = micros();
+#endif
+
+    // Callback function generates a hash in the form of a std::vector<uint8_t>
+    // If this is not identical to previously returned hash then force message generation
+    std::vector<uint8_t>& newStateHash = _stateHashScratch;
+    newStateHash.clear();
+    uint64_t detectStartUs = micros();
+    pubRec._stateDetectFn(getTopic(pubRec).c_str(), newStateHash);
+    pubRec._detectStats.add(micros() - detectStartUs);
+
+    // Hashes longer than the inline store are folded (FNV-1a 64 bit)
+    uint8_t foldedHash[sizeof(uint64_t)];
+    const uint8_t* pNewHash = newStateHash.data();
+    uint32_t newHashLen = newStateHash.size();
+    if (newHashLen > STATE_HASH_MAX_LEN)
+    {
+        uint64_t hashVal = 0xcbf29ce484222325ull;
+        for (uint8_t hashByte : newStateHash)
+            hashVal = (hashVal ^ hashByte) * 0x100000001b3ull;
+        memcpy(foldedHash, &hashVal, sizeof(foldedHash));
+        pNewHash = foldedHash;
+        newHashLen = sizeof(foldedHash);
+    }
+
+#ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
+    getStateHashUs = micros() - startUs;
+    if (_debugSlowestGetHashUs < getStateHashUs)
+        _debugSlowestGetHashUs = getStateHashUs;
 #endif
 
 #ifdef DEBUG_PUBLISHING_HASH
 #ifdef DEBUG_ONLY_THIS_TOPIC
-                if (pubRec._pubTopic.equals(DEBUG_ONLY_THIS_TOPIC))
-                {
+    if (getTopic(pubRec).equals(DEBUG_ONLY_THIS_TOPIC))
+    {
 #endif
-                    String curHashStr;
-                    Raft::getHexStrFromBytes(pubRec._stateHash.data(), pubRec._stateHash.size(), curHashStr);
-                    String newHashStr;
-                    Raft::getHexStrFromBytes(newStateHash.data(), newStateHash.size(), newHashStr);
-                    LOG_I(MODULE_PREFIX, "loop check hash for topic %s curHash %s newHash %s", 
-                                    pubRec._pubTopic.c_str(), curHashStr.c_str(), newHashStr.c_str());
+        String curHashStr;
+        Raft::getHexStrFromBytes(pubRec._stateHash, pubRec._stateHashLen, curHashStr);
+        String newHashStr;
+        Raft::getHexStrFromBytes(pNewHash, newHashLen, newHashStr);
+        LOG_I(MODULE_PREFIX, "loop check hash for topic %s curHash %s newHash %s", 
+                        getTopic(pubRec).c_str(), curHashStr.c_str(), newHashStr.c_str());
 #ifdef DEBUG_ONLY_THIS_TOPIC
-                }
+    }
 #endif
 #endif
 
-                // Check hash value
-                if(pubRec._stateHash != newStateHash)
-                {
-                    publishDueToStateChange = true;
-                    pubRec._stateHash = newStateHash;
+    // Check hash value
+    if ((pubRec._stateHashLen == newHashLen) && (memcmp(pubRec._stateHash, pNewHash, newHashLen) == 0))
+        return false;
+    memcpy(pubRec._stateHash, pNewHash, newHashLen);
+    pubRec._stateHashLen = newHashLen;
 #ifdef DEBUG_FORCE_GENERATION_OF_PUBLISH_MSGS
-                    LOG_I(MODULE_PREFIX, "Force generation on state change for topic %s", pubRec._pubTopic.c_str());
+    LOG_I(MODULE_PREFIX, "Force generation on state change for topic %s", getTopic(pubRec).c_str());
 #endif
-                }
-            }
-        }
+    return true;
+}
 
-        // And each interface
-        for (PubInterfaceRec& rateRec : pubRec._interfaceRecs)
-        {
-            // Check if interface is suppressed
-            if (rateRec._isSuppressed)
-                continue;
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service an interface of a publication record (publishes if due or pending)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void StatePublisher::serviceInterface(PubRec& pubRec, PubInterfaceRec& rateRec, bool publishDueToStateChange, bool reducePublishingRate)
+{
+    // Check if interface is suppressed
+    if (rateRec._isSuppressed)
+        return;
 
-            // Check for time to publish
-            bool publishTime = (rateRec._rateHz != 0) && Raft::isTimeout(millis(), rateRec._lastPublishMs, 
-                                    reducePublishingRate ? REDUCED_PUB_RATE_WHEN_BUSY_MS : rateRec._betweenPubsMs);
+    // Check for time to publish
+    bool publishTime = (rateRec._rateHz != 0) && Raft::isTimeout(millis(), rateRec._lastPublishMs, 
+                            reducePublishingRate ? REDUCED_PUB_RATE_WHEN_BUSY_MS : rateRec.getBetweenPubsMs());
 
 #ifdef DEBUG_PUBLISHING_REASON
-            const char* ifStr = rateRec._interface.length() == 0 ? "<ALL>" : rateRec._interface.c_str();
-            if (publishDueToStateChange)
-            {
-                LOG_I(MODULE_PREFIX, "loop publish due to state change for topic %s i/f %s", pubRec._pubTopic.c_str(), ifStr);
-            }
-            else if (publishTime)
-            {
-                LOG_I(MODULE_PREFIX, "loop publish due to timeout for topic %s i/f %s", pubRec._pubTopic.c_str(), ifStr);
-            }
-            else if (rateRec._isPending)
-            {
-                LOG_I(MODULE_PREFIX, "loop publish pending for topic %s i/f %s", pubRec._pubTopic.c_str(), ifStr);
-            }
+    const char* ifStr = _ifNames.getName(rateRec._interfaceID).length() == 0 ? "<ALL>" : _ifNames.getName(rateRec._interfaceID).c_str();
+    if (publishDueToStateChange)
+    {
+        LOG_I(MODULE_PREFIX, "loop publish due to state change for topic %s i/f %s", getTopic(pubRec).c_str(), ifStr);
+    }
+    else if (publishTime)
+    {
+        LOG_I(MODULE_PREFIX, "loop publish due to timeout for topic %s i/f %s", getTopic(pubRec).c_str(), ifStr);
+    }
+    else if (rateRec._isPending)
+    {
+        LOG_I(MODULE_PREFIX, "loop publish pending for topic %s i/f %s", getTopic(pubRec).c_str(), ifStr);
+    }
 #endif
-            // Check for publish required
-            if (publishDueToStateChange || publishTime || rateRec._isPending)
-            {
-                // Publish is pending
-                rateRec._isPending = true;
+    // Check for publish required
+    if (publishDueToStateChange || publishTime || rateRec._isPending)
+    {
+        // Publish is pending
+        rateRec.setPending(millis());
 
-                // Check if channelID is defined
-                if (rateRec._channelID == PUBLISHING_HANDLE_UNDEFINED)
-                {
-                    // Get a match of interface and protocol
-                    rateRec._channelID = getCommsCore()->getChannelIDByName(rateRec._interface, rateRec._protocol);
+        // Check if channelID is defined
+        if (rateRec._channelID == PUBLISHING_HANDLE_UNDEFINED)
+        {
+            // Get a match of interface and protocol
+            rateRec._channelID = resolveChannelID(rateRec._interfaceID, rateRec._protocolID);
 
 #ifdef DEBUG_PUBLISHING_HANDLE
-                    // Debug
-                    LOG_I(MODULE_PREFIX, "Got channelID %d for topic %s i/f %s protocol %s", rateRec._channelID, pubRec._pubTopic.c_str(),
-                            rateRec._interface.length() == 0 ? "<ALL>" : rateRec._interface.c_str(), 
-                            rateRec._protocol.c_str());
+            // Debug
+            LOG_I(MODULE_PREFIX, "Got channelID %d for topic %s i/f %s protocol %s", rateRec._channelID, getTopic(pubRec).c_str(),
+                    _ifNames.getName(rateRec._interfaceID).length() == 0 ? "<ALL>" : _ifNames.getName(rateRec._interfaceID).c_str(), 
+                    _ifNames.getName(rateRec._protocolID).c_str());
 #endif
 
-                    // Still undefined?
-                    if (rateRec._channelID == PUBLISHING_HANDLE_UNDEFINED)
-                        continue;
-                }
+            // Still undefined?
+            if (rateRec._channelID == PUBLISHING_HANDLE_UNDEFINED)
+                return;
+        }
 
-                // Check if interface can accept messages
-                bool noConn = false;
-                if (getCommsCore()->outboundCanAccept(rateRec._channelID, MSG_TYPE_PUBLISH, noConn))
-                {
+        // Check if interface can accept messages
+        bool noConn = false;
+        if (getCommsCore()->outboundCanAccept(rateRec._channelID, MSG_TYPE_PUBLISH, noConn))
+        {
 
 #ifdef DEBUG_REDUCED_PUBLISHING_RATE_WHEN_BUSY
-                    if (reducePublishingRate)
-                    {
-                        LOG_I(MODULE_PREFIX, "loop publishing rate reduced for channel %d", rateRec._channelID);
-                    }
+            if (reducePublishingRate)
+            {
+                LOG_I(MODULE_PREFIX, "loop publishing rate reduced for channel %d", rateRec._channelID);
+            }
 #endif
 
 #ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
-                    uint64_t startUs = micros();
+            uint64_t startUs = micros();
 #endif
 
-                    CommsCoreRetCode publishRetc = publishData(pubRec, rateRec);
+            CommsCoreRetCode publishRetc = publishData(pubRec, rateRec);
 
 #ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
-                    uint64_t elapUs = micros() - startUs;
-                    if (_debugSlowestPublishUs < elapUs)
-                        _debugSlowestPublishUs = elapUs;
-                    if (Raft::isTimeout(millis(), _debugLastShowPerfTimeMs, 1000))
-                    {
-                        LOG_I(MODULE_PREFIX, "loop slowest publish %lld slowest stateHash %lld", 
-                                    _debugSlowestPublishUs, _debugSlowestGetHashUs);
-                        _debugSlowestPublishUs = 0;
-                        _debugSlowestGetHashUs = 0;
-                        _debugLastShowPerfTimeMs = millis();
-                    }
+            uint64_t elapUs = micros() - startUs;
+            if (_debugSlowestPublishUs < elapUs)
+                _debugSlowestPublishUs = elapUs;
+            if (Raft::isTimeout(millis(), _debugLastShowPerfTimeMs, 1000))
+            {
+                LOG_I(MODULE_PREFIX, "loop slowest publish %lld slowest stateHash %lld", 
+                            _debugSlowestPublishUs, _debugSlowestGetHashUs);
+                _debugSlowestPublishUs = 0;
+                _debugSlowestGetHashUs = 0;
+                _debugLastShowPerfTimeMs = millis();
+            }
 #endif
 
-                    // Check for no connection
-                    if (publishRetc == COMMS_CORE_RET_NO_CONN)
-                    {
-                        noConn = true;
-                    }
-                    // Publish no longer pending (whether successful or not)
-                    rateRec._isPending = false;
-                    rateRec._lastPublishMs = millis();
-                }
-                else
-                {
+            // Check for no connection
+            if (publishRetc == COMMS_CORE_RET_NO_CONN)
+            {
+                noConn = true;
+            }
+            else if (_adaptiveRate && (publishRetc == COMMS_CORE_RET_OK))
+            {
+                rateRec.adaptiveAccepted(millis());
+            }
+            if (publishRetc == COMMS_CORE_RET_OK)
+                rateRec._sentCount++;
+            else
+                rateRec._failedCount++;
+
+            // Publish no longer pending (whether successful or not)
+            uint32_t pendingMs = millis() - rateRec._pendingStartMs;
+            rateRec._pendingTotalMs += pendingMs;
+            if (rateRec._pendingMaxMs < pendingMs)
+                rateRec._pendingMaxMs = pendingMs;
+            rateRec._isPending = false;
+            rateRec._lastPublishMs = millis();
+        }
+        else
+        {
 #ifdef DEBUG_NO_PUBLISH_IF_CANNOT_ACCEPT_OUTBOUND
-                    LOG_I(MODULE_PREFIX, "loop cannot accept outbound for channel %d noConn %d", rateRec._channelID, noConn);
+            LOG_I(MODULE_PREFIX, "loop cannot accept outbound for channel %d noConn %d", rateRec._channelID, noConn);
 #endif
-                }
+            // Channel is busy so back off
+            rateRec.setPendingRefused();
+            if (_adaptiveRate && !noConn)
+                rateRec.adaptiveRefused(millis());
+        }
 
-                // Check if there is no connection on this channel - if so then check if the rateRec is
-                // persistent and, if not, then suppress publishing this rateRec
-                if (noConn && !rateRec._isPersistent)
-                {
+        // Check if there is no connection on this channel - if so then check if the rateRec is
+        // persistent and, if not, then suppress publishing this rateRec
+        if (noConn && !rateRec._isPersistent)
+        {
 #ifdef DEBUG_PUBLISH_SUPPRESS_RESTART
-                    LOG_I(MODULE_PREFIX, "loop suppressing rateRec channelID %d", rateRec._channelID);
+            LOG_I(MODULE_PREFIX, "loop suppressing rateRec channelID %d", rateRec._channelID);
+#endif
+            rateRec._isSuppressed = true;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service state changes signalled by data sources (rate limited by minStateChangeMs)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void StatePublisher::serviceSignalledStateChanges(bool reducePublishingRate)
+{
+    _anyStateChangeSignalled = false;
+    for (PubRec& pubRec : _publicationRecs)
+    {
+        if (!pubRec._stateChangeSignalled.load())
+            continue;
+
+        // Leave signalled until the minimum time since the last signalled publish has passed
+        if (!Raft::isTimeout(millis(), pubRec._lastSignalledPublishMs, pubRec._minStateChangeMs))
+        {
+            _anyStateChangeSignalled = true;
+            continue;
+        }
+        pubRec._stateChangeSignalled = false;
+        pubRec._lastSignalledPublishMs = millis();
+
+#ifdef DEBUG_FORCE_GENERATION_OF_PUBLISH_MSGS
+        LOG_I(MODULE_PREFIX, "Force generation on signalled state change for topic %s", getTopic(pubRec).c_str());
 #endif
-                    rateRec._isSuppressed = true;
+
+        // Publish on each interface (deadline scheduling reschedules each interface for its next publish)
+        for (PubInterfaceRec& rateRec : pubRec._interfaceRecs)
+        {
+            serviceInterface(pubRec, rateRec, true, reducePublishingRate);
+            if (_deadlineSched)
+                scheduleInterface(pubRec, rateRec, millis());
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Deadline scheduling
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void StatePublisher::loopDeadlineSched(bool reducePublishingRate)
+{
+    // Intervals change when the publishing rate is reduced so reschedule
+    if (reducePublishingRate != _schedReducedRate)
+    {
+        _schedReducedRate = reducePublishingRate;
+        rebuildSchedule();
+    }
+
+    // Service entries which are due (bounded in case entries are rescheduled as due immediately)
+    uint32_t nowMs = millis();
+    uint32_t maxEntries = _schedHeap.size() * 2;
+    for (uint32_t i = 0; (i < maxEntries) && !_schedHeap.empty(); i++)
+    {
+        // Check if the earliest entry is due
+        if ((int32_t)(nowMs - _schedHeap.front().dueMs) < 0)
+            break;
+        std::pop_heap(_schedHeap.begin(), _schedHeap.end(), 
+                [](const SchedEntry& a, const SchedEntry& b) { return (int32_t)(a.dueMs - b.dueMs) > 0; });
+        SchedEntry entry = _schedHeap.back();
+        _schedHeap.pop_back();
+        PubRec& pubRec = *entry.pPubRec;
+
+        // State check
+        if (!entry.pIfRec)
+        {
+            if (entry.seq != pubRec._stateCheckSchedSeq)
+                continue;
+            if (pubRec._stateDetectFn && checkStateChange(pubRec))
+            {
+                // Publish on all interfaces now
+                for (PubInterfaceRec& rateRec : pubRec._interfaceRecs)
+                {
+                    if (rateRec._isSuppressed)
+                        continue;
+                    rateRec.setPending(nowMs);
+                    scheduleInterface(pubRec, rateRec, nowMs, true);
                 }
             }
+            scheduleStateCheck(pubRec, nowMs);
+            continue;
         }
+
+        // Interface publish
+        PubInterfaceRec& rateRec = *entry.pIfRec;
+        if (entry.seq != rateRec._schedSeq)
+            continue;
+        serviceInterface(pubRec, rateRec, false, reducePublishingRate);
+        scheduleInterface(pubRec, rateRec, millis());
+    }
+}
+
+void StatePublisher::scheduleInterface(PubRec& pubRec, PubInterfaceRec& rateRec, uint32_t nowMs, bool isImmediate)
+{
+    // Any existing entry becomes stale
+    rateRec._schedSeq++;
+    if (!_deadlineSched || rateRec._isSuppressed)
+        return;
+
+    // Pending publishes are retried soon, otherwise publish when the interval has elapsed (isTimeout
+    // requires the interval to be exceeded)
+    SchedEntry entry;
+    if (isImmediate)
+        entry.dueMs = nowMs;
+    else if (rateRec._isPending)
+        entry.dueMs = nowMs + PENDING_PUBLISH_RETRY_MS;
+    else if (rateRec._rateHz != 0)
+        entry.dueMs = rateRec._lastPublishMs + (_schedReducedRate ? REDUCED_PUB_RATE_WHEN_BUSY_MS : rateRec.getBetweenPubsMs()) + 1;
+    else
+        return;
+    entry.seq = rateRec._schedSeq;
+    entry.pPubRec = &pubRec;
+    entry.pIfRec = &rateRec;
+    pushSchedEntry(entry);
+}
+
+void StatePublisher::scheduleStateCheck(PubRec& pubRec, uint32_t nowMs)
+{
+    // Any existing entry becomes stale
+    pubRec._stateCheckSchedSeq++;
+    if (!_deadlineSched || !pubRec._stateDetectFn)
+        return;
+    SchedEntry entry;
+    entry.dueMs = pubRec._lastHashCheckMs + pubRec._minStateChangeMs + 1;
+    entry.seq = pubRec._stateCheckSchedSeq;
+    entry.pPubRec = &pubRec;
+    pushSchedEntry(entry);
+}
+
+void StatePublisher::pushSchedEntry(const SchedEntry& entry)
+{
+    _schedHeap.push_back(entry);
+    std::push_heap(_schedHeap.begin(), _schedHeap.end(), 
+            [](const SchedEntry& a, const SchedEntry& b) { return (int32_t)(a.dueMs - b.dueMs) > 0; });
+}
+
+void StatePublisher::rebuildSchedule()
+{
+    _schedHeap.clear();
+    uint32_t nowMs = millis();
+    for (PubRec& pubRec : _publicationRecs)
+    {
+        scheduleStateCheck(pubRec, nowMs);
+        for (PubInterfaceRec& rateRec : pubRec._interfaceRecs)
+            scheduleInterface(pubRec, rateRec, nowMs);
     }
 }
 
@@ -336,6 +580,11 @@ void StatePublisher::addRestAPIEndpoints(RestAPIEndpointManager& endpointManager
     endpointManager.addEndpoint("subscription", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
                 std::bind(&StatePublisher::apiSubscription, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
                 "Subscription to published messages, see docs for details");
+
+    // Publishing metrics
+    endpointManager.addEndpoint("pubstats", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
+                std::bind(&StatePublisher::apiPubStats, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                "Publishing metrics per topic and interface, pubstats/clear to reset");
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -344,27 +593,94 @@ void StatePublisher::addRestAPIEndpoints(RestAPIEndpointManager& endpointManager
 
 bool StatePublisher::registerDataSource(const char* pubTopic, SysMod_publishMsgGenFn msgGenCB, SysMod_stateDetectCB stateDetectCB)
 {
-    // Search for publication records using this pubTopic
-    bool found = false;
+    // Search for publication record using this pubTopic
+    PubRec* pPubRec = findPubRec(pubTopic);
+    if (!pPubRec)
+    {
+        LOG_W(MODULE_PREFIX, "registerDataSource msgGenFn not registered for topic %s", pubTopic);
+        return false;
+    }
+    LOG_I(MODULE_PREFIX, "registerDataSource registered msgGenFn for topic %s", pubTopic);
+    pPubRec->_msgGenFn = msgGenCB;
+    pPubRec->_stateDetectFn = stateDetectCB;
+    scheduleStateCheck(*pPubRec, millis());
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Signal state change (push path for data sources)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool StatePublisher::stateChanged(const char* pubTopic)
+{
+    // The publication records and topic names are only changed in setup() so can be searched from any task
+    PubRec* pPubRec = findPubRec(pubTopic);
+    if (!pPubRec)
+        return false;
+    pPubRec->_stateChangeSignalled = true;
+    _anyStateChangeSignalled = true;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Find publication record by topic name
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+StatePublisher::PubRec* StatePublisher::findPubRec(const char* pTopic)
+{
+    int32_t topicID = _topicNames.find(pTopic);
+    if (topicID == InternedNames::NAME_ID_NOT_FOUND)
+        return nullptr;
     for (PubRec& pubRec : _publicationRecs)
-    {   
-        // Check ID
-        if (pubRec._pubTopic.equals(pubTopic))
+    {
+        if (pubRec._topicID == topicID)
+            return &pubRec;
+    }
+    return nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Resolve channel ID from interface and protocol names (cached)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int32_t StatePublisher::resolveChannelID(uint16_t interfaceID, uint16_t protocolID)
+{
+    // Check cache
+    ChannelCacheEntry* pEntry = nullptr;
+    for (ChannelCacheEntry& entry : _channelCache)
+    {
+        if ((entry.interfaceID == interfaceID) && (entry.protocolID == protocolID))
         {
-            LOG_I(MODULE_PREFIX, "registerDataSource registered msgGenFn for topic %s", pubTopic);
-            pubRec._msgGenFn = msgGenCB;
-            pubRec._stateDetectFn = stateDetectCB;
-            found = true;
+            pEntry = &entry;
             break;
         }
     }
-
-    // Not found?
-    if (!found)
+    if (!pEntry)
     {
-        LOG_W(MODULE_PREFIX, "registerDataSource msgGenFn not registered for topic %s", pubTopic);
+        _channelCache.emplace_back();
+        pEntry = &_channelCache.back();
+        pEntry->interfaceID = interfaceID;
+        pEntry->protocolID = protocolID;
+    }
+    else if ((pEntry->channelID != PUBLISHING_HANDLE_UNDEFINED) || 
+                !Raft::isTimeout(millis(), pEntry->lastLookupMs, CHANNEL_LOOKUP_RETRY_MS))
+    {
+        return pEntry->channelID;
     }
-    return found;
+
+    // Lookup
+    pEntry->lastLookupMs = millis();
+    pEntry->channelID = getCommsCore()->getChannelIDByName(_ifNames.getName(interfaceID), _ifNames.getName(protocolID));
+    return pEntry->channelID;
+}
+
+RaftRetCode StatePublisher::receiveCmdJSON(const char* cmdJSON)
+{
+    RaftJson cmdInfo(cmdJSON);
+    String cmd = cmdInfo.getString("cmd", "");
+    if (!cmd.equalsIgnoreCase("stateChanged"))
+        return RAFT_INVALID_OPERATION;
+    return stateChanged(cmdInfo.getString("topic", "").c_str()) ? RAFT_OK : RAFT_INVALID_DATA;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -380,19 +696,40 @@ CommsCoreRetCode StatePublisher::publishData(StatePublisher::PubRec& pubRec, Pub
     // Endpoint message we're going to send
     CommsChannelMsg endpointMsg(rateRec._channelID, MSG_PROTOCOL_ROSSERIAL, 0, MSG_TYPE_PUBLISH);
 
-    // Generate message
+    // Check if the message for this topic has already been generated in this loop pass
     bool msgOk = false;
-    if (pubRec._msgGenFn)
+    if ((_msgCache.pPubRec == &pubRec) && (_msgCache.loopCount == _loopCount) && (_msgCache.protocolID == rateRec._protocolID))
     {
-        msgOk = pubRec._msgGenFn(pubRec._pubTopic.c_str(), endpointMsg);
+        endpointMsg = _msgCache.msg;
+        endpointMsg.setChannelID(rateRec._channelID);
+        msgOk = _msgCache.msgOk;
+        _msgGenSavedCount++;
+    }
+    else if (pubRec._msgGenFn)
+    {
+        // Generate message
+        uint64_t genStartUs = micros();
+        msgOk = pubRec._msgGenFn(getTopic(pubRec).c_str(), endpointMsg);
+        pubRec._genStats.add(micros() - genStartUs);
+        _msgGenCount++;
+
+        // Keep a copy if it may be sent on other interfaces
+        if (pubRec._interfaceRecs.size() > 1)
+        {
+            _msgCache.pPubRec = &pubRec;
+            _msgCache.loopCount = _loopCount;
+            _msgCache.protocolID = rateRec._protocolID;
+            _msgCache.msgOk = msgOk;
+            _msgCache.msg = endpointMsg;
+        }
     }
 
 #ifdef DEBUG_PUBLISHING_MESSAGE
 #ifdef DEBUG_ONLY_THIS_TOPIC
-    if (pubRec._pubTopic.equals(DEBUG_ONLY_THIS_TOPIC))
+    if (getTopic(pubRec).equals(DEBUG_ONLY_THIS_TOPIC))
 #endif
     {
-        LOG_I(MODULE_PREFIX, "publishData len %d topic %s %s", endpointMsg.getBufLen(), pubRec._pubTopic.c_str(), msgOk ? "msgGenOk" : "msgGenFail");
+        LOG_I(MODULE_PREFIX, "publishData len %d topic %s %s", endpointMsg.getBufLen(), getTopic(pubRec).c_str(), msgOk ? "msgGenOk" : "msgGenFail");
     }
 #endif
     if (!msgOk)
@@ -400,9 +737,15 @@ CommsCoreRetCode StatePublisher::publishData(StatePublisher::PubRec& pubRec, Pub
     if (endpointMsg.getBufLen() == 0)
         return COMMS_CORE_RET_FAIL;
 
+    // Delta publishing
+    std::string fullJSON;
+    bool isKeyframe = false;
+    if (rateRec._isDelta && !encodeDelta(rateRec, endpointMsg, fullJSON, isKeyframe))
+        return COMMS_CORE_RET_OK;
+
 #ifdef DEBUG_PUBLISHING_MESSAGE
 #ifdef DEBUG_ONLY_THIS_TOPIC
-    if (pubRec._pubTopic.equals(DEBUG_ONLY_THIS_TOPIC))
+    if (getTopic(pubRec).equals(DEBUG_ONLY_THIS_TOPIC))
 #endif
     {
         // Debug
@@ -415,17 +758,37 @@ CommsCoreRetCode StatePublisher::publishData(StatePublisher::PubRec& pubRec, Pub
         Raft::getHexStrFromBytes(endpointMsg.getBuf(), endpointMsg.getBufLen(), outStr);
 #endif
         LOG_I(MODULE_PREFIX, "publishData if %s channelID %d payloadLen %d payload %s", 
-                        rateRec._interface.length() == 0 ? "<ALL>" : rateRec._interface.c_str(), 
+                        _ifNames.getName(rateRec._interfaceID).length() == 0 ? "<ALL>" : _ifNames.getName(rateRec._interfaceID).c_str(), 
                         rateRec._channelID, endpointMsg.getBufLen(), outStr.c_str());
     }
 #endif
 
-    // Send message
-    CommsCoreRetCode retc = getCommsCore()->outboundHandleMsg(endpointMsg);
+    // Send message (or hold it to be bundled at the end of the loop pass)
+    rateRec._sizeHist.add(endpointMsg.getBufLen());
+    CommsCoreRetCode retc = COMMS_CORE_RET_OK;
+    if (rateRec._isBundled)
+    {
+        _bundleMsgs.emplace_back();
+        _bundleMsgs.back().channelID = rateRec._channelID;
+        _bundleMsgs.back().topicIdx = pubRec._topicIdx;
+        _bundleMsgs.back().msg = endpointMsg;
+    }
+    else
+    {
+        retc = getCommsCore()->outboundHandleMsg(endpointMsg);
+    }
+
+    // Later deltas are relative to the last message accepted for sending
+    if (rateRec._isDelta && (retc == COMMS_CORE_RET_OK))
+    {
+        rateRec._deltaBase.swap(fullJSON);
+        if (isKeyframe)
+            rateRec._lastKeyframeMs = millis();
+    }
 
 #ifdef DEBUG_PUBLISHING_MESSAGE
 #ifdef DEBUG_ONLY_THIS_TOPIC
-    if (pubRec._pubTopic.equals(DEBUG_ONLY_THIS_TOPIC))
+    if (getTopic(pubRec).equals(DEBUG_ONLY_THIS_TOPIC))
 #endif
     {
         // Debug
@@ -436,12 +799,139 @@ CommsCoreRetCode StatePublisher::publishData(StatePublisher::PubRec& pubRec, Pub
     return retc;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send bundles
+// Messages held for bundled interfaces are packed into frames by channel (and protocol) - a message which
+// ends up alone in a frame is sent unchanged
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void StatePublisher::sendBundles()
+{
+    if (_bundleMsgs.empty() || !getCommsCore())
+        return;
+    for (uint32_t firstIdx = 0; firstIdx < _bundleMsgs.size(); firstIdx++)
+    {
+        BundleMsg& firstMsg = _bundleMsgs[firstIdx];
+        if (firstMsg.isSent)
+            continue;
+
+        // Pack the messages for this channel which fit into the frame (others are left for the next frame)
+        uint32_t numInFrame = 0;
+        BundleMsg* pLastMsg = nullptr;
+        _bundleFrame.clear();
+        _bundleFrame.push_back(BUNDLE_FRAME_MARKER);
+        _bundleFrame.push_back(0);
+        for (uint32_t msgIdx = firstIdx; msgIdx < _bundleMsgs.size(); msgIdx++)
+        {
+            BundleMsg& bundleMsg = _bundleMsgs[msgIdx];
+            uint32_t msgLen = bundleMsg.msg.getBufLen();
+            if (bundleMsg.isSent || (bundleMsg.channelID != firstMsg.channelID) ||
+                        (bundleMsg.msg.getProtocol() != firstMsg.msg.getProtocol()) || (numInFrame >= UINT8_MAX))
+                continue;
+            if ((numInFrame > 0) && (_bundleFrame.size() + BUNDLE_ENTRY_HEADER_LEN + msgLen > _bundleMaxBytes))
+                continue;
+            _bundleFrame.push_back(bundleMsg.topicIdx);
+            _bundleFrame.push_back((msgLen >> 8) & 0xff);
+            _bundleFrame.push_back(msgLen & 0xff);
+            _bundleFrame.insert(_bundleFrame.end(), bundleMsg.msg.getBuf(), bundleMsg.msg.getBuf() + msgLen);
+            bundleMsg.isSent = true;
+            pLastMsg = &bundleMsg;
+            numInFrame++;
+        }
+
+        // Send alone or as a bundle (the first message is always in the frame and any which didn't fit
+        // start a later frame)
+        if (numInFrame == 1)
+        {
+            getCommsCore()->outboundHandleMsg(pLastMsg->msg);
+            continue;
+        }
+        _bundleFrame[1] = numInFrame;
+        CommsChannelMsg frameMsg(firstMsg.channelID, firstMsg.msg.getProtocol(), 0, MSG_TYPE_PUBLISH);
+        frameMsg.setFromBuffer(_bundleFrame.data(), _bundleFrame.size());
+        getCommsCore()->outboundHandleMsg(frameMsg);
+        _bundleFrameCount++;
+        _bundledMsgCount += numInFrame;
+    }
+    _bundleMsgs.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Encode delta
+// Replaces a JSON publish message with the members changed since the last message sent on the interface
+// (in the form {"_delta":1,...} with removed members set to null) unless a keyframe is due
+// Returns false if nothing has changed (so nothing need be sent)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool StatePublisher::encodeDelta(PubInterfaceRec& rateRec, CommsChannelMsg& msg, std::string& fullJSON, bool& isKeyframe)
+{
+    // Find the JSON object (the payload may start with a single byte element code and end with a terminator)
+    const char* pBuf = (const char*)msg.getBuf();
+    uint32_t bufLen = msg.getBufLen();
+    uint32_t prefixLen = (pBuf[0] == '{') ? 0 : 1;
+    uint32_t jsonEnd = bufLen;
+    while ((jsonEnd > prefixLen) && ((pBuf[jsonEnd-1] == 0) || (pBuf[jsonEnd-1] == ' ') || (pBuf[jsonEnd-1] == '\n')))
+        jsonEnd--;
+    isKeyframe = true;
+    if ((jsonEnd <= prefixLen) || (pBuf[prefixLen] != '{'))
+    {
+        // Not JSON so always sent in full
+        _keyframeCount++;
+        return true;
+    }
+    fullJSON.assign(pBuf + prefixLen, jsonEnd - prefixLen);
+
+    // Check for keyframe
+    if (rateRec._deltaBase.empty() ||
+            ((rateRec._keyframeMs != 0) && Raft::isTimeout(millis(), rateRec._lastKeyframeMs, rateRec._keyframeMs)))
+    {
+        _keyframeCount++;
+        return true;
+    }
+
+    // Get changed members
+    static const char DELTA_MARKER[] = R"("_delta":1)";
+    std::string delta = DELTA_MARKER;
+    if (!JSONDelta::getChangedMembers(rateRec._deltaBase.c_str(), rateRec._deltaBase.length(),
+                fullJSON.c_str(), fullJSON.length(), DELTA_MAX_DEPTH, delta))
+    {
+        _keyframeCount++;
+        return true;
+    }
+    if (delta.length() == sizeof(DELTA_MARKER) - 1)
+    {
+        _deltaNoChangeCount++;
+        return false;
+    }
+
+    // Send the full message if the delta isn't smaller
+    if (delta.length() + 2 >= fullJSON.length())
+    {
+        _keyframeCount++;
+        return true;
+    }
+
+    // Replace the message contents
+    std::string deltaMsg(pBuf, prefixLen);
+    deltaMsg += "{";
+    deltaMsg += delta;
+    deltaMsg += "}";
+    deltaMsg.append(pBuf + jsonEnd, bufLen - jsonEnd);
+    _deltaBytesSaved += bufLen - deltaMsg.length();
+    msg.setFromBuffer((const uint8_t*)deltaMsg.c_str(), deltaMsg.length());
+    isKeyframe = false;
+    _deltaCount++;
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Subscription
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
 {
+    SYSMOD_TIMED_API("subscription");
+
 #ifdef DEBUG_API_SUBSCRIPTION
     LOG_I(MODULE_PREFIX, "apiSubscription reqStr %s", reqStr.c_str());
 #endif
@@ -492,7 +982,10 @@ RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respSt
             // a single element if so
             String pubTopic = jsonParams.getString("topic", jsonParams.getString("name", "").c_str());
             double pubRateHz = jsonParams.getDouble("rateHz", 1.0);
-            String pubRec = R"({"topic":")" + pubTopic + R"(","rateHz":)" + String(pubRateHz) + R"(})";
+            String pubRec = R"({"topic":")" + pubTopic + R"(","rateHz":)" + String(pubRateHz) +
+                        R"(,"delta":)" + String(jsonParams.getBool("delta", false) ? 1 : 0) +
+                        R"(,"bundle":)" + String(jsonParams.getBool("bundle", false) ? 1 : 0) +
+                        R"(,"keyframeS":)" + String(jsonParams.getDouble("keyframeS", DELTA_KEYFRAME_MS_DEFAULT / 1000.0)) + R"(})";
             pubRecsToMod.push_back(pubRec);
         }
 
@@ -504,14 +997,20 @@ RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respSt
             String pubTopic = pubRecConf.getString("topic", pubRecConf.getString("name", "").c_str());
             double pubRateHz = pubRecConf.getDouble("rateHz", 1.0);
 
+            // Delta publishing (keyframe interval of 0 means keyframes only after subscribing)
+            bool isDelta = pubRecConf.getBool("delta", false);
+            bool isBundled = pubRecConf.getBool("bundle", false);
+            uint32_t keyframeMs = pubRecConf.getDouble("keyframeS", DELTA_KEYFRAME_MS_DEFAULT / 1000.0) * 1000;
+
             // Find the existing publication record to update
 #ifdef DEBUG_API_SUBSCRIPTION
             LOG_I(MODULE_PREFIX, "apiSubscription pubRec info %s", pubRecToMod.c_str());
 #endif
+            int32_t topicID = _topicNames.find(pubTopic.c_str());
             for (PubRec& pubRec : _publicationRecs)
             {
-                // Check name
-                if (!pubRec._pubTopic.equals(pubTopic))
+                // Check topic
+                if (pubRec._topicID != topicID)
                     continue;
 
                 // Update interface-rate record (if there is one)
@@ -522,9 +1021,9 @@ RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respSt
                     {
                         interfaceRecFound = true;
                         rateRec.setRateHz(pubRateHz);
-                        rateRec._isPending = true;
+                        rateRec.setPending(millis());
                         rateRec._lastPublishMs = millis();
-                        rateRec._interface = "Subscr_ch_" + String(channelID);
+                        rateRec._interfaceID = _ifNames.intern(("Subscr_ch_" + String(channelID)).c_str());
 #ifdef DEBUG_PUBLISH_SUPPRESS_RESTART
                         if (rateRec._isSuppressed)
                         {
@@ -532,6 +1031,9 @@ RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respSt
                         }   
 #endif                     
                         rateRec._isSuppressed = false;
+                        rateRec.setDelta(isDelta, keyframeMs);
+                        rateRec._isBundled = isBundled;
+                        scheduleInterface(pubRec, rateRec, millis(), true);
 #ifdef DEBUG_API_SUBSCRIPTION
                         LOG_I(MODULE_PREFIX, "apiSubscription updated rateRec channelID %d rateHz %.2f", channelID, pubRateHz);
 #endif
@@ -546,9 +1048,15 @@ RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respSt
                     ifRec._channelID = channelID;
                     ifRec.setRateHz(pubRateHz);
                     ifRec._lastPublishMs = millis();
-                    ifRec._isPending = true;
+                    ifRec.setPending(millis());
                     ifRec._isSuppressed = false;
+                    ifRec.setDelta(isDelta, keyframeMs);
+                    ifRec._isBundled = isBundled;
                     pubRec._interfaceRecs.push_back(ifRec);
+
+                    // Adding the record may have moved the others so reschedule them all
+                    rebuildSchedule();
+                    scheduleInterface(pubRec, pubRec._interfaceRecs.back(), millis(), true);
 #ifdef DEBUG_API_SUBSCRIPTION
                     LOG_I(MODULE_PREFIX, "apiSubscription created rateRec channelID %d rateHz %.2f", channelID, pubRateHz);
 #endif
@@ -557,7 +1065,82 @@ RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respSt
             }
         }
     }
-    return Raft::setJsonBoolResult(cmdName.c_str(), respStr, true);
+    // Respond with the rates of the subscriptions on this channel
+    String ratesJSON = R"("subs":)" + getInterfaceRatesJSON(channelID);
+    return Raft::setJsonResult(cmdName.c_str(), respStr, true, nullptr, ratesJSON.c_str());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Publishing metrics
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode StatePublisher::apiPubStats(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
+{
+    SYSMOD_TIMED_API("pubstats");
+
+    // Check for clear
+    String cmdName = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 0);
+    bool clearStats = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1).equalsIgnoreCase("clear");
+
+    // Metrics for each topic and its interfaces
+    String topicsJSON;
+    for (PubRec& pubRec : _publicationRecs)
+    {
+        String ifsJSON;
+        for (PubInterfaceRec& rateRec : pubRec._interfaceRecs)
+        {
+            char ifStr[200];
+            snprintf(ifStr, sizeof(ifStr), 
+                        R"({"if":"%s","ch":%d,"sent":%u,"refused":%u,"failed":%u,"pendTotMs":%u,"pendMaxMs":%u,"sizes":)",
+                        _ifNames.getName(rateRec._interfaceID).c_str(), (int)rateRec._channelID, (unsigned)rateRec._sentCount,
+                        (unsigned)rateRec._refusedCount, (unsigned)rateRec._failedCount,
+                        (unsigned)rateRec._pendingTotalMs, (unsigned)rateRec._pendingMaxMs);
+            if (ifsJSON.length() > 0)
+                ifsJSON += ",";
+            ifsJSON += ifStr;
+            ifsJSON += rateRec._sizeHist.getJSON() + "}";
+            if (clearStats)
+                rateRec.clearStats();
+        }
+        if (topicsJSON.length() > 0)
+            topicsJSON += ",";
+        topicsJSON += R"({"topic":")" + getTopic(pubRec) + R"(","gen":)" + pubRec._genStats.getJSON() + 
+                    R"(,"detect":)" + pubRec._detectStats.getJSON() + R"(,"ifs":[)" + ifsJSON + "]}";
+        if (clearStats)
+        {
+            pubRec._genStats.clear();
+            pubRec._detectStats.clear();
+        }
+    }
+    String statsJSON = R"("topics":[)" + topicsJSON + "]";
+    return Raft::setJsonResult(cmdName.c_str(), respStr, true, nullptr, statsJSON.c_str());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get JSON array of requested and effective publishing rates for the interfaces on a channel (or all)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String StatePublisher::getInterfaceRatesJSON(int32_t channelID) const
+{
+    String jsonStr;
+    for (const PubRec& pubRec : _publicationRecs)
+    {
+        for (const PubInterfaceRec& rateRec : pubRec._interfaceRecs)
+        {
+            if ((channelID != PUBLISHING_HANDLE_UNDEFINED) && (rateRec._channelID != channelID))
+                continue;
+            char rateStr[200];
+            snprintf(rateStr, sizeof(rateStr), 
+                        R"({"topic":"%s","idx":%d,"ch":%d,"reqHz":%.2f,"effHz":%.2f,"acc":%d,"ref":%d,"drainMs":%d,"delta":%d,"bundle":%d})",
+                        getTopic(pubRec).c_str(), (int)pubRec._topicIdx, (int)rateRec._channelID, rateRec._rateHz, rateRec.getEffRateHz(),
+                        (int)rateRec._sentCount, (int)rateRec._refusedCount, (int)rateRec._lastDrainMs,
+                        rateRec._isDelta ? 1 : 0, rateRec._isBundled ? 1 : 0);
+            if (jsonStr.length() > 0)
+                jsonStr += ",";
+            jsonStr += rateStr;
+        }
+    }
+    return "[" + jsonStr + "]";
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -566,4 +1149,7 @@ RaftRetCode StatePublisher::apiSubscription(const String &reqStr, String& respSt
 
 void StatePublisher::cleanUp()
 {
+    _schedHeap.clear();
+    _channelCache.clear();
+    _bundleMsgs.clear();
 }
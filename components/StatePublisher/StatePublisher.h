@@ -8,12 +8,16 @@
 
 #pragma once
 
-#include <list>
 #include <vector>
+#include <atomic>
+#include <string>
 #include "RaftArduino.h"
 #include "APISourceInfo.h"
 #include "RaftSysMod.h"
+#include "SysModTiming.h"
 #include "CommsCoreIF.h"
+#include "StatePublisherStats.h"
+#include "InternedNames.h"
 
 class RobotController;
 
@@ -35,9 +39,29 @@ public:
     // Subscription API
     RaftRetCode apiSubscription(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
 
+    // Publishing metrics API
+    RaftRetCode apiPubStats(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
+
     // Receive msg generator callback function
     virtual bool registerDataSource(const char* pubTopic, SysMod_publishMsgGenFn msgGenCB, SysMod_stateDetectCB stateDetectCB) override final;
 
+    // Signal that the state of a topic has changed (publishes on the next loop without waiting for the
+    // state detect callback to be polled) - can be called from any task
+    bool stateChanged(const char* pubTopic);
+
+    // Receive JSON command - {"cmd":"stateChanged","topic":"<topic>"} signals a state change
+    virtual RaftRetCode receiveCmdJSON(const char* cmdJSON) override final;
+
+    // Get debug info JSON
+    virtual String getDebugJSON() const override final
+    {
+        return R"({"msgGens":)" + String(_msgGenCount) + R"(,"msgGensSaved":)" + String(_msgGenSavedCount) +
+                R"(,"deltas":)" + String(_deltaCount) + R"(,"keyframes":)" + String(_keyframeCount) +
+                R"(,"deltaNoChg":)" + String(_deltaNoChangeCount) + R"(,"deltaSavedBytes":)" + String(_deltaBytesSaved) +
+                R"(,"bundles":)" + String(_bundleFrameCount) + R"(,"bundled":)" + String(_bundledMsgCount) +
+                R"(,"subs":)" + getInterfaceRatesJSON(PUBLISHING_HANDLE_UNDEFINED) + "}";
+    }
+
 protected:
     // Setup
     virtual void setup() override final;
@@ -65,6 +89,18 @@ private:
     static const int32_t PUBLISHING_HANDLE_UNDEFINED = -1;
     static const uint32_t REDUCED_PUB_RATE_WHEN_BUSY_MS = 1000;
     static const uint32_t MIN_MS_BETWEEN_STATE_CHANGE_PUBLISHES = 100;
+    static const uint32_t PENDING_PUBLISH_RETRY_MS = 5;
+    static const uint32_t STATE_HASH_MAX_LEN = 16;
+    static const uint32_t DELTA_KEYFRAME_MS_DEFAULT = 30000;
+    static const uint32_t DELTA_MAX_DEPTH = 3;
+    static const uint32_t AIMD_MIN_BACKOFF_MS = 10;
+    static const uint32_t AIMD_MAX_BETWEEN_PUBS_MS = 5000;
+    static constexpr double AIMD_INCREASE_FRACTION = 0.1;
+    static constexpr double AIMD_INCREASE_MIN_HZ = 0.1;
+    static const uint32_t BUNDLE_MAX_BYTES_DEFAULT = 500;
+    static const uint8_t BUNDLE_FRAME_MARKER = 0xbf;
+    static const uint32_t BUNDLE_FRAME_HEADER_LEN = 2;
+    static const uint32_t BUNDLE_ENTRY_HEADER_LEN = 3;
 
     class PubInterfaceRec
     {
@@ -82,9 +118,65 @@ private:
             // Fix between pubs ms as isTimout check has an average of 1ms more than requested
             if (_betweenPubsMs > 9)
                 _betweenPubsMs--;
+            _adaptiveBetweenPubsMs = 0;
+        }
+
+        // Interval between publishes allowing for the adaptive rate
+        uint32_t getBetweenPubsMs() const
+        {
+            return _adaptiveBetweenPubsMs > _betweenPubsMs ? _adaptiveBetweenPubsMs : _betweenPubsMs;
         }
-        String _interface;
-        String _protocol;
+
+        // Effective publishing rate
+        double getEffRateHz() const
+        {
+            uint32_t betweenPubsMs = getBetweenPubsMs();
+            if ((_rateHz == 0) || (betweenPubsMs <= _betweenPubsMs))
+                return _rateHz;
+            return 1000.0 / betweenPubsMs;
+        }
+
+        // Adaptive rate (AIMD) - the interval between publishes is doubled the first time a publish is refused
+        // by the channel and the rate is then increased additively for each publish accepted without refusal
+        // until the requested rate is reached - the interval is also kept above the time the channel took to
+        // drain enough to accept the last refused publish
+        void adaptiveRefused(uint32_t nowMs)
+        {
+            if (_isRefused)
+                return;
+            _isRefused = true;
+            _firstRefusedMs = nowMs;
+            uint32_t betweenPubsMs = getBetweenPubsMs();
+            if (betweenPubsMs < AIMD_MIN_BACKOFF_MS)
+                betweenPubsMs = AIMD_MIN_BACKOFF_MS;
+            betweenPubsMs *= 2;
+            _adaptiveBetweenPubsMs = betweenPubsMs > AIMD_MAX_BETWEEN_PUBS_MS ? AIMD_MAX_BETWEEN_PUBS_MS : betweenPubsMs;
+        }
+        void adaptiveAccepted(uint32_t nowMs)
+        {
+            if (_isRefused)
+            {
+                _isRefused = false;
+                _lastDrainMs = nowMs - _firstRefusedMs;
+                uint32_t drainMs = _lastDrainMs > AIMD_MAX_BETWEEN_PUBS_MS ? AIMD_MAX_BETWEEN_PUBS_MS : _lastDrainMs;
+                if (_adaptiveBetweenPubsMs < drainMs)
+                    _adaptiveBetweenPubsMs = drainMs;
+                return;
+            }
+            if (_adaptiveBetweenPubsMs <= _betweenPubsMs)
+            {
+                _adaptiveBetweenPubsMs = 0;
+                return;
+            }
+            double increaseHz = _rateHz * AIMD_INCREASE_FRACTION;
+            double rateHz = 1000.0 / _adaptiveBetweenPubsMs + (increaseHz < AIMD_INCREASE_MIN_HZ ? AIMD_INCREASE_MIN_HZ : increaseHz);
+            _adaptiveBetweenPubsMs = 1000 / rateHz;
+            if (_adaptiveBetweenPubsMs <= _betweenPubsMs)
+                _adaptiveBetweenPubsMs = 0;
+        }
+        // Interface and protocol names (IDs in the interface names table)
+        uint16_t _interfaceID = 0;
+        uint16_t _protocolID = 0;
         double _rateHz = 1.0;
         uint32_t _betweenPubsMs = 0;
         uint32_t _lastPublishMs = 0;
@@ -103,28 +195,186 @@ private:
         // Indicates that the criteria for publishing has been met but the publishing
         // event has not occurred due to the channel being busy, etc
         bool _isPending = false;
+
+        // Sequence number of the current schedule entry (older entries are stale)
+        uint32_t _schedSeq = 0;
+
+        // Adaptive rate state (interval of 0 when running at the requested rate) and stats
+        uint32_t _adaptiveBetweenPubsMs = 0;
+        bool _isRefused = false;
+        uint32_t _firstRefusedMs = 0;
+        uint32_t _lastDrainMs = 0;
+
+        // Metrics (a publish refused by the channel is counted once however many times it is retried)
+        uint32_t _sentCount = 0;
+        uint32_t _refusedCount = 0;
+        bool _isPendingRefused = false;
+        uint32_t _failedCount = 0;
+        uint32_t _pendingStartMs = 0;
+        uint32_t _pendingTotalMs = 0;
+        uint32_t _pendingMaxMs = 0;
+        PubSizeHist _sizeHist;
+        void setPending(uint32_t nowMs)
+        {
+            if (!_isPending)
+            {
+                _pendingStartMs = nowMs;
+                _isPendingRefused = false;
+            }
+            _isPending = true;
+        }
+        void setPendingRefused()
+        {
+            if (!_isPendingRefused)
+                _refusedCount++;
+            _isPendingRefused = true;
+        }
+        void clearStats()
+        {
+            _sentCount = 0;
+            _refusedCount = 0;
+            _failedCount = 0;
+            _pendingTotalMs = 0;
+            _pendingMaxMs = 0;
+            _sizeHist.clear();
+        }
+
+        // Bundling - messages for all topics due on the channel in a loop pass are sent in one frame
+        bool _isBundled = false;
+
+        // Delta publishing (opted into when subscribing) - only the JSON members which have changed since
+        // the last publish accepted for sending are sent, with a full keyframe after subscribing and at
+        // intervals to resync
+        bool _isDelta = false;
+        uint32_t _keyframeMs = DELTA_KEYFRAME_MS_DEFAULT;
+        uint32_t _lastKeyframeMs = 0;
+        std::string _deltaBase;
+        void setDelta(bool isDelta, uint32_t keyframeMs)
+        {
+            _isDelta = isDelta;
+            _keyframeMs = keyframeMs;
+            _deltaBase.clear();
+        }
     };
 
     // Publication records
     class PubRec
     {
     public:
-        // Name used to refer to this publication record in the API
-        String _pubTopic;
+        // Name used to refer to this publication record in the API (ID in the topic names table)
+        uint16_t _topicID = 0;
+        // Index used to refer to the topic in bundle frames
+        uint8_t _topicIdx = 0;
         TriggerType_t _trigger = TRIGGER_ON_TIME_INTERVALS;
         SysMod_publishMsgGenFn _msgGenFn = nullptr;
         SysMod_stateDetectCB _stateDetectFn = nullptr;;
         uint16_t _minStateChangeMs = MIN_MS_BETWEEN_STATE_CHANGE_PUBLISHES;
-        std::list<PubInterfaceRec> _interfaceRecs;
+        std::vector<PubInterfaceRec> _interfaceRecs;
         uint32_t _lastHashCheckMs = 0;
 
         // This is used by _stateDetectFn callback for state change
         // detection information - the state change is detected by
         // the comparing the returned value from the callback with
-        // the previous hash value
-        std::vector<uint8_t> _stateHash;
+        // the previous hash value (held inline - longer hashes are folded)
+        uint8_t _stateHash[STATE_HASH_MAX_LEN] = {};
+        uint8_t _stateHashLen = 0;
+
+        // Set when the data source signals a state change with stateChanged() (may be set from any task)
+        std::atomic<bool> _stateChangeSignalled = false;
+        uint32_t _lastSignalledPublishMs = 0;
+
+        // Sequence number of the current state check schedule entry
+        uint32_t _stateCheckSchedSeq = 0;
+
+        // Metrics for message generation and state detection
+        TimeStats _genStats;
+        TimeStats _detectStats;
+    };
+    // Publication records are created in setup() and held contiguously (the vector is never resized after
+    // setup so records can be referred to by pointer)
+    std::vector<PubRec> _publicationRecs;
+
+    // Interned names - topic names are only added in setup() so can be searched from any task, interface
+    // and protocol names (including those of dynamic subscriptions) are added in the main task
+    InternedNames _topicNames;
+    InternedNames _ifNames;
+    const String& getTopic(const PubRec& pubRec) const
+    {
+        return _topicNames.getName(pubRec._topicID);
+    }
+    PubRec* findPubRec(const char* pTopic);
+
+    // Channel IDs resolved from interface and protocol names (shared by records using the same names) -
+    // lookups which fail are retried at intervals rather than on every loop
+    struct ChannelCacheEntry
+    {
+        uint16_t interfaceID = 0;
+        uint16_t protocolID = 0;
+        int32_t channelID = PUBLISHING_HANDLE_UNDEFINED;
+        uint32_t lastLookupMs = 0;
+    };
+    std::vector<ChannelCacheEntry> _channelCache;
+    static const uint32_t CHANNEL_LOOKUP_RETRY_MS = 1000;
+    int32_t resolveChannelID(uint16_t interfaceID, uint16_t protocolID);
+
+    // Deadline scheduling - when enabled the interface publish times and state checks are held in a
+    // min-heap ordered by due time so loop() only services records which are due (otherwise every
+    // record is checked on every loop)
+    struct SchedEntry
+    {
+        uint32_t dueMs = 0;
+        uint32_t seq = 0;
+        PubRec* pPubRec = nullptr;
+        // nullptr for a state check
+        PubInterfaceRec* pIfRec = nullptr;
+    };
+    bool _deadlineSched = false;
+
+    // Adapt the publishing rate of each interface to the backpressure from its channel
+    bool _adaptiveRate = true;
+    std::atomic<bool> _anyStateChangeSignalled = false;
+
+    // Reused for the state detect callback to avoid allocating on each check
+    std::vector<uint8_t> _stateHashScratch;
+
+    // Message generated for a topic in the current loop pass - reused when the topic is due on
+    // several interfaces with the same protocol so the message is only generated once
+    struct MsgCache
+    {
+        const PubRec* pPubRec = nullptr;
+        uint32_t loopCount = 0;
+        uint16_t protocolID = 0;
+        bool msgOk = false;
+        CommsChannelMsg msg;
     };
-    std::list<PubRec> _publicationRecs;
+    MsgCache _msgCache;
+    uint32_t _loopCount = 0;
+    uint32_t _msgGenCount = 0;
+    uint32_t _msgGenSavedCount = 0;
+
+    // Messages for bundled interfaces waiting to be sent at the end of the loop pass - where several are
+    // for the same channel (and protocol) they are sent in a frame of the form:
+    // BUNDLE_FRAME_MARKER, numTopics, then for each topic: topicIdx, payloadLen (MSB first, 2 bytes), payload
+    struct BundleMsg
+    {
+        int32_t channelID = PUBLISHING_HANDLE_UNDEFINED;
+        uint8_t topicIdx = 0;
+        bool isSent = false;
+        CommsChannelMsg msg;
+    };
+    std::vector<BundleMsg> _bundleMsgs;
+    std::vector<uint8_t> _bundleFrame;
+    uint32_t _bundleMaxBytes = BUNDLE_MAX_BYTES_DEFAULT;
+    uint32_t _bundleFrameCount = 0;
+    uint32_t _bundledMsgCount = 0;
+
+    // Delta publishing stats
+    uint32_t _deltaCount = 0;
+    uint32_t _keyframeCount = 0;
+    uint32_t _deltaNoChangeCount = 0;
+    uint32_t _deltaBytesSaved = 0;
+    bool _schedReducedRate = false;
+    std::vector<SchedEntry> _schedHeap;
 
 #ifdef DEBUG_STATEPUB_OUTPUT_PUBLISH_STATS
     // Stats
@@ -136,6 +386,22 @@ private:
     // Helpers
     void cleanUp();
     CommsCoreRetCode publishData(PubRec& pubRec, PubInterfaceRec& rateRec);
+    String getInterfaceRatesJSON(int32_t channelID) const;
+    void sendBundles();
+    bool encodeDelta(PubInterfaceRec& rateRec, CommsChannelMsg& msg, std::string& fullJSON, bool& isKeyframe);
+    bool checkStateChange(PubRec& pubRec);
+    void serviceSignalledStateChanges(bool reducePublishingRate);
+    void serviceInterface(PubRec& pubRec, PubInterfaceRec& rateRec, bool publishDueToStateChange, bool reducePublishingRate);
+
+    // Deadline scheduling helpers
+    void loopDeadlineSched(bool reducePublishingRate);
+    void scheduleInterface(PubRec& pubRec, PubInterfaceRec& rateRec, uint32_t nowMs, bool isImmediate = false);
+    void scheduleStateCheck(PubRec& pubRec, uint32_t nowMs);
+    void pushSchedEntry(const SchedEntry& entry);
+    void rebuildSchedule();
+
+    // Loop timing (per instance)
+    SysModTiming::EntryRef _loopTiming;
 
     // Log prefix
     static constexpr const char *MODULE_PREFIX = "StatePub";
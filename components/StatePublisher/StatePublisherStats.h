@@ -0,0 +1,60 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// StatePublisherStats
+// Always-on publishing metrics - cheap enough to update on every publish (times are held in TimeStats)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "RaftArduino.h"
+#include "TimeStats.h"
+
+class PubSizeHist
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add a message size
+    /// @param len message length in bytes
+    void add(uint32_t len)
+    {
+        uint32_t bucketIdx = 0;
+        while ((bucketIdx < NUM_BUCKETS - 1) && (len >= (FIRST_BUCKET_LIMIT << bucketIdx)))
+            bucketIdx++;
+        _buckets[bucketIdx]++;
+        _totalBytes += len;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear
+    void clear()
+    {
+        *this = PubSizeHist();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get JSON
+    /// @return JSON object {"bytes":N,"hist":[<32,<64,<128,<256,<512,<1024,<2048,larger]}
+    String getJSON() const
+    {
+        String jsonStr = R"({"bytes":)" + String(_totalBytes) + R"(,"hist":[)";
+        for (uint32_t bucketIdx = 0; bucketIdx < NUM_BUCKETS; bucketIdx++)
+        {
+            if (bucketIdx != 0)
+                jsonStr += ",";
+            jsonStr += String(_buckets[bucketIdx]);
+        }
+        return jsonStr + "]}";
+    }
+
+private:
+    // Bucket N holds sizes < FIRST_BUCKET_LIMIT * 2^N (the last bucket holds everything larger)
+    static const uint32_t NUM_BUCKETS = 8;
+    static const uint32_t FIRST_BUCKET_LIMIT = 32;
+    uint32_t _buckets[NUM_BUCKETS] = {};
+    uint32_t _totalBytes = 0;
+};
@@ -0,0 +1,242 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SysModTiming
+// Timing of SysMod loop() calls and REST API handlers with a trace ring of recent slow calls
+//
+// Functions are instrumented with SYSMOD_TIMED_LOOP() or SYSMOD_TIMED_API("<endpoint>") as their first
+// statement - the time until the function returns is added to the stats for that name (count, min, avg,
+// p99 and max). Calls taking at least the trace threshold are also recorded in a fixed-size ring.
+//
+// SYSMOD_TIMED_LOOP() is named by modName() so the entry is held per instance - a SysMod using it has a
+// SysModTiming::EntryRef _loopTiming member. SYSMOD_TIMED_API() caches the entry in the function so takes
+// literal names only - SYSMOD_TIMED_API_REF(entryRef, name) is used for names which vary by instance.
+//
+// Stats are updated and read under the entries mutex (calls are timed from the loop and API tasks).
+//
+// Instrumentation is compiled in unless SYSMOD_TIMING_DISABLE is defined, in which case the macros are
+// empty, there is no sysModTiming instance and EntryRef is an empty type.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef SYSMOD_TIMING_DISABLE
+#define SYSMOD_TIMING_ENABLED
+#endif
+
+#ifdef SYSMOD_TIMING_ENABLED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <list>
+#include "RaftArduino.h"
+#include "RaftThreading.h"
+#include "TimeStats.h"
+
+class SysModTiming
+{
+public:
+    enum EntryType
+    {
+        TYPE_LOOP,
+        TYPE_API
+    };
+
+    class Entry
+    {
+    public:
+        Entry(EntryType type, const char* pName) : type(type), name(pName)
+        {
+        }
+        EntryType type;
+        String name;
+        TimeStats stats;
+    };
+
+    // Times a scope
+    class Scope
+    {
+    public:
+        Scope(Entry* pEntry) : _pEntry(pEntry), _startUs(micros())
+        {
+        }
+        ~Scope();
+    private:
+        Entry* _pEntry;
+        uint64_t _startUs;
+    };
+
+    // Entry for an instance (resolved on first use)
+    class EntryRef
+    {
+    public:
+        Entry* get(EntryType type, const char* pName);
+    private:
+        Entry* _pEntry = nullptr;
+    };
+
+    SysModTiming()
+    {
+        _entriesMutex = xSemaphoreCreateMutex();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get (or create) the entry for a name
+    /// @param type entry type
+    /// @param pName name (copied)
+    /// @return entry (valid for the lifetime of the program)
+    Entry* getEntry(EntryType type, const char* pName)
+    {
+        Entry* pEntry = nullptr;
+        if (xSemaphoreTake(_entriesMutex, portMAX_DELAY) != pdTRUE)
+            return nullptr;
+        for (Entry& entry : _entries)
+        {
+            if ((entry.type == type) && entry.name.equals(pName))
+                pEntry = &entry;
+        }
+        if (!pEntry)
+        {
+            _entries.emplace_back(type, pName);
+            pEntry = &_entries.back();
+        }
+        xSemaphoreGive(_entriesMutex);
+        return pEntry;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record a call
+    /// @param pEntry entry
+    /// @param us duration in microseconds
+    void record(Entry* pEntry, uint32_t us)
+    {
+        if (!pEntry || (xSemaphoreTake(_entriesMutex, portMAX_DELAY) != pdTRUE))
+            return;
+        pEntry->stats.add(us);
+        xSemaphoreGive(_entriesMutex);
+        if ((_traceSlowUs == 0) || (us < _traceSlowUs))
+            return;
+        TraceEvent& event = _trace[_traceCount.fetch_add(1) % TRACE_LEN];
+        event.timeMs = millis();
+        event.pEntry = pEntry;
+        event.us = us;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set the trace threshold
+    /// @param slowUs calls taking at least this long are traced (0 to disable the trace)
+    void setTraceThreshold(uint32_t slowUs)
+    {
+        _traceSlowUs = slowUs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get stats JSON
+    /// @param clear clear the stats after getting them
+    /// @return JSON members "loop":{"<name>":{stats},...},"api":{"<name>":{stats},...}
+    String getStatsJSON(bool clear)
+    {
+        String loopJSON;
+        String apiJSON;
+        if (xSemaphoreTake(_entriesMutex, portMAX_DELAY) == pdTRUE)
+        {
+            for (Entry& entry : _entries)
+            {
+                String& jsonStr = entry.type == TYPE_LOOP ? loopJSON : apiJSON;
+                if (jsonStr.length() > 0)
+                    jsonStr += ",";
+                jsonStr += "\"" + entry.name + "\":" + entry.stats.getJSON();
+                if (clear)
+                    entry.stats.clear();
+            }
+            xSemaphoreGive(_entriesMutex);
+        }
+        return R"("loop":{)" + loopJSON + R"(},"api":{)" + apiJSON + "}";
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get trace JSON (oldest first)
+    /// @param clear clear the trace after getting it
+    /// @return JSON members "slowUs":N,"trace":[{"t":ms,"type":"loop"|"api","name":"<name>","us":N},...]
+    String getTraceJSON(bool clear)
+    {
+        uint32_t traceCount = _traceCount;
+        uint32_t numEvents = traceCount < TRACE_LEN ? traceCount : TRACE_LEN;
+        String traceJSON;
+        for (uint32_t i = traceCount - numEvents; i != traceCount; i++)
+        {
+            const TraceEvent& event = _trace[i % TRACE_LEN];
+            if (!event.pEntry)
+                continue;
+            char eventStr[60];
+            snprintf(eventStr, sizeof(eventStr), R"(%s{"t":%u,"type":"%s","name":")", traceJSON.length() > 0 ? "," : "",
+                        (unsigned)event.timeMs, event.pEntry->type == TYPE_LOOP ? "loop" : "api");
+            traceJSON += eventStr + event.pEntry->name + R"(","us":)" + String(event.us) + "}";
+        }
+        if (clear)
+            _traceCount = 0;
+        return R"("slowUs":)" + String(_traceSlowUs) + R"(,"trace":[)" + traceJSON + "]";
+    }
+
+private:
+    // Entries
+    std::list<Entry> _entries;
+    SemaphoreHandle_t _entriesMutex = nullptr;
+
+    // Trace ring
+    class TraceEvent
+    {
+    public:
+        uint32_t timeMs = 0;
+        const Entry* pEntry = nullptr;
+        uint32_t us = 0;
+    };
+    static const uint32_t TRACE_LEN = 32;
+    TraceEvent _trace[TRACE_LEN];
+    std::atomic<uint32_t> _traceCount = 0;
+    uint32_t _traceSlowUs = 0;
+};
+
+// Timing for all SysMods
+inline SysModTiming sysModTiming;
+
+inline SysModTiming::Scope::~Scope()
+{
+    sysModTiming.record(_pEntry, micros() - _startUs);
+}
+
+inline SysModTiming::Entry* SysModTiming::EntryRef::get(EntryType type, const char* pName)
+{
+    if (!_pEntry)
+        _pEntry = sysModTiming.getEntry(type, pName);
+    return _pEntry;
+}
+
+#define SYSMOD_TIMED_SCOPE(type, name) \
+    static SysModTiming::Entry* _pSysModTimingEntry = sysModTiming.getEntry(type, name); \
+    SysModTiming::Scope _sysModTimingScope(_pSysModTimingEntry)
+#define SYSMOD_TIMED_SCOPE_REF(entryRef, type, name) \
+    SysModTiming::Scope _sysModTimingScope((entryRef).get(type, name))
+#define SYSMOD_TIMED_LOOP() SYSMOD_TIMED_SCOPE_REF(_loopTiming, SysModTiming::TYPE_LOOP, modName())
+#define SYSMOD_TIMED_API(name) SYSMOD_TIMED_SCOPE(SysModTiming::TYPE_API, name)
+#define SYSMOD_TIMED_API_REF(entryRef, name) SYSMOD_TIMED_SCOPE_REF(entryRef, SysModTiming::TYPE_API, name)
+
+#else
+
+// Timing compiled out - SysMods hold an empty EntryRef
+class SysModTiming
+{
+public:
+    class EntryRef
+    {
+    };
+};
+
+#define SYSMOD_TIMED_LOOP()
+#define SYSMOD_TIMED_API(name)
+#define SYSMOD_TIMED_API_REF(entryRef, name)
+
+#endif // SYSMOD_TIMING_ENABLED
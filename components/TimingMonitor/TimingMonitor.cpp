@@ -0,0 +1,68 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Timing Monitor
+// REST API access to SysMod loop and API handler timing (see SysModTiming.h)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "TimingMonitor.h"
+#include "SysModTiming.h"
+#include "Logger.h"
+#include "RaftUtils.h"
+#include "RestAPIEndpointManager.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TimingMonitor::TimingMonitor(const char *pModuleName, RaftJsonIF& sysConfig)
+    : RaftSysMod(pModuleName, sysConfig)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void TimingMonitor::setup()
+{
+#ifdef SYSMOD_TIMING_ENABLED
+    // Trace threshold (0 disables the trace)
+    uint32_t traceSlowUs = configGetLong("traceSlowUs", DEFAULT_TRACE_SLOW_US);
+    sysModTiming.setTraceThreshold(traceSlowUs);
+    LOG_I(MODULE_PREFIX, "setup traceSlowUs %d", traceSlowUs);
+#else
+    LOG_I(MODULE_PREFIX, "setup timing instrumentation not compiled in");
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Endpoints
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void TimingMonitor::addRestAPIEndpoints(RestAPIEndpointManager &endpointManager)
+{
+    endpointManager.addEndpoint("timing", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
+                std::bind(&TimingMonitor::apiTiming, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                "timing - loop and API timing, timing/clear - get and clear, timing/trace - recent slow calls, timing/trace/clear");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Timing API
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode TimingMonitor::apiTiming(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
+{
+#ifdef SYSMOD_TIMING_ENABLED
+    String cmdName = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 0);
+    String arg1 = RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 1);
+    bool isTrace = arg1.equalsIgnoreCase("trace");
+    bool clear = (isTrace ? RestAPIEndpointManager::getNthArgStr(reqStr.c_str(), 2) : arg1).equalsIgnoreCase("clear");
+    String timingJSON = isTrace ? sysModTiming.getTraceJSON(clear) : sysModTiming.getStatsJSON(clear);
+    return Raft::setJsonResult(cmdName.c_str(), respStr, true, nullptr, timingJSON.c_str());
+#else
+    return Raft::setJsonErrorResult(reqStr.c_str(), respStr, "notCompiledIn");
+#endif
+}
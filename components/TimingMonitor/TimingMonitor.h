@@ -0,0 +1,45 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Timing Monitor
+// REST API access to SysMod loop and API handler timing (see SysModTiming.h)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "RaftSysMod.h"
+
+class RaftJsonIF;
+class RestAPIEndpointManager;
+class APISourceInfo;
+
+class TimingMonitor : public RaftSysMod
+{
+public:
+    TimingMonitor(const char* pModuleName, RaftJsonIF& sysConfig);
+
+    // Create function (for use by SysManager factory)
+    static RaftSysMod* create(const char* pModuleName, RaftJsonIF& sysConfig)
+    {
+        return new TimingMonitor(pModuleName, sysConfig);
+    }
+    
+protected:
+    // Setup
+    virtual void setup() override final;
+
+    // Add endpoints
+    virtual void addRestAPIEndpoints(RestAPIEndpointManager& endpointManager) override final;
+
+private:
+    // Default trace threshold
+    static const uint32_t DEFAULT_TRACE_SLOW_US = 20000;
+
+    // API
+    RaftRetCode apiTiming(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
+
+    // Log prefix
+    static constexpr const char *MODULE_PREFIX = "TimingMon";
+};